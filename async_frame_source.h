@@ -0,0 +1,578 @@
+#pragma once
+
+// Coroutine frame sources need C++20; the rest of the renderer builds as C++11
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#define ASYNC_FRAME_SOURCE 1
+#endif
+#endif
+
+#ifdef ASYNC_FRAME_SOURCE
+
+#include <cerrno>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include "buffer_pool.h"
+#include "io_reactor.h"
+#include "memory_governor.h"
+#include "worker_pool.h"
+
+constexpr std::size_t gCoroutineFrameGranule = 64;
+constexpr std::size_t gCoroutineFrameClasses = 32;  // Pooled frames up to 2 KiB
+
+// Recycles coroutine frames by size class, so a source that suspends every
+// frame does not go to the heap for each coroutine it starts. Larger frames
+// bypass the pool. Idle blocks are charged to the memory governor as a pool
+// and freed first under pressure.
+class CoroutineFramePool
+{
+public:
+    CoroutineFramePool()
+    {
+        mOwner = memoryGovernor().registerOwner("coroutine.frames", MemoryOwnerKind::Pool,
+            [this](std::size_t bytes) { return shrink(bytes); });
+    }
+
+    ~CoroutineFramePool()
+    {
+        memoryGovernor().release(mOwner, shrink(static_cast<std::size_t>(-1)));
+        memoryGovernor().unregisterOwner(mOwner);
+    }
+
+    CoroutineFramePool(const CoroutineFramePool&) = delete;
+    CoroutineFramePool& operator=(const CoroutineFramePool&) = delete;
+
+    void* allocate(std::size_t bytes)
+    {
+        std::size_t sizeClass = classOf(bytes);
+        if (sizeClass >= gCoroutineFrameClasses)
+            return ::operator new(bytes);
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            std::vector<void*>& idle = mIdle[sizeClass];
+            if (!idle.empty()) {
+                void* block = idle.back();
+                idle.pop_back();
+                ++mHits;
+                return block;
+            }
+            ++mMisses;
+        }
+        memoryGovernor().acquire(mOwner, classBytes(sizeClass));
+        return ::operator new(classBytes(sizeClass));
+    }
+
+    void deallocate(void* block, std::size_t bytes)
+    {
+        std::size_t sizeClass = classOf(bytes);
+        if (sizeClass >= gCoroutineFrameClasses) {
+            ::operator delete(block);
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mMutex);
+        mIdle[sizeClass].push_back(block);
+    }
+
+    std::uint64_t hits() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mHits;
+    }
+
+    std::uint64_t misses() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mMisses;
+    }
+
+private:
+    static std::size_t classOf(std::size_t bytes) { return bytes == 0 ? 0 : (bytes - 1) / gCoroutineFrameGranule; }
+    static std::size_t classBytes(std::size_t sizeClass) { return (sizeClass + 1) * gCoroutineFrameGranule; }
+
+    // Governor reclaim callback: free idle blocks, largest classes first. The
+    // governor releases the returned bytes itself.
+    std::size_t shrink(std::size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        std::size_t freed = 0;
+        for (std::size_t sizeClass = gCoroutineFrameClasses; sizeClass-- > 0 && freed < bytes;) {
+            std::vector<void*>& idle = mIdle[sizeClass];
+            while (!idle.empty() && freed < bytes) {
+                ::operator delete(idle.back());
+                idle.pop_back();
+                freed += classBytes(sizeClass);
+            }
+        }
+        return freed;
+    }
+
+    MemoryGovernor::OwnerId mOwner = -1;
+    mutable std::mutex mMutex;
+    std::vector<void*> mIdle[gCoroutineFrameClasses];
+    std::uint64_t mHits = 0;
+    std::uint64_t mMisses = 0;
+};
+
+inline CoroutineFramePool& coroutineFramePool()
+{
+    static CoroutineFramePool pool;
+    return pool;
+}
+
+// Base of every promise here, so coroutine frames come from the pool
+struct PooledCoroutineFrame
+{
+    static void* operator new(std::size_t bytes) { return coroutineFramePool().allocate(bytes); }
+    static void operator delete(void* block, std::size_t bytes) { coroutineFramePool().deallocate(block, bytes); }
+};
+
+template <typename T>
+class AsyncTask;
+
+template <typename T>
+struct AsyncTaskPromiseBase : PooledCoroutineFrame
+{
+    // Resume whoever awaited the task; symmetric transfer keeps long chains off the stack
+    struct FinalAwaiter
+    {
+        bool await_ready() noexcept { return false; }
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+        {
+            std::coroutine_handle<> continuation = handle.promise().continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { exception = std::current_exception(); }
+
+    std::coroutine_handle<> continuation;
+    std::exception_ptr exception;
+};
+
+template <typename T>
+struct AsyncTaskPromise : AsyncTaskPromiseBase<T>
+{
+    AsyncTask<T> get_return_object();
+    template <typename Value>
+    void return_value(Value&& value) { result.emplace(std::forward<Value>(value)); }
+
+    T take()
+    {
+        if (this->exception)
+            std::rethrow_exception(this->exception);
+        return std::move(*result);
+    }
+
+    std::optional<T> result;
+};
+
+template <>
+struct AsyncTaskPromise<void> : AsyncTaskPromiseBase<void>
+{
+    AsyncTask<void> get_return_object();
+    void return_void() {}
+
+    void take()
+    {
+        if (exception)
+            std::rethrow_exception(exception);
+    }
+};
+
+// Lazily started coroutine producing a T. Awaiting it runs it on the awaiting
+// thread up to its first suspension; the awaiter resumes where it finishes.
+template <typename T>
+class AsyncTask
+{
+public:
+    using promise_type = AsyncTaskPromise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    explicit AsyncTask(Handle handle)
+        : mHandle(handle)
+    {
+    }
+
+    AsyncTask(AsyncTask&& other) noexcept
+        : mHandle(std::exchange(other.mHandle, nullptr))
+    {
+    }
+
+    AsyncTask& operator=(AsyncTask&& other) noexcept
+    {
+        if (this != &other) {
+            if (mHandle)
+                mHandle.destroy();
+            mHandle = std::exchange(other.mHandle, nullptr);
+        }
+        return *this;
+    }
+
+    ~AsyncTask()
+    {
+        if (mHandle)
+            mHandle.destroy();
+    }
+
+    AsyncTask(const AsyncTask&) = delete;
+    AsyncTask& operator=(const AsyncTask&) = delete;
+
+    bool await_ready() const noexcept { return !mHandle || mHandle.done(); }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        mHandle.promise().continuation = awaiting;
+        return mHandle;
+    }
+
+    T await_resume() { return mHandle.promise().take(); }
+
+private:
+    Handle mHandle;
+};
+
+template <typename T>
+AsyncTask<T> AsyncTaskPromise<T>::get_return_object()
+{
+    return AsyncTask<T>(AsyncTask<T>::Handle::from_promise(*this));
+}
+
+inline AsyncTask<void> AsyncTaskPromise<void>::get_return_object()
+{
+    return AsyncTask<void>(AsyncTask<void>::Handle::from_promise(*this));
+}
+
+// Resume a coroutine on the pool as one task due by the deadline
+inline void resumeOnPool(WorkerPool& pool, std::coroutine_handle<> handle, WorkerPool::Clock::time_point deadline)
+{
+    std::vector<WorkerPool::Task> tasks;
+    tasks.push_back([handle] { handle.resume(); });
+    pool.submitBatch(std::move(tasks), deadline);
+}
+
+// Everything a source needs for one frame: where to draw, and awaitables
+// that suspend the source until I/O completes and resume it on the pool
+// under the frame's deadline. The pixels stay valid until the source's
+// coroutine returns.
+class AsyncFrameContext
+{
+public:
+    using Clock = WorkerPool::Clock;
+
+    AsyncFrameContext(WorkerPool& pool, IoReactor& reactor, std::size_t frameId, Clock::time_point deadline,
+        std::uint32_t* pixels, int width, int height)
+        : mPool(pool)
+        , mReactor(reactor)
+        , mFrameId(frameId)
+        , mDeadline(deadline)
+        , mPixels(pixels)
+        , mWidth(width)
+        , mHeight(height)
+    {
+    }
+
+    std::size_t frameId() const { return mFrameId; }
+    Clock::time_point deadline() const { return mDeadline; }
+    std::uint32_t* pixels() const { return mPixels; }
+    int width() const { return mWidth; }
+    int height() const { return mHeight; }
+
+    // co_await schedule(): continue on a worker, for example to split off CPU work
+    struct ScheduleAwaiter
+    {
+        AsyncFrameContext& context;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) { resumeOnPool(context.mPool, handle, context.mDeadline); }
+        void await_resume() const noexcept {}
+    };
+    ScheduleAwaiter schedule() { return ScheduleAwaiter{ *this }; }
+
+    // co_await readable(fd): until fd has data, has hung up or is invalid;
+    // 0, or the error that ended the wait, such as ECANCELED when the
+    // reactor shuts down
+    struct ReadableAwaiter
+    {
+        AsyncFrameContext& context;
+        int fd;
+        int error = 0;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            WorkerPool& pool = context.mPool;
+            Clock::time_point deadline = context.mDeadline;
+            context.mReactor.whenReadable(fd, [this, &pool, handle, deadline](int result) {
+                error = result;
+                resumeOnPool(pool, handle, deadline);
+            });
+        }
+        int await_resume() const noexcept { return error; }
+    };
+    ReadableAwaiter readable(int fd) { return ReadableAwaiter{ *this, fd }; }
+
+    // co_await readFile(...): pread on the reactor's file thread; bytes read, or -errno
+    struct FileReadAwaiter
+    {
+        AsyncFrameContext& context;
+        int fd;
+        void* buffer;
+        std::size_t bytes;
+        off_t offset;
+        ssize_t result = 0;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            WorkerPool& pool = context.mPool;
+            Clock::time_point deadline = context.mDeadline;
+            context.mReactor.readFile(fd, buffer, bytes, offset, [this, &pool, handle, deadline](ssize_t read, int error) {
+                result = read < 0 ? -error : read;
+                resumeOnPool(pool, handle, deadline);
+            });
+        }
+        ssize_t await_resume() const noexcept { return result; }
+    };
+    FileReadAwaiter readFile(int fd, void* buffer, std::size_t bytes, off_t offset)
+    {
+        return FileReadAwaiter{ *this, fd, buffer, bytes, offset };
+    }
+
+    // Read what a non-blocking socket or pipe has, waiting until there is
+    // something; bytes read, 0 at end of stream, or -errno
+    AsyncTask<ssize_t> readSome(int fd, void* buffer, std::size_t bytes)
+    {
+        for (;;) {
+            ssize_t result = read(fd, buffer, bytes);
+            if (result >= 0)
+                co_return result;
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                co_return -errno;
+            if (errno != EINTR) {
+                int error = co_await readable(fd);
+                if (error)
+                    co_return -error;
+            }
+        }
+    }
+
+    // Read exactly bytes unless the stream ends or fails first; bytes read, or -errno
+    AsyncTask<ssize_t> readExactly(int fd, void* buffer, std::size_t bytes)
+    {
+        std::size_t done = 0;
+        while (done < bytes) {
+            ssize_t result = co_await readSome(fd, static_cast<char*>(buffer) + done, bytes - done);
+            if (result < 0)
+                co_return result;
+            if (result == 0)
+                break;
+            done += static_cast<std::size_t>(result);
+        }
+        co_return static_cast<ssize_t>(done);
+    }
+
+private:
+    WorkerPool& mPool;
+    IoReactor& mReactor;
+    std::size_t mFrameId;
+    Clock::time_point mDeadline;
+    std::uint32_t* mPixels;
+    int mWidth;
+    int mHeight;
+};
+
+struct AsyncSourceStats
+{
+    std::uint64_t framesRequested = 0;
+    std::uint64_t framesStarted = 0;
+    std::uint64_t framesPublished = 0;
+    std::uint64_t framesCoalesced = 0;  // Requests superseded while an earlier frame was still in flight
+    std::uint64_t framesFailed = 0;     // The source threw; nothing was published
+};
+
+// Drives one coroutine source: each frame is produce(context), a coroutine
+// that may suspend on I/O any number of times and runs only on the worker
+// pool in between, so a handful of threads serve many I/O-bound sources. One
+// frame is in flight per source; requests arriving meanwhile coalesce into
+// the latest, which starts when the current one is published. Buffers come
+// from a per-source FrameBufferPool, coroutine frames from the coroutine pool.
+class AsyncFrameDriver
+{
+public:
+    using Clock = WorkerPool::Clock;
+    using ProduceFunction = std::function<AsyncTask<void>(AsyncFrameContext& context)>;
+    using PublishFunction = std::function<void(std::size_t frameId, const std::vector<std::uint32_t>& pixels)>;
+
+    AsyncFrameDriver(
+        WorkerPool& pool,
+        IoReactor& reactor,
+        int width,
+        int height,
+        ProduceFunction produce,
+        PublishFunction publish,
+        const std::string& sourceName = "async")
+        : mPool(pool)
+        , mReactor(reactor)
+        , mWidth(width)
+        , mHeight(height)
+        , mProduce(produce)
+        , mPublish(publish)
+        , mSourceName(sourceName)
+        , mBuffers(static_cast<std::size_t>(width) * height, sourceName + ".buffers")
+    {
+    }
+
+    ~AsyncFrameDriver() { waitIdle(); }
+
+    AsyncFrameDriver(const AsyncFrameDriver&) = delete;
+    AsyncFrameDriver& operator=(const AsyncFrameDriver&) = delete;
+
+    const std::string& sourceName() const { return mSourceName; }
+
+    void requestFrame(std::size_t frameId, Clock::time_point deadline)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            ++mStats.framesRequested;
+            if (mBusy) {
+                if (mHasPending)
+                    ++mStats.framesCoalesced;
+                mHasPending = true;
+                mPendingFrameId = frameId;
+                mPendingDeadline = deadline;
+                return;
+            }
+            mBusy = true;
+            ++mStats.framesStarted;
+        }
+        start(frameId, deadline);
+    }
+
+    // Drop any pending request and wait for the frame in flight, so its source
+    // must eventually finish; closing the descriptors it waits on ends its waits
+    void waitIdle()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mHasPending = false;
+        mIdle.wait(lock, [this] { return !mBusy; });
+    }
+
+    AsyncSourceStats stats() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mStats;
+    }
+
+private:
+    struct FrameJob
+    {
+        FrameJob(AsyncFrameDriver& driver, std::size_t frameId, Clock::time_point deadline)
+            : driver(driver)
+            , pixels(driver.mBuffers.acquire())
+            , context(driver.mPool, driver.mReactor, frameId, deadline, pixels.data(), driver.mWidth, driver.mHeight)
+        {
+        }
+
+        ~FrameJob()
+        {
+            driver.mBuffers.recycle(std::move(pixels));
+        }
+
+        AsyncFrameDriver& driver;
+        std::vector<std::uint32_t> pixels;
+        AsyncFrameContext context;
+    };
+
+    // Owns the frame's coroutine chain; destroys itself when the frame is done
+    struct DetachedFrame
+    {
+        struct promise_type : PooledCoroutineFrame
+        {
+            DetachedFrame get_return_object() { return DetachedFrame{ std::coroutine_handle<promise_type>::from_promise(*this) }; }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    static DetachedFrame runFrame(AsyncFrameDriver* driver, std::unique_ptr<FrameJob> job)
+    {
+        bool produced = true;
+        try {
+            co_await driver->mProduce(job->context);
+        } catch (...) {
+            produced = false;
+        }
+        driver->finish(std::move(job), produced);
+    }
+
+    void start(std::size_t frameId, Clock::time_point deadline)
+    {
+        std::unique_ptr<FrameJob> job(new FrameJob(*this, frameId, deadline));
+        DetachedFrame frame = runFrame(this, std::move(job));
+        resumeOnPool(mPool, frame.handle, deadline);
+    }
+
+    void finish(std::unique_ptr<FrameJob> job, bool produced)
+    {
+        if (produced)
+            mPublish(job->context.frameId(), job->pixels);
+        job.reset();
+
+        std::size_t frameId = 0;
+        Clock::time_point deadline;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            ++(produced ? mStats.framesPublished : mStats.framesFailed);
+            if (!mHasPending) {
+                mBusy = false;
+                mIdle.notify_all();
+                return;
+            }
+            mHasPending = false;
+            frameId = mPendingFrameId;
+            deadline = mPendingDeadline;
+            ++mStats.framesStarted;
+        }
+        start(frameId, deadline);
+    }
+
+    WorkerPool& mPool;
+    IoReactor& mReactor;
+    int mWidth;
+    int mHeight;
+    ProduceFunction mProduce;
+    PublishFunction mPublish;
+    std::string mSourceName;
+    FrameBufferPool mBuffers;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mIdle;
+    bool mBusy = false;
+    bool mHasPending = false;
+    std::size_t mPendingFrameId = 0;
+    Clock::time_point mPendingDeadline;
+    AsyncSourceStats mStats;
+};
+
+#endif // ASYNC_FRAME_SOURCE
@@ -0,0 +1,2261 @@
+// Headless benchmark driver for the portable parts of the renderer.
+// Build: clang++ -std=c++11 -O2 -pthread bench.cpp -o bench
+// Usage: ./bench <mode> [options]
+// On Linux, BENCH_PROFILE=<path> samples any mode and writes folded stacks to path.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "async_frame_source.h"
+#include "color_space.h"
+#include "command_queue.h"
+#include "energy_meter.h"
+#include "event_loop_linux.h"
+#include "frame_arena.h"
+#include "frame_graph.h"
+#include "frame_log.h"
+#include "frame_renderer.h"
+#include "frame_source.h"
+#include "hdr_frame.h"
+#include "headless_presenter.h"
+#include "input_latency.h"
+#include "metrics_exporter.h"
+#include "numa_topology.h"
+#include "offline_renderer.h"
+#include "render_farm.h"
+#include "sampling_profiler.h"
+#include "virtual_canvas.h"
+#include "worker_pool.h"
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+using BenchClock = std::chrono::steady_clock;
+
+// Configuration constants (mirroring main.cpp)
+constexpr int gImageWidth = 800;
+constexpr int gImageHeight = 600;
+constexpr int gTargetFps = 60;
+constexpr double gTargetFrameTime = 1.0 / gTargetFps;
+constexpr int gBandRows = 32;
+
+inline BenchClock::duration secondsToDuration(double seconds)
+{
+    return std::chrono::duration_cast<BenchClock::duration>(std::chrono::duration<double>(seconds));
+}
+
+inline double argumentOr(int argc, char** argv, int index, double fallback)
+{
+    return index < argc ? std::atof(argv[index]) : fallback;
+}
+
+// Synthetic overload: a cheap 60 Hz foreground source and an expensive
+// background source share one pool, once FIFO and once earliest-deadline.
+// Usage: bench deadline [seconds] [background-cost-multiplier]
+int benchDeadline(int argc, char** argv)
+{
+    double seconds = argumentOr(argc, argv, 2, 5.0);
+    int backgroundPasses = static_cast<int>(argumentOr(argc, argv, 3, 6.0));
+
+    const SchedulingPolicy policies[] = { SchedulingPolicy::Fifo, SchedulingPolicy::EarliestDeadline };
+    for (SchedulingPolicy policy : policies) {
+        WorkerPool pool(0, policy);
+
+        FrameRenderer foreground(
+            pool, gImageWidth, gImageHeight, gBandRows,
+            [](std::size_t frameId, std::uint32_t* pixels, int firstRow, int lastRow) {
+                shadeAnimationRows(pixels, gImageWidth, gImageHeight, frameId, gTargetFrameTime, firstRow, lastRow);
+            },
+            [](std::size_t, const std::vector<std::uint32_t>&) {},
+            "foreground");
+
+        // Background repaints a larger canvas several times per band to simulate an expensive effect
+        const int backgroundWidth = 1920;
+        const int backgroundHeight = 1080;
+        const double backgroundFrameTime = 0.1;
+        FrameRenderer background(
+            pool, backgroundWidth, backgroundHeight, gBandRows,
+            [=](std::size_t frameId, std::uint32_t* pixels, int firstRow, int lastRow) {
+                for (int pass = 0; pass < backgroundPasses; ++pass)
+                    shadeAnimationRows(pixels, backgroundWidth, backgroundHeight, frameId + pass, gTargetFrameTime, firstRow, lastRow);
+            },
+            [](std::size_t, const std::vector<std::uint32_t>&) {},
+            "background");
+
+        BenchClock::time_point start = BenchClock::now();
+        BenchClock::time_point end = start + secondsToDuration(seconds);
+        BenchClock::time_point nextForeground = start;
+        BenchClock::time_point nextBackground = start;
+        std::size_t foregroundFrame = 0;
+        std::size_t backgroundFrame = 0;
+
+        while (BenchClock::now() < end) {
+            BenchClock::time_point now = BenchClock::now();
+            if (now >= nextForeground) {
+                nextForeground += secondsToDuration(gTargetFrameTime);
+                foreground.requestFrame(foregroundFrame++, nextForeground);
+            }
+            if (now >= nextBackground) {
+                nextBackground += secondsToDuration(backgroundFrameTime);
+                background.requestFrame(backgroundFrame++, nextBackground);
+            }
+            std::this_thread::sleep_until(std::min(nextForeground, nextBackground));
+        }
+        pool.waitIdle();
+
+        std::printf("policy %s, %u threads\n", policy == SchedulingPolicy::Fifo ? "fifo" : "edf", pool.threadCount());
+        std::fputs(foreground.statsReport().c_str(), stdout);
+        std::fputs(background.statsReport().c_str(), stdout);
+    }
+    return 0;
+}
+
+// Time from process-style cold start (pool and renderer construction) to the
+// first published frame, with and without pre-warming spare buffers while the
+// first frame renders.
+// Usage: bench startup [runs]
+int benchStartup(int argc, char** argv)
+{
+    int runs = std::max(1, static_cast<int>(argumentOr(argc, argv, 2, 20.0)));
+
+    for (int prewarm = 0; prewarm < 2; ++prewarm) {
+        std::vector<double> samples;
+        for (int run = 0; run < runs; ++run) {
+            std::mutex mutex;
+            std::condition_variable published;
+            bool done = false;
+
+            BenchClock::time_point start = BenchClock::now();
+            WorkerPool pool;
+            FrameRenderer renderer(
+                pool, gImageWidth, gImageHeight, gBandRows,
+                [](std::size_t frameId, std::uint32_t* pixels, int firstRow, int lastRow) {
+                    shadeAnimationRows(pixels, gImageWidth, gImageHeight, frameId, gTargetFrameTime, firstRow, lastRow);
+                },
+                [&](std::size_t, const std::vector<std::uint32_t>&) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    done = true;
+                    published.notify_one();
+                },
+                "startup");
+            renderer.requestFrame(0);
+            if (prewarm)
+                renderer.prewarm(2);
+
+            std::unique_lock<std::mutex> lock(mutex);
+            published.wait(lock, [&] { return done; });
+            samples.push_back(std::chrono::duration<double, std::milli>(BenchClock::now() - start).count());
+        }
+
+        std::sort(samples.begin(), samples.end());
+        std::printf("time to first frame (%s): min %.2f ms, median %.2f ms, max %.2f ms over %d runs\n",
+            prewarm ? "prewarmed" : "cold", samples.front(), samples[samples.size() / 2], samples.back(), runs);
+    }
+    return 0;
+}
+
+// Typical per-band scratch: a row buffer, a span list and a histogram
+template<typename RowVector, typename SpanVector, typename HistogramVector>
+std::uint32_t scratchWorkload(RowVector& row, SpanVector& spans, HistogramVector& histogram, std::size_t frameId)
+{
+    row.resize(gImageWidth);
+    histogram.assign(256, 0);
+    for (int x = 0; x < gImageWidth; ++x) {
+        row[x] = static_cast<std::uint32_t>(x * 2654435761u + frameId);
+        ++histogram[row[x] & 0xFF];
+        if ((row[x] & 0x3F) == 0)
+            spans.push_back(x);
+    }
+    return row[gImageWidth / 2] + histogram[17] + static_cast<std::uint32_t>(spans.size());
+}
+
+// Per-band scratch from the global heap versus the thread's frame arena.
+// Usage: bench arena [frames]
+int benchArena(int argc, char** argv)
+{
+    int frames = std::max(1, static_cast<int>(argumentOr(argc, argv, 2, 600.0)));
+    const int bands = gImageHeight / gBandRows;
+    std::uint32_t checksum = 0;
+
+    BenchClock::time_point start = BenchClock::now();
+    for (int frame = 0; frame < frames; ++frame) {
+        for (int band = 0; band < bands; ++band) {
+            std::vector<std::uint32_t> row;
+            std::vector<int> spans;
+            std::vector<std::uint32_t> histogram;
+            checksum += scratchWorkload(row, spans, histogram, frame);
+        }
+    }
+    double heapMs = std::chrono::duration<double, std::milli>(BenchClock::now() - start).count();
+
+    FrameArena& arena = threadFrameArena();
+    std::size_t warmupBlocks = 0;
+    start = BenchClock::now();
+    for (int frame = 0; frame < frames; ++frame) {
+        for (int band = 0; band < bands; ++band) {
+            FrameArenaScope scratch(arena);
+            ArenaVector<std::uint32_t> row;
+            ArenaVector<int> spans;
+            ArenaVector<std::uint32_t> histogram;
+            checksum += scratchWorkload(row, spans, histogram, frame);
+        }
+        arena.reset();
+        if (frame == 0)
+            warmupBlocks = arena.heapAllocations();
+    }
+    double arenaMs = std::chrono::duration<double, std::milli>(BenchClock::now() - start).count();
+
+    std::printf("heap scratch:  %.3f ms per frame\n", heapMs / frames);
+    std::printf("arena scratch: %.3f ms per frame, %zu heap blocks after the first frame, %zu in steady state (checksum %u)\n",
+        arenaMs / frames, warmupBlocks, arena.heapAllocations() - warmupBlocks, checksum);
+    return 0;
+}
+
+// Input-to-photon latency on the headless presenter: synthetic inputs arrive
+// at random, frames are requested every refresh, and the swap chain depth is
+// varied to show what each level of pipelining costs.
+// Usage: bench latency [seconds-per-depth] [max-depth]
+int benchLatency(int argc, char** argv)
+{
+    double seconds = argumentOr(argc, argv, 2, 3.0);
+    int maxDepth = std::max(1, static_cast<int>(argumentOr(argc, argv, 3, 3.0)));
+
+    for (int depth = 1; depth <= maxDepth; ++depth) {
+        InputLatencyTracker tracker;
+        WorkerPool pool;
+        HeadlessPresenter presenter(static_cast<std::size_t>(gImageWidth) * gImageHeight, gTargetFrameTime, depth, &tracker);
+        FrameRenderer renderer(
+            pool, gImageWidth, gImageHeight, gBandRows,
+            [](std::size_t frameId, std::uint32_t* pixels, int firstRow, int lastRow) {
+                shadeAnimationRows(pixels, gImageWidth, gImageHeight, frameId, gTargetFrameTime, firstRow, lastRow);
+            },
+            [&](std::size_t frameId, const std::vector<std::uint32_t>& pixels) {
+                tracker.frameReached(frameId, FrameStage::Rendered);
+                presenter.submit(frameId, pixels);
+                tracker.frameReached(frameId, FrameStage::Published);
+            },
+            "latency");
+
+        BenchClock::time_point end = BenchClock::now() + secondsToDuration(seconds);
+        std::thread inputs([&] {
+            std::mt19937 random(1234);
+            std::exponential_distribution<double> gap(200.0);
+            while (BenchClock::now() < end) {
+                std::this_thread::sleep_for(secondsToDuration(gap(random)));
+                tracker.stampInput();
+            }
+        });
+
+        BenchClock::time_point nextFrame = BenchClock::now();
+        for (std::size_t frameId = 0; BenchClock::now() < end; ++frameId) {
+            nextFrame += secondsToDuration(gTargetFrameTime);
+            tracker.frameRequested(frameId);
+            renderer.requestFrame(frameId, nextFrame);
+            std::this_thread::sleep_until(nextFrame);
+        }
+        inputs.join();
+        pool.waitIdle();
+
+        std::printf("swap chain depth %d: %llu presented, %llu replaced\n", depth,
+            (unsigned long long)presenter.presentedCount(), (unsigned long long)presenter.replacedCount());
+        std::fputs(tracker.report().c_str(), stdout);
+    }
+    return 0;
+}
+
+// Several producer threads post redraw-style commands to a consumer thread
+// that drains once per wakeup, as the UI thread does.
+// Usage: bench commands [seconds] [producers]
+int benchCommands(int argc, char** argv)
+{
+    double seconds = argumentOr(argc, argv, 2, 2.0);
+    int producers = std::max(1, static_cast<int>(argumentOr(argc, argv, 3, 4.0)));
+
+    std::mutex mutex;
+    std::condition_variable woken;
+    bool wakePending = false;
+    std::atomic<bool> running(true);
+
+    CommandQueue queue;
+    std::vector<std::uint64_t> lastSeen(4, 0);
+    std::uint64_t outOfOrder = 0;
+    std::vector<CommandQueue::CommandId> commands;
+    for (int i = 0; i < 4; ++i) {
+        commands.push_back(queue.registerCommand([&lastSeen, &outOfOrder, i](std::uint64_t argument) {
+            if (argument < lastSeen[i])
+                ++outOfOrder;
+            lastSeen[i] = argument;
+        }));
+    }
+    queue.setWakeFunction([&] {
+        std::lock_guard<std::mutex> lock(mutex);
+        wakePending = true;
+        woken.notify_one();
+    });
+
+    std::thread consumer([&] {
+        while (running.load()) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                woken.wait_for(lock, std::chrono::milliseconds(10), [&] { return wakePending; });
+                wakePending = false;
+            }
+            queue.drain();
+        }
+        queue.drain();
+    });
+
+    std::vector<std::thread> threads;
+    BenchClock::time_point end = BenchClock::now() + secondsToDuration(seconds);
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&, p] {
+            for (std::uint64_t n = 1; BenchClock::now() < end; ++n)
+                queue.post(commands[(n + p) % commands.size()], n);
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+    running.store(false);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        wakePending = true;
+        woken.notify_one();
+    }
+    consumer.join();
+
+    CommandQueueStats stats = queue.stats();
+    std::printf("%d producers: %.2f M posts/s, %llu executed, %.1f%% coalesced, %llu wakeups, %llu batches, %.2f commands per batch\n",
+        producers, stats.posted / seconds / 1e6, (unsigned long long)stats.executed,
+        stats.posted ? 100.0 * stats.coalesced / stats.posted : 0.0, (unsigned long long)stats.wakeups,
+        (unsigned long long)stats.batches, stats.batches ? double(stats.executed) / stats.batches : 0.0);
+    std::printf("consistency: posted %llu = executed + coalesced %llu\n",
+        (unsigned long long)stats.posted, (unsigned long long)(stats.executed + stats.coalesced));
+    return stats.posted == stats.executed + stats.coalesced ? 0 : 1;
+}
+
+// Frame pacing jitter: how far each 60 Hz tick lands from its ideal time,
+// with sleep_until on a plain thread and, on Linux, with the timerfd event loop.
+// Usage: bench pacer [seconds]
+int benchPacer(int argc, char** argv)
+{
+    double seconds = argumentOr(argc, argv, 2, 3.0);
+    const BenchClock::duration period = secondsToDuration(gTargetFrameTime);
+    const int ticks = static_cast<int>(seconds * gTargetFps);
+
+    LatencyHistogram sleepJitter;
+    BenchClock::time_point ideal = BenchClock::now();
+    for (int tick = 0; tick < ticks; ++tick) {
+        ideal += period;
+        std::this_thread::sleep_until(ideal);
+        sleepJitter.record(std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now() - ideal).count());
+    }
+    std::fputs("pacer jitter:\n", stdout);
+    std::fputs(sleepJitter.report("sleep_until").c_str(), stdout);
+
+#ifdef __linux__
+    LatencyHistogram timerJitter;
+    EventLoop loop;
+    int tick = 0;
+    ideal = BenchClock::now() + period;
+    EventLoop::SourceId timer = -1;
+    timer = loop.addTimer([&](std::uint64_t) {
+        timerJitter.record(std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now() - ideal).count());
+        ideal += period;
+        if (++tick == ticks)
+            loop.stop();
+        else
+            loop.setDeadline(timer, ideal);
+    });
+    loop.setDeadline(timer, ideal);
+    loop.run();
+    std::fputs(timerJitter.report("epoll/timerfd").c_str(), stdout);
+#endif
+    return 0;
+}
+
+#ifdef __linux__
+// Cross-thread wakeups into the epoll loop: another thread posts UI commands
+// at a fixed rate and the loop drains them on each eventfd wakeup. Reports
+// the loop thread's CPU time per wakeup.
+// Usage: bench wakeups [seconds] [rate-per-second]
+int benchWakeups(int argc, char** argv)
+{
+    double seconds = argumentOr(argc, argv, 2, 3.0);
+    double rate = argumentOr(argc, argv, 3, 10000.0);
+
+    EventLoop loop;
+    CommandQueue commands;
+    std::uint64_t executed = 0;
+    CommandQueue::CommandId redraw = commands.registerCommand([&](std::uint64_t) { ++executed; });
+    commands.setWakeFunction([&] { loop.wake(); });
+    loop.setWakeCallback([&] { commands.drain(); });
+
+    std::thread producer([&] {
+        BenchClock::time_point next = BenchClock::now();
+        BenchClock::time_point end = next + secondsToDuration(seconds);
+        while (next < end) {
+            next += secondsToDuration(1.0 / rate);
+            std::this_thread::sleep_until(next);
+            commands.post(redraw);
+        }
+        loop.stop();
+    });
+
+    struct timespec cpuStart;
+    struct timespec cpuEnd;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpuStart);
+    loop.run();
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpuEnd);
+    producer.join();
+
+    double cpuSeconds = (cpuEnd.tv_sec - cpuStart.tv_sec) + (cpuEnd.tv_nsec - cpuStart.tv_nsec) / 1e9;
+    EventLoopStats stats = loop.stats();
+    std::printf("%.0f wakeups/s requested: %llu loop wakeups, %llu iterations, %llu commands executed\n",
+        rate, (unsigned long long)stats.wakeups, (unsigned long long)stats.iterations, (unsigned long long)executed);
+    std::printf("loop thread cpu: %.1f ms total, %.2f%% of one core, %.2f us per wakeup\n",
+        cpuSeconds * 1e3, seconds > 0.0 ? 100.0 * cpuSeconds / seconds : 0.0, stats.wakeups ? cpuSeconds * 1e6 / stats.wakeups : 0.0);
+    return 0;
+}
+#endif
+
+
+inline std::uint64_t fnv1a(const std::uint32_t* pixels, std::size_t count)
+{
+    std::uint64_t hash = 14695981039346656037ull;
+    for (std::size_t i = 0; i < count; ++i) {
+        for (int shift = 0; shift < 32; shift += 8) {
+            hash ^= (pixels[i] >> shift) & 0xFF;
+            hash *= 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+inline std::uint64_t fnv1a(const std::vector<std::uint32_t>& pixels)
+{
+    return fnv1a(pixels.data(), pixels.size());
+}
+
+// Peak signal-to-noise ratio over the colour channels, in dB
+inline double psnr(const std::vector<std::uint32_t>& reference, const std::vector<std::uint32_t>& test)
+{
+    double squaredError = 0.0;
+    for (std::size_t i = 0; i < reference.size(); ++i) {
+        for (int shift = 0; shift < 24; shift += 8) {
+            double difference = double((reference[i] >> shift) & 0xFF) - double((test[i] >> shift) & 0xFF);
+            squaredError += difference * difference;
+        }
+    }
+    double mse = squaredError / (reference.size() * 3.0);
+    return mse == 0.0 ? INFINITY : 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+// Double-precision versus fixed-point shading: speed, worst channel error and
+// a checksum of the integer output to compare across machines.
+// Usage: bench fixedpoint [frames]
+int benchFixedPoint(int argc, char** argv)
+{
+    int frames = std::max(1, static_cast<int>(argumentOr(argc, argv, 2, 60.0)));
+    std::vector<std::uint32_t> reference(static_cast<std::size_t>(gImageWidth) * gImageHeight);
+    std::vector<std::uint32_t> fixed(reference.size());
+
+    const std::size_t sampleFrames[] = { 0, 1, 59, 1000, 123456, 5000000 };
+    int worst = 0;
+    std::size_t overOne = 0;
+    std::uint64_t checksum = 0;
+    for (std::size_t frameId : sampleFrames) {
+        shadeAnimationRows(reference.data(), gImageWidth, gImageHeight, frameId, gTargetFrameTime, 0, gImageHeight);
+        shadeAnimationRowsFixed(fixed.data(), gImageWidth, gImageHeight, frameId, gTargetFrameTime, 0, gImageHeight);
+        for (std::size_t i = 0; i < reference.size(); ++i) {
+            int difference = argbDistance(reference[i], fixed[i]);
+            worst = std::max(worst, difference);
+            if (difference > 1)
+                ++overOne;
+        }
+        checksum ^= fnv1a(fixed) + frameId;
+    }
+
+    const ShadingMode modes[] = { ShadingMode::Double, ShadingMode::FixedPoint };
+    double perFrameMs[2] = {};
+    for (int m = 0; m < 2; ++m) {
+        BenchClock::time_point start = BenchClock::now();
+        for (int frame = 0; frame < frames; ++frame) {
+            for (int row = 0; row < gImageHeight; row += gBandRows)
+                shadeAnimationRows(modes[m], fixed.data(), gImageWidth, gImageHeight, frame, gTargetFrameTime, row, std::min(gImageHeight, row + gBandRows));
+        }
+        perFrameMs[m] = std::chrono::duration<double, std::milli>(BenchClock::now() - start).count() / frames;
+    }
+
+    std::printf("double:      %.3f ms per frame\n", perFrameMs[0]);
+    std::printf("fixed-point: %.3f ms per frame (%.1fx)\n", perFrameMs[1], perFrameMs[0] / perFrameMs[1]);
+    std::printf("worst channel difference %d LSB, %zu pixels over 1 LSB, fixed-point checksum %016llx\n",
+        worst, overOne, (unsigned long long)checksum);
+    return worst <= 1 ? 0 : 1;
+}
+
+// Adaptive coarse shading against full shading: speed, PSNR and the share
+// of interpolated blocks for a range of error budgets.
+// Usage: bench adaptive [frames]
+int benchAdaptive(int argc, char** argv)
+{
+    int frames = std::max(1, static_cast<int>(argumentOr(argc, argv, 2, 30.0)));
+    std::vector<std::uint32_t> reference(static_cast<std::size_t>(gImageWidth) * gImageHeight);
+    std::vector<std::uint32_t> adaptive(reference.size());
+
+    BenchClock::time_point start = BenchClock::now();
+    for (int frame = 0; frame < frames; ++frame) {
+        for (int row = 0; row < gImageHeight; row += gBandRows)
+            shadeAnimationRows(reference.data(), gImageWidth, gImageHeight, frame, gTargetFrameTime, row, std::min(gImageHeight, row + gBandRows));
+    }
+    double fullMs = std::chrono::duration<double, std::milli>(BenchClock::now() - start).count() / frames;
+    std::printf("gradient source, full shading: %.3f ms per frame\n", fullMs);
+
+    const int budgets[] = { 0, 1, 2, 4, 8 };
+    for (int budget : budgets) {
+        AdaptiveShadingStats stats;
+        start = BenchClock::now();
+        for (int frame = 0; frame < frames; ++frame) {
+            for (int row = 0; row < gImageHeight; row += gBandRows)
+                shadeAnimationRowsAdaptive(adaptive.data(), gImageWidth, gImageHeight, frame, gTargetFrameTime, row, std::min(gImageHeight, row + gBandRows), budget, &stats);
+        }
+        double adaptiveMs = std::chrono::duration<double, std::milli>(BenchClock::now() - start).count() / frames;
+
+        // Quality on the last frame of the run
+        shadeAnimationRows(reference.data(), gImageWidth, gImageHeight, frames - 1, gTargetFrameTime, 0, gImageHeight);
+        std::uint64_t blocks = stats.blocksInterpolated + stats.blocksShaded;
+        std::printf("  budget %d LSB: %.3f ms per frame (%.1fx), PSNR %.1f dB, %.1f%% of blocks interpolated\n",
+            budget, adaptiveMs, fullMs / adaptiveMs, psnr(reference, adaptive),
+            blocks ? 100.0 * stats.blocksInterpolated / blocks : 0.0);
+    }
+    return 0;
+}
+
+// Checkerboard and interlaced temporal rendering against full shading on one
+// worker: per-frame cost, PSNR of the published frames and the fraction of
+// frames rendered in full. The source reports a large change every cutEvery
+// frames, which forces a full frame.
+// Usage: bench temporal [frames] [cutEvery]
+int benchTemporal(int argc, char** argv)
+{
+    int frames = std::max(1, static_cast<int>(argumentOr(argc, argv, 2, 120.0)));
+    int cutEvery = std::max(1, static_cast<int>(argumentOr(argc, argv, 3, 30.0)));
+    const TemporalMode modes[] = { TemporalMode::Full, TemporalMode::Checkerboard, TemporalMode::Interlaced };
+    const char* names[] = { "full", "checkerboard", "interlaced" };
+
+    std::vector<std::uint32_t> reference(static_cast<std::size_t>(gImageWidth) * gImageHeight);
+    double fullMs = 0.0;
+    for (int m = 0; m < 3; ++m) {
+        WorkerPool pool(1);
+        double psnrTotal = 0.0;
+        double psnrWorst = INFINITY;
+        FrameRenderer renderer(
+            pool, gImageWidth, gImageHeight, gBandRows,
+            [](std::size_t frameId, std::uint32_t* pixels, int firstRow, int lastRow) {
+                shadeAnimationRows(pixels, gImageWidth, gImageHeight, frameId, gTargetFrameTime, firstRow, lastRow);
+            },
+            [&](std::size_t frameId, const std::vector<std::uint32_t>& pixels) {
+                shadeAnimationRows(reference.data(), gImageWidth, gImageHeight, frameId, gTargetFrameTime, 0, gImageHeight);
+                double quality = std::min(psnr(reference, pixels), 99.0);
+                psnrTotal += quality;
+                psnrWorst = std::min(psnrWorst, quality);
+            },
+            names[m]);
+        renderer.setTemporalMode(modes[m],
+            [](std::size_t frameId, TemporalMode mode, int parity, std::uint32_t* pixels, int firstRow, int lastRow) {
+                shadeAnimationRowsTemporal(ShadingMode::Double, mode, parity, pixels, gImageWidth, gImageHeight, frameId, gTargetFrameTime, firstRow, lastRow);
+            });
+
+        for (int frame = 0; frame < frames; ++frame) {
+            if (frame % cutEvery == 0)
+                renderer.invalidateHistory();
+            renderer.requestFrame(frame);
+            pool.waitIdle();
+        }
+
+        CancellationStats stats = renderer.stats();
+        TemporalStats temporal = renderer.temporalStats();
+        double costMs = renderer.deadlineStats().estimatedCostNanos / 1e6;
+        if (m == 0)
+            fullMs = costMs;
+        std::printf("%-12s %.3f ms per frame (%.2fx), PSNR mean %.1f dB worst %.1f dB (99 = exact), %.1f%% of frames full\n",
+            names[m], costMs, fullMs / costMs, psnrTotal / stats.framesPublished, psnrWorst,
+            m == 0 ? 100.0 : temporal.fullFraction() * 100.0);
+    }
+    return 0;
+}
+
+// Scrape the metrics exporter over its Unix socket while a renderer runs at
+// the target rate: scrape latency, the renderer's frame rate and deadline
+// misses, and one scrape printed in full.
+// Usage: bench metrics [seconds] [scrapesPerSecond]
+int benchMetrics(int argc, char** argv)
+{
+    double seconds = argumentOr(argc, argv, 2, 3.0);
+    double scrapeRate = std::max(1.0, argumentOr(argc, argv, 3, 100.0));
+    std::string socketPath = "/tmp/bench-metrics-" + std::to_string(getpid()) + ".sock";
+
+    WorkerPool pool;
+    InputLatencyTracker tracker;
+    FrameRenderer renderer(
+        pool, gImageWidth, gImageHeight, gBandRows,
+        [](std::size_t frameId, std::uint32_t* pixels, int firstRow, int lastRow) {
+            shadeAnimationRows(ShadingMode::FixedPoint, pixels, gImageWidth, gImageHeight, frameId, gTargetFrameTime, firstRow, lastRow);
+        },
+        [&](std::size_t frameId, const std::vector<std::uint32_t>&) {
+            tracker.frameReached(frameId, FrameStage::Presented);
+        },
+        "gradient");
+
+    std::uint64_t previousPublished = 0;
+    BenchClock::time_point previousTime = BenchClock::now();
+    MetricsExporter exporter(socketPath);
+    exporter.addCollector([&](MetricsWriter& writer) {
+        writeRendererMetrics(writer, renderer, previousPublished, previousTime);
+        writeLatencyMetrics(writer, tracker);
+        writeMemoryMetrics(writer, memoryGovernor());
+    });
+    exporter.start();
+
+    // Scraper: one connection per scrape, as Prometheus does
+    std::atomic<bool> running{ true };
+    LatencyHistogram scrapeLatency;
+    std::string lastScrape;
+    std::thread scraper([&] {
+        struct sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+        BenchClock::time_point next = BenchClock::now();
+        while (running.load()) {
+            next += secondsToDuration(1.0 / scrapeRate);
+            BenchClock::time_point start = BenchClock::now();
+            int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd >= 0 && connect(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) == 0) {
+                const char request[] = "GET /metrics HTTP/1.0\r\n\r\n";
+                ssize_t written = write(fd, request, sizeof(request) - 1);
+                (void)written;
+                std::string response;
+                char buffer[4096];
+                ssize_t received;
+                while ((received = read(fd, buffer, sizeof(buffer))) > 0)
+                    response.append(buffer, static_cast<std::size_t>(received));
+                scrapeLatency.record(static_cast<std::uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now() - start).count()));
+                lastScrape.swap(response);
+            }
+            if (fd >= 0)
+                close(fd);
+            std::this_thread::sleep_until(next);
+        }
+    });
+
+    BenchClock::time_point end = BenchClock::now() + secondsToDuration(seconds);
+    BenchClock::time_point nextFrame = BenchClock::now();
+    std::size_t frameId = 0;
+    while (BenchClock::now() < end) {
+        nextFrame += secondsToDuration(gTargetFrameTime);
+        tracker.stampInput();
+        tracker.frameRequested(frameId);
+        renderer.requestFrame(frameId++, nextFrame);
+        std::this_thread::sleep_until(nextFrame);
+    }
+    running.store(false);
+    scraper.join();
+    pool.waitIdle();
+    exporter.stop();
+
+    std::size_t bodyStart = lastScrape.find("\r\n\r\n");
+    std::fputs(bodyStart == std::string::npos ? lastScrape.c_str() : lastScrape.c_str() + bodyStart + 4, stdout);
+    std::printf("%llu scrapes at %.0f per second\n", (unsigned long long)exporter.scrapeCount(), scrapeRate);
+    std::fputs(scrapeLatency.report("scrape").c_str(), stdout);
+    std::fputs(renderer.statsReport().c_str(), stdout);
+    return 0;
+}
+
+// Frame log overhead: cost per event on the producer side, and frame cost
+// with and without logging while rendering back to back. The log is written
+// with a small rotation size so rotation is exercised too.
+// Usage: bench framelog [frames] [path]
+int benchFrameLog(int argc, char** argv)
+{
+    int frames = std::max(1, static_cast<int>(argumentOr(argc, argv, 2, 600.0)));
+    std::string path = argc > 3 ? argv[3] : "/tmp/bench-frames.frlog";
+
+    // Producer-side cost of one event
+    double eventNanos = 0.0;
+    std::uint64_t loggedEvents = 0;
+    {
+        FrameLog log(path, 64 * 1024 * 1024, 1);
+        std::uint32_t source = log.registerSource("synthetic");
+        const int events = 20000;
+        BenchClock::duration spent{};
+        for (int i = 0; i < events; ++i) {
+            BenchClock::time_point now = BenchClock::now();
+            BenchClock::time_point start = BenchClock::now();
+            log.rendered(source, i, now, now + std::chrono::microseconds(900), now + std::chrono::milliseconds(16),
+                i % 50 == 0 ? FrameEventFlag::DeadlineMiss : 0, 19, 0);
+            log.reached(source, i, FrameEventKind::Presented, now + std::chrono::milliseconds(2));
+            spent += BenchClock::now() - start;
+        }
+        eventNanos = std::chrono::duration<double, std::nano>(spent).count() / (2.0 * events);
+        FrameLogStats stats = log.stats();
+        loggedEvents = stats.events;
+        std::printf("producer: %.0f ns per event, %llu events, %llu dropped while the writer caught up\n",
+            eventNanos, (unsigned long long)stats.events, (unsigned long long)stats.droppedEvents);
+    }
+    if (std::FILE* file = std::fopen(path.c_str(), "rb")) {
+        std::fseek(file, 0, SEEK_END);
+        std::printf("file: %.1f bytes per event\n", double(std::ftell(file)) / std::max<std::uint64_t>(1, loggedEvents));
+        std::fclose(file);
+    }
+
+    double frameMs[2] = {};
+    for (int logged = 0; logged < 2; ++logged) {
+        WorkerPool pool;
+        std::unique_ptr<FrameLog> log(logged ? new FrameLog(path, 16 * 1024, 3) : nullptr);
+        FrameRenderer renderer(
+            pool, gImageWidth, gImageHeight, gBandRows,
+            [](std::size_t frameId, std::uint32_t* pixels, int firstRow, int lastRow) {
+                shadeAnimationRows(ShadingMode::FixedPoint, pixels, gImageWidth, gImageHeight, frameId, gTargetFrameTime, firstRow, lastRow);
+            },
+            [&](std::size_t frameId, const std::vector<std::uint32_t>&) {
+                if (log)
+                    log->reached(renderer.frameLogSource(), frameId, FrameEventKind::Published);
+            },
+            "gradient");
+        renderer.setFrameLog(log.get());
+
+        BenchClock::time_point start = BenchClock::now();
+        for (int frame = 0; frame < frames; ++frame) {
+            renderer.requestFrame(frame, BenchClock::now() + secondsToDuration(gTargetFrameTime));
+            pool.waitIdle();
+        }
+        frameMs[logged] = std::chrono::duration<double, std::milli>(BenchClock::now() - start).count() / frames;
+        if (log) {
+            FrameLogStats stats = log->stats();
+            std::printf("render loop: %llu events, %llu dropped, %llu files opened\n",
+                (unsigned long long)stats.events, (unsigned long long)stats.droppedEvents, (unsigned long long)stats.filesOpened);
+        }
+    }
+
+    std::printf("frame without log %.3f ms, with log %.3f ms; two events per frame cost %.4f%% of the render and %.5f%% of a %.1f ms frame\n",
+        frameMs[0], frameMs[1], 2.0 * eventNanos / (frameMs[0] * 1e6) * 100.0,
+        2.0 * eventNanos / (gTargetFrameTime * 1e9) * 100.0, gTargetFrameTime * 1e3);
+    std::printf("summarize with: frame_log_tool summary %s.2 %s.1 %s\n", path.c_str(), path.c_str(), path.c_str());
+    return 0;
+}
+
+#ifdef __linux__
+// Share of the pages of a frame buffer that sit on the node rendering their
+// band; -1 when the kernel cannot report page placement
+double pagesOnBandNode(const std::vector<std::uint32_t>& pixels, int bandCount, std::size_t nodeCount)
+{
+    long pageSize = sysconf(_SC_PAGESIZE);
+    std::uintptr_t page = static_cast<std::uintptr_t>(pageSize);
+    std::uintptr_t begin = (reinterpret_cast<std::uintptr_t>(pixels.data()) + page - 1) & ~(page - 1);
+    std::uintptr_t end = reinterpret_cast<std::uintptr_t>(pixels.data() + pixels.size()) & ~(page - 1);
+    std::vector<void*> pages;
+    for (std::uintptr_t address = begin; address < end; address += page)
+        pages.push_back(reinterpret_cast<void*>(address));
+    std::vector<int> status(pages.size(), -1);
+    if (pages.empty() || syscall(SYS_move_pages, 0, pages.size(), pages.data(), nullptr, status.data(), 0) != 0)
+        return -1.0;
+
+    std::size_t bandBytes = static_cast<std::size_t>(gBandRows) * gImageWidth * sizeof(std::uint32_t);
+    std::size_t matching = 0;
+    for (std::size_t i = 0; i < pages.size(); ++i) {
+        std::size_t offset = reinterpret_cast<std::uintptr_t>(pages[i]) - reinterpret_cast<std::uintptr_t>(pixels.data());
+        int band = static_cast<int>(offset / bandBytes);
+        if (status[i] >= 0 && static_cast<std::size_t>(status[i]) == numaNodeForBand(band, bandCount, nodeCount))
+            ++matching;
+    }
+    return double(matching) / pages.size();
+}
+#endif
+
+// NUMA-aware rendering: frames on a pool that ignores NUMA and on one spread
+// over the detected nodes or, on a single-node machine, over the CPUs split
+// into simulated nodes. Reports frame time, the share of bands that ran on
+// their own node, the output checksum of each pool and, on a real multi-node
+// Linux host, how many buffer pages ended up on their band's node.
+// Usage: bench numa [frames] [simulated-nodes]
+int benchNuma(int argc, char** argv)
+{
+    int frames = std::max(1, static_cast<int>(argumentOr(argc, argv, 2, 120.0)));
+    std::size_t simulatedNodes = static_cast<std::size_t>(std::max(2.0, argumentOr(argc, argv, 3, 2.0)));
+    const NumaTopology& detected = systemNumaTopology();
+    std::printf("detected %zu NUMA node(s)\n", detected.nodeCount());
+    for (std::size_t node = 0; node < detected.nodeCpus.size(); ++node)
+        std::printf("  node %zu: %zu CPUs\n", node, detected.nodeCpus[node].size());
+
+    std::vector<int> cpus;
+    for (const std::vector<int>& node : detected.nodeCpus)
+        cpus.insert(cpus.end(), node.begin(), node.end());
+    if (cpus.empty())
+        cpus.push_back(0);
+
+    struct NumaRun
+    {
+        std::string name;
+        NumaTopology topology;
+    };
+    std::vector<NumaRun> runs;
+    runs.push_back({ "unaware", NumaTopology() });
+    if (detected.multiNode())
+        runs.push_back({ "detected", detected });
+    else
+        runs.push_back({ "simulated " + std::to_string(simulatedNodes) + " nodes", simulatedNumaTopology(simulatedNodes, cpus) });
+
+    const int bandCount = (gImageHeight + gBandRows - 1) / gBandRows;
+    std::vector<std::uint64_t> checksums;
+    for (const NumaRun& run : runs) {
+        WorkerPool pool(0, SchedulingPolicy::EarliestDeadline, run.topology);
+        std::uint64_t checksum = 0;
+        double placement = -1.0;
+        FrameRenderer renderer(
+            pool, gImageWidth, gImageHeight, gBandRows,
+            [](std::size_t frameId, std::uint32_t* pixels, int firstRow, int lastRow) {
+                shadeAnimationRows(ShadingMode::FixedPoint, pixels, gImageWidth, gImageHeight, frameId, gTargetFrameTime, firstRow, lastRow);
+            },
+            [&](std::size_t frameId, const std::vector<std::uint32_t>& pixels) {
+                checksum ^= fnv1a(pixels) + frameId;
+#ifdef __linux__
+                if (run.topology.multiNode() && &run.topology == &detected)
+                    placement = pagesOnBandNode(pixels, bandCount, pool.nodeCount());
+#endif
+            },
+            "gradient");
+
+        BenchClock::time_point start = BenchClock::now();
+        for (int frame = 0; frame < frames; ++frame) {
+            renderer.requestFrame(frame);
+            pool.waitIdle();
+        }
+        double frameMs = std::chrono::duration<double, std::milli>(BenchClock::now() - start).count() / frames;
+
+        NumaTaskStats stats = pool.numaStats();
+        std::uint64_t tasks = stats.localTasks + stats.stolenTasks;
+        std::printf("%-20s %zu node(s), %u workers: %.3f ms per frame, %.1f%% of bands on their node, checksum %016llx\n",
+            run.name.c_str(), pool.nodeCount(), pool.threadCount(), frameMs,
+            tasks ? 100.0 * stats.localTasks / tasks : 0.0, (unsigned long long)checksum);
+        if (placement >= 0.0)
+            std::printf("%-20s %.1f%% of frame buffer pages on their band's node\n", "", placement * 100.0);
+        checksums.push_back(checksum);
+    }
+    bool identical = std::equal(checksums.begin() + 1, checksums.end(), checksums.begin());
+    std::printf("output %s across pools\n", identical ? "identical" : "DIFFERS");
+    return identical ? 0 : 1;
+}
+
+// Post-processing stages after generation, once with a barrier after every
+// stage and once as a tile-granular FrameGraph: generate, grade, statistics,
+// HUD (which needs the whole frame's statistics), convert and encode. Reports
+// wall time, critical path, available parallelism and utilization per frame,
+// and checks that both schedules produce the same output.
+// Usage: bench graph [frames] [threads]
+int benchGraph(int argc, char** argv)
+{
+    int frames = std::max(1, static_cast<int>(argumentOr(argc, argv, 2, 60.0)));
+    unsigned threads = static_cast<unsigned>(std::max(0.0, argumentOr(argc, argv, 3, 0.0)));
+    const int tileCount = (gImageHeight + gBandRows - 1) / gBandRows;
+    const std::size_t pixelCount = static_cast<std::size_t>(gImageWidth) * gImageHeight;
+
+    std::vector<std::uint32_t> pixels(pixelCount);
+    std::vector<std::uint32_t> output(pixelCount);
+    std::vector<std::uint32_t> tileHistograms(static_cast<std::size_t>(tileCount) * 256);
+    std::vector<std::uint64_t> tileHashes(tileCount);
+    std::uint8_t curve[256];
+    for (int i = 0; i < 256; ++i)
+        curve[i] = static_cast<std::uint8_t>(std::lround(255.0 * std::pow(i / 255.0, 0.8)));
+
+    auto rows = [&](int tile, int& firstRow, int& lastRow) {
+        firstRow = tile * gBandRows;
+        lastRow = std::min(gImageHeight, firstRow + gBandRows);
+    };
+    auto generate = [&](std::size_t frameId, int tile) {
+        int firstRow, lastRow;
+        rows(tile, firstRow, lastRow);
+        shadeAnimationRowsFixed(pixels.data(), gImageWidth, gImageHeight, frameId, gTargetFrameTime, firstRow, lastRow);
+    };
+    auto grade = [&](std::size_t, int tile) {
+        int firstRow, lastRow;
+        rows(tile, firstRow, lastRow);
+        for (std::size_t i = static_cast<std::size_t>(firstRow) * gImageWidth; i < static_cast<std::size_t>(lastRow) * gImageWidth; ++i) {
+            std::uint32_t p = pixels[i];
+            pixels[i] = (p & 0xFF000000u) | (std::uint32_t(curve[(p >> 16) & 0xFF]) << 16)
+                | (std::uint32_t(curve[(p >> 8) & 0xFF]) << 8) | curve[p & 0xFF];
+        }
+    };
+    auto statistics = [&](std::size_t, int tile) {
+        int firstRow, lastRow;
+        rows(tile, firstRow, lastRow);
+        std::uint32_t* histogram = tileHistograms.data() + static_cast<std::size_t>(tile) * 256;
+        std::fill(histogram, histogram + 256, 0u);
+        for (std::size_t i = static_cast<std::size_t>(firstRow) * gImageWidth; i < static_cast<std::size_t>(lastRow) * gImageWidth; ++i) {
+            std::uint32_t p = pixels[i];
+            ++histogram[(((p >> 16) & 0xFF) * 77 + ((p >> 8) & 0xFF) * 150 + (p & 0xFF) * 29) >> 8];
+        }
+    };
+    // Luminance histogram of the whole frame drawn as bars over the top band
+    auto hud = [&](std::size_t, int tile) {
+        if (tile != 0)
+            return;
+        std::uint32_t totals[256] = {};
+        std::uint32_t peak = 1;
+        for (int t = 0; t < tileCount; ++t) {
+            for (int bin = 0; bin < 256; ++bin) {
+                totals[bin] += tileHistograms[static_cast<std::size_t>(t) * 256 + bin];
+                peak = std::max(peak, totals[bin]);
+            }
+        }
+        int barRows = std::min(gBandRows, gImageHeight);
+        for (int bin = 0; bin < 256 && bin < gImageWidth; ++bin) {
+            int height = static_cast<int>(std::uint64_t(totals[bin]) * barRows / peak);
+            for (int y = barRows - height; y < barRows; ++y)
+                pixels[static_cast<std::size_t>(y) * gImageWidth + bin] = 0xFFFFFFFFu;
+        }
+    };
+    auto convert = [&](std::size_t, int tile) {
+        int firstRow, lastRow;
+        rows(tile, firstRow, lastRow);
+        for (std::size_t i = static_cast<std::size_t>(firstRow) * gImageWidth; i < static_cast<std::size_t>(lastRow) * gImageWidth; ++i) {
+            std::uint32_t p = pixels[i];
+            output[i] = (p >> 24) | ((p >> 8) & 0xFF00) | ((p << 8) & 0xFF0000) | (p << 24);
+        }
+    };
+    auto encode = [&](std::size_t, int tile) {
+        int firstRow, lastRow;
+        rows(tile, firstRow, lastRow);
+        std::uint64_t hash = 14695981039346656037ull;
+        for (std::size_t i = static_cast<std::size_t>(firstRow) * gImageWidth; i < static_cast<std::size_t>(lastRow) * gImageWidth; ++i)
+            hash = (hash ^ output[i]) * 1099511628211ull;
+        tileHashes[tile] = hash;
+    };
+    auto frameHash = [&] {
+        std::uint64_t hash = 0;
+        for (std::uint64_t tileHash : tileHashes)
+            hash = hash * 31 + tileHash;
+        return hash;
+    };
+
+    WorkerPool pool(threads);
+    const std::function<void(std::size_t, int)> stages[] = { generate, grade, statistics, hud, convert, encode };
+    const char* stageNames[] = { "generate", "grade", "statistics", "hud", "convert", "encode" };
+
+    // Stage by stage, waiting for every tile before the next stage starts
+    std::uint64_t stagedHash = 0;
+    BenchClock::time_point start = BenchClock::now();
+    for (int frame = 0; frame < frames; ++frame) {
+        for (const std::function<void(std::size_t, int)>& stage : stages) {
+            std::vector<WorkerPool::Task> tasks;
+            for (int tile = 0; tile < tileCount; ++tile)
+                tasks.push_back([&stage, frame, tile] { stage(frame, tile); });
+            pool.submitBatch(std::move(tasks), WorkerPool::Clock::now());
+            pool.waitIdle();
+        }
+        stagedHash ^= frameHash() + frame;
+    }
+    double stagedMs = std::chrono::duration<double, std::milli>(BenchClock::now() - start).count() / frames;
+
+    FrameGraph graph(pool, tileCount);
+    int ids[6];
+    for (int s = 0; s < 6; ++s)
+        ids[s] = graph.addStage(stageNames[s], stages[s]);
+    graph.addDependency(ids[1], ids[0]);
+    graph.addDependency(ids[2], ids[1]);
+    graph.addDependency(ids[3], ids[2], TileDependency::AllTiles);
+    graph.addDependency(ids[4], ids[1]);
+    graph.addDependency(ids[4], ids[3]);
+    graph.addDependency(ids[5], ids[4]);
+
+    std::uint64_t graphHash = 0;
+    FrameGraphReport total;
+    start = BenchClock::now();
+    for (int frame = 0; frame < frames; ++frame) {
+        FrameGraphReport report = graph.run(frame, WorkerPool::Clock::now() + secondsToDuration(gTargetFrameTime));
+        graphHash ^= frameHash() + frame;
+        total.wallNanos += report.wallNanos;
+        total.workNanos += report.workNanos;
+        total.criticalPathNanos += report.criticalPathNanos;
+        total.threads = report.threads;
+        total.stages = report.stages;
+    }
+    double graphMs = std::chrono::duration<double, std::milli>(BenchClock::now() - start).count() / frames;
+
+    std::printf("%d tiles, 6 stages, %u threads\n", tileCount, pool.threadCount());
+    std::printf("staged: %.3f ms per frame\n", stagedMs);
+    std::printf("graph:  %.3f ms per frame (%.2fx)\n", graphMs, stagedMs / graphMs);
+    std::printf("graph per frame: critical path %.3f ms, work %.3f ms, parallelism %.2f, utilization %.1f%%\n",
+        total.criticalPathNanos / 1e6 / frames, total.workNanos / 1e6 / frames, total.parallelism(), total.utilization() * 100.0);
+    std::fputs(graph.lastReport().summary().c_str(), stdout);
+    std::printf("output %s (%016llx)\n", stagedHash == graphHash ? "identical" : "DIFFERS", (unsigned long long)graphHash);
+    return stagedHash == graphHash ? 0 : 1;
+}
+
+// Offline batch rendering with one frame in flight, split across every
+// worker, against many frames in flight delivered in order through the
+// reorder buffer; at the window size and at a quarter of it.
+// Usage: bench offline [frames] [threads]
+int benchOffline(int argc, char** argv)
+{
+    std::size_t frames = static_cast<std::size_t>(std::max(1.0, argumentOr(argc, argv, 2, 240.0)));
+    unsigned threads = static_cast<unsigned>(std::max(0.0, argumentOr(argc, argv, 3, 0.0)));
+    WorkerPool pool(threads);
+
+    const int sizes[][2] = { { gImageWidth, gImageHeight }, { gImageWidth / 2, gImageHeight / 2 } };
+    bool ordered = true;
+    for (const auto& size : sizes) {
+        int width = size[0];
+        int height = size[1];
+        double framesPerSecond[2] = {};
+        std::uint64_t checksums[2] = {};
+        const std::size_t inFlight[2] = { 1, 0 };
+        for (int run = 0; run < 2; ++run) {
+            OfflineRenderer renderer(
+                pool, width, height,
+                [width, height](std::size_t frameId, std::uint32_t* pixels, int firstRow, int lastRow) {
+                    shadeAnimationRows(ShadingMode::FixedPoint, pixels, width, height, frameId, gTargetFrameTime, firstRow, lastRow);
+                },
+                inFlight[run]);
+            std::size_t expected = 0;
+            OfflineRenderStats stats = renderer.render(0, frames, [&](std::size_t frameId, const std::vector<std::uint32_t>& pixels) {
+                ordered = ordered && frameId == expected++;
+                checksums[run] ^= fnv1a(pixels) + frameId;
+            });
+            framesPerSecond[run] = stats.framesPerSecond();
+            std::printf("%dx%d, %zu in flight x %zu tasks: %.0f frames/s, %zu buffered at most, %llu reorder waits\n",
+                width, height, stats.framesInFlight, stats.groupSize, stats.framesPerSecond(), stats.maxBuffered,
+                (unsigned long long)stats.reorderWaits);
+        }
+        std::printf("%dx%d: %.2fx throughput with frames in flight, output %s\n", width, height,
+            framesPerSecond[1] / framesPerSecond[0], checksums[0] == checksums[1] ? "identical" : "DIFFERS");
+        ordered = ordered && checksums[0] == checksums[1];
+    }
+    std::printf("%u workers, delivery %s\n", pool.threadCount(), ordered ? "in order" : "OUT OF ORDER");
+    return ordered ? 0 : 1;
+}
+
+#ifdef __linux__
+// Frame-range rendering across local worker processes against the same
+// frames in this process: once fault free, then with worker 0 slowed down
+// and one worker killed halfway, which must not change the output.
+// Usage: bench farm [frames] [workers]
+int benchFarm(int argc, char** argv)
+{
+    std::size_t frames = static_cast<std::size_t>(std::max(1.0, argumentOr(argc, argv, 2, 240.0)));
+    int workers = std::max(1, static_cast<int>(argumentOr(argc, argv, 3, 4.0)));
+    const int width = gImageWidth / 2;
+    const int height = gImageHeight / 2;
+    const std::size_t pixelCount = static_cast<std::size_t>(width) * height;
+
+    std::uint64_t reference = 0;
+    std::vector<std::uint32_t> pixels(pixelCount);
+    BenchClock::time_point started = BenchClock::now();
+    for (std::size_t frameId = 0; frameId < frames; ++frameId) {
+        shadeAnimationRows(ShadingMode::FixedPoint, pixels.data(), width, height, frameId, gTargetFrameTime, 0, height);
+        reference ^= fnv1a(pixels) + frameId;
+    }
+    double inProcess = frames / std::chrono::duration<double>(BenchClock::now() - started).count();
+    std::printf("%dx%d in process: %.0f frames/s\n", width, height, inProcess);
+
+    // Shared with the workers, so only the first worker to reach the frame dies
+    std::atomic<bool>* crashed = static_cast<std::atomic<bool>*>(
+        mmap(nullptr, sizeof(std::atomic<bool>), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    if (crashed == MAP_FAILED) {
+        std::perror("mmap");
+        return 1;
+    }
+    new (crashed) std::atomic<bool>(false);
+
+    bool correct = true;
+    const char* runs[] = { "fault free", "slow worker 0, one crash" };
+    for (int run = 0; run < 2; ++run) {
+        bool faults = run == 1;
+        RenderFarmOptions options;
+        options.workers = workers;
+        RenderFarm farm(width, height,
+            [faults, frames, crashed](std::size_t frameId, std::uint32_t* out, int w, int h) {
+                if (faults && renderFarmWorkerIndex() == 0)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(4));
+                if (faults && frameId == frames / 2 && !crashed->exchange(true))
+                    raise(SIGKILL);
+                shadeAnimationRows(ShadingMode::FixedPoint, out, w, h, frameId, gTargetFrameTime, 0, h);
+            },
+            options);
+
+        std::uint64_t checksum = 0;
+        std::size_t expected = 0;
+        bool ordered = true;
+        RenderFarmStats stats = farm.render(0, frames, [&](std::size_t frameId, const std::uint32_t* out) {
+            ordered = ordered && frameId == expected++;
+            checksum ^= fnv1a(out, pixelCount) + frameId;
+        });
+        bool identical = checksum == reference;
+        correct = correct && ordered && identical && expected == frames;
+
+        std::printf("%s: %.0f frames/s, %.2fx in process, %llu chunks, %llu duplicated, %llu frames discarded, "
+                    "%llu crashes, %llu restarts, %llu frames reassigned\n",
+            runs[run], stats.framesPerSecond(), stats.framesPerSecond() / inProcess,
+            (unsigned long long)stats.chunksAssigned, (unsigned long long)stats.chunksDuplicated,
+            (unsigned long long)stats.framesDiscarded, (unsigned long long)stats.workerCrashes,
+            (unsigned long long)stats.workerRestarts, (unsigned long long)stats.framesReassigned);
+        std::printf("  frames per worker:");
+        for (std::uint64_t count : stats.framesPerWorker)
+            std::printf(" %llu", (unsigned long long)count);
+        std::printf("; delivery %s, output %s\n", ordered ? "in order" : "OUT OF ORDER", identical ? "identical" : "DIFFERS");
+    }
+    munmap(crashed, sizeof(std::atomic<bool>));
+    return correct ? 0 : 1;
+}
+#endif
+
+#ifdef ASYNC_FRAME_SOURCE
+// Many I/O-bound coroutine sources on a small pool. For every frame each
+// source waits for a header on its socket, reads a tile of a shared file on
+// the reactor's file thread and expands it into its frame. Reports delivered
+// frames, header-to-publish latency, the threads used and coroutine frame
+// reuse. Needs a C++20 build: clang++ -std=c++20 -O2 -pthread bench.cpp
+// Usage: bench async [seconds] [sources]
+int benchAsync(int argc, char** argv)
+{
+    double seconds = argumentOr(argc, argv, 2, 3.0);
+    int sourceCount = std::max(1, static_cast<int>(argumentOr(argc, argv, 3, 64.0)));
+    const int sourceSize = 128;
+    const int tileSize = 32;
+    const int tileCount = 16;
+    const std::size_t tileBytes = static_cast<std::size_t>(tileSize) * tileSize * sizeof(std::uint32_t);
+
+    // Tile file, read back at an offset chosen by each frame's header
+    std::string path = "/tmp/bench-async-" + std::to_string(getpid()) + ".tiles";
+    int fileFd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fileFd < 0) {
+        std::fprintf(stderr, "cannot create %s\n", path.c_str());
+        return 1;
+    }
+    unlink(path.c_str());
+    std::vector<std::uint32_t> tiles(tileBytes / sizeof(std::uint32_t) * tileCount);
+    for (std::size_t i = 0; i < tiles.size(); ++i)
+        tiles[i] = 0xFF000000u | static_cast<std::uint32_t>(i * 2654435761u >> 8);
+    if (pwrite(fileFd, tiles.data(), tiles.size() * sizeof(std::uint32_t), 0) < 0) {
+        close(fileFd);
+        return 1;
+    }
+
+    IoReactor reactor;
+    WorkerPool pool;
+    std::mutex latencyMutex;
+    LatencyHistogram latency;
+    std::vector<int> writeFds(sourceCount);
+    std::vector<int> readFds(sourceCount);
+    std::vector<std::vector<std::uint32_t>> tileBuffers(sourceCount, std::vector<std::uint32_t>(tileBytes / sizeof(std::uint32_t)));
+    std::vector<std::uint64_t> sentNanos(sourceCount);
+    std::vector<std::unique_ptr<AsyncFrameDriver>> drivers;
+    for (int source = 0; source < sourceCount; ++source) {
+        int pair[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0)
+            return 1;
+        fcntl(pair[0], F_SETFL, O_NONBLOCK);
+        readFds[source] = pair[0];
+        writeFds[source] = pair[1];
+
+        drivers.emplace_back(new AsyncFrameDriver(
+            pool, reactor, sourceSize, sourceSize,
+            [&, source](AsyncFrameContext& context) -> AsyncTask<void> {
+                std::uint64_t header[2];
+                ssize_t received = co_await context.readExactly(readFds[source], header, sizeof(header));
+                if (received != static_cast<ssize_t>(sizeof(header)))
+                    throw std::runtime_error("source closed");
+                std::uint32_t* tile = tileBuffers[source].data();
+                off_t offset = static_cast<off_t>((header[0] + source) % tileCount * tileBytes);
+                if (co_await context.readFile(fileFd, tile, tileBytes, offset) != static_cast<ssize_t>(tileBytes))
+                    throw std::runtime_error("short tile read");
+                for (int y = 0; y < context.height(); ++y) {
+                    std::uint32_t* row = context.pixels() + static_cast<std::size_t>(y) * context.width();
+                    const std::uint32_t* tileRow = tile + (y % tileSize) * tileSize;
+                    for (int x = 0; x < context.width(); ++x)
+                        row[x] = tileRow[x % tileSize];
+                }
+                sentNanos[source] = header[1];
+            },
+            [&, source](std::size_t, const std::vector<std::uint32_t>&) {
+                std::uint64_t now = static_cast<std::uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now().time_since_epoch()).count());
+                std::lock_guard<std::mutex> lock(latencyMutex);
+                latency.record(now - sentNanos[source]);
+            },
+            "source" + std::to_string(source)));
+    }
+
+    // Each tick requests a frame from every source, then delivers its data
+    int frames = std::max(1, static_cast<int>(seconds * gTargetFps));
+    BenchClock::time_point next = BenchClock::now();
+    for (int frame = 0; frame < frames; ++frame) {
+        next += secondsToDuration(gTargetFrameTime);
+        for (std::unique_ptr<AsyncFrameDriver>& driver : drivers)
+            driver->requestFrame(frame, next);
+        for (int source = 0; source < sourceCount; ++source) {
+            std::uint64_t header[2] = { static_cast<std::uint64_t>(frame), static_cast<std::uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now().time_since_epoch()).count()) };
+            ssize_t written = write(writeFds[source], header, sizeof(header));
+            (void)written;
+        }
+        std::this_thread::sleep_until(next);
+    }
+
+    // Closing the write ends fails any frame still waiting for data
+    for (int fd : writeFds)
+        close(fd);
+    AsyncSourceStats total;
+    for (std::unique_ptr<AsyncFrameDriver>& driver : drivers) {
+        driver->waitIdle();
+        AsyncSourceStats stats = driver->stats();
+        total.framesRequested += stats.framesRequested;
+        total.framesPublished += stats.framesPublished;
+        total.framesCoalesced += stats.framesCoalesced;
+        total.framesFailed += stats.framesFailed;
+    }
+    drivers.clear();
+    for (int fd : readFds)
+        close(fd);
+    close(fileFd);
+
+    IoReactorStats io = reactor.stats();
+    std::printf("%d sources at %d fps on %u workers plus 2 reactor threads\n", sourceCount, gTargetFps, pool.threadCount());
+    std::printf("frames: %llu requested, %llu published (%.1f%%), %llu coalesced, %llu failed\n",
+        (unsigned long long)total.framesRequested, (unsigned long long)total.framesPublished,
+        total.framesRequested ? 100.0 * total.framesPublished / total.framesRequested : 0.0,
+        (unsigned long long)total.framesCoalesced, (unsigned long long)total.framesFailed);
+    std::printf("reactor: %llu readiness waits, %llu file reads, %llu poll iterations\n",
+        (unsigned long long)io.readinessWaits, (unsigned long long)io.fileReads, (unsigned long long)io.pollIterations);
+    std::printf("coroutine frames: %llu pooled, %llu allocated\n",
+        (unsigned long long)coroutineFramePool().hits(), (unsigned long long)coroutineFramePool().misses());
+    std::fputs(latency.report("header->published").c_str(), stdout);
+    return 0;
+}
+#endif
+
+// Sink for benchmark results the optimizer would otherwise discard
+volatile std::uint64_t gBenchSink = 0;
+
+// Keeps a scalar accumulator in a register of its own, so the compiler does
+// not pack the independent chains of the scalar peak loop into SIMD lanes
+#if defined(__GNUC__) && defined(__x86_64__)
+#define BENCH_KEEP_SCALAR(value) __asm__ volatile("" : "+x"(value))
+#elif defined(__GNUC__) && defined(__aarch64__)
+#define BENCH_KEEP_SCALAR(value) __asm__ volatile("" : "+w"(value))
+#else
+#define BENCH_KEEP_SCALAR(value) (void)0
+#endif
+
+// Fastest of repeats timed calls of body, in seconds, after one warm-up call
+template <typename Body>
+double bestSecondsPerCall(int repeats, Body body)
+{
+    body();
+    double best = INFINITY;
+    for (int repeat = 0; repeat < repeats; ++repeat) {
+        BenchClock::time_point start = BenchClock::now();
+        body();
+        best = std::min(best, std::chrono::duration<double>(BenchClock::now() - start).count());
+    }
+    return best;
+}
+
+// Sustained single-thread bandwidth in GB/s over a buffer of the given size;
+// copy counts the bytes read plus the bytes written
+struct Bandwidth
+{
+    double read = 0.0;
+    double write = 0.0;
+    double copy = 0.0;
+};
+
+Bandwidth measureBandwidth(std::size_t bytes, int repeats)
+{
+    std::size_t words = bytes / sizeof(std::uint64_t);
+    std::vector<std::uint64_t> source(words, 1);
+    std::vector<std::uint64_t> destination(words, 0);
+    bytes = words * sizeof(std::uint64_t);
+
+    double read = bestSecondsPerCall(repeats, [&] {
+        std::uint64_t sums[4] = {};
+        for (std::size_t i = 0; i + 4 <= words; i += 4) {
+            sums[0] += source[i];
+            sums[1] += source[i + 1];
+            sums[2] += source[i + 2];
+            sums[3] += source[i + 3];
+        }
+        gBenchSink = sums[0] + sums[1] + sums[2] + sums[3];
+    });
+    std::uint64_t value = 0;
+    double write = bestSecondsPerCall(repeats, [&] {
+        std::fill(destination.begin(), destination.end(), ++value);
+        gBenchSink = destination[words / 2];
+    });
+    double copy = bestSecondsPerCall(repeats, [&] {
+        std::memcpy(destination.data(), source.data(), bytes);
+        gBenchSink = destination[words / 2];
+    });
+
+    Bandwidth result;
+    result.read = bytes / read / 1e9;
+    result.write = bytes / write / 1e9;
+    result.copy = 2.0 * bytes / copy / 1e9;
+    return result;
+}
+
+// Peak single-thread arithmetic in Gop/s: eight independent multiply-add
+// chains, long enough that latency is hidden and throughput is measured
+double measureScalarDoublePeak(int iterations)
+{
+    double a[8] = { 1.0, 1.1, 1.2, 1.3, 1.4, 1.5, 1.6, 1.7 };
+    const double m = 0.9999999;
+    const double c = 1e-7;
+    double seconds = bestSecondsPerCall(5, [&] {
+        for (int i = 0; i < iterations; ++i) {
+            for (int k = 0; k < 8; ++k) {
+                a[k] = a[k] * m + c;
+                BENCH_KEEP_SCALAR(a[k]);
+            }
+        }
+        gBenchSink = static_cast<std::uint64_t>(a[0] + a[1] + a[2] + a[3] + a[4] + a[5] + a[6] + a[7]);
+    });
+    return 2.0 * 8 * iterations / seconds / 1e9;
+}
+
+// Same chains on the SIMD unit the kernels are built for: doubles, and
+// 8-bit lanes as used by the packing, blending and reconstruction kernels.
+// Without SIMD these return 0 and the scalar peak stands in.
+double measureSimdDoublePeak(int iterations)
+{
+#if defined(FRAME_SOURCE_SSE2)
+    __m128d a[8];
+    for (int k = 0; k < 8; ++k)
+        a[k] = _mm_set1_pd(1.0 + 0.1 * k);
+    const __m128d m = _mm_set1_pd(0.9999999);
+    const __m128d c = _mm_set1_pd(1e-7);
+    double seconds = bestSecondsPerCall(5, [&] {
+        for (int i = 0; i < iterations; ++i) {
+            for (int k = 0; k < 8; ++k)
+                a[k] = _mm_add_pd(_mm_mul_pd(a[k], m), c);
+        }
+        __m128d sum = _mm_add_pd(_mm_add_pd(_mm_add_pd(a[0], a[1]), _mm_add_pd(a[2], a[3])), _mm_add_pd(_mm_add_pd(a[4], a[5]), _mm_add_pd(a[6], a[7])));
+        gBenchSink = static_cast<std::uint64_t>(_mm_cvtsd_f64(sum));
+    });
+    return 4.0 * 8 * iterations / seconds / 1e9;
+#elif defined(FRAME_SOURCE_NEON) && defined(__aarch64__)
+    float64x2_t a[8];
+    for (int k = 0; k < 8; ++k)
+        a[k] = vdupq_n_f64(1.0 + 0.1 * k);
+    const float64x2_t m = vdupq_n_f64(0.9999999);
+    const float64x2_t c = vdupq_n_f64(1e-7);
+    double seconds = bestSecondsPerCall(5, [&] {
+        for (int i = 0; i < iterations; ++i) {
+            for (int k = 0; k < 8; ++k)
+                a[k] = vaddq_f64(vmulq_f64(a[k], m), c);
+        }
+        float64x2_t sum = vaddq_f64(vaddq_f64(vaddq_f64(a[0], a[1]), vaddq_f64(a[2], a[3])), vaddq_f64(vaddq_f64(a[4], a[5]), vaddq_f64(a[6], a[7])));
+        gBenchSink = static_cast<std::uint64_t>(vgetq_lane_f64(sum, 0));
+    });
+    return 4.0 * 8 * iterations / seconds / 1e9;
+#else
+    (void)iterations;
+    return 0.0;
+#endif
+}
+
+double measureSimdBytePeak(int iterations)
+{
+#if defined(FRAME_SOURCE_SSE2)
+    __m128i a[8];
+    for (int k = 0; k < 8; ++k)
+        a[k] = _mm_set1_epi8(static_cast<char>(k));
+    const __m128i c = _mm_set1_epi8(3);
+    const __m128i m = _mm_set1_epi8(7);
+    double seconds = bestSecondsPerCall(5, [&] {
+        for (int i = 0; i < iterations; ++i) {
+            for (int k = 0; k < 8; ++k)
+                a[k] = _mm_max_epu8(_mm_add_epi8(a[k], c), m);
+        }
+        __m128i sum = _mm_add_epi8(_mm_add_epi8(_mm_add_epi8(a[0], a[1]), _mm_add_epi8(a[2], a[3])), _mm_add_epi8(_mm_add_epi8(a[4], a[5]), _mm_add_epi8(a[6], a[7])));
+        gBenchSink = static_cast<std::uint64_t>(_mm_cvtsi128_si32(sum));
+    });
+    return 2.0 * 16 * 8 * iterations / seconds / 1e9;
+#elif defined(FRAME_SOURCE_NEON)
+    uint8x16_t a[8];
+    for (int k = 0; k < 8; ++k)
+        a[k] = vdupq_n_u8(static_cast<std::uint8_t>(k));
+    const uint8x16_t c = vdupq_n_u8(3);
+    const uint8x16_t m = vdupq_n_u8(7);
+    double seconds = bestSecondsPerCall(5, [&] {
+        for (int i = 0; i < iterations; ++i) {
+            for (int k = 0; k < 8; ++k)
+                a[k] = vmaxq_u8(vaddq_u8(a[k], c), m);
+        }
+        uint8x16_t sum = vaddq_u8(vaddq_u8(vaddq_u8(a[0], a[1]), vaddq_u8(a[2], a[3])), vaddq_u8(vaddq_u8(a[4], a[5]), vaddq_u8(a[6], a[7])));
+        gBenchSink = vgetq_lane_u8(sum, 0);
+    });
+    return 2.0 * 16 * 8 * iterations / seconds / 1e9;
+#else
+    (void)iterations;
+    return 0.0;
+#endif
+}
+
+// One pipeline kernel on the roofline. Traffic and operations are per-pixel
+// estimates: operations count scalar-equivalent arithmetic, one per double or
+// per 8-bit channel lane, so SIMD kernels are compared with the matching peak.
+struct RooflineKernel
+{
+    const char* name;
+    const char* location;
+    double readBytes;
+    double writeBytes;
+    double operations;
+    bool byteLanes;
+    std::function<void()> run;
+
+    // Measured; zero in the initializers
+    double seconds;
+    double bandwidthRoof;
+    double computeRoof;
+
+    double bytes() const { return readBytes + writeBytes; }
+    double intensity() const { return operations / bytes(); }
+};
+
+// Roofline of the pipeline kernels on one core. Measures read, write and copy
+// bandwidth for a buffer far larger than the caches and for a frame-sized one
+// that stays in them, the scalar and SIMD arithmetic peaks, then places each
+// kernel by arithmetic intensity. Frames are small enough to stay in cache
+// between stages, so kernels are judged against the frame-sized roof; the
+// DRAM roof is reported alongside. Writes a text chart and a CSV.
+// Usage: bench roofline [csv-path] [dram-MiB]
+int benchRoofline(int argc, char** argv)
+{
+    const char* csvPath = argc > 2 ? argv[2] : "roofline.csv";
+    std::size_t dramBytes = static_cast<std::size_t>(std::max(8.0, argumentOr(argc, argv, 3, 256.0))) << 20;
+    const std::size_t pixelCount = static_cast<std::size_t>(gImageWidth) * gImageHeight;
+    const std::size_t frameBytes = pixelCount * sizeof(std::uint32_t);
+
+    Bandwidth dram = measureBandwidth(dramBytes, 5);
+    Bandwidth frame = measureBandwidth(frameBytes, 50);
+    const int peakIterations = 20000000;
+    double scalarPeak = measureScalarDoublePeak(peakIterations);
+    double simdPeak = measureSimdDoublePeak(peakIterations);
+    double bytePeak = measureSimdBytePeak(peakIterations);
+    double doubleRoof = std::max(scalarPeak, simdPeak);
+    double byteRoof = bytePeak > 0.0 ? bytePeak : scalarPeak;
+
+    std::printf("ceilings, one thread:\n");
+    std::printf("  bandwidth %4zu MiB buffer: read %6.1f, write %6.1f, copy %6.1f GB/s\n", dramBytes >> 20, dram.read, dram.write, dram.copy);
+    std::printf("  bandwidth frame buffer:   read %6.1f, write %6.1f, copy %6.1f GB/s\n", frame.read, frame.write, frame.copy);
+    std::printf("  compute: scalar double %.1f, SIMD double %.1f, SIMD 8-bit lanes %.1f Gop/s\n", scalarPeak, simdPeak, bytePeak);
+
+    std::vector<std::uint32_t> pixels(pixelCount);
+    std::vector<std::uint32_t> previous(pixelCount);
+    std::vector<std::uint32_t> published;
+    shadeAnimationRows(previous.data(), gImageWidth, gImageHeight, 1, gTargetFrameTime, 0, gImageHeight);
+    shadeAnimationRows(pixels.data(), gImageWidth, gImageHeight, 2, gTargetFrameTime, 0, gImageHeight);
+    const int gridColumns = gImageWidth / gCoarseBlockSize + 1;
+    std::vector<std::uint64_t> grid(static_cast<std::size_t>(gridColumns) * (gImageHeight / gCoarseBlockSize + 1));
+    for (std::size_t i = 0; i < grid.size(); ++i)
+        grid[i] = expandArgb(previous[i % pixelCount]);
+
+    // The three libm calls of the double path are counted at about 20 operations each
+    std::vector<RooflineKernel> kernels = {
+        { "fill", "shadeAnimationRows, double path", 0.0, 4.0, 75.0, false, [&] {
+            for (int row = 0; row < gImageHeight; row += gBandRows)
+                shadeAnimationRows(pixels.data(), gImageWidth, gImageHeight, 3, gTargetFrameTime, row, std::min(gImageHeight, row + gBandRows));
+        }, 0.0, 0.0, 0.0 },
+        { "pack", "shadeAnimationRowsFixed, packArgbRow", 0.0, 4.0, 6.0, true, [&] {
+            for (int row = 0; row < gImageHeight; row += gBandRows)
+                shadeAnimationRowsFixed(pixels.data(), gImageWidth, gImageHeight, 3, gTargetFrameTime, row, std::min(gImageHeight, row + gBandRows));
+        }, 0.0, 0.0, 0.0 },
+        { "copy", "updateImageData, gImageData = newData", 4.0, 4.0, 0.0, true, [&] {
+            published = pixels;
+            gBenchSink = published[pixelCount / 2];
+        }, 0.0, 0.0, 0.0 },
+        { "convert", "ARGB to big-endian byte order for CoreGraphics", 4.0, 4.0, 4.0, true, [&] {
+            for (std::size_t i = 0; i < pixelCount; ++i) {
+                std::uint32_t p = previous[i];
+                pixels[i] = (p >> 24) | ((p >> 8) & 0xFF00) | ((p << 8) & 0xFF0000) | (p << 24);
+            }
+        }, 0.0, 0.0, 0.0 },
+        { "blend", "blendExpanded, adaptive interpolated blocks", 0.5, 4.0, 36.0, true, [&] {
+            const int n = gCoarseBlockSize;
+            for (int y0 = 0; y0 < gImageHeight; y0 += n) {
+                const std::uint64_t* top = grid.data() + static_cast<std::size_t>(y0 / n) * gridColumns;
+                const std::uint64_t* bottom = top + gridColumns;
+                for (int gx = 0; gx + 1 < gridColumns; ++gx) {
+                    for (int dy = 0; dy < n; ++dy) {
+                        std::uint32_t* row = pixels.data() + static_cast<std::size_t>(y0 + dy) * gImageWidth + gx * n;
+                        for (int dx = 0; dx < n; ++dx)
+                            row[dx] = blendExpanded(top[gx], top[gx + 1], bottom[gx], bottom[gx + 1], dx, dy);
+                    }
+                }
+            }
+        }, 0.0, 0.0, 0.0 },
+        { "reconstruct", "reconstructRows, checkerboard", 8.0, 4.0, 52.0, true, [&] {
+            for (int row = 0; row < gImageHeight; row += gBandRows)
+                reconstructRows(pixels.data(), previous.data(), gImageWidth, row, std::min(gImageHeight, row + gBandRows), TemporalMode::Checkerboard, 0);
+        }, 0.0, 0.0, 0.0 },
+    };
+
+    for (RooflineKernel& kernel : kernels) {
+        kernel.seconds = bestSecondsPerCall(30, kernel.run);
+        bool mixed = kernel.readBytes > 0.0 && kernel.writeBytes > 0.0;
+        kernel.bandwidthRoof = mixed ? frame.copy : kernel.writeBytes > 0.0 ? frame.write : frame.read;
+        kernel.computeRoof = kernel.byteLanes ? byteRoof : doubleRoof;
+    }
+
+    // Roofline chart, log-log: operations per byte across, Gop/s up
+    const int octaveColumns = 5;
+    const int lowestOctave = -6;
+    const int columns = 12 * octaveColumns + 1;
+    const int decadeRows = 4;
+    double highest = std::max(doubleRoof, byteRoof) * 2.0;
+    double lowest = highest;
+    for (const RooflineKernel& kernel : kernels) {
+        if (kernel.operations > 0.0)
+            lowest = std::min(lowest, kernel.operations * pixelCount / kernel.seconds / 1e9);
+    }
+    int topDecade = static_cast<int>(std::ceil(std::log10(highest)));
+    int bottomDecade = static_cast<int>(std::floor(std::log10(std::min(lowest, std::pow(2.0, lowestOctave) * frame.copy))));
+    int rows = (topDecade - bottomDecade) * decadeRows + 1;
+    std::vector<std::string> chart(rows, std::string(columns, ' '));
+    auto plot = [&](double intensity, double rate, char mark, bool overwrite) {
+        int column = static_cast<int>(std::lround((std::log2(intensity) - lowestOctave) * octaveColumns));
+        int row = static_cast<int>(std::lround((topDecade - std::log10(rate)) * decadeRows));
+        if (column >= 0 && column < columns && row >= 0 && row < rows && (overwrite || chart[row][column] == ' '))
+            chart[row][column] = mark;
+    };
+    for (int column = 0; column < columns; ++column) {
+        double intensity = std::pow(2.0, lowestOctave + double(column) / octaveColumns);
+        plot(intensity, std::min(byteRoof, intensity * frame.copy), '=', false);
+        plot(intensity, std::min(doubleRoof, intensity * frame.copy), '-', false);
+        plot(intensity, std::min(byteRoof, intensity * dram.copy), '.', false);
+    }
+    for (std::size_t k = 0; k < kernels.size(); ++k) {
+        const RooflineKernel& kernel = kernels[k];
+        if (kernel.operations > 0.0)
+            plot(kernel.intensity(), kernel.operations * pixelCount / kernel.seconds / 1e9, static_cast<char>('1' + k), true);
+    }
+
+    std::printf("\nroofline, Gop/s against operations per byte (2^%d to 2^%d):\n", lowestOctave, lowestOctave + 12);
+    for (int row = 0; row < rows; ++row) {
+        if (row % decadeRows == 0)
+            std::printf("%10g |%s\n", std::pow(10.0, topDecade - row / decadeRows), chart[row].c_str());
+        else
+            std::printf("%10s |%s\n", "", chart[row].c_str());
+    }
+    std::printf("%10s +%s\n", "", std::string(columns, '-').c_str());
+    std::printf("  = frame-sized copy roof, 8-bit lane peak   - same roof, double peak   . DRAM copy roof\n");
+
+    std::printf("\n  %-12s %6s %6s %7s %9s %8s %8s %7s  %-8s %s\n",
+        "kernel", "B/px", "op/px", "op/B", "ms/frame", "GB/s", "Gop/s", "roof %", "bound", "where");
+    std::FILE* csv = std::fopen(csvPath, "w");
+    if (csv) {
+        std::fprintf(csv, "kind,name,bytes_per_pixel,ops_per_pixel,ops_per_byte,ms_per_frame,gb_per_s,gop_per_s,roof_gop_per_s,dram_roof_gop_per_s,fraction_of_roof,bound\n");
+        std::fprintf(csv, "ceiling,read %zu MiB,,,,,%.3f,,,,,\n", dramBytes >> 20, dram.read);
+        std::fprintf(csv, "ceiling,write %zu MiB,,,,,%.3f,,,,,\n", dramBytes >> 20, dram.write);
+        std::fprintf(csv, "ceiling,copy %zu MiB,,,,,%.3f,,,,,\n", dramBytes >> 20, dram.copy);
+        std::fprintf(csv, "ceiling,read frame,,,,,%.3f,,,,,\n", frame.read);
+        std::fprintf(csv, "ceiling,write frame,,,,,%.3f,,,,,\n", frame.write);
+        std::fprintf(csv, "ceiling,copy frame,,,,,%.3f,,,,,\n", frame.copy);
+        std::fprintf(csv, "ceiling,scalar double,,,,,,%.3f,,,,\n", scalarPeak);
+        std::fprintf(csv, "ceiling,SIMD double,,,,,,%.3f,,,,\n", simdPeak);
+        std::fprintf(csv, "ceiling,SIMD 8-bit lanes,,,,,,%.3f,,,,\n", bytePeak);
+    }
+    for (std::size_t k = 0; k < kernels.size(); ++k) {
+        const RooflineKernel& kernel = kernels[k];
+        double achievedBytes = kernel.bytes() * pixelCount / kernel.seconds / 1e9;
+        double achievedOps = kernel.operations * pixelCount / kernel.seconds / 1e9;
+        double memoryRoof = kernel.intensity() * kernel.bandwidthRoof;
+        double dramRoof = std::min(kernel.computeRoof, kernel.intensity() * dram.copy);
+        bool memoryBound = memoryRoof < kernel.computeRoof;
+        // Achieved over attainable, min(compute, intensity x bandwidth), which also covers copy's zero operations
+        double fraction = std::max(achievedOps / kernel.computeRoof, achievedBytes / kernel.bandwidthRoof);
+        std::printf("%c %-12s %6.1f %6.1f %7.2f %9.3f %8.1f %8.1f %6.0f%%  %-8s %s\n",
+            kernel.operations > 0.0 ? static_cast<char>('1' + k) : ' ', kernel.name, kernel.bytes(), kernel.operations,
+            kernel.intensity(), kernel.seconds * 1e3, achievedBytes, achievedOps, fraction * 100.0,
+            memoryBound ? "memory" : "compute", kernel.location);
+        if (csv) {
+            std::fprintf(csv, "kernel,%s,%.2f,%.2f,%.4f,%.4f,%.3f,%.3f,%.3f,%.3f,%.4f,%s\n",
+                kernel.name, kernel.bytes(), kernel.operations, kernel.intensity(), kernel.seconds * 1e3,
+                achievedBytes, achievedOps, std::min(kernel.computeRoof, memoryRoof), dramRoof, fraction,
+                memoryBound ? "memory" : "compute");
+        }
+    }
+    std::printf("  kernels far below 100%% of their roof have headroom; those near it only gain from doing less work\n");
+
+    if (!csv) {
+        std::fprintf(stderr, "cannot write %s\n", csvPath);
+        return 1;
+    }
+    std::fclose(csv);
+    std::printf("wrote %s\n", csvPath);
+    return 0;
+}
+
+// Cost per pixel of the sRGB conversions and of compositing and 2x2
+// downscaling in gamma and in linear light at the window size, with the
+// accuracy of the tables against the exact transfer functions.
+// Usage: bench srgb [repeats]
+int benchSrgb(int argc, char** argv)
+{
+    int repeats = std::max(1, static_cast<int>(argumentOr(argc, argv, 2, 20.0)));
+    const int width = gImageWidth;
+    const int height = gImageHeight;
+    const std::size_t pixelCount = static_cast<std::size_t>(width) * height;
+
+    // Frame under a ramp from black to white whose opacity rises down the frame
+    std::vector<std::uint32_t> frame(pixelCount);
+    std::vector<std::uint32_t> overlay(pixelCount);
+    shadeAnimationRows(ShadingMode::FixedPoint, frame.data(), width, height, 0, gTargetFrameTime, 0, height);
+    for (int y = 0; y < height; ++y) {
+        std::uint32_t alpha = static_cast<std::uint32_t>(y * 255 / std::max(1, height - 1));
+        for (int x = 0; x < width; ++x)
+            overlay[static_cast<std::size_t>(y) * width + x] = (alpha << 24) | (static_cast<std::uint32_t>(x * 255 / std::max(1, width - 1)) * 0x010101u);
+    }
+
+    // Accuracy: exact round trip of every 8-bit value, worst encode error, SIMD against scalar compositing
+    int roundTrips = 0;
+    for (std::uint32_t value = 0; value < 256; ++value) {
+        std::uint32_t pixel = 0xFF000000u | value * 0x010101u;
+        std::uint16_t wide[gWideLanes];
+        std::uint32_t back = 0;
+        widenRow(BlendSpace::Linear, &pixel, wide, 1);
+        narrowRow(BlendSpace::Linear, wide, &back, 1);
+        roundTrips += back == pixel;
+    }
+    double worstEncode = 0.0;
+    for (std::uint32_t lane = 0; lane < 0x10000; ++lane) {
+        double exact = linearToSrgb(lane / 65535.0) * 255.0;
+        worstEncode = std::max(worstEncode, std::fabs(srgbTables().encode[lane >> (16 - gSrgbEncodeBits)] - exact));
+    }
+    std::vector<std::uint16_t> wideFrame(pixelCount * gWideLanes);
+    std::vector<std::uint16_t> wideOverlay(pixelCount * gWideLanes);
+    widenRow(BlendSpace::Linear, frame.data(), wideFrame.data(), static_cast<int>(pixelCount));
+    widenRow(BlendSpace::Linear, overlay.data(), wideOverlay.data(), static_cast<int>(pixelCount));
+    std::vector<std::uint16_t> expected(wideFrame);
+    for (std::size_t i = 0; i < pixelCount; ++i) {
+        std::uint32_t alpha = wideOverlay[i * gWideLanes + 3];
+        for (int lane = 0; lane < gWideLanes; ++lane) {
+            std::uint32_t source = lane == 3 ? 0xFFFF : wideOverlay[i * gWideLanes + lane];
+            expected[i * gWideLanes + lane] = compositeLane(source, expected[i * gWideLanes + lane], alpha);
+        }
+    }
+    std::vector<std::uint16_t> composited(wideFrame);
+    compositeOverWide(composited.data(), wideOverlay.data(), static_cast<int>(pixelCount));
+    bool kernelMatches = composited == expected;
+    std::printf("round trip exact for %d of 256 values, encode table within %.2f LSB of exact, composite kernel %s scalar\n",
+        roundTrips, worstEncode, kernelMatches ? "matches" : "DIFFERS FROM");
+
+    // How far the two spaces disagree on the composite and the downscale
+    std::vector<std::uint32_t> gammaFrame(frame);
+    std::vector<std::uint32_t> linearFrame(frame);
+    compositeOverRows(BlendSpace::Gamma, gammaFrame.data(), overlay.data(), width, 0, height);
+    compositeOverRows(BlendSpace::Linear, linearFrame.data(), overlay.data(), width, 0, height);
+    std::vector<std::uint32_t> gammaHalf(pixelCount / 4);
+    std::vector<std::uint32_t> linearHalf(pixelCount / 4);
+    downscaleHalfRows(BlendSpace::Gamma, frame.data(), width, gammaHalf.data(), 0, height / 2);
+    downscaleHalfRows(BlendSpace::Linear, frame.data(), width, linearHalf.data(), 0, height / 2);
+    auto meanDistance = [](const std::vector<std::uint32_t>& a, const std::vector<std::uint32_t>& b) {
+        double total = 0.0;
+        for (std::size_t i = 0; i < a.size(); ++i)
+            total += argbDistance(a[i], b[i]);
+        return a.empty() ? 0.0 : total / a.size();
+    };
+    std::printf("linear minus gamma: composite %.2f LSB, downscale %.2f LSB mean largest channel difference\n",
+        meanDistance(gammaFrame, linearFrame), meanDistance(gammaHalf, linearHalf));
+
+    // Each kernel over the whole frame as one long row; stages row by row with scratch from the arena
+    std::vector<std::uint32_t> narrowed(pixelCount);
+    int count = static_cast<int>(pixelCount);
+    struct Timing
+    {
+        const char* name;
+        std::function<void()> body;
+    };
+    const Timing timings[] = {
+        { "widen, gamma", [&] { widenRow(BlendSpace::Gamma, frame.data(), wideFrame.data(), count); } },
+        { "decode to linear", [&] { widenRow(BlendSpace::Linear, frame.data(), wideFrame.data(), count); } },
+        { "narrow, gamma", [&] { narrowRow(BlendSpace::Gamma, wideFrame.data(), narrowed.data(), count); } },
+        { "encode from linear", [&] { narrowRow(BlendSpace::Linear, wideFrame.data(), narrowed.data(), count); } },
+        { "composite kernel", [&] { compositeOverWide(composited.data(), wideOverlay.data(), count); } },
+        { "downscale kernel", [&] {
+             for (int y = 0; y + 1 < height; y += 2)
+                 downscaleHalfWide(wideFrame.data() + static_cast<std::size_t>(y) * width * gWideLanes,
+                     wideFrame.data() + static_cast<std::size_t>(y + 1) * width * gWideLanes,
+                     expected.data() + static_cast<std::size_t>(y / 2) * (width / 2) * gWideLanes, width / 2);
+         } },
+        { "composite stage, gamma", [&] { compositeOverRows(BlendSpace::Gamma, gammaFrame.data(), overlay.data(), width, 0, height); } },
+        { "composite stage, linear", [&] { compositeOverRows(BlendSpace::Linear, linearFrame.data(), overlay.data(), width, 0, height); } },
+        { "downscale stage, gamma", [&] { downscaleHalfRows(BlendSpace::Gamma, frame.data(), width, gammaHalf.data(), 0, height / 2); } },
+        { "downscale stage, linear", [&] { downscaleHalfRows(BlendSpace::Linear, frame.data(), width, linearHalf.data(), 0, height / 2); } },
+    };
+    double nanos[sizeof(timings) / sizeof(timings[0])];
+    for (std::size_t i = 0; i < sizeof(timings) / sizeof(timings[0]); ++i) {
+        nanos[i] = bestSecondsPerCall(repeats, timings[i].body) * 1e9 / pixelCount;
+        std::printf("%-24s %6.2f ns per source pixel\n", timings[i].name, nanos[i]);
+    }
+    gBenchSink = narrowed[pixelCount / 2] + gammaFrame[pixelCount / 2] + linearHalf[pixelCount / 8] + composited[pixelCount];
+    std::printf("linear light costs %.2fx gamma compositing and %.2fx gamma downscaling\n", nanos[7] / nanos[6], nanos[9] / nanos[8]);
+    return roundTrips == 256 && kernelMatches ? 0 : 1;
+}
+
+// The half-float HDR working format against the 8-bit path at the window
+// size: conversion kernel speed, shading and tone mapping cost per pixel,
+// bytes per frame and memory traffic at 60 Hz, and the precision each format
+// keeps through an exposure round trip. F16C needs -mf16c or -march=native.
+// Usage: bench hdr [repeats]
+int benchHdr(int argc, char** argv)
+{
+    int repeats = std::max(1, static_cast<int>(argumentOr(argc, argv, 2, 20.0)));
+    const int width = gImageWidth;
+    const int height = gImageHeight;
+    const std::size_t pixelCount = static_cast<std::size_t>(width) * height;
+    const std::size_t valueCount = pixelCount * gHdrChannels;
+#if defined(HDR_FRAME_F16C)
+    const char* conversions = "F16C";
+#elif defined(HDR_FRAME_NEON)
+    const char* conversions = "NEON";
+#else
+    const char* conversions = "scalar";
+#endif
+
+    std::vector<float> values(valueCount);
+    std::vector<std::uint16_t> halves(valueCount);
+    std::vector<std::uint32_t> frame(pixelCount);
+    for (std::size_t i = 0; i < valueCount; ++i)
+        values[i] = static_cast<float>(i % 4096) / 1024.0f;
+
+    struct Timing
+    {
+        const char* name;
+        std::function<void()> body;
+    };
+    const Timing timings[] = {
+        { "float to half", [&] { floatToHalfRow(values.data(), halves.data(), valueCount); } },
+        { "half to float", [&] { halfToFloatRow(halves.data(), values.data(), valueCount); } },
+        { "shade, 8-bit fixed point", [&] {
+             shadeAnimationRows(ShadingMode::FixedPoint, frame.data(), width, height, 0, gTargetFrameTime, 0, height);
+         } },
+        { "shade, half float", [&] { shadeAnimationRowsHdr(halves.data(), width, height, 0, gTargetFrameTime, 0, height); } },
+        { "tone map, clamp", [&] { toneMapRows(ToneMapOperator::Clamp, halves.data(), frame.data(), width, height); } },
+        { "tone map, Reinhard", [&] { toneMapRows(ToneMapOperator::Reinhard, halves.data(), frame.data(), width, height); } },
+        { "tone map, ACES", [&] { toneMapRows(ToneMapOperator::Aces, halves.data(), frame.data(), width, height); } },
+        { "banded shade + Reinhard", [&] {
+             for (int firstRow = 0; firstRow < height; firstRow += gBandRows)
+                 shadeAnimationRowsHdrToneMapped(ToneMapOperator::Reinhard, frame.data(), width, height, 0, gTargetFrameTime,
+                     firstRow, std::min(height, firstRow + gBandRows));
+         } },
+    };
+    std::printf("half conversions: %s\n", conversions);
+    double nanos[sizeof(timings) / sizeof(timings[0])];
+    for (std::size_t i = 0; i < sizeof(timings) / sizeof(timings[0]); ++i) {
+        nanos[i] = bestSecondsPerCall(repeats, timings[i].body) * 1e9 / pixelCount;
+        std::printf("%-26s %6.2f ns per pixel\n", timings[i].name, nanos[i]);
+    }
+    gBenchSink = frame[pixelCount / 2] + halves[valueCount / 2];
+    std::printf("HDR frame costs %.2fx the 8-bit path banded, %.2fx through a full-frame buffer\n",
+        nanos[7] / nanos[2], (nanos[3] + nanos[5]) / nanos[2]);
+
+    // Memory: the 8-bit path writes its frame once; a full-frame HDR buffer is
+    // written by shading, read by the tone map, and the ARGB frame written again
+    const double mib = 1024.0 * 1024.0;
+    std::printf("frame: ARGB %.2f MiB, RGBA16F %.2f MiB (+%.2f MiB per band in flight when banded)\n",
+        pixelCount * 4 / mib, pixelCount * gHdrPixelBytes / mib, static_cast<double>(width) * gBandRows * gHdrPixelBytes / mib);
+    std::printf("traffic at 60 Hz: 8-bit %.0f MB/s, full-frame HDR %.0f MB/s\n",
+        pixelCount * 4 * 60 / 1e6, pixelCount * (gHdrPixelBytes * 2 + 4) * 60 / 1e6);
+
+    // Precision: darken by 16 in linear light, store, brighten by 16, store
+    // as sRGB. The 8-bit path stores the dark value as sRGB bytes in between.
+    int worst8 = 0;
+    int worstHalf = 0;
+    const std::uint8_t* encode = srgbTables().encode;
+    const std::uint16_t* decode = srgbTables().decode;
+    auto encodeLinear = [encode](double linear) {
+        return encode[static_cast<int>(std::min(65535.0, std::max(0.0, linear * 65535.0 + 0.5))) >> (16 - gSrgbEncodeBits)];
+    };
+    for (int value = 0; value < 256; ++value) {
+        double linear = decode[value] / 65535.0;
+        int dark = encodeLinear(linear / 16.0);
+        int back8 = encodeLinear(decode[dark] / 65535.0 * 16.0);
+        int backHalf = encodeLinear(halfToFloat(floatToHalf(static_cast<float>(linear / 16.0))) * 16.0);
+        worst8 = std::max(worst8, std::abs(back8 - value));
+        worstHalf = std::max(worstHalf, std::abs(backHalf - value));
+    }
+    std::printf("exposure -4 stops and back: 8-bit off by up to %d LSB, half float by up to %d LSB\n", worst8, worstHalf);
+    return 0;
+}
+
+// Shading through views: tiles, a padded stride, a dirty rectangle and a
+// canvas owned by someone else must match the same pixels of a full frame,
+// and slicing a view must cost nothing against shading into a packed tile
+int benchViews(int argc, char** argv)
+{
+    int repeats = std::max(1, static_cast<int>(argumentOr(argc, argv, 2, 20.0)));
+    const int width = gImageWidth;
+    const int height = gImageHeight;
+    const int tile = 64;
+    const std::size_t frameId = 5;
+    const FrameRegion whole = { width, height, 0, 0 };
+
+    // Whether view matches the rectangle of reference at (x, y)
+    auto matches = [](ConstArgbView view, ConstArgbView reference, int x, int y) {
+        ConstArgbView expected = reference.subView(x, y, view.width(), view.height());
+        for (int row = 0; row < view.height(); ++row) {
+            if (!std::equal(view.row(row), view.row(row) + view.width(), expected.row(row)))
+                return false;
+        }
+        return true;
+    };
+
+    const ShadingMode modes[] = { ShadingMode::Double, ShadingMode::FixedPoint, ShadingMode::Adaptive };
+    const char* modeNames[] = { "double", "fixed point", "adaptive" };
+    std::vector<std::uint32_t> reference(static_cast<std::size_t>(width) * height);
+    std::vector<std::uint32_t> tiled(reference.size());
+    bool allMatch = true;
+    for (int m = 0; m < 3; ++m) {
+        shadeAnimation(modes[m], makeImageView(reference, width, height), whole, frameId, gTargetFrameTime);
+        ArgbView frame = makeImageView(tiled, width, height);
+        for (int y = 0; y < height; y += tile) {
+            for (int x = 0; x < width; x += tile)
+                shadeAnimation(modes[m], frame.subView(x, y, tile, tile), FrameRegion{ width, height, x, y }, frameId, gTargetFrameTime);
+        }
+        bool tilesMatch = tiled == reference;
+
+        // Rows padded to a 256-byte multiple, as an image library might hand them over
+        const int paddedPixels = (width + 63) / 64 * 64 + 16;
+        std::vector<std::uint32_t> padded(static_cast<std::size_t>(paddedPixels) * height, 0xDEADBEEFu);
+        ArgbView paddedView(padded.data(), width, height, paddedPixels * sizeof(std::uint32_t));
+        shadeAnimation(modes[m], paddedView, whole, frameId, gTargetFrameTime);
+        bool paddingKept = padded[width] == 0xDEADBEEFu && padded.back() == 0xDEADBEEFu;
+
+        // A dirty rectangle at an odd origin. The adaptive grid starts at the
+        // view origin, so off the frame's grid it only matches within budget.
+        std::vector<std::uint32_t> dirty(static_cast<std::size_t>(tile) * tile);
+        ArgbView dirtyView = makeImageView(dirty, tile, tile);
+        shadeAnimation(modes[m], dirtyView, FrameRegion{ width, height, 37, 11 }, frameId, gTargetFrameTime);
+        bool dirtyMatch = modes[m] == ShadingMode::Adaptive || matches(dirtyView, makeImageView(reference, width, height), 37, 11);
+
+        std::printf("%-12s 64x64 tiles %s, padded stride %s, dirty rect at (37, 11) %s\n", modeNames[m], tilesMatch ? "match" : "DIFFER",
+            matches(paddedView, makeImageView(reference, width, height), 0, 0) && paddingKept ? "matches" : "DIFFERS",
+            modes[m] == ShadingMode::Adaptive ? "n/a" : dirtyMatch ? "matches" : "DIFFERS");
+        allMatch = allMatch && tilesMatch && paddingKept && dirtyMatch;
+    }
+
+    // The frame drawn straight into a larger canvas owned by someone else
+    const int canvasWidth = width + 200;
+    const int canvasHeight = height + 100;
+    std::vector<std::uint32_t> canvas(static_cast<std::size_t>(canvasWidth) * canvasHeight, 0xFF000000u);
+    ArgbView canvasView = makeImageView(canvas, canvasWidth, canvasHeight);
+    shadeAnimation(ShadingMode::Double, makeImageView(reference, width, height), whole, frameId, gTargetFrameTime);
+    shadeAnimation(ShadingMode::Double, canvasView.subView(100, 50, width, height), whole, frameId, gTargetFrameTime);
+    bool embedded = matches(canvasView.subView(100, 50, width, height), makeImageView(reference, width, height), 0, 0)
+        && canvasView(99, 50) == 0xFF000000u && canvasView(100, 49) == 0xFF000000u;
+    std::printf("frame embedded at (100, 50) in a %dx%d canvas: %s\n", canvasWidth, canvasHeight, embedded ? "matches" : "DIFFERS");
+    allMatch = allMatch && embedded;
+
+    // Tiles shaded in place through sub-views versus into a packed tile then copied
+    std::vector<std::uint32_t> staging(static_cast<std::size_t>(tile) * tile);
+    ArgbView frame = makeImageView(tiled, width, height);
+    double inPlace = bestSecondsPerCall(repeats, [&] {
+        for (int y = 0; y < height; y += tile) {
+            for (int x = 0; x < width; x += tile)
+                shadeAnimationFixed(frame.subView(x, y, tile, tile), FrameRegion{ width, height, x, y }, frameId, gTargetFrameTime);
+        }
+    });
+    double copied = bestSecondsPerCall(repeats, [&] {
+        for (int y = 0; y < height; y += tile) {
+            for (int x = 0; x < width; x += tile) {
+                ArgbView destination = frame.subView(x, y, tile, tile);
+                ArgbView packed(staging.data(), destination.width(), destination.height());
+                shadeAnimationFixed(packed, FrameRegion{ width, height, x, y }, frameId, gTargetFrameTime);
+                for (int row = 0; row < packed.height(); ++row)
+                    std::copy(packed.row(row), packed.row(row) + packed.width(), destination.row(row));
+            }
+        }
+    });
+    const double pixelCount = static_cast<double>(width) * height;
+    std::printf("64x64 fixed-point tiles: in place %.2f ns per pixel, staged and copied %.2f ns per pixel\n",
+        inPlace * 1e9 / pixelCount, copied * 1e9 / pixelCount);
+    gBenchSink = tiled[tiled.size() / 2] + canvas[canvas.size() / 2];
+    return allMatch ? 0 : 1;
+}
+
+// Virtual canvas: frame cost against canvas size, a pan with and without
+// idle prefetch, and a zoom out through every level of detail. Frames render
+// on this thread in bands, leaving the pool's workers to prefetch.
+int benchCanvas(int argc, char** argv)
+{
+    int frames = std::max(1, static_cast<int>(argumentOr(argc, argv, 2, 240.0)));
+    unsigned threads = static_cast<unsigned>(std::max(0.0, argumentOr(argc, argv, 3, 0.0)));
+    WorkerPool pool(threads);
+    const int width = gImageWidth;
+    const int height = gImageHeight;
+    std::vector<std::uint32_t> frame(static_cast<std::size_t>(width) * height);
+    ArgbView frameView = makeImageView(frame, width, height);
+
+    struct PassResult
+    {
+        double meanMillis = 0.0;
+        double worstMillis = 0.0;
+        double tilesShadedPerFrame = 0.0;
+        std::uint64_t worstTilesShaded = 0;
+        CanvasStats stats;
+    };
+    // Render each frame's viewport, optionally prefetching and pacing at
+    // period. The first frame fills the cache and is left out of the results.
+    auto runPass = [&](VirtualCanvas& canvas, const std::function<CanvasViewport(int)>& viewportAt, bool prefetch, double period) {
+        PassResult result;
+        std::uint64_t coldTiles = 0;
+        auto next = std::chrono::steady_clock::now();
+        for (int i = 0; i <= frames; ++i) {
+            CanvasViewport viewport = viewportAt(i);
+            std::uint64_t shadedBefore = canvas.stats().tilesShaded;
+            auto start = std::chrono::steady_clock::now();
+            for (int firstRow = 0; firstRow < height; firstRow += gBandRows) {
+                int lastRow = std::min(height, firstRow + gBandRows);
+                canvas.render(frameView.rows(firstRow, lastRow), FrameRegion{ width, height, 0, firstRow }, viewport);
+            }
+            double millis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            std::uint64_t shaded = canvas.stats().tilesShaded - shadedBefore;
+            if (i == 0) {
+                coldTiles = shaded;
+            } else {
+                result.meanMillis += millis / frames;
+                result.worstMillis = std::max(result.worstMillis, millis);
+                result.worstTilesShaded = std::max(result.worstTilesShaded, shaded);
+            }
+            if (prefetch)
+                canvas.prefetch(viewport, width, height);
+            if (period > 0.0) {
+                next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(period));
+                std::this_thread::sleep_until(next);
+            }
+        }
+        pool.waitIdle();
+        result.stats = canvas.stats();
+        result.stats.tilesShaded -= coldTiles;
+        result.tilesShadedPerFrame = static_cast<double>(result.stats.tilesShaded) / frames;
+        return result;
+    };
+
+    // At zoom 1 on whole pixels the canvas shows the content unscaled
+    bool matches = false;
+    {
+        VirtualCanvas canvas(pool, 1 << 16, 1 << 16, shadeCanvasPattern);
+        CanvasViewport viewport;
+        viewport.centerX = 30000 + width / 2;
+        viewport.centerY = 20000 + height / 2;
+        canvas.render(frameView, FrameRegion{ width, height, 0, 0 }, viewport);
+        std::vector<std::uint32_t> expected(frame.size());
+        shadeCanvasPattern(makeImageView(expected, width, height), FrameRegion{ 1 << 16, 1 << 16, 30000, 20000 }, 0);
+        matches = expected == frame;
+        std::printf("zoom 1 matches the content shaded directly: %s\n", matches ? "yes" : "NO");
+    }
+
+    // Frame cost follows the viewport: the same pan over canvases 256x apart in area
+    auto pan = [width, height](int i) {
+        CanvasViewport viewport;
+        viewport.centerX = width + i * 12.0;
+        viewport.centerY = height + i * 3.0;
+        return viewport;
+    };
+    const int sides[] = { 1 << 12, 1 << 16, 1 << 20 };
+    for (int side : sides) {
+        VirtualCanvas canvas(pool, side, side, shadeCanvasPattern);
+        PassResult result = runPass(canvas, pan, false, 0.0);
+        std::printf("%7d^2 canvas, %2d levels: %.2f ms per frame (worst %.2f), %.2f tiles shaded per frame, %.0f%% hits\n", side,
+            canvas.levelCount(), result.meanMillis, result.worstMillis, result.tilesShadedPerFrame, result.stats.hitRate() * 100.0);
+    }
+
+    // Paced at 120 Hz, the idle time shades the tiles the pan reaches next
+    const char* prefetchNames[] = { "without prefetch", "with prefetch   " };
+    for (int prefetch = 0; prefetch < 2; ++prefetch) {
+        VirtualCanvas canvas(pool, 1 << 20, 1 << 20, shadeCanvasPattern);
+        PassResult result = runPass(canvas, pan, prefetch != 0, 1.0 / 120.0);
+        std::printf("pan %s: worst frame %.2f ms, %llu tiles shaded by frames (at most %llu in one), %llu prefetched, %llu of them used\n",
+            prefetchNames[prefetch], result.worstMillis, (unsigned long long)result.stats.tilesShaded, (unsigned long long)result.worstTilesShaded,
+            (unsigned long long)result.stats.tilesPrefetched, (unsigned long long)result.stats.prefetchHits);
+    }
+
+    // Zooming out through every level keeps each frame to a few dozen tiles
+    {
+        VirtualCanvas canvas(pool, 1 << 20, 1 << 20, shadeCanvasPattern);
+        const double endZoom = static_cast<double>(width) / (1 << 20);
+        auto zoomOut = [frames, endZoom](int i) {
+            CanvasViewport viewport;
+            viewport.centerX = 1 << 19;
+            viewport.centerY = 1 << 19;
+            viewport.zoom = std::pow(endZoom, std::min(1.0, static_cast<double>(i) / frames));
+            return viewport;
+        };
+        PassResult result = runPass(canvas, zoomOut, true, 1.0 / 120.0);
+        std::printf("zoom out through %d levels: worst frame %.2f ms, at most %llu tiles shaded in one frame, %.1f MiB cached\n",
+            canvas.levelCount(), result.worstMillis, (unsigned long long)result.worstTilesShaded, canvas.cachedBytes() / 1048576.0);
+    }
+    gBenchSink = frame[frame.size() / 2];
+    return matches ? 0 : 1;
+}
+
+// Energy per frame from the RAPL counters for each shading kernel at one,
+// half and all threads, next to the time per frame. Each configuration
+// renders offline for a fixed time; package power while sleeping is the
+// idle baseline, and the share above it is what the frames cost. Without
+// readable counters only the times are reported.
+// Usage: bench energy [seconds-per-configuration]
+int benchEnergy(int argc, char** argv)
+{
+    double seconds = std::max(0.1, argumentOr(argc, argv, 2, 1.0));
+    const std::uint64_t pixelsPerFrame = static_cast<std::uint64_t>(gImageWidth) * gImageHeight;
+    EnergyMeter meter;
+    double idleWatts = 0.0;
+    if (meter.available()) {
+        std::printf("RAPL through %s:", meter.source().c_str());
+        for (std::size_t domain = 0; domain < meter.domainCount(); ++domain)
+            std::printf(" %s", meter.domainName(domain).c_str());
+        EnergyReading begin = meter.read();
+        std::this_thread::sleep_for(secondsToDuration(seconds));
+        idleWatts = meter.report(begin, meter.read(), 0, 0).watts();
+        std::printf(", %.2f W idle\n", idleWatts);
+    } else {
+        std::printf("energy unavailable (%s), reporting time only\n", meter.source().c_str());
+    }
+
+    struct Kernel
+    {
+        const char* name;
+        OfflineRenderer::ShadeFunction shade;
+    };
+    const Kernel kernels[] = {
+        { "double", [](std::size_t frameId, std::uint32_t* pixels, int firstRow, int lastRow) {
+             shadeAnimationRows(ShadingMode::Double, pixels, gImageWidth, gImageHeight, frameId, gTargetFrameTime, firstRow, lastRow);
+         } },
+        { "fixed-point", [](std::size_t frameId, std::uint32_t* pixels, int firstRow, int lastRow) {
+             shadeAnimationRows(ShadingMode::FixedPoint, pixels, gImageWidth, gImageHeight, frameId, gTargetFrameTime, firstRow, lastRow);
+         } },
+        { "adaptive", [](std::size_t frameId, std::uint32_t* pixels, int firstRow, int lastRow) {
+             shadeAnimationRows(ShadingMode::Adaptive, pixels, gImageWidth, gImageHeight, frameId, gTargetFrameTime, firstRow, lastRow);
+         } },
+        { "hdr-aces", [](std::size_t frameId, std::uint32_t* pixels, int firstRow, int lastRow) {
+             shadeAnimationRowsHdrToneMapped(ToneMapOperator::Aces, pixels, gImageWidth, gImageHeight, frameId, gTargetFrameTime, firstRow, lastRow);
+         } },
+    };
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned> threadCounts = { 1u };
+    if (cores / 2 > 1)
+        threadCounts.push_back(cores / 2);
+    if (cores > 1)
+        threadCounts.push_back(cores);
+
+    std::string leastEnergy;
+    std::string fastest;
+    double leastJoules = 1e300;
+    double fastestMillis = 1e300;
+    std::uint64_t checksum = 0;
+    for (const Kernel& kernel : kernels) {
+        for (unsigned threads : threadCounts) {
+            WorkerPool pool(threads);
+            OfflineRenderer renderer(pool, gImageWidth, gImageHeight, kernel.shade);
+            auto sink = [&checksum](std::size_t, const std::vector<std::uint32_t>& pixels) { checksum += pixels[pixels.size() / 2]; };
+            const std::size_t batch = std::max<std::size_t>(4, renderer.framesInFlight());
+            renderer.render(0, batch, sink);
+
+            // Whole batches until the interval is long enough for the counters' resolution
+            std::size_t frames = 0;
+            EnergyReading begin = meter.read();
+            do {
+                renderer.render(frames, batch, sink);
+                frames += batch;
+            } while (BenchClock::now() - begin.time < secondsToDuration(seconds));
+            EnergyReport report = meter.report(begin, meter.read(), frames, pixelsPerFrame);
+
+            double millis = report.seconds * 1e3 / frames;
+            std::string name = std::string(kernel.name) + " x" + std::to_string(threads);
+            std::printf("%-16s %7.3f ms/frame %7.1f MP/s", name.c_str(), millis, report.megapixels / report.seconds);
+            if (meter.available()) {
+                double aboveIdle = (report.joules - idleWatts * report.seconds) / frames;
+                std::printf("  %7.2f mJ/frame (%.2f above idle) %7.2f mJ/MP %6.1f W", report.joulesPerFrame() * 1e3, aboveIdle * 1e3,
+                    report.joulesPerMegapixel() * 1e3, report.watts());
+                if (report.joulesPerFrame() < leastJoules) {
+                    leastJoules = report.joulesPerFrame();
+                    leastEnergy = name;
+                }
+            }
+            std::printf("\n");
+            if (millis < fastestMillis) {
+                fastestMillis = millis;
+                fastest = name;
+            }
+        }
+    }
+    std::printf("fastest: %s at %.3f ms/frame", fastest.c_str(), fastestMillis);
+    if (meter.available())
+        std::printf(", least energy: %s at %.2f mJ/frame", leastEnergy.c_str(), leastJoules * 1e3);
+    std::printf("\n");
+    gBenchSink = checksum;
+    return 0;
+}
+
+#ifdef __linux__
+// Sampling profiler overhead at 1 kHz on offline rendering with every core
+// busy, alternating runs with and without it, on each sampling clock. The
+// profile of the CPU-clock runs is summarised by stage and optionally
+// written as folded stacks.
+int benchProfile(int argc, char** argv)
+{
+    std::size_t frames = static_cast<std::size_t>(std::max(1.0, argumentOr(argc, argv, 2, 120.0)));
+    const char* foldedPath = argc > 3 ? argv[3] : nullptr;
+    const int rounds = 5;
+    WorkerPool pool;
+    OfflineRenderer renderer(pool, gImageWidth, gImageHeight, [](std::size_t frameId, std::uint32_t* pixels, int firstRow, int lastRow) {
+        shadeAnimationRows(ShadingMode::Double, pixels, gImageWidth, gImageHeight, frameId, gTargetFrameTime, firstRow, lastRow);
+    });
+    // Process CPU seconds, which unlike wall time do not count time other tenants took
+    std::uint64_t checksum = 0;
+    auto renderAll = [&] {
+        std::clock_t begin = std::clock();
+        renderer.render(0, frames, [&](std::size_t, const std::vector<std::uint32_t>& pixels) { checksum += pixels[pixels.size() / 2]; });
+        return static_cast<double>(std::clock() - begin) / CLOCKS_PER_SEC;
+    };
+    renderAll();
+
+    const SamplingClock clocks[] = { SamplingClock::Wall, SamplingClock::ThreadCpu };
+    const char* clockNames[] = { "wall clock", "thread CPU clock" };
+    for (int c = 0; c < 2; ++c) {
+        SamplingProfilerOptions options;
+        options.clock = clocks[c];
+        SamplingProfiler profiler(options);
+        double bestOff = 1e9;
+        double bestOn = 1e9;
+        double profiledSeconds = 0.0;
+        for (int round = 0; round < rounds; ++round) {
+            bestOff = std::min(bestOff, renderAll());
+            profiler.start();
+            double seconds = renderAll();
+            profiler.stop();
+            bestOn = std::min(bestOn, seconds);
+            profiledSeconds += seconds;
+        }
+
+        SamplingProfilerStats stats = profiler.stats();
+        std::map<std::string, std::uint64_t> stages = profiler.stageSamples();
+        std::printf("%s: %zu frames on %u threads, %.1f CPU ms unprofiled, %.1f CPU ms at %d Hz, overhead %.2f%% (%.3f%% in the handler)\n",
+            clockNames[c], frames, pool.threadCount(), bestOff * 1e3, bestOn * 1e3, options.frequencyHz, (bestOn / bestOff - 1.0) * 100.0,
+            stats.handlerNanos / (profiledSeconds * 1e9) * 100.0);
+        std::printf("  %llu samples (%llu dropped, %llu skipped as idle, %.0f Hz per CPU second rendering) from %zu threads on %s, %.2f us in the handler each\n",
+            (unsigned long long)stats.samples, (unsigned long long)stats.dropped, (unsigned long long)stats.skipped, stages["shade"] / profiledSeconds, stats.threads,
+            stats.perThreadTimers ? "per-thread timers" : "ITIMER_PROF", stats.handlerMicrosPerSample());
+        std::printf("  by stage:");
+        for (const auto& stage : stages)
+            std::printf(" %s %.1f%%", stage.first.c_str(), stats.samples ? stage.second * 100.0 / stats.samples : 0.0);
+        std::printf("\n");
+        if (clocks[c] != SamplingClock::ThreadCpu)
+            continue;
+
+        // The heaviest stack, with its frames on separate lines
+        std::string folded = profiler.foldedStacks();
+        std::string heaviest = folded.substr(0, folded.find('\n'));
+        std::printf("heaviest of %zu distinct stacks:\n", stats.uniqueStacks);
+        for (std::size_t begin = 0, end; begin < heaviest.size(); begin = end + 1) {
+            end = std::min(heaviest.find(';', begin), heaviest.size());
+            std::printf("  %s\n", heaviest.substr(begin, end - begin).c_str());
+        }
+        if (foldedPath) {
+            profiler.writeFoldedStacks(foldedPath);
+            std::printf("folded stacks written to %s\n", foldedPath);
+        }
+    }
+    gBenchSink = checksum;
+    return 0;
+}
+#endif
+
+struct BenchMode
+{
+    const char* name;
+    const char* description;
+    int (*run)(int argc, char** argv);
+};
+
+const BenchMode gBenchModes[] = {
+    { "deadline", "per-source deadline-miss rates under overload, FIFO vs EDF", benchDeadline },
+    { "startup", "time to first frame, cold and with pre-warmed buffers", benchStartup },
+    { "arena", "per-band scratch from the heap versus the frame arena", benchArena },
+    { "latency", "input-to-photon latency histograms by swap chain depth", benchLatency },
+    { "commands", "lock-free UI command queue throughput, coalescing and wakeups", benchCommands },
+    { "fixedpoint", "integer shading speed and error against the double path", benchFixedPoint },
+    { "adaptive", "adaptive coarse shading speedup and PSNR by error budget", benchAdaptive },
+    { "temporal", "checkerboard and interlaced rendering cost, PSNR and full-frame share", benchTemporal },
+    { "metrics", "metrics exporter scrape latency over its Unix socket under load", benchMetrics },
+    { "framelog", "binary frame-event log cost per event and per frame", benchFrameLog },
+    { "graph", "post-processing stages as a tile-granular task graph versus stage barriers", benchGraph },
+    { "offline", "batch rendering throughput with many frames in flight and in-order delivery", benchOffline },
+#ifdef __linux__
+    { "farm", "frame-range rendering across worker processes, with a slow and a crashing worker", benchFarm },
+#endif
+#ifdef ASYNC_FRAME_SOURCE
+    { "async", "many I/O-bound coroutine sources on a small pool (C++20 builds)", benchAsync },
+#endif
+    { "numa", "NUMA-aware band placement and pinning against an unaware pool", benchNuma },
+    { "roofline", "bandwidth and compute ceilings with every pipeline kernel on a roofline", benchRoofline },
+    { "srgb", "sRGB conversion and linear-light compositing and downscaling cost per pixel", benchSrgb },
+    { "hdr", "half-float HDR shading and tone mapping against the 8-bit path, cost and bytes", benchHdr },
+    { "views", "kernels on tiles, padded strides, dirty rects and foreign canvases through image views", benchViews },
+#ifdef __linux__
+    { "profile", "in-process sampling profiler overhead at 1 kHz, samples by stage and folded stacks", benchProfile },
+#endif
+    { "energy", "RAPL joules per frame and per megapixel by shading kernel and thread count, with time", benchEnergy },
+    { "canvas", "virtual canvas frame cost by canvas size, pan prefetch and zoom through the tile levels", benchCanvas },
+    { "pacer", "60 Hz tick jitter, sleep_until versus the timerfd event loop", benchPacer },
+#ifdef __linux__
+    { "wakeups", "eventfd wakeup rate and loop CPU cost on the epoll event loop", benchWakeups },
+#endif
+};
+
+int main(int argc, char** argv)
+{
+    if (argc >= 2) {
+        for (const BenchMode& mode : gBenchModes) {
+            if (std::strcmp(argv[1], mode.name) != 0)
+                continue;
+#ifdef __linux__
+            const char* profilePath = std::getenv("BENCH_PROFILE");
+            if (profilePath && *profilePath) {
+                SamplingProfiler profiler;
+                profiler.start();
+                int status = mode.run(argc, argv);
+                profiler.stop();
+                profiler.writeFoldedStacks(profilePath);
+                std::fprintf(stderr, "profile: %llu samples written to %s\n", (unsigned long long)profiler.stats().samples, profilePath);
+                return status;
+            }
+#endif
+            return mode.run(argc, argv);
+        }
+    }
+
+    std::fprintf(stderr, "usage: %s <mode> [options]\n", argv[0]);
+    for (const BenchMode& mode : gBenchModes)
+        std::fprintf(stderr, "  %-12s %s\n", mode.name, mode.description);
+    return 1;
+}
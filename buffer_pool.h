@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "memory_governor.h"
+#include "numa_topology.h"
+
+// Recycles frame-sized pixel buffers so steady-state frames do not allocate.
+// Every buffer the pool owns, idle or handed out, is charged to the memory
+// governor as a pool; under pressure the governor frees idle buffers.
+//
+// With first touch on, new buffers hand their pages back to the kernel, so the
+// workers filling each band range place those pages on their own NUMA node.
+// A pool serves one renderer, whose bands always map to the same nodes, so
+// recycled buffers keep their placement and pages never move between nodes.
+class FrameBufferPool
+{
+public:
+    using Buffer = std::vector<std::uint32_t>;
+
+    FrameBufferPool(std::size_t pixelCount, const std::string& ownerName, std::size_t maxIdle = 3)
+        : mPixelCount(pixelCount)
+        , mMaxIdle(maxIdle)
+    {
+        mOwner = memoryGovernor().registerOwner(ownerName, MemoryOwnerKind::Pool,
+            [this](std::size_t bytes) { return shrink(bytes); });
+    }
+
+    ~FrameBufferPool()
+    {
+        memoryGovernor().unregisterOwner(mOwner);
+    }
+
+    FrameBufferPool(const FrameBufferPool&) = delete;
+    FrameBufferPool& operator=(const FrameBufferPool&) = delete;
+
+    std::size_t bufferBytes() const { return mPixelCount * sizeof(std::uint32_t); }
+
+    // Leave the first write of new buffers to the threads that fill them
+    void setFirstTouch(bool firstTouch)
+    {
+        mFirstTouch.store(firstTouch, std::memory_order_relaxed);
+    }
+
+    // Allocate and touch buffers up front so the first frames find them ready;
+    // with first touch on, only the allocation is done ahead. Spares are
+    // speculative: they only take memory the budget has free, without
+    // squeezing caches, and prewarming stops at the first refusal. Buffers a
+    // frame needs come from acquire(). No governor call is made under the
+    // pool lock.
+    void prewarm(std::size_t count)
+    {
+        count = std::min(count, mMaxIdle);
+        for (std::size_t added = 0; added < count; ++added) {
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                if (mIdle.size() >= count)
+                    return;
+            }
+            if (!memoryGovernor().tryAcquire(mOwner, bufferBytes(), false))
+                return;
+            Buffer buffer = newBuffer();
+
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (mIdle.size() >= count) {
+                memoryGovernor().release(mOwner, bufferBytes());
+                return;
+            }
+            mIdle.push_back(std::move(buffer));
+            mIdleCount.store(mIdle.size(), std::memory_order_relaxed);
+        }
+    }
+
+    Buffer acquire()
+    {
+        mInUse.fetch_add(1, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (!mIdle.empty()) {
+                Buffer buffer = std::move(mIdle.back());
+                mIdle.pop_back();
+                mIdleCount.store(mIdle.size(), std::memory_order_relaxed);
+                mHits.fetch_add(1, std::memory_order_relaxed);
+                return buffer;
+            }
+        }
+
+        mMisses.fetch_add(1, std::memory_order_relaxed);
+        memoryGovernor().acquire(mOwner, bufferBytes());
+        return newBuffer();
+    }
+
+    void recycle(Buffer&& buffer)
+    {
+        if (buffer.size() != mPixelCount)
+            return;
+        mInUse.fetch_sub(1, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mIdle.size() < mMaxIdle) {
+            mIdle.push_back(std::move(buffer));
+            mIdleCount.store(mIdle.size(), std::memory_order_relaxed);
+            return;
+        }
+        Buffer().swap(buffer);
+        memoryGovernor().release(mOwner, bufferBytes());
+    }
+
+    // Occupancy and reuse, readable without the pool lock
+    std::size_t idleCount() const { return mIdleCount.load(std::memory_order_relaxed); }
+    std::size_t inUseCount() const { return mInUse.load(std::memory_order_relaxed); }
+    std::uint64_t hits() const { return mHits.load(std::memory_order_relaxed); }
+    std::uint64_t misses() const { return mMisses.load(std::memory_order_relaxed); }
+
+private:
+    Buffer newBuffer() const
+    {
+        Buffer buffer(mPixelCount);
+        if (mFirstTouch.load(std::memory_order_relaxed))
+            releaseForFirstTouch(buffer.data(), bufferBytes());
+        return buffer;
+    }
+
+    // Governor reclaim callback: free idle buffers, never ones in use
+    std::size_t shrink(std::size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        std::size_t freed = 0;
+        while (freed < bytes && !mIdle.empty()) {
+            mIdle.pop_back();
+            freed += bufferBytes();
+        }
+        mIdleCount.store(mIdle.size(), std::memory_order_relaxed);
+        return freed;
+    }
+
+    std::size_t mPixelCount;
+    std::size_t mMaxIdle;
+    MemoryGovernor::OwnerId mOwner = -1;
+    mutable std::mutex mMutex;
+    std::vector<Buffer> mIdle;
+    std::atomic<bool> mFirstTouch{ false };
+    std::atomic<std::size_t> mIdleCount{ 0 };
+    std::atomic<std::size_t> mInUse{ 0 };
+    std::atomic<std::uint64_t> mHits{ 0 };
+    std::atomic<std::uint64_t> mMisses{ 0 };
+};
@@ -0,0 +1,332 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define COLOR_SPACE_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define COLOR_SPACE_NEON 1
+#endif
+
+#include "frame_arena.h"
+#include "image_view.h"
+
+// Space that compositing and scaling stages blend in. Shading writes sRGB
+// values, so blending them directly darkens mixes of bright and dark pixels;
+// Linear decodes to linear light first and encodes the result back.
+enum class BlendSpace
+{
+    Gamma,   // Blend the stored sRGB values, cheapest
+    Linear,  // Decode to linear light, blend, encode
+};
+
+// Wide rows hold four 16-bit lanes per pixel in the byte order of an ARGB
+// word in memory (B, G, R, A). Alpha is always linear, scaled by 257.
+constexpr int gWideLanes = 4;
+
+// Encoding looks up the top gSrgbEncodeBits of a linear lane
+constexpr int gSrgbEncodeBits = 12;
+
+// Exact transfer functions on [0, 1]
+inline double srgbToLinear(double value)
+{
+    return value <= 0.04045 ? value / 12.92 : std::pow((value + 0.055) / 1.055, 2.4);
+}
+
+inline double linearToSrgb(double value)
+{
+    return value <= 0.0031308 ? value * 12.92 : 1.055 * std::pow(value, 1.0 / 2.4) - 0.055;
+}
+
+struct SrgbTables
+{
+    std::uint16_t decode[256];
+    std::uint8_t encode[1 << gSrgbEncodeBits];
+};
+
+// Each encode entry holds the sRGB value of the middle of its bucket; the
+// buckets that decoded values land in are then pinned to those values, so
+// decoding and encoding an 8-bit value gives it back exactly
+inline const SrgbTables& srgbTables()
+{
+    static const SrgbTables tables = [] {
+        SrgbTables built;
+        const int shift = 16 - gSrgbEncodeBits;
+        for (int i = 0; i < (1 << gSrgbEncodeBits); ++i) {
+            double linear = ((i << shift) + (1 << (shift - 1))) / 65535.0;
+            built.encode[i] = static_cast<std::uint8_t>(std::min(255.0, std::floor(linearToSrgb(linear) * 255.0 + 0.5)));
+        }
+        for (int value = 0; value < 256; ++value) {
+            built.decode[value] = static_cast<std::uint16_t>(std::floor(srgbToLinear(value / 255.0) * 65535.0 + 0.5));
+            built.encode[built.decode[value] >> shift] = static_cast<std::uint8_t>(value);
+        }
+        return built;
+    }();
+    return tables;
+}
+
+// 8-bit to wide and back without changing space: v * 257, and division by
+// 257 rounded to nearest, which saturating keeps exact at the top
+inline std::uint16_t widenChannel(std::uint32_t value) { return static_cast<std::uint16_t>(value * 257); }
+
+inline std::uint8_t narrowChannel(std::uint32_t lane)
+{
+    std::uint32_t rounded = std::min<std::uint32_t>(lane + 128, 0xFFFF);
+    return static_cast<std::uint8_t>((rounded - (rounded >> 8)) >> 8);
+}
+
+inline void widenRow(BlendSpace space, const std::uint32_t* argb, std::uint16_t* wide, int width)
+{
+    int x = 0;
+    if (space == BlendSpace::Linear) {
+        // Table lookups, so scalar: SSE2 and NEON have no gather
+        const std::uint16_t* decode = srgbTables().decode;
+        for (; x < width; ++x) {
+            std::uint32_t pixel = argb[x];
+            std::uint16_t* out = wide + static_cast<std::size_t>(x) * gWideLanes;
+            out[0] = decode[pixel & 0xFF];
+            out[1] = decode[(pixel >> 8) & 0xFF];
+            out[2] = decode[(pixel >> 16) & 0xFF];
+            out[3] = widenChannel(pixel >> 24);
+        }
+        return;
+    }
+#if defined(COLOR_SPACE_SSE2)
+    for (; x + 4 <= width; x += 4) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(argb + x));
+        __m128i* out = reinterpret_cast<__m128i*>(wide + static_cast<std::size_t>(x) * gWideLanes);
+        _mm_storeu_si128(out + 0, _mm_unpacklo_epi8(bytes, bytes));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi8(bytes, bytes));
+    }
+#elif defined(COLOR_SPACE_NEON)
+    for (; x + 4 <= width; x += 4) {
+        uint8x16_t bytes = vld1q_u8(reinterpret_cast<const std::uint8_t*>(argb + x));
+        std::uint16_t* out = wide + static_cast<std::size_t>(x) * gWideLanes;
+        vst1q_u16(out, vmulq_n_u16(vmovl_u8(vget_low_u8(bytes)), 257));
+        vst1q_u16(out + 8, vmulq_n_u16(vmovl_u8(vget_high_u8(bytes)), 257));
+    }
+#endif
+    for (; x < width; ++x) {
+        std::uint32_t pixel = argb[x];
+        std::uint16_t* out = wide + static_cast<std::size_t>(x) * gWideLanes;
+        for (int lane = 0; lane < gWideLanes; ++lane)
+            out[lane] = widenChannel((pixel >> (lane * 8)) & 0xFF);
+    }
+}
+
+inline void narrowRow(BlendSpace space, const std::uint16_t* wide, std::uint32_t* argb, int width)
+{
+    int x = 0;
+    if (space == BlendSpace::Linear) {
+        const std::uint8_t* encode = srgbTables().encode;
+        const int shift = 16 - gSrgbEncodeBits;
+        for (; x < width; ++x) {
+            const std::uint16_t* in = wide + static_cast<std::size_t>(x) * gWideLanes;
+            argb[x] = (static_cast<std::uint32_t>(narrowChannel(in[3])) << 24) | (static_cast<std::uint32_t>(encode[in[2] >> shift]) << 16)
+                | (static_cast<std::uint32_t>(encode[in[1] >> shift]) << 8) | encode[in[0] >> shift];
+        }
+        return;
+    }
+#if defined(COLOR_SPACE_SSE2)
+    const __m128i half = _mm_set1_epi16(128);
+    for (; x + 4 <= width; x += 4) {
+        const __m128i* in = reinterpret_cast<const __m128i*>(wide + static_cast<std::size_t>(x) * gWideLanes);
+        __m128i low = _mm_adds_epu16(_mm_loadu_si128(in + 0), half);
+        __m128i high = _mm_adds_epu16(_mm_loadu_si128(in + 1), half);
+        low = _mm_srli_epi16(_mm_sub_epi16(low, _mm_srli_epi16(low, 8)), 8);
+        high = _mm_srli_epi16(_mm_sub_epi16(high, _mm_srli_epi16(high, 8)), 8);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(argb + x), _mm_packus_epi16(low, high));
+    }
+#elif defined(COLOR_SPACE_NEON)
+    for (; x + 4 <= width; x += 4) {
+        const std::uint16_t* in = wide + static_cast<std::size_t>(x) * gWideLanes;
+        uint16x8_t low = vqaddq_u16(vld1q_u16(in), vdupq_n_u16(128));
+        uint16x8_t high = vqaddq_u16(vld1q_u16(in + 8), vdupq_n_u16(128));
+        low = vshrq_n_u16(vsubq_u16(low, vshrq_n_u16(low, 8)), 8);
+        high = vshrq_n_u16(vsubq_u16(high, vshrq_n_u16(high, 8)), 8);
+        vst1q_u8(reinterpret_cast<std::uint8_t*>(argb + x), vcombine_u8(vmovn_u16(low), vmovn_u16(high)));
+    }
+#endif
+    for (; x < width; ++x) {
+        const std::uint16_t* in = wide + static_cast<std::size_t>(x) * gWideLanes;
+        std::uint32_t pixel = 0;
+        for (int lane = 0; lane < gWideLanes; ++lane)
+            pixel |= static_cast<std::uint32_t>(narrowChannel(in[lane])) << (lane * 8);
+        argb[x] = pixel;
+    }
+}
+
+// (source * alpha + destination * (65535 - alpha)) / 65535, rounded to nearest
+inline std::uint16_t compositeLane(std::uint32_t source, std::uint32_t destination, std::uint32_t alpha)
+{
+    std::uint32_t sum = source * alpha + destination * (0xFFFF - alpha) + 0x8000;
+    return static_cast<std::uint16_t>((sum + (sum >> 16)) >> 16);
+}
+
+// Source over destination with the source's straight alpha, in place. The
+// alpha lane composites a source value of one, giving a + d * (1 - a).
+inline void compositeOverWide(std::uint16_t* destination, const std::uint16_t* source, int width)
+{
+    int x = 0;
+#if defined(COLOR_SPACE_SSE2)
+    const __m128i alphaLanes = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+    const __m128i bias = _mm_set1_epi32(0x8000);
+    const __m128i signFlip = _mm_set1_epi16(static_cast<short>(0x8000));
+    for (; x + 2 <= width; x += 2) {
+        __m128i* out = reinterpret_cast<__m128i*>(destination + static_cast<std::size_t>(x) * gWideLanes);
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + static_cast<std::size_t>(x) * gWideLanes));
+        __m128i d = _mm_loadu_si128(out);
+        __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xFF), 0xFF);
+        __m128i inverse = _mm_xor_si128(alpha, _mm_set1_epi16(-1));
+        s = _mm_or_si128(s, alphaLanes);
+
+        // 32-bit products from the low and high halves of 16-bit multiplies
+        __m128i sLow = _mm_mullo_epi16(s, alpha);
+        __m128i sHigh = _mm_mulhi_epu16(s, alpha);
+        __m128i dLow = _mm_mullo_epi16(d, inverse);
+        __m128i dHigh = _mm_mulhi_epu16(d, inverse);
+        __m128i sum0 = _mm_add_epi32(_mm_add_epi32(_mm_unpacklo_epi16(sLow, sHigh), _mm_unpacklo_epi16(dLow, dHigh)), bias);
+        __m128i sum1 = _mm_add_epi32(_mm_add_epi32(_mm_unpackhi_epi16(sLow, sHigh), _mm_unpackhi_epi16(dLow, dHigh)), bias);
+        sum0 = _mm_srli_epi32(_mm_add_epi32(sum0, _mm_srli_epi32(sum0, 16)), 16);
+        sum1 = _mm_srli_epi32(_mm_add_epi32(sum1, _mm_srli_epi32(sum1, 16)), 16);
+
+        // Unsigned 32-to-16 pack without SSE4.1: shift into signed range, pack, shift back
+        __m128i packed = _mm_packs_epi32(_mm_sub_epi32(sum0, bias), _mm_sub_epi32(sum1, bias));
+        _mm_storeu_si128(out, _mm_add_epi16(packed, signFlip));
+    }
+#elif defined(COLOR_SPACE_NEON)
+    static const std::uint16_t alphaMask[8] = { 0, 0, 0, 0xFFFF, 0, 0, 0, 0xFFFF };
+    const uint16x8_t alphaLanes = vld1q_u16(alphaMask);
+    for (; x + 2 <= width; x += 2) {
+        std::uint16_t* out = destination + static_cast<std::size_t>(x) * gWideLanes;
+        uint16x8_t s = vld1q_u16(source + static_cast<std::size_t>(x) * gWideLanes);
+        uint16x8_t d = vld1q_u16(out);
+        uint16x8_t alpha = vcombine_u16(vdup_lane_u16(vget_low_u16(s), 3), vdup_lane_u16(vget_high_u16(s), 3));
+        uint16x8_t inverse = vmvnq_u16(alpha);
+        s = vorrq_u16(s, alphaLanes);
+        uint32x4_t sum0 = vmlal_u16(vmull_u16(vget_low_u16(s), vget_low_u16(alpha)), vget_low_u16(d), vget_low_u16(inverse));
+        uint32x4_t sum1 = vmlal_u16(vmull_u16(vget_high_u16(s), vget_high_u16(alpha)), vget_high_u16(d), vget_high_u16(inverse));
+        sum0 = vaddq_u32(sum0, vdupq_n_u32(0x8000));
+        sum1 = vaddq_u32(sum1, vdupq_n_u32(0x8000));
+        sum0 = vsraq_n_u32(sum0, sum0, 16);
+        sum1 = vsraq_n_u32(sum1, sum1, 16);
+        vst1q_u16(out, vcombine_u16(vshrn_n_u32(sum0, 16), vshrn_n_u32(sum1, 16)));
+    }
+#endif
+    for (; x < width; ++x) {
+        std::uint16_t* out = destination + static_cast<std::size_t>(x) * gWideLanes;
+        const std::uint16_t* in = source + static_cast<std::size_t>(x) * gWideLanes;
+        std::uint32_t alpha = in[3];
+        for (int lane = 0; lane < 3; ++lane)
+            out[lane] = compositeLane(in[lane], out[lane], alpha);
+        out[3] = compositeLane(0xFFFF, out[3], alpha);
+    }
+}
+
+inline std::uint16_t averageLanes(std::uint32_t a, std::uint32_t b) { return static_cast<std::uint16_t>((a + b + 1) >> 1); }
+
+// 2x2 box filter of two wide source rows into one row of outputWidth pixels:
+// the rounded average of the two rounded vertical averages, as the SIMD
+// rounding averages compute it
+inline void downscaleHalfWide(const std::uint16_t* top, const std::uint16_t* bottom, std::uint16_t* output, int outputWidth)
+{
+    int x = 0;
+#if defined(COLOR_SPACE_SSE2)
+    for (; x + 2 <= outputWidth; x += 2) {
+        const std::size_t in = static_cast<std::size_t>(x) * 2 * gWideLanes;
+        __m128i left = _mm_avg_epu16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(top + in)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom + in)));
+        __m128i right = _mm_avg_epu16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(top + in + 8)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom + in + 8)));
+        __m128i averaged = _mm_avg_epu16(_mm_unpacklo_epi64(left, right), _mm_unpackhi_epi64(left, right));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + static_cast<std::size_t>(x) * gWideLanes), averaged);
+    }
+#elif defined(COLOR_SPACE_NEON)
+    for (; x + 2 <= outputWidth; x += 2) {
+        const std::size_t in = static_cast<std::size_t>(x) * 2 * gWideLanes;
+        uint16x8_t left = vrhaddq_u16(vld1q_u16(top + in), vld1q_u16(bottom + in));
+        uint16x8_t right = vrhaddq_u16(vld1q_u16(top + in + 8), vld1q_u16(bottom + in + 8));
+        uint16x8_t averaged = vrhaddq_u16(vcombine_u16(vget_low_u16(left), vget_low_u16(right)),
+            vcombine_u16(vget_high_u16(left), vget_high_u16(right)));
+        vst1q_u16(output + static_cast<std::size_t>(x) * gWideLanes, averaged);
+    }
+#endif
+    for (; x < outputWidth; ++x) {
+        const std::size_t in = static_cast<std::size_t>(x) * 2 * gWideLanes;
+        for (int lane = 0; lane < gWideLanes; ++lane) {
+            std::uint16_t left = averageLanes(top[in + lane], bottom[in + lane]);
+            std::uint16_t right = averageLanes(top[in + gWideLanes + lane], bottom[in + gWideLanes + lane]);
+            output[static_cast<std::size_t>(x) * gWideLanes + lane] = averageLanes(left, right);
+        }
+    }
+}
+
+// Composite an overlay over the frame in the given space; both views are
+// cropped to their common size
+inline void compositeOver(BlendSpace space, ArgbView pixels, ConstArgbView overlay)
+{
+    int width = std::min(pixels.width(), overlay.width());
+    int height = std::min(pixels.height(), overlay.height());
+    if (width <= 0 || height <= 0)
+        return;
+    FrameArenaScope scratch(threadFrameArena());
+    std::uint16_t* wideFrame = threadFrameArena().allocateArray<std::uint16_t>(static_cast<std::size_t>(width) * gWideLanes);
+    std::uint16_t* wideOverlay = threadFrameArena().allocateArray<std::uint16_t>(static_cast<std::size_t>(width) * gWideLanes);
+    for (int y = 0; y < height; ++y) {
+        widenRow(space, pixels.row(y), wideFrame, width);
+        widenRow(space, overlay.row(y), wideOverlay, width);
+        compositeOverWide(wideFrame, wideOverlay, width);
+        narrowRow(space, wideFrame, pixels.row(y), width);
+    }
+}
+
+// Composite rows of a same-sized overlay over the frame in the given space
+inline void compositeOverRows(
+    BlendSpace space,
+    std::uint32_t* pixels,
+    const std::uint32_t* overlay,
+    int width,
+    int firstRow,
+    int lastRow)
+{
+    compositeOver(space, ArgbView(pixels, width, lastRow).rows(firstRow, lastRow), ConstArgbView(overlay, width, lastRow).rows(firstRow, lastRow));
+}
+
+// Half-resolution copy of the source in the given space, as much of it as
+// fits the output; an odd last source row or column is dropped
+inline void downscaleHalf(BlendSpace space, ConstArgbView source, ArgbView output)
+{
+    int outputWidth = std::min(output.width(), source.width() / 2);
+    int outputHeight = std::min(output.height(), source.height() / 2);
+    if (outputWidth <= 0 || outputHeight <= 0)
+        return;
+    int width = outputWidth * 2;
+    FrameArenaScope scratch(threadFrameArena());
+    std::uint16_t* top = threadFrameArena().allocateArray<std::uint16_t>(static_cast<std::size_t>(width) * gWideLanes);
+    std::uint16_t* bottom = threadFrameArena().allocateArray<std::uint16_t>(static_cast<std::size_t>(width) * gWideLanes);
+    std::uint16_t* wideOutput = threadFrameArena().allocateArray<std::uint16_t>(static_cast<std::size_t>(outputWidth) * gWideLanes);
+    for (int y = 0; y < outputHeight; ++y) {
+        widenRow(space, source.row(2 * y), top, width);
+        widenRow(space, source.row(2 * y + 1), bottom, width);
+        downscaleHalfWide(top, bottom, wideOutput, outputWidth);
+        narrowRow(space, wideOutput, output.row(y), outputWidth);
+    }
+}
+
+// Output rows [firstRow, lastRow) of the half-resolution copy of a packed width-wide frame
+inline void downscaleHalfRows(
+    BlendSpace space,
+    const std::uint32_t* pixels,
+    int width,
+    std::uint32_t* output,
+    int firstRow,
+    int lastRow)
+{
+    downscaleHalf(space, ConstArgbView(pixels, width, 2 * lastRow).rows(2 * firstRow, 2 * lastRow),
+        ArgbView(output, width / 2, lastRow).rows(firstRow, lastRow));
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+struct CommandQueueStats
+{
+    std::uint64_t posted = 0;
+    std::uint64_t coalesced = 0;   // Posted while an identical command was still queued
+    std::uint64_t executed = 0;
+    std::uint64_t wakeups = 0;
+    std::uint64_t batches = 0;
+};
+
+// Lock-free multi-producer, single-consumer queue of commands for the UI
+// thread. Commands are registered up front, and each one owns a single
+// preallocated node, so posting never allocates. A command posted again
+// while it is still queued is coalesced: only its latest argument is kept.
+// Producers link nodes into an intrusive Vyukov MPSC list. Only the post that
+// finds the queue idle calls the wake function, so the UI thread is woken
+// once per batch and runs drain() on its next tick.
+class CommandQueue
+{
+public:
+    using CommandId = int;
+    using Handler = std::function<void(std::uint64_t argument)>;
+    using WakeFunction = std::function<void()>;
+
+    explicit CommandQueue(std::size_t capacity = 16)
+        : mCommands(capacity)
+        , mHead(&mStub)
+        , mTail(&mStub)
+    {
+    }
+
+    CommandQueue(const CommandQueue&) = delete;
+    CommandQueue& operator=(const CommandQueue&) = delete;
+
+    // Registration and the wake function must be set up before producers start
+    CommandId registerCommand(Handler handler)
+    {
+        assert(mRegistered < mCommands.size());
+        mCommands[mRegistered].node.index = mRegistered;
+        mCommands[mRegistered].handler = handler;
+        return static_cast<CommandId>(mRegistered++);
+    }
+
+    void setWakeFunction(WakeFunction wake) { mWake = wake; }
+
+    // Any thread; lock-free and allocation-free
+    void post(CommandId commandId, std::uint64_t argument = 0)
+    {
+        Command& command = mCommands[commandId];
+        command.argument.store(argument, std::memory_order_relaxed);
+        mPosted.fetch_add(1, std::memory_order_relaxed);
+
+        if (command.queued.exchange(true, std::memory_order_acq_rel)) {
+            mCoalesced.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        push(&command.node);
+
+        if (!mWakePending.exchange(true, std::memory_order_acq_rel)) {
+            mWakeups.fetch_add(1, std::memory_order_relaxed);
+            if (mWake)
+                mWake();
+        }
+    }
+
+    // Consumer thread only; runs every queued command once
+    std::size_t drain()
+    {
+        // Clear first so a post racing with this drain wakes us again
+        mWakePending.store(false, std::memory_order_release);
+
+        std::size_t executed = 0;
+        while (Node* node = pop()) {
+            Command& command = mCommands[node->index];
+            command.queued.store(false, std::memory_order_release);
+            std::uint64_t argument = command.argument.load(std::memory_order_relaxed);
+            command.handler(argument);
+            ++executed;
+        }
+
+        if (executed) {
+            mExecuted.fetch_add(executed, std::memory_order_relaxed);
+            mBatches.fetch_add(1, std::memory_order_relaxed);
+        }
+        return executed;
+    }
+
+    // Any thread; counters are read without a lock
+    CommandQueueStats stats() const
+    {
+        CommandQueueStats stats;
+        stats.posted = mPosted.load(std::memory_order_relaxed);
+        stats.coalesced = mCoalesced.load(std::memory_order_relaxed);
+        stats.wakeups = mWakeups.load(std::memory_order_relaxed);
+        stats.executed = mExecuted.load(std::memory_order_relaxed);
+        stats.batches = mBatches.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    struct Node
+    {
+        std::atomic<Node*> next{ nullptr };
+        std::size_t index = 0;
+    };
+
+    struct Command
+    {
+        Node node;
+        std::atomic<std::uint64_t> argument{ 0 };
+        std::atomic<bool> queued{ false };
+        Handler handler;
+    };
+
+    void push(Node* node)
+    {
+        node->next.store(nullptr, std::memory_order_relaxed);
+        Node* previous = mHead.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+    }
+
+    // Returns nullptr when empty or when a producer is between its two push steps;
+    // that producer's node is then picked up by the next drain
+    Node* pop()
+    {
+        Node* tail = mTail;
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (tail == &mStub) {
+            if (!next)
+                return nullptr;
+            mTail = next;
+            tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (next) {
+            mTail = next;
+            return tail;
+        }
+        if (tail != mHead.load(std::memory_order_acquire))
+            return nullptr;
+
+        push(&mStub);
+        next = tail->next.load(std::memory_order_acquire);
+        if (next) {
+            mTail = next;
+            return tail;
+        }
+        return nullptr;
+    }
+
+    std::vector<Command> mCommands;
+    std::size_t mRegistered = 0;
+    WakeFunction mWake;
+
+    Node mStub;
+    std::atomic<Node*> mHead;
+    Node* mTail;
+    std::atomic<bool> mWakePending{ false };
+
+    std::atomic<std::uint64_t> mPosted{ 0 };
+    std::atomic<std::uint64_t> mCoalesced{ 0 };
+    std::atomic<std::uint64_t> mWakeups{ 0 };
+    std::atomic<std::uint64_t> mExecuted{ 0 };
+    std::atomic<std::uint64_t> mBatches{ 0 };
+};
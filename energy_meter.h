@@ -0,0 +1,319 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// RAPL registers for the MSR fallback, read through /dev/cpu/N/msr
+constexpr std::uint32_t gRaplPowerUnitMsr = 0x606;
+constexpr std::uint32_t gRaplPackageEnergyMsr = 0x611;
+
+struct EnergyReading
+{
+    std::chrono::steady_clock::time_point time;
+    std::vector<std::uint64_t> counters;  // Raw, one per domain
+};
+
+// Energy over an interval of frames
+struct EnergyReport
+{
+    double joules = 0.0;
+    double seconds = 0.0;
+    std::uint64_t frames = 0;
+    double megapixels = 0.0;  // Shaded over the interval
+
+    double watts() const { return seconds > 0.0 ? joules / seconds : 0.0; }
+    double joulesPerFrame() const { return frames ? joules / frames : 0.0; }
+    double joulesPerMegapixel() const { return megapixels > 0.0 ? joules / megapixels : 0.0; }
+};
+
+// Reads the RAPL energy counters of the CPU packages and DRAM. Zones come
+// from the powercap sysfs tree, or from the package energy MSR of one CPU
+// per package when powercap is missing. Reading needs root on most kernels
+// since 5.10. When neither source can be read, or off Linux, the meter is
+// unavailable: readings are empty, every interval measures zero joules, and
+// source() says why, so callers report time alone.
+//
+// RAPL counts a whole package, including other processes and idle power,
+// and updates about once a millisecond, so measure intervals of many frames
+// and compare against an idle baseline. The counters wrap; an interval
+// must be read at least once per wrap (a minute or more at full load).
+class EnergyMeter
+{
+public:
+    EnergyMeter()
+    {
+#ifdef __linux__
+        if (!openPowercap())
+            openMsr();
+#else
+        mSource = "RAPL is only read on Linux";
+#endif
+    }
+
+    ~EnergyMeter()
+    {
+#ifdef __linux__
+        for (const Domain& domain : mDomains)
+            close(domain.fd);
+#endif
+    }
+
+    EnergyMeter(const EnergyMeter&) = delete;
+    EnergyMeter& operator=(const EnergyMeter&) = delete;
+
+    bool available() const { return !mDomains.empty(); }
+
+    // "powercap" or "msr", or why neither could be read
+    const std::string& source() const { return mSource; }
+
+    std::size_t domainCount() const { return mDomains.size(); }
+    const std::string& domainName(std::size_t domain) const { return mDomains[domain].name; }
+
+    EnergyReading read() const
+    {
+        EnergyReading reading;
+        reading.time = std::chrono::steady_clock::now();
+        reading.counters.reserve(mDomains.size());
+        for (const Domain& domain : mDomains)
+            reading.counters.push_back(readCounter(domain));
+        return reading;
+    }
+
+    // Joules one domain used between two readings, across one counter wrap
+    double domainJoules(std::size_t domain, const EnergyReading& begin, const EnergyReading& end) const
+    {
+        if (domain >= begin.counters.size() || domain >= end.counters.size())
+            return 0.0;
+        const Domain& d = mDomains[domain];
+        std::uint64_t first = begin.counters[domain];
+        std::uint64_t last = end.counters[domain];
+        std::uint64_t delta = last >= first ? last - first : last + (d.range - first) + 1;
+        return delta * d.joulesPerUnit;
+    }
+
+    // Joules of the packages and DRAM together; subzones such as the cores
+    // are part of their package and a platform zone overlaps everything
+    double joules(const EnergyReading& begin, const EnergyReading& end) const
+    {
+        double total = 0.0;
+        for (std::size_t domain = 0; domain < mDomains.size(); ++domain) {
+            if (mDomains[domain].counted)
+                total += domainJoules(domain, begin, end);
+        }
+        return total;
+    }
+
+    EnergyReport report(const EnergyReading& begin, const EnergyReading& end, std::uint64_t frames, std::uint64_t pixelsPerFrame) const
+    {
+        EnergyReport report;
+        report.joules = joules(begin, end);
+        report.seconds = std::chrono::duration<double>(end.time - begin.time).count();
+        report.frames = frames;
+        report.megapixels = static_cast<double>(frames) * pixelsPerFrame / 1e6;
+        return report;
+    }
+
+private:
+    struct Domain
+    {
+        std::string name;
+        int fd = -1;
+        std::uint64_t range = 0;  // Largest raw value before the counter wraps
+        double joulesPerUnit = 0.0;
+        bool counted = false;     // Part of the total
+        bool msr = false;
+    };
+
+#ifdef __linux__
+    static bool readText(const std::string& path, std::string& text)
+    {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return false;
+        char buffer[256];
+        ssize_t count = ::read(fd, buffer, sizeof(buffer) - 1);
+        close(fd);
+        if (count <= 0)
+            return false;
+        buffer[count] = '\0';
+        text = buffer;
+        while (!text.empty() && (text.back() == '\n' || text.back() == ' '))
+            text.pop_back();
+        return true;
+    }
+
+    // Zones named intel-rapl:P (a package or the platform) and intel-rapl:P:S
+    // (a part of one); AMD processors use the same names
+    bool openPowercap()
+    {
+        const std::string root = "/sys/class/powercap/";
+        DIR* directory = opendir(root.c_str());
+        if (!directory) {
+            mSource = "no RAPL counters: /sys/class/powercap is missing";
+            return false;
+        }
+        std::vector<std::string> zones;
+        while (dirent* entry = readdir(directory)) {
+            if (std::strncmp(entry->d_name, "intel-rapl:", 11) == 0)
+                zones.push_back(entry->d_name);
+        }
+        closedir(directory);
+        std::sort(zones.begin(), zones.end());
+        if (zones.empty())
+            mSource = "no RAPL counters: no intel-rapl zones under /sys/class/powercap";
+
+        bool denied = false;
+        for (const std::string& zone : zones) {
+            std::string name;
+            std::string range;
+            if (!readText(root + zone + "/name", name) || !readText(root + zone + "/max_energy_range_uj", range))
+                continue;
+            int fd = open((root + zone + "/energy_uj").c_str(), O_RDONLY | O_CLOEXEC);
+            std::uint64_t probe = 0;
+            if (fd >= 0 && !readPowercap(fd, probe)) {
+                close(fd);
+                fd = -1;
+            }
+            if (fd < 0) {
+                denied = denied || errno == EACCES || errno == EPERM;
+                continue;
+            }
+            Domain domain;
+            domain.name = name;
+            domain.fd = fd;
+            domain.range = std::strtoull(range.c_str(), nullptr, 10);
+            domain.joulesPerUnit = 1e-6;
+            bool subzone = std::count(zone.begin(), zone.end(), ':') > 1;
+            domain.counted = subzone ? name == "dram" : name.compare(0, 7, "package") == 0;
+            mDomains.push_back(domain);
+        }
+        if (!mDomains.empty()) {
+            mSource = "powercap";
+            return true;
+        }
+        if (denied)
+            mSource = "no RAPL counters: energy_uj is readable by root only";
+        else if (mSource.empty())
+            mSource = "no RAPL counters: no readable intel-rapl zone";
+        return false;
+    }
+
+    static bool readPowercap(int fd, std::uint64_t& value)
+    {
+        char buffer[32];
+        ssize_t count = pread(fd, buffer, sizeof(buffer) - 1, 0);
+        if (count <= 0)
+            return false;
+        buffer[count] = '\0';
+        value = std::strtoull(buffer, nullptr, 10);
+        return true;
+    }
+
+    static bool readMsr(int fd, std::uint32_t msr, std::uint64_t& value)
+    {
+        return pread(fd, &value, sizeof(value), msr) == static_cast<ssize_t>(sizeof(value));
+    }
+
+    // One CPU per physical package, read through the msr driver
+    void openMsr()
+    {
+        std::vector<int> packages;
+        for (int cpu = 0;; ++cpu) {
+            std::string package;
+            std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+            if (!readText(base + "/topology/physical_package_id", package)) {
+                if (access(base.c_str(), F_OK) == 0)
+                    continue;
+                break;
+            }
+            int id = std::atoi(package.c_str());
+            if (std::find(packages.begin(), packages.end(), id) != packages.end())
+                continue;
+            packages.push_back(id);
+
+            int fd = open(("/dev/cpu/" + std::to_string(cpu) + "/msr").c_str(), O_RDONLY | O_CLOEXEC);
+            std::uint64_t units = 0;
+            if (fd < 0 || !readMsr(fd, gRaplPowerUnitMsr, units)) {
+                if (fd >= 0)
+                    close(fd);
+                continue;
+            }
+            Domain domain;
+            domain.name = "package-" + std::to_string(id);
+            domain.fd = fd;
+            domain.range = 0xFFFFFFFFull;
+            domain.joulesPerUnit = 1.0 / static_cast<double>(1ull << ((units >> 8) & 0x1F));
+            domain.counted = true;
+            domain.msr = true;
+            mDomains.push_back(domain);
+        }
+        if (!mDomains.empty())
+            mSource = "msr";
+        else
+            mSource += ", and no /dev/cpu/*/msr is readable";
+    }
+
+    static std::uint64_t readCounter(const Domain& domain)
+    {
+        std::uint64_t value = 0;
+        if (domain.msr) {
+            readMsr(domain.fd, gRaplPackageEnergyMsr, value);
+            value &= 0xFFFFFFFFull;
+        } else {
+            readPowercap(domain.fd, value);
+        }
+        return value;
+    }
+#else
+    static std::uint64_t readCounter(const Domain&) { return 0; }
+#endif
+
+    std::vector<Domain> mDomains;
+    std::string mSource;
+};
+
+// Running energy totals per domain for counters that must never go
+// backwards, such as exported metrics; update() folds in the interval since
+// the last call, so it must run at least once per counter wrap
+class EnergyCounter
+{
+public:
+    explicit EnergyCounter(const EnergyMeter& meter)
+        : mMeter(meter)
+        , mLast(meter.read())
+        , mJoules(meter.domainCount(), 0.0)
+    {
+    }
+
+    // Per-domain joules since construction
+    std::vector<double> update()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        EnergyReading now = mMeter.read();
+        for (std::size_t domain = 0; domain < mJoules.size(); ++domain)
+            mJoules[domain] += mMeter.domainJoules(domain, mLast, now);
+        mLast = now;
+        return mJoules;
+    }
+
+    const EnergyMeter& meter() const { return mMeter; }
+
+private:
+    const EnergyMeter& mMeter;
+    std::mutex mMutex;
+    EnergyReading mLast;
+    std::vector<double> mJoules;
+};
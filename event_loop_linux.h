@@ -0,0 +1,268 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+constexpr int gEventLoopMaxReadyEvents = 64;
+
+struct EventLoopStats
+{
+    std::uint64_t iterations = 0;
+    std::uint64_t events = 0;
+    std::uint64_t timerExpirations = 0;
+    std::uint64_t wakeups = 0;
+};
+
+// Event loop for the Linux backend, the counterpart of the NSApplication run
+// loop on macOS. Frame deadlines are timerfds, cross-thread wakeups go through
+// one eventfd, and signals can be taken as events through a signalfd. Sources
+// are registered before run(); each iteration is one epoll_wait into a fixed
+// event array followed by dispatch of every ready source, so the loop itself
+// never allocates once running.
+class EventLoop
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using SourceId = int;
+    using TimerCallback = std::function<void(std::uint64_t expirations)>;
+    using WakeCallback = std::function<void()>;
+    using SignalCallback = std::function<void(int signal)>;
+
+    EventLoop()
+    {
+        mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (mEpollFd < 0)
+            throwSystemError("epoll_create1");
+
+        // The destructor does not run for a constructor that throws
+        try {
+            mWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (mWakeFd < 0)
+                throwSystemError("eventfd");
+            addSource(mWakeFd, SourceType::Wake);
+        } catch (...) {
+            close(mEpollFd);
+            throw;
+        }
+    }
+
+    ~EventLoop()
+    {
+        for (const Source& source : mSources)
+            close(source.fd);
+        close(mEpollFd);
+    }
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    // Timer that fires every period, first after one period
+    SourceId addPeriodicTimer(Clock::duration period, TimerCallback callback)
+    {
+        SourceId id = addTimer(callback);
+        struct itimerspec spec = {};
+        spec.it_interval = toTimespec(period);
+        spec.it_value = spec.it_interval;
+        if (timerfd_settime(mSources[id].fd, 0, &spec, nullptr) < 0)
+            throwSystemError("timerfd_settime");
+        return id;
+    }
+
+    // Timer armed later with setDeadline()
+    SourceId addTimer(TimerCallback callback)
+    {
+        int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (fd < 0)
+            throwSystemError("timerfd_create");
+        SourceId id = addSource(fd, SourceType::Timer);
+        mSources[id].timer = callback;
+        return id;
+    }
+
+    // Arm a one-shot timer for an absolute steady_clock deadline (CLOCK_MONOTONIC on Linux)
+    void setDeadline(SourceId timer, Clock::time_point deadline)
+    {
+        struct itimerspec spec = {};
+        spec.it_value = toTimespec(deadline.time_since_epoch());
+        if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0)
+            spec.it_value.tv_nsec = 1;
+        if (timerfd_settime(mSources[timer].fd, TFD_TIMER_ABSTIME, &spec, nullptr) < 0)
+            throwSystemError("timerfd_settime");
+    }
+
+    // Callback run on the loop thread after wake(); wakeups between two
+    // iterations are merged into one call
+    void setWakeCallback(WakeCallback callback) { mWakeCallback = callback; }
+
+    // Deliver a signal as an event instead of asynchronously; blocks it for the calling thread
+    SourceId addSignal(int signal, SignalCallback callback)
+    {
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigaddset(&mask, signal);
+        if (pthread_sigmask(SIG_BLOCK, &mask, nullptr) != 0)
+            throwSystemError("pthread_sigmask");
+        int fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (fd < 0)
+            throwSystemError("signalfd");
+        SourceId id = addSource(fd, SourceType::Signal);
+        mSources[id].signal = callback;
+        return id;
+    }
+
+    // Any thread
+    void wake()
+    {
+        std::uint64_t one = 1;
+        ssize_t written = write(mWakeFd, &one, sizeof(one));
+        (void)written;
+    }
+
+    // Any thread
+    void stop()
+    {
+        mStopping.store(true, std::memory_order_release);
+        wake();
+    }
+
+    // Returns once stop() is called, including a stop() made before run();
+    // the request is consumed so the loop can be run again
+    void run()
+    {
+        while (!mStopping.exchange(false, std::memory_order_acq_rel))
+            runOnce(-1);
+    }
+
+    // Wait up to timeoutMs (-1 forever) and dispatch every ready source
+    int runOnce(int timeoutMs)
+    {
+        int ready = epoll_wait(mEpollFd, mReady, gEventLoopMaxReadyEvents, timeoutMs);
+        if (ready < 0) {
+            if (errno == EINTR)
+                return 0;
+            throwSystemError("epoll_wait");
+        }
+
+        ++mStats.iterations;
+        mStats.events += static_cast<std::uint64_t>(ready);
+        for (int i = 0; i < ready; ++i)
+            dispatch(mSources[mReady[i].data.u32]);
+        return ready;
+    }
+
+    EventLoopStats stats() const { return mStats; }
+
+private:
+    enum class SourceType
+    {
+        Wake,
+        Timer,
+        Signal,
+    };
+
+    struct Source
+    {
+        int fd;
+        SourceType type;
+        TimerCallback timer;
+        SignalCallback signal;
+    };
+
+    // Takes ownership of fd, closing it if it cannot be added
+    SourceId addSource(int fd, SourceType type)
+    {
+        SourceId id = static_cast<SourceId>(mSources.size());
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.u32 = static_cast<std::uint32_t>(id);
+        if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            int error = errno;
+            close(fd);
+            errno = error;
+            throwSystemError("epoll_ctl");
+        }
+
+        Source source;
+        source.fd = fd;
+        source.type = type;
+        try {
+            mSources.push_back(source);
+        } catch (...) {
+            close(fd);
+            throw;
+        }
+        return id;
+    }
+
+    void dispatch(Source& source)
+    {
+        switch (source.type) {
+            case SourceType::Wake: {
+                std::uint64_t count = 0;
+                if (read(source.fd, &count, sizeof(count)) == sizeof(count)) {
+                    ++mStats.wakeups;
+                    if (mWakeCallback)
+                        mWakeCallback();
+                }
+                break;
+            }
+            case SourceType::Timer: {
+                std::uint64_t expirations = 0;
+                if (read(source.fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+                    mStats.timerExpirations += expirations;
+                    if (source.timer)
+                        source.timer(expirations);
+                }
+                break;
+            }
+            case SourceType::Signal: {
+                struct signalfd_siginfo info;
+                while (read(source.fd, &info, sizeof(info)) == sizeof(info)) {
+                    if (source.signal)
+                        source.signal(static_cast<int>(info.ssi_signo));
+                }
+                break;
+            }
+        }
+    }
+
+    static struct timespec toTimespec(Clock::duration duration)
+    {
+        auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+        struct timespec spec;
+        spec.tv_sec = static_cast<time_t>(nanos / 1000000000);
+        spec.tv_nsec = static_cast<long>(nanos % 1000000000);
+        return spec;
+    }
+
+    static void throwSystemError(const char* call)
+    {
+        throw std::runtime_error(std::string(call) + ": " + std::strerror(errno));
+    }
+
+    int mEpollFd = -1;
+    int mWakeFd = -1;
+    std::vector<Source> mSources;
+    struct epoll_event mReady[gEventLoopMaxReadyEvents];
+    WakeCallback mWakeCallback;
+    std::atomic<bool> mStopping{ false };
+    EventLoopStats mStats;
+};
+
+#endif // __linux__
@@ -0,0 +1,280 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <vector>
+
+// AddressSanitizer hooks, so stale pointers into a reset arena fault under ASan
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define FRAME_ARENA_ASAN 1
+#endif
+#endif
+#if defined(__SANITIZE_ADDRESS__)
+#define FRAME_ARENA_ASAN 1
+#endif
+
+#ifdef FRAME_ARENA_ASAN
+#include <sanitizer/asan_interface.h>
+#define FRAME_ARENA_POISON(address, size) ASAN_POISON_MEMORY_REGION(address, size)
+#define FRAME_ARENA_UNPOISON(address, size) ASAN_UNPOISON_MEMORY_REGION(address, size)
+#else
+#define FRAME_ARENA_POISON(address, size) ((void)(address), (void)(size))
+#define FRAME_ARENA_UNPOISON(address, size) ((void)(address), (void)(size))
+#endif
+
+constexpr std::size_t gFrameArenaAlignment = 64;
+constexpr std::size_t gFrameArenaBlockSize = 256 * 1024;
+
+// Bump allocator for transient per-frame scratch. Memory comes from a list of
+// blocks that is kept across resets, so once the arena has grown to a frame's
+// peak usage, later frames never touch the global heap. reset() and rewinding
+// to a mark are O(1). Debug builds fill released memory with a poison pattern
+// and check that allocators are not used after a reset, or after the rewind
+// of the mark they were created under.
+class FrameArena
+{
+public:
+    struct Mark
+    {
+        std::size_t block;
+        std::size_t offset;
+        std::uint64_t generation;  // Restored by rewinding to the mark
+    };
+
+    explicit FrameArena(std::size_t blockSize = gFrameArenaBlockSize)
+        : mBlockSize(blockSize)
+    {
+    }
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    void* allocate(std::size_t bytes, std::size_t alignment = gFrameArenaAlignment)
+    {
+        assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+        if (bytes == 0)
+            bytes = 1;
+
+        for (;;) {
+            if (mCurrent < mBlocks.size()) {
+                Block& block = mBlocks[mCurrent];
+                std::uintptr_t base = reinterpret_cast<std::uintptr_t>(block.data);
+                std::uintptr_t aligned = (base + mOffset + alignment - 1) & ~(std::uintptr_t(alignment) - 1);
+                std::size_t end = static_cast<std::size_t>(aligned - base) + bytes;
+                if (end <= block.size) {
+                    mOffset = end;
+                    void* result = reinterpret_cast<void*>(aligned);
+                    FRAME_ARENA_UNPOISON(result, bytes);
+                    return result;
+                }
+                if (mCurrent + 1 < mBlocks.size()) {
+                    ++mCurrent;
+                    mOffset = 0;
+                    continue;
+                }
+            }
+            addBlock(bytes + alignment);
+        }
+    }
+
+    template<typename T>
+    T* allocateArray(std::size_t count)
+    {
+        std::size_t alignment = alignof(T) > gFrameArenaAlignment ? alignof(T) : gFrameArenaAlignment;
+        return static_cast<T*>(allocate(count * sizeof(T), alignment));
+    }
+
+    // Starts a new generation, which lasts until the mark is rewound; every
+    // mark must be rewound, innermost first
+    Mark mark()
+    {
+        Mark mark{ mCurrent, mOffset, mGeneration };
+        mGeneration = ++mGenerationCount;
+        return mark;
+    }
+
+    // Release everything allocated after the mark and return to the
+    // generation before it
+    void rewind(Mark mark)
+    {
+        releaseFrom(mark.block, mark.offset);
+        mCurrent = mark.block;
+        mOffset = mark.offset;
+        mGeneration = mark.generation;
+    }
+
+    // Release everything; called at frame end
+    void reset()
+    {
+        releaseFrom(0, 0);
+        mCurrent = 0;
+        mOffset = 0;
+        mGeneration = ++mGenerationCount;
+    }
+
+    // Changed by every mark, rewind and reset, and never reused. Allocators
+    // remember it, so one used after its scope was rewound or the arena was
+    // reset asserts, as does growing an outer scope's container inside an
+    // inner scope, whose rewind would free the new storage.
+    std::uint64_t generation() const { return mGeneration; }
+
+    std::size_t capacity() const
+    {
+        std::size_t total = 0;
+        for (const Block& block : mBlocks)
+            total += block.size;
+        return total;
+    }
+
+    // Number of times the arena went to the global heap for a new block
+    std::size_t heapAllocations() const { return mHeapAllocations; }
+
+private:
+    struct Block
+    {
+        std::unique_ptr<unsigned char[]> storage;
+        unsigned char* data;
+        std::size_t size;
+    };
+
+    void addBlock(std::size_t minimumBytes)
+    {
+        std::size_t size = minimumBytes > mBlockSize ? minimumBytes : mBlockSize;
+        Block block;
+        block.storage.reset(new unsigned char[size + gFrameArenaAlignment]);
+        std::uintptr_t raw = reinterpret_cast<std::uintptr_t>(block.storage.get());
+        std::uintptr_t aligned = (raw + gFrameArenaAlignment - 1) & ~(std::uintptr_t(gFrameArenaAlignment) - 1);
+        block.data = reinterpret_cast<unsigned char*>(aligned);
+        block.size = size;
+        FRAME_ARENA_POISON(block.data, block.size);
+        mBlocks.push_back(std::move(block));
+        ++mHeapAllocations;
+
+        mCurrent = mBlocks.size() - 1;
+        mOffset = 0;
+    }
+
+    // Only touches the released range in debug or ASan builds, so release builds stay O(1)
+    void releaseFrom(std::size_t blockIndex, std::size_t offset)
+    {
+#if !defined(NDEBUG) || defined(FRAME_ARENA_ASAN)
+        for (std::size_t i = blockIndex; i <= mCurrent && i < mBlocks.size(); ++i) {
+            std::size_t begin = i == blockIndex ? offset : 0;
+            std::size_t end = i == mCurrent ? mOffset : mBlocks[i].size;
+            if (end <= begin)
+                continue;
+            FRAME_ARENA_UNPOISON(mBlocks[i].data + begin, end - begin);
+#ifndef NDEBUG
+            std::memset(mBlocks[i].data + begin, 0xCD, end - begin);
+#endif
+            FRAME_ARENA_POISON(mBlocks[i].data + begin, end - begin);
+        }
+#else
+        (void)blockIndex;
+        (void)offset;
+#endif
+    }
+
+    std::vector<Block> mBlocks;
+    std::size_t mBlockSize;
+    std::size_t mCurrent = 0;
+    std::size_t mOffset = 0;
+    std::uint64_t mGeneration = 0;
+    std::uint64_t mGenerationCount = 0;
+    std::size_t mHeapAllocations = 0;
+};
+
+// Scratch arena of the calling thread
+inline FrameArena& threadFrameArena()
+{
+    static thread_local FrameArena arena;
+    return arena;
+}
+
+// Rewinds the arena to where it was when the scope was entered
+class FrameArenaScope
+{
+public:
+    explicit FrameArenaScope(FrameArena& arena)
+        : mArena(arena)
+        , mMark(arena.mark())
+    {
+    }
+
+    ~FrameArenaScope() { mArena.rewind(mMark); }
+
+    FrameArenaScope(const FrameArenaScope&) = delete;
+    FrameArenaScope& operator=(const FrameArenaScope&) = delete;
+
+private:
+    FrameArena& mArena;
+    FrameArena::Mark mMark;
+};
+
+// STL allocator over a frame arena; deallocation is a no-op. Containers using
+// it must not outlive the scope they were created in or the next reset,
+// which debug builds assert.
+template<typename T>
+class ArenaAllocator
+{
+public:
+    using value_type = T;
+
+    template<typename U>
+    struct rebind
+    {
+        using other = ArenaAllocator<U>;
+    };
+
+    explicit ArenaAllocator(FrameArena& arena = threadFrameArena())
+        : mArena(&arena)
+        , mGeneration(arena.generation())
+    {
+    }
+
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other)
+        : mArena(other.arena())
+        , mGeneration(other.generation())
+    {
+    }
+
+    T* allocate(std::size_t count)
+    {
+        assert(mGeneration == mArena->generation() && "arena allocator used after its scope was rewound or the arena reset");
+        return mArena->allocateArray<T>(count);
+    }
+
+    void deallocate(T*, std::size_t)
+    {
+        assert(mGeneration == mArena->generation() && "arena memory released after its scope was rewound or the arena reset");
+    }
+
+    FrameArena* arena() const { return mArena; }
+    std::uint64_t generation() const { return mGeneration; }
+
+private:
+    FrameArena* mArena;
+    std::uint64_t mGeneration;
+};
+
+template<typename T, typename U>
+inline bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)
+{
+    return a.arena() == b.arena();
+}
+
+template<typename T, typename U>
+inline bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)
+{
+    return !(a == b);
+}
+
+// Vector whose storage lives in the calling thread's frame arena
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
@@ -0,0 +1,338 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "frame_arena.h"
+#include "numa_topology.h"
+#include "sampling_profiler.h"
+#include "worker_pool.h"
+
+// How the tiles of a stage wait on the tiles of an earlier stage
+enum class TileDependency
+{
+    SameTile,       // Tile i waits for tile i
+    NeighbourTiles, // Tile i waits for tiles i - 1 to i + 1, e.g. for a filter reaching across band edges
+    AllTiles,       // Every tile waits for the whole earlier stage, e.g. for frame-wide statistics
+};
+
+struct FrameGraphStageReport
+{
+    std::string name;
+    std::uint64_t workNanos = 0;
+};
+
+struct FrameGraphReport
+{
+    std::size_t frameId = 0;
+    std::uint64_t wallNanos = 0;
+    std::uint64_t workNanos = 0;          // Sum over every node
+    std::uint64_t criticalPathNanos = 0;  // Longest dependency chain by measured node times
+    unsigned threads = 1;
+    std::vector<FrameGraphStageReport> stages;
+
+    // Share of the pool's thread time spent in nodes while the frame ran
+    double utilization() const { return wallNanos && threads ? double(workNanos) / (double(wallNanos) * threads) : 0.0; }
+    // Speedup the graph allows at best, whatever the thread count
+    double parallelism() const { return criticalPathNanos ? double(workNanos) / criticalPathNanos : 0.0; }
+
+    std::string summary() const
+    {
+        char text[256];
+        std::snprintf(text, sizeof(text),
+            "frame %zu: wall %.3f ms, work %.3f ms, critical path %.3f ms, parallelism %.2f, utilization %.1f%% of %u threads\n",
+            frameId, wallNanos / 1e6, workNanos / 1e6, criticalPathNanos / 1e6, parallelism(), utilization() * 100.0, threads);
+        return text;
+    }
+};
+
+// Static task graph for the stages that run on each frame: every stage is
+// split into the same tiles (bands), and each tile of a stage waits only for
+// the tiles of earlier stages it reads, so statistics on tile 3 start as soon
+// as tile 3 is generated rather than after the whole frame. The graph is
+// built once; nodes, dependency lists and counters are preallocated, and a
+// frame only resets counters. A finished node runs one newly ready successor
+// itself while its tile is still in cache and hands the rest to the pool, on
+// the NUMA node that owns the tile. One frame runs through a graph at a time.
+class FrameGraph
+{
+public:
+    using Clock = WorkerPool::Clock;
+    using StageFunction = std::function<void(std::size_t frameId, int tile)>;
+    using DoneFunction = std::function<void(const FrameGraphReport& report)>;
+
+    FrameGraph(WorkerPool& pool, int tileCount)
+        : mPool(pool)
+        , mTileCount(std::max(1, tileCount))
+    {
+    }
+
+    ~FrameGraph() { waitIdle(); }
+
+    FrameGraph(const FrameGraph&) = delete;
+    FrameGraph& operator=(const FrameGraph&) = delete;
+
+    int tileCount() const { return mTileCount; }
+
+    // Stages are added in an order where every stage comes after the ones it depends on
+    int addStage(const std::string& name, StageFunction run)
+    {
+        mStages.push_back(Stage{ name, internProfileStage(name), run, {} });
+        mBuilt = false;
+        return static_cast<int>(mStages.size() - 1);
+    }
+
+    void addDependency(int stage, int dependsOn, TileDependency kind = TileDependency::SameTile)
+    {
+        if (dependsOn < 0 || dependsOn >= stage || stage >= static_cast<int>(mStages.size()))
+            throw std::invalid_argument("frame graph stages may only depend on earlier stages");
+        mStages[stage].dependencies.push_back(Dependency{ dependsOn, kind });
+        mBuilt = false;
+    }
+
+    // Run one frame. done is called on the worker that finishes the last node,
+    // after the graph is idle again, so it may start the next frame.
+    void start(std::size_t frameId, Clock::time_point deadline, DoneFunction done = nullptr)
+    {
+        build();
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mIdle.wait(lock, [this] { return !mRunning; });
+            mRunning = true;
+        }
+        mFrameId = frameId;
+        mDeadline = deadline;
+        mDone = done;
+        mRemaining.store(mNodes.size(), std::memory_order_relaxed);
+        for (Node& node : mNodes)
+            node.pending.store(node.predecessorCount, std::memory_order_relaxed);
+        mStarted = Clock::now();
+        submit(mRoots);
+    }
+
+    // Run one frame and wait for it; not from a worker of the same pool
+    FrameGraphReport run(std::size_t frameId, Clock::time_point deadline)
+    {
+        start(frameId, deadline);
+        waitIdle();
+        return lastReport();
+    }
+
+    void waitIdle()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mIdle.wait(lock, [this] { return !mRunning; });
+    }
+
+    FrameGraphReport lastReport() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mLastReport;
+    }
+
+private:
+    struct Dependency
+    {
+        int stage;
+        TileDependency kind;
+    };
+
+    struct Stage
+    {
+        std::string name;
+        const char* profileStage;  // The name for profiler samples
+        StageFunction run;
+        std::vector<Dependency> dependencies;
+    };
+
+    struct Node
+    {
+        int stage = 0;
+        int tile = 0;
+        int predecessorCount = 0;
+        std::size_t firstSuccessor = 0;    // Range in mSuccessors
+        std::size_t successorCount = 0;
+        std::size_t firstPredecessor = 0;  // Range in mPredecessors
+        std::atomic<int> pending{ 0 };
+        std::uint64_t beginNanos = 0;      // Since the frame started; written by the node's worker
+        std::uint64_t endNanos = 0;
+    };
+
+    std::size_t nodeIndex(int stage, int tile) const { return static_cast<std::size_t>(stage) * mTileCount + tile; }
+
+    // Flatten the stage dependencies into per-node predecessor and successor lists
+    void build()
+    {
+        if (mBuilt)
+            return;
+        std::size_t nodeCount = mStages.size() * mTileCount;
+        std::vector<std::vector<std::size_t>> predecessors(nodeCount);
+        for (int stage = 0; stage < static_cast<int>(mStages.size()); ++stage) {
+            for (int tile = 0; tile < mTileCount; ++tile) {
+                std::vector<std::size_t>& list = predecessors[nodeIndex(stage, tile)];
+                for (const Dependency& dependency : mStages[stage].dependencies) {
+                    int first = tile;
+                    int last = tile;
+                    if (dependency.kind == TileDependency::NeighbourTiles) {
+                        first = std::max(0, tile - 1);
+                        last = std::min(mTileCount - 1, tile + 1);
+                    } else if (dependency.kind == TileDependency::AllTiles) {
+                        first = 0;
+                        last = mTileCount - 1;
+                    }
+                    for (int other = first; other <= last; ++other)
+                        list.push_back(nodeIndex(dependency.stage, other));
+                }
+                std::sort(list.begin(), list.end());
+                list.erase(std::unique(list.begin(), list.end()), list.end());
+            }
+        }
+
+        std::vector<std::vector<std::size_t>> successors(nodeCount);
+        for (std::size_t node = 0; node < nodeCount; ++node) {
+            for (std::size_t predecessor : predecessors[node])
+                successors[predecessor].push_back(node);
+        }
+
+        std::vector<Node> nodes(nodeCount);
+        mSuccessors.clear();
+        mPredecessors.clear();
+        mRoots.clear();
+        for (std::size_t i = 0; i < nodeCount; ++i) {
+            Node& node = nodes[i];
+            node.stage = static_cast<int>(i / mTileCount);
+            node.tile = static_cast<int>(i % mTileCount);
+            node.predecessorCount = static_cast<int>(predecessors[i].size());
+            node.firstPredecessor = mPredecessors.size();
+            mPredecessors.insert(mPredecessors.end(), predecessors[i].begin(), predecessors[i].end());
+            node.firstSuccessor = mSuccessors.size();
+            node.successorCount = successors[i].size();
+            mSuccessors.insert(mSuccessors.end(), successors[i].begin(), successors[i].end());
+            if (node.predecessorCount == 0)
+                mRoots.push_back(i);
+        }
+        mNodes.swap(nodes);
+        mBuilt = true;
+    }
+
+    void submit(const std::vector<std::size_t>& ready)
+    {
+        if (ready.empty())
+            return;
+        std::vector<WorkerPool::Task> tasks;
+        std::vector<std::size_t> numaNodes;
+        tasks.reserve(ready.size());
+        for (std::size_t index : ready) {
+            tasks.push_back([this, index] { runFrom(index); });
+            if (mPool.nodeCount() > 1)
+                numaNodes.push_back(numaNodeForBand(mNodes[index].tile, mTileCount, mPool.nodeCount()));
+        }
+        mPool.submitBatch(std::move(tasks), mDeadline, numaNodes);
+    }
+
+    std::uint64_t sinceStart() const
+    {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - mStarted).count());
+    }
+
+    // Run a node, then keep going with one successor it made ready
+    void runFrom(std::size_t index)
+    {
+        std::vector<std::size_t> ready;
+        ready.reserve(mNodes[index].successorCount);
+        while (index != static_cast<std::size_t>(-1)) {
+            Node& node = mNodes[index];
+            node.beginNanos = sinceStart();
+            {
+                FrameArenaScope scratch(threadFrameArena());
+                ProfileStageScope stage(mStages[node.stage].profileStage);
+                mStages[node.stage].run(mFrameId, node.tile);
+            }
+            node.endNanos = sinceStart();
+
+            ready.clear();
+            for (std::size_t i = 0; i < node.successorCount; ++i) {
+                std::size_t successor = mSuccessors[node.firstSuccessor + i];
+                if (mNodes[successor].pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    ready.push_back(successor);
+            }
+            index = static_cast<std::size_t>(-1);
+            if (!ready.empty()) {
+                index = ready.front();
+                ready.erase(ready.begin());
+                submit(ready);
+            }
+
+            if (mRemaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                finish();
+        }
+    }
+
+    void finish()
+    {
+        FrameGraphReport report;
+        report.frameId = mFrameId;
+        report.wallNanos = sinceStart();
+        report.threads = mPool.threadCount();
+        report.stages.resize(mStages.size());
+        for (std::size_t stage = 0; stage < mStages.size(); ++stage)
+            report.stages[stage].name = mStages[stage].name;
+
+        // Nodes are numbered stage by stage, which is a topological order
+        std::vector<std::uint64_t> pathEnd(mNodes.size());
+        for (std::size_t i = 0; i < mNodes.size(); ++i) {
+            const Node& node = mNodes[i];
+            std::uint64_t duration = node.endNanos - node.beginNanos;
+            std::uint64_t longestBefore = 0;
+            for (int p = 0; p < node.predecessorCount; ++p)
+                longestBefore = std::max(longestBefore, pathEnd[mPredecessors[node.firstPredecessor + p]]);
+            pathEnd[i] = longestBefore + duration;
+            report.criticalPathNanos = std::max(report.criticalPathNanos, pathEnd[i]);
+            report.workNanos += duration;
+            report.stages[node.stage].workNanos += duration;
+        }
+
+        // Notify under the lock: a waiter may destroy the graph as soon as it
+        // sees mRunning clear, and done runs from locals only
+        DoneFunction done = mDone;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mLastReport = report;
+            mRunning = false;
+            mIdle.notify_all();
+        }
+        if (done)
+            done(report);
+    }
+
+    WorkerPool& mPool;
+    int mTileCount;
+    std::vector<Stage> mStages;
+    bool mBuilt = false;
+
+    std::vector<Node> mNodes;
+    std::vector<std::size_t> mSuccessors;
+    std::vector<std::size_t> mPredecessors;
+    std::vector<std::size_t> mRoots;
+
+    std::size_t mFrameId = 0;
+    Clock::time_point mDeadline;
+    Clock::time_point mStarted;
+    DoneFunction mDone;
+    std::atomic<std::size_t> mRemaining{ 0 };
+
+    mutable std::mutex mMutex;
+    std::condition_variable mIdle;
+    bool mRunning = false;
+    FrameGraphReport mLastReport;
+};
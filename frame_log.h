@@ -0,0 +1,646 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// File layout: gFrameLogMagic, a varint wall-clock time of the log epoch in
+// nanoseconds since 1970, then blocks of a type byte, a varint payload length
+// and the payload. A sources block lists every source name (ids are the list
+// order) and is repeated at the start of each file. An events block holds one
+// thread's events: varint thread, varint count, varint base frame id, zigzag
+// base time, then per event a head byte (kind in the low two bits, flags
+// above), varint source, zigzag frame id and time deltas from the previous
+// event, and for rendered events the render time, zigzag deadline slack and
+// band counts.
+constexpr char gFrameLogMagic[8] = { 'F', 'R', 'M', 'L', 'O', 'G', '0', '1' };
+constexpr std::size_t gFrameLogChunkBytes = 4096;
+constexpr std::size_t gFrameLogChunksPerThread = 4;
+constexpr std::size_t gFrameLogMaxEventBytes = 64;
+constexpr std::size_t gFrameLogMaxChunkHeaderBytes = 48;
+constexpr std::chrono::milliseconds gFrameLogFlushInterval{ 1000 };
+constexpr std::uint8_t gFrameLogSourcesBlock = 1;
+constexpr std::uint8_t gFrameLogEventsBlock = 2;
+
+enum class FrameEventKind : std::uint8_t
+{
+    Rendered,   // Renderer finished or dropped the frame; carries band counts
+    Published,
+    Presented,
+};
+
+namespace FrameEventFlag
+{
+    constexpr std::uint8_t Dropped = 1 << 0;        // Cancelled before it was published
+    constexpr std::uint8_t DeadlineMiss = 1 << 1;
+    constexpr std::uint8_t PredictedMiss = 1 << 2;
+    constexpr std::uint8_t Reconstructed = 1 << 3;  // Half shaded in a temporal mode
+}
+
+// One decoded event with absolute values; times are nanoseconds since the log epoch
+struct FrameLogEvent
+{
+    FrameEventKind kind = FrameEventKind::Rendered;
+    std::uint8_t flags = 0;
+    std::uint32_t source = 0;
+    std::uint32_t thread = 0;
+    std::uint64_t frameId = 0;
+    std::int64_t timeNanos = 0;      // Request time for rendered events
+    std::uint64_t renderNanos = 0;   // Request to finish
+    std::int64_t slackNanos = 0;     // Deadline minus finish; negative when late
+    std::uint32_t bandsRendered = 0;
+    std::uint32_t bandsSkipped = 0;
+};
+
+struct FrameLogStats
+{
+    std::uint64_t events = 0;
+    std::uint64_t droppedEvents = 0;  // Writer fell behind and a thread's chunks were all full
+    std::uint64_t bytesWritten = 0;
+    std::uint64_t filesOpened = 0;
+};
+
+inline void frameLogPutVarint(std::uint8_t*& out, std::uint64_t value)
+{
+    while (value >= 0x80) {
+        *out++ = static_cast<std::uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = static_cast<std::uint8_t>(value);
+}
+
+inline std::uint64_t frameLogZigzag(std::int64_t value)
+{
+    return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+}
+
+inline std::int64_t frameLogUnzigzag(std::uint64_t value)
+{
+    return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+}
+
+// Returns false when the varint runs past end
+inline bool frameLogGetVarint(const std::uint8_t*& in, const std::uint8_t* end, std::uint64_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64 && in < end; shift += 7) {
+        std::uint8_t byte = *in++;
+        value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// Always-on log of per-frame events for offline analysis. Each thread encodes
+// events into chunks of its own, so recording takes no lock and does not
+// allocate once a thread has logged its first event to a log. Each thread has
+// a small ring of chunks per log. A full chunk is sealed by its thread and
+// handed to a writer thread, which appends it to the current file; the writer
+// also seals a chunk that has been open longer than gFrameLogFlushInterval,
+// so a thread that stops logging still has its events written. A thread's
+// chunks are freed once it exits, and every thread's once the log is gone.
+// The writer rotates files as log, log.1, ... once one passes maxFileBytes.
+// When the writer falls so far behind that a thread has no free chunk,
+// that thread's events are counted and dropped rather than waited on.
+class FrameLog
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    FrameLog(const std::string& path, std::size_t maxFileBytes = 64 * 1024 * 1024, std::size_t maxFiles = 4)
+        : mPath(path)
+        , mMaxFileBytes(maxFileBytes)
+        , mMaxFiles(maxFiles == 0 ? 1 : maxFiles)
+        , mEpoch(Clock::now())
+        , mWallEpoch(std::chrono::system_clock::now())
+        , mInstance(nextInstance())
+    {
+        openFile();
+        mWriter = std::thread([this] { writerLoop(); });
+    }
+
+    // Producers must have stopped logging; their partial chunks are written out
+    ~FrameLog()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mWriterMutex);
+            mStopping = true;
+        }
+        mWriterWake.notify_all();
+        mWriter.join();
+
+        std::lock_guard<std::mutex> lock(mThreadsMutex);
+        writeSealedChunks(std::numeric_limits<std::int64_t>::max());
+        if (mFile)
+            std::fclose(mFile);
+        for (const std::shared_ptr<ThreadLink>& link : mThreads) {
+            link->closed.store(true, std::memory_order_release);
+            link->state.reset();
+        }
+    }
+
+    FrameLog(const FrameLog&) = delete;
+    FrameLog& operator=(const FrameLog&) = delete;
+
+    // Register a source before logging its frames; ids are stable for the log's lifetime
+    std::uint32_t registerSource(const std::string& name)
+    {
+        std::lock_guard<std::mutex> lock(mThreadsMutex);
+        mSources.push_back(name);
+        mSourcesChanged = true;
+        return static_cast<std::uint32_t>(mSources.size() - 1);
+    }
+
+    // Renderer finished a frame, published or dropped
+    void rendered(
+        std::uint32_t source,
+        std::uint64_t frameId,
+        Clock::time_point requested,
+        Clock::time_point finished,
+        Clock::time_point deadline,
+        std::uint8_t flags,
+        std::uint32_t bandsRendered,
+        std::uint32_t bandsSkipped)
+    {
+        FrameLogEvent event;
+        event.kind = FrameEventKind::Rendered;
+        event.flags = flags;
+        event.source = source;
+        event.frameId = frameId;
+        event.timeNanos = sinceEpoch(requested);
+        event.renderNanos = finished > requested ? static_cast<std::uint64_t>(sinceEpoch(finished) - event.timeNanos) : 0;
+        event.slackNanos = sinceEpoch(deadline) - sinceEpoch(finished);
+        event.bandsRendered = bandsRendered;
+        event.bandsSkipped = bandsSkipped;
+        append(event, finished);
+    }
+
+    // Frame reached a later stage: published or presented
+    void reached(std::uint32_t source, std::uint64_t frameId, FrameEventKind kind, Clock::time_point when = Clock::now())
+    {
+        FrameLogEvent event;
+        event.kind = kind;
+        event.source = source;
+        event.frameId = frameId;
+        event.timeNanos = sinceEpoch(when);
+        append(event, when);
+    }
+
+    FrameLogStats stats() const
+    {
+        FrameLogStats stats;
+        stats.events = mEvents.load(std::memory_order_relaxed);
+        stats.droppedEvents = mDroppedEvents.load(std::memory_order_relaxed);
+        stats.bytesWritten = mBytesWritten.load(std::memory_order_relaxed);
+        stats.filesOpened = mFilesOpened.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    // Free -> Appending <-> Open -> Sealed -> Free. The producer holds a
+    // chunk as Appending while it encodes an event, so the writer can only
+    // seal a stale chunk between events.
+    enum ChunkState : std::uint8_t
+    {
+        ChunkFree,
+        ChunkOpen,
+        ChunkAppending,
+        ChunkSealed,
+    };
+
+    struct Chunk
+    {
+        std::atomic<std::uint8_t> state{ ChunkFree };
+        std::uint32_t count = 0;
+        std::uint64_t baseFrameId = 0;
+        std::int64_t baseNanos = 0;
+        std::int64_t openedNanos = 0;
+        std::size_t size = 0;
+        std::uint8_t bytes[gFrameLogChunkBytes];
+    };
+
+    // One producer thread's ring; the writer frees chunks in the order they were sealed
+    struct ThreadState
+    {
+        std::uint32_t thread = 0;
+        Chunk chunks[gFrameLogChunksPerThread];
+        std::size_t current = 0;   // Producer only
+        std::size_t nextToWrite = 0;  // Writer only
+        bool open = false;         // Producer only: current chunk holds events
+        std::uint64_t lastFrameId = 0;
+        std::int64_t lastNanos = 0;
+    };
+
+    // Shared by a log and one producer thread; the log owns the state and
+    // frees it once the thread has exited or the log is destroyed
+    struct ThreadLink
+    {
+        std::uint64_t instance = 0;
+        std::unique_ptr<ThreadState> state;
+        std::atomic<bool> exited{ false };  // Set by the thread
+        std::atomic<bool> closed{ false };  // Set by the log
+    };
+
+    // Every log a thread has logged to; tells each one when the thread exits
+    struct ThreadLinks
+    {
+        std::vector<std::shared_ptr<ThreadLink>> links;
+
+        ~ThreadLinks()
+        {
+            for (const std::shared_ptr<ThreadLink>& link : links)
+                link->exited.store(true, std::memory_order_release);
+        }
+    };
+
+    static std::uint64_t nextInstance()
+    {
+        static std::atomic<std::uint64_t> instances{ 0 };
+        return instances.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    std::int64_t sinceEpoch(Clock::time_point when) const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(when - mEpoch).count();
+    }
+
+    // The last log used is cached; switching between logs looks the others
+    // up in the thread's links, dropping those of logs that are gone
+    ThreadState& threadState()
+    {
+        static thread_local std::uint64_t cachedInstance = 0;
+        static thread_local ThreadState* cachedState = nullptr;
+        if (cachedInstance == mInstance)
+            return *cachedState;
+
+        static thread_local ThreadLinks threadLinks;
+        std::vector<std::shared_ptr<ThreadLink>>& links = threadLinks.links;
+        ThreadState* state = nullptr;
+        for (std::size_t i = 0; i < links.size();) {
+            if (links[i]->closed.load(std::memory_order_acquire)) {
+                links[i] = links.back();
+                links.pop_back();
+                continue;
+            }
+            if (links[i]->instance == mInstance)
+                state = links[i]->state.get();
+            ++i;
+        }
+        if (!state) {
+            std::shared_ptr<ThreadLink> link = std::make_shared<ThreadLink>();
+            link->instance = mInstance;
+            link->state.reset(new ThreadState());
+            state = link->state.get();
+            {
+                std::lock_guard<std::mutex> lock(mThreadsMutex);
+                state->thread = mNextThread++;
+                mThreads.push_back(link);
+            }
+            links.push_back(link);
+        }
+        cachedInstance = mInstance;
+        cachedState = state;
+        return *state;
+    }
+
+    void append(const FrameLogEvent& event, Clock::time_point now)
+    {
+        ThreadState& state = threadState();
+        std::int64_t nowNanos = sinceEpoch(now);
+        Chunk* chunk = &state.chunks[state.current];
+        if (state.open) {
+            std::uint8_t expected = ChunkOpen;
+            if (!chunk->state.compare_exchange_strong(expected, ChunkAppending, std::memory_order_acquire)) {
+                // The writer sealed it as stale; start the next one
+                state.current = (state.current + 1) % gFrameLogChunksPerThread;
+                state.open = false;
+                chunk = &state.chunks[state.current];
+            }
+        }
+        if (!state.open) {
+            if (chunk->state.load(std::memory_order_acquire) != ChunkFree) {
+                mDroppedEvents.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            chunk->state.store(ChunkAppending, std::memory_order_relaxed);
+            chunk->count = 0;
+            chunk->size = 0;
+            chunk->baseFrameId = event.frameId;
+            chunk->baseNanos = event.timeNanos;
+            chunk->openedNanos = nowNanos;
+            state.lastFrameId = event.frameId;
+            state.lastNanos = event.timeNanos;
+            state.open = true;
+        }
+
+        std::uint8_t* out = chunk->bytes + chunk->size;
+        *out++ = static_cast<std::uint8_t>(static_cast<std::uint8_t>(event.kind) | (event.flags << 2));
+        frameLogPutVarint(out, event.source);
+        frameLogPutVarint(out, frameLogZigzag(static_cast<std::int64_t>(event.frameId - state.lastFrameId)));
+        frameLogPutVarint(out, frameLogZigzag(event.timeNanos - state.lastNanos));
+        if (event.kind == FrameEventKind::Rendered) {
+            frameLogPutVarint(out, event.renderNanos);
+            frameLogPutVarint(out, frameLogZigzag(event.slackNanos));
+            frameLogPutVarint(out, event.bandsRendered);
+            frameLogPutVarint(out, event.bandsSkipped);
+        }
+        chunk->size = static_cast<std::size_t>(out - chunk->bytes);
+        ++chunk->count;
+        state.lastFrameId = event.frameId;
+        state.lastNanos = event.timeNanos;
+        mEvents.fetch_add(1, std::memory_order_relaxed);
+
+        if (chunk->size + gFrameLogMaxEventBytes > gFrameLogChunkBytes || nowNanos - chunk->openedNanos >= flushIntervalNanos()) {
+            seal(state);
+            return;
+        }
+        chunk->state.store(ChunkOpen, std::memory_order_release);
+    }
+
+    // Hand the current chunk to the writer; producer only. The wakeup takes
+    // no lock; a missed one only delays the write to the next poll.
+    void seal(ThreadState& state)
+    {
+        state.chunks[state.current].state.store(ChunkSealed, std::memory_order_release);
+        state.current = (state.current + 1) % gFrameLogChunksPerThread;
+        state.open = false;
+        mWriterWake.notify_one();
+    }
+
+    static std::int64_t flushIntervalNanos()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(gFrameLogFlushInterval).count();
+    }
+
+    void writerLoop()
+    {
+        std::unique_lock<std::mutex> lock(mWriterMutex);
+        while (!mStopping) {
+            mWriterWake.wait_for(lock, gFrameLogFlushInterval / 4);
+            lock.unlock();
+            {
+                std::lock_guard<std::mutex> threadsLock(mThreadsMutex);
+                writeSealedChunks(sinceEpoch(Clock::now()) - flushIntervalNanos());
+            }
+            lock.lock();
+        }
+    }
+
+    // Write every sealed chunk, first sealing open chunks opened before
+    // staleNanos and those of threads that have exited, and free the states
+    // of exited threads. Caller holds mThreadsMutex.
+    void writeSealedChunks(std::int64_t staleNanos)
+    {
+        if (mFile && mSourcesChanged)
+            writeSources();
+
+        bool wrote = false;
+        for (std::size_t i = 0; i < mThreads.size();) {
+            ThreadState& state = *mThreads[i]->state;
+            bool exited = mThreads[i]->exited.load(std::memory_order_acquire);
+            for (;;) {
+                Chunk& chunk = state.chunks[state.nextToWrite];
+                std::uint8_t expected = ChunkOpen;
+                if (chunk.state.load(std::memory_order_acquire) == ChunkOpen && (exited || chunk.openedNanos < staleNanos))
+                    chunk.state.compare_exchange_strong(expected, ChunkSealed, std::memory_order_acquire);
+                if (chunk.state.load(std::memory_order_acquire) != ChunkSealed)
+                    break;
+                if (mFile) {
+                    writeChunk(state.thread, chunk);
+                    wrote = true;
+                }
+                chunk.state.store(ChunkFree, std::memory_order_release);
+                state.nextToWrite = (state.nextToWrite + 1) % gFrameLogChunksPerThread;
+            }
+            if (exited) {
+                mThreads[i] = mThreads.back();
+                mThreads.pop_back();
+                continue;
+            }
+            ++i;
+        }
+        if (wrote) {
+            std::fflush(mFile);
+            if (mFileBytes >= mMaxFileBytes)
+                rotate();
+        }
+    }
+
+    void writeChunk(std::uint32_t thread, const Chunk& chunk)
+    {
+        std::uint8_t header[gFrameLogMaxChunkHeaderBytes];
+        std::uint8_t* out = header;
+        frameLogPutVarint(out, thread);
+        frameLogPutVarint(out, chunk.count);
+        frameLogPutVarint(out, chunk.baseFrameId);
+        frameLogPutVarint(out, frameLogZigzag(chunk.baseNanos));
+        std::size_t headerSize = static_cast<std::size_t>(out - header);
+        writeBlock(gFrameLogEventsBlock, header, headerSize, chunk.bytes, chunk.size);
+    }
+
+    void writeSources()
+    {
+        std::vector<std::uint8_t> payload(10);
+        std::uint8_t* out = payload.data();
+        frameLogPutVarint(out, mSources.size());
+        payload.resize(static_cast<std::size_t>(out - payload.data()));
+        for (const std::string& name : mSources) {
+            std::uint8_t length[10];
+            std::uint8_t* lengthEnd = length;
+            frameLogPutVarint(lengthEnd, name.size());
+            payload.insert(payload.end(), length, lengthEnd);
+            payload.insert(payload.end(), name.begin(), name.end());
+        }
+        writeBlock(gFrameLogSourcesBlock, payload.data(), payload.size(), nullptr, 0);
+        mSourcesChanged = false;
+    }
+
+    void writeBlock(std::uint8_t type, const std::uint8_t* head, std::size_t headSize, const std::uint8_t* body, std::size_t bodySize)
+    {
+        std::uint8_t prefix[11];
+        std::uint8_t* out = prefix;
+        *out++ = type;
+        frameLogPutVarint(out, headSize + bodySize);
+        std::size_t prefixSize = static_cast<std::size_t>(out - prefix);
+        std::fwrite(prefix, 1, prefixSize, mFile);
+        std::fwrite(head, 1, headSize, mFile);
+        if (bodySize)
+            std::fwrite(body, 1, bodySize, mFile);
+        std::size_t total = prefixSize + headSize + bodySize;
+        mFileBytes += total;
+        mBytesWritten.fetch_add(total, std::memory_order_relaxed);
+    }
+
+    void openFile()
+    {
+        mFile = std::fopen(mPath.c_str(), "wb");
+        if (!mFile) {
+            std::fprintf(stderr, "frame log: cannot open %s\n", mPath.c_str());
+            return;
+        }
+        std::uint8_t header[sizeof(gFrameLogMagic) + 10];
+        std::memcpy(header, gFrameLogMagic, sizeof(gFrameLogMagic));
+        std::uint8_t* out = header + sizeof(gFrameLogMagic);
+        auto wallNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(mWallEpoch.time_since_epoch()).count();
+        frameLogPutVarint(out, static_cast<std::uint64_t>(wallNanos));
+        std::size_t size = static_cast<std::size_t>(out - header);
+        std::fwrite(header, 1, size, mFile);
+        mFileBytes = size;
+        mBytesWritten.fetch_add(size, std::memory_order_relaxed);
+        mFilesOpened.fetch_add(1, std::memory_order_relaxed);
+        mSourcesChanged = true;
+    }
+
+    // log -> log.1 -> ... -> log.(maxFiles - 1), dropping the oldest
+    void rotate()
+    {
+        std::fclose(mFile);
+        mFile = nullptr;
+        for (std::size_t index = mMaxFiles - 1; index > 0; --index) {
+            std::string from = index == 1 ? mPath : mPath + "." + std::to_string(index - 1);
+            std::string to = mPath + "." + std::to_string(index);
+            std::rename(from.c_str(), to.c_str());
+        }
+        openFile();
+    }
+
+    std::string mPath;
+    std::size_t mMaxFileBytes;
+    std::size_t mMaxFiles;
+    Clock::time_point mEpoch;
+    std::chrono::system_clock::time_point mWallEpoch;
+    std::uint64_t mInstance;
+
+    // Thread registry and source table; producers only take this on their first event
+    std::mutex mThreadsMutex;
+    std::vector<std::shared_ptr<ThreadLink>> mThreads;
+    std::uint32_t mNextThread = 0;
+    std::vector<std::string> mSources;
+    bool mSourcesChanged = false;
+
+    // Writer thread state
+    std::FILE* mFile = nullptr;
+    std::size_t mFileBytes = 0;
+    std::mutex mWriterMutex;
+    std::condition_variable mWriterWake;
+    bool mStopping = false;
+    std::thread mWriter;
+
+    std::atomic<std::uint64_t> mEvents{ 0 };
+    std::atomic<std::uint64_t> mDroppedEvents{ 0 };
+    std::atomic<std::uint64_t> mBytesWritten{ 0 };
+    std::atomic<std::uint64_t> mFilesOpened{ 0 };
+};
+
+// Reads every block of one log file; returns false with a message on a
+// malformed or truncated file, keeping whatever decoded before the damage
+inline bool readFrameLog(
+    const std::string& path,
+    std::vector<FrameLogEvent>& events,
+    std::vector<std::string>& sources,
+    std::uint64_t& wallEpochNanos,
+    std::string& error)
+{
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+    std::vector<std::uint8_t> data;
+    std::uint8_t buffer[65536];
+    std::size_t read;
+    while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+        data.insert(data.end(), buffer, buffer + read);
+    std::fclose(file);
+
+    const std::uint8_t* in = data.data();
+    const std::uint8_t* end = data.data() + data.size();
+    if (data.size() < sizeof(gFrameLogMagic) || std::memcmp(in, gFrameLogMagic, sizeof(gFrameLogMagic)) != 0) {
+        error = path + ": not a frame log";
+        return false;
+    }
+    in += sizeof(gFrameLogMagic);
+    if (!frameLogGetVarint(in, end, wallEpochNanos)) {
+        error = path + ": truncated header";
+        return false;
+    }
+
+    while (in < end) {
+        std::uint8_t type = *in++;
+        std::uint64_t length = 0;
+        if (!frameLogGetVarint(in, end, length) || length > static_cast<std::uint64_t>(end - in)) {
+            error = path + ": truncated block";
+            return false;
+        }
+        const std::uint8_t* block = in;
+        const std::uint8_t* blockEnd = in + length;
+        in = blockEnd;
+
+        if (type == gFrameLogSourcesBlock) {
+            std::uint64_t count = 0;
+            if (!frameLogGetVarint(block, blockEnd, count))
+                continue;
+            sources.clear();
+            for (std::uint64_t i = 0; i < count; ++i) {
+                std::uint64_t size = 0;
+                if (!frameLogGetVarint(block, blockEnd, size) || size > static_cast<std::uint64_t>(blockEnd - block))
+                    break;
+                sources.push_back(std::string(reinterpret_cast<const char*>(block), static_cast<std::size_t>(size)));
+                block += size;
+            }
+            continue;
+        }
+        if (type != gFrameLogEventsBlock)
+            continue;
+
+        std::uint64_t thread = 0, count = 0, frameId = 0, zigzagNanos = 0;
+        if (!frameLogGetVarint(block, blockEnd, thread) || !frameLogGetVarint(block, blockEnd, count)
+            || !frameLogGetVarint(block, blockEnd, frameId) || !frameLogGetVarint(block, blockEnd, zigzagNanos)) {
+            error = path + ": bad events block";
+            return false;
+        }
+        std::int64_t nanos = frameLogUnzigzag(zigzagNanos);
+        for (std::uint64_t i = 0; i < count && block < blockEnd; ++i) {
+            FrameLogEvent event;
+            std::uint8_t head = *block++;
+            event.kind = static_cast<FrameEventKind>(head & 3);
+            event.flags = static_cast<std::uint8_t>(head >> 2);
+            event.thread = static_cast<std::uint32_t>(thread);
+            std::uint64_t source = 0, frameDelta = 0, timeDelta = 0;
+            if (!frameLogGetVarint(block, blockEnd, source) || !frameLogGetVarint(block, blockEnd, frameDelta)
+                || !frameLogGetVarint(block, blockEnd, timeDelta)) {
+                error = path + ": bad event";
+                return false;
+            }
+            event.source = static_cast<std::uint32_t>(source);
+            frameId += static_cast<std::uint64_t>(frameLogUnzigzag(frameDelta));
+            nanos += frameLogUnzigzag(timeDelta);
+            event.frameId = frameId;
+            event.timeNanos = nanos;
+            if (event.kind == FrameEventKind::Rendered) {
+                std::uint64_t slack = 0, bandsRendered = 0, bandsSkipped = 0;
+                if (!frameLogGetVarint(block, blockEnd, event.renderNanos) || !frameLogGetVarint(block, blockEnd, slack)
+                    || !frameLogGetVarint(block, blockEnd, bandsRendered) || !frameLogGetVarint(block, blockEnd, bandsSkipped)) {
+                    error = path + ": bad event";
+                    return false;
+                }
+                event.slackNanos = frameLogUnzigzag(slack);
+                event.bandsRendered = static_cast<std::uint32_t>(bandsRendered);
+                event.bandsSkipped = static_cast<std::uint32_t>(bandsSkipped);
+            }
+            events.push_back(event);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,196 @@
+// Offline summaries of frame logs written by FrameLog (frame_log.h).
+// Build: clang++ -std=c++11 -O2 frame_log_tool.cpp -o frame_log_tool
+// Usage: ./frame_log_tool summary <log> [more logs...]
+//        ./frame_log_tool diff <log A> <log B>
+//        ./frame_log_tool diff <logs A...> -- <logs B...>
+// Rotated files of one session can be passed together, oldest first.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "frame_log.h"
+#include "input_latency.h"
+
+struct SourceSummary
+{
+    std::uint64_t framesRendered = 0;
+    std::uint64_t framesDropped = 0;
+    std::uint64_t framesPublished = 0;
+    std::uint64_t framesPresented = 0;
+    std::uint64_t deadlineMisses = 0;
+    std::uint64_t predictedMisses = 0;
+    std::uint64_t framesReconstructed = 0;
+    std::uint64_t bandsRendered = 0;
+    std::uint64_t bandsSkipped = 0;
+    std::int64_t firstNanos = 0;
+    std::int64_t lastNanos = 0;
+    std::unique_ptr<LatencyHistogram> render{ new LatencyHistogram() };
+    std::unique_ptr<LatencyHistogram> publish{ new LatencyHistogram() };
+    std::unique_ptr<LatencyHistogram> present{ new LatencyHistogram() };
+
+    double seconds() const { return (lastNanos - firstNanos) / 1e9; }
+    double frameRate() const { return seconds() > 0.0 ? framesPublished / seconds() : 0.0; }
+    double dropRate() const { return framesRendered ? double(framesDropped) / framesRendered : 0.0; }
+    double missRate() const
+    {
+        std::uint64_t finished = framesRendered - framesDropped;
+        return finished ? double(deadlineMisses) / finished : 0.0;
+    }
+};
+
+using LogSummary = std::map<std::string, SourceSummary>;
+
+bool summarize(const std::vector<std::string>& paths, LogSummary& summary)
+{
+    std::vector<FrameLogEvent> events;
+    std::vector<std::string> sources;
+    for (const std::string& path : paths) {
+        std::uint64_t wallEpochNanos = 0;
+        std::string error;
+        if (!readFrameLog(path, events, sources, wallEpochNanos, error)) {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            if (events.empty())
+                return false;
+        }
+    }
+
+    // Request time of every rendered frame, so later stages can be measured from it
+    std::map<std::pair<std::uint32_t, std::uint64_t>, std::int64_t> requested;
+    for (const FrameLogEvent& event : events) {
+        if (event.kind == FrameEventKind::Rendered)
+            requested[std::make_pair(event.source, event.frameId)] = event.timeNanos;
+    }
+
+    for (const FrameLogEvent& event : events) {
+        std::string name = event.source < sources.size() ? sources[event.source] : "source " + std::to_string(event.source);
+        SourceSummary& s = summary[name];
+        if (s.framesRendered + s.framesPublished + s.framesPresented == 0)
+            s.firstNanos = s.lastNanos = event.timeNanos;
+        s.firstNanos = std::min(s.firstNanos, event.timeNanos);
+        s.lastNanos = std::max(s.lastNanos, event.timeNanos);
+
+        if (event.kind == FrameEventKind::Rendered) {
+            ++s.framesRendered;
+            s.bandsRendered += event.bandsRendered;
+            s.bandsSkipped += event.bandsSkipped;
+            if (event.flags & FrameEventFlag::Dropped)
+                ++s.framesDropped;
+            else
+                s.render->record(event.renderNanos);
+            if (event.flags & FrameEventFlag::DeadlineMiss)
+                ++s.deadlineMisses;
+            if (event.flags & FrameEventFlag::PredictedMiss)
+                ++s.predictedMisses;
+            if (event.flags & FrameEventFlag::Reconstructed)
+                ++s.framesReconstructed;
+            continue;
+        }
+
+        bool published = event.kind == FrameEventKind::Published;
+        ++(published ? s.framesPublished : s.framesPresented);
+        auto found = requested.find(std::make_pair(event.source, event.frameId));
+        if (found != requested.end() && event.timeNanos >= found->second)
+            (published ? s.publish : s.present)->record(static_cast<std::uint64_t>(event.timeNanos - found->second));
+    }
+    return true;
+}
+
+void printSummary(const LogSummary& summary)
+{
+    for (const auto& entry : summary) {
+        const SourceSummary& s = entry.second;
+        std::printf("%s: %.1f s, %.1f fps\n", entry.first.c_str(), s.seconds(), s.frameRate());
+        std::printf("  frames: %llu rendered, %llu dropped (%.1f%%), %llu published, %llu presented, %llu reconstructed\n",
+            (unsigned long long)s.framesRendered, (unsigned long long)s.framesDropped, s.dropRate() * 100.0,
+            (unsigned long long)s.framesPublished, (unsigned long long)s.framesPresented,
+            (unsigned long long)s.framesReconstructed);
+        std::printf("  deadline misses: %llu (%.1f%%, %llu predicted); bands: %llu rendered, %llu skipped\n",
+            (unsigned long long)s.deadlineMisses, s.missRate() * 100.0, (unsigned long long)s.predictedMisses,
+            (unsigned long long)s.bandsRendered, (unsigned long long)s.bandsSkipped);
+        std::fputs(s.render->report("request->rendered").c_str(), stdout);
+        std::fputs(s.publish->report("request->published").c_str(), stdout);
+        std::fputs(s.present->report("request->presented").c_str(), stdout);
+    }
+}
+
+void printDifference(const char* name, double a, double b, const char* unit)
+{
+    double change = a != 0.0 ? (b - a) / a * 100.0 : 0.0;
+    std::printf("  %-22s %10.3f %10.3f %+9.1f%%  %s\n", name, a, b, change, unit);
+}
+
+std::string joinPaths(const std::vector<std::string>& paths)
+{
+    std::string joined;
+    for (const std::string& path : paths)
+        joined += (joined.empty() ? "" : " ") + path;
+    return joined;
+}
+
+int diffLogs(const std::vector<std::string>& pathsA, const std::vector<std::string>& pathsB)
+{
+    LogSummary a;
+    LogSummary b;
+    if (!summarize(pathsA, a) || !summarize(pathsB, b))
+        return 1;
+    std::string nameA = joinPaths(pathsA);
+    std::string nameB = joinPaths(pathsB);
+
+    for (const auto& entry : a) {
+        auto other = b.find(entry.first);
+        if (other == b.end()) {
+            std::printf("%s: only in %s\n", entry.first.c_str(), nameA.c_str());
+            continue;
+        }
+        const SourceSummary& x = entry.second;
+        const SourceSummary& y = other->second;
+        std::printf("%s: %-22s %10s %10s %10s\n", entry.first.c_str(), "", "A", "B", "change");
+        printDifference("frame rate", x.frameRate(), y.frameRate(), "fps");
+        printDifference("drop rate", x.dropRate() * 100.0, y.dropRate() * 100.0, "%");
+        printDifference("deadline miss rate", x.missRate() * 100.0, y.missRate() * 100.0, "%");
+        printDifference("render mean", x.render->meanMs(), y.render->meanMs(), "ms");
+        printDifference("render p99", x.render->quantileMs(0.99), y.render->quantileMs(0.99), "ms");
+        printDifference("present mean", x.present->meanMs(), y.present->meanMs(), "ms");
+        printDifference("present p99", x.present->quantileMs(0.99), y.present->quantileMs(0.99), "ms");
+        double bandsX = x.framesRendered ? double(x.bandsRendered) / x.framesRendered : 0.0;
+        double bandsY = y.framesRendered ? double(y.bandsRendered) / y.framesRendered : 0.0;
+        printDifference("bands per frame", bandsX, bandsY, "");
+    }
+    for (const auto& entry : b) {
+        if (a.find(entry.first) == a.end())
+            std::printf("%s: only in %s\n", entry.first.c_str(), nameB.c_str());
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc >= 3 && std::strcmp(argv[1], "summary") == 0) {
+        LogSummary summary;
+        if (!summarize(std::vector<std::string>(argv + 2, argv + argc), summary))
+            return 1;
+        printSummary(summary);
+        return 0;
+    }
+    if (argc >= 4 && std::strcmp(argv[1], "diff") == 0) {
+        // Either one log per side, or each side's logs split by --
+        std::vector<std::string> arguments(argv + 2, argv + argc);
+        auto split = std::find(arguments.begin(), arguments.end(), std::string("--"));
+        if (split == arguments.end() && arguments.size() == 2)
+            return diffLogs({ arguments[0] }, { arguments[1] });
+        if (split != arguments.end() && split != arguments.begin() && split + 1 != arguments.end())
+            return diffLogs(std::vector<std::string>(arguments.begin(), split), std::vector<std::string>(split + 1, arguments.end()));
+    }
+
+    std::fprintf(stderr, "usage: %s summary <log> [more logs...]\n       %s diff <log A> <log B>\n       %s diff <logs A...> -- <logs B...>\n",
+        argv[0], argv[0], argv[0]);
+    return 1;
+}
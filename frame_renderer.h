@@ -0,0 +1,508 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "buffer_pool.h"
+#include "frame_arena.h"
+#include "frame_log.h"
+#include "sampling_profiler.h"
+#include "sharded_counter.h"
+#include "temporal_reconstruction.h"
+#include "worker_pool.h"
+
+// Weight of the newest frame in the learned per-source cost estimate
+constexpr double gCostEstimateWeight = 0.125;
+
+// Forward progress when frames cost more than the request interval: a newer
+// request never cancels a frame with at least this share of its bands done,
+// nor more than this many frames in a row
+constexpr double gCancelProgressLimit = 0.5;
+constexpr int gMaxConsecutiveCancels = 2;
+
+// Shared flag a frame job's workers poll between bands
+class CancellationToken
+{
+public:
+    CancellationToken()
+        : mCancelled(std::make_shared<std::atomic<bool>>(false))
+    {
+    }
+
+    void cancel() { mCancelled->store(true, std::memory_order_relaxed); }
+    bool isCancelled() const { return mCancelled->load(std::memory_order_relaxed); }
+
+private:
+    std::shared_ptr<std::atomic<bool>> mCancelled;
+};
+
+struct CancellationStats
+{
+    std::uint64_t framesRequested = 0;
+    std::uint64_t framesPublished = 0;
+    std::uint64_t framesCancelled = 0;
+    std::uint64_t framesKept = 0;      // Superseded, but left to finish for forward progress
+    std::uint64_t bandsRendered = 0;
+    std::uint64_t bandsSkipped = 0;
+    std::uint64_t wastedNanos = 0;     // Spent on bands of frames that were cancelled anyway
+    std::uint64_t reclaimedNanos = 0;  // Estimated from skipped bands at the average band cost
+};
+
+struct DeadlineStats
+{
+    std::uint64_t framesPublished = 0;
+    std::uint64_t deadlineMisses = 0;
+    std::uint64_t predictedMisses = 0;  // Already infeasible at request time by the cost estimate
+    std::uint64_t worstLatenessNanos = 0;
+    double estimatedCostNanos = 0.0;    // Learned CPU cost of one frame across all bands
+
+    double missRate() const { return framesPublished ? double(deadlineMisses) / framesPublished : 0.0; }
+};
+
+// Running totals kept alongside the stats above in lock-free counters, for
+// readers such as the metrics exporter that must not take the renderer lock
+struct RenderCounters
+{
+    ShardedCounter framesRequested;
+    ShardedCounter framesPublished;
+    ShardedCounter framesCancelled;
+    ShardedCounter framesFull;
+    ShardedCounter deadlineMisses;
+    ShardedCounter bandsRendered;
+    ShardedCounter bandsSkipped;
+    ShardedCounter bandNanos;
+};
+
+struct TemporalStats
+{
+    std::uint64_t framesFull = 0;
+    std::uint64_t framesReconstructed = 0;
+
+    double fullFraction() const
+    {
+        std::uint64_t total = framesFull + framesReconstructed;
+        return total ? double(framesFull) / total : 0.0;
+    }
+};
+
+// Splits each frame of one source into row bands on the worker pool, drawing
+// frame buffers from a per-source pool. Every
+// frame job carries its presentation deadline, which orders its bands against
+// other sources sharing the pool. Requesting a new frame cancels the one in
+// flight: its queued bands are skipped and its buffer goes back to the pool
+// as soon as the bands already running return. A frame that is mostly done,
+// or that follows gMaxConsecutiveCancels cancelled ones, is left to finish
+// instead, so frames that cost more than the request interval still get
+// published; a kept frame that finishes after a newer one is dropped.
+// cancelInFlight() cancels unconditionally. On a pool spread over several
+// NUMA nodes each node renders one contiguous range of bands, and buffers are
+// left for those workers to first-touch.
+//
+// In a temporal mode only half of each frame is shaded and the other half is
+// reconstructed from the last published frame, which is kept alive as history
+// until its successor is published. A frame renders in full when there is no
+// usable history: the mode was just enabled, the source reported a large
+// change through invalidateHistory(), or frames were skipped for longer than
+// gTemporalMaxFrameGap.
+class FrameRenderer
+{
+public:
+    using Clock = WorkerPool::Clock;
+    using ShadeFunction = std::function<void(std::size_t frameId, std::uint32_t* pixels, int firstRow, int lastRow)>;
+    using PublishFunction = std::function<void(std::size_t frameId, const std::vector<std::uint32_t>& pixels)>;
+    using TemporalShadeFunction = std::function<void(std::size_t frameId, TemporalMode mode, int parity, std::uint32_t* pixels, int firstRow, int lastRow)>;
+
+    FrameRenderer(
+        WorkerPool& pool,
+        int width,
+        int height,
+        int bandRows,
+        ShadeFunction shade,
+        PublishFunction publish,
+        const std::string& sourceName = "frame")
+        : mPool(pool)
+        , mWidth(width)
+        , mHeight(height)
+        , mBandRows(std::max(1, bandRows))
+        , mShade(shade)
+        , mPublish(publish)
+        , mSourceName(sourceName)
+        , mBuffers(static_cast<std::size_t>(width) * height, sourceName + ".buffers")
+    {
+        // Each node's workers render one range of bands and first-touch its pages
+        mBuffers.setFirstTouch(pool.nodeCount() > 1);
+    }
+
+    // Waits for this renderer's own bands only, so other work on the pool
+    // does not hold it up; not from one of its own bands
+    ~FrameRenderer()
+    {
+        cancelInFlight();
+        std::unique_lock<std::mutex> lock(mBandsMutex);
+        mBandsDone.wait(lock, [this] { return mBandsOutstanding == 0; });
+    }
+
+    const std::string& sourceName() const { return mSourceName; }
+
+    const RenderCounters& counters() const { return mCounters; }
+    const FrameBufferPool& buffers() const { return mBuffers; }
+
+    // Allocate frame buffers ahead of the first request
+    void prewarm(std::size_t bufferCount) { mBuffers.prewarm(bufferCount); }
+
+    // Shade half of each frame with shadeTemporal and reconstruct the rest;
+    // must be set up before the first request
+    void setTemporalMode(TemporalMode mode, TemporalShadeFunction shadeTemporal = nullptr)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mTemporalMode = shadeTemporal ? mode : TemporalMode::Full;
+        mShadeTemporal = shadeTemporal;
+        mHistory.reset();
+    }
+
+    // Log a rendered or dropped event per frame; must be set up before the first request
+    void setFrameLog(FrameLog* log)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mFrameLog = log;
+        if (log)
+            mFrameLogSource = log->registerSource(mSourceName);
+    }
+
+    // Source id of this renderer in its frame log
+    std::uint32_t frameLogSource() const { return mFrameLogSource; }
+
+    // The source changed too much for the last frame to serve as history;
+    // the next frame renders in full
+    void invalidateHistory()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mHistory.reset();
+    }
+
+    // Start rendering a frame due as soon as possible
+    void requestFrame(std::size_t frameId) { requestFrame(frameId, Clock::now()); }
+
+    // Start rendering a frame due for presentation at the deadline,
+    // superseding whatever is still in flight
+    void requestFrame(std::size_t frameId, Clock::time_point deadline)
+    {
+        std::shared_ptr<FrameJob> job = std::make_shared<FrameJob>(*this, frameId);
+        job->requested = Clock::now();
+        job->deadline = deadline;
+        int bandCount = (mHeight + mBandRows - 1) / mBandRows;
+        job->bandCount = bandCount;
+        job->pendingBands.store(bandCount);
+        {
+            std::lock_guard<std::mutex> lock(mBandsMutex);
+            mBandsOutstanding += bandCount;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (mInFlight)
+                supersede(mInFlight);
+            mInFlight = job;
+            ++mStats.framesRequested;
+            mCounters.framesRequested.add();
+
+            if (mHistory && mTemporalMode != TemporalMode::Full && frameId > mHistory->frameId
+                && frameId - mHistory->frameId <= gTemporalMaxFrameGap) {
+                job->temporal = mTemporalMode;
+                job->parity = mHistory->parity ^ 1;
+                job->history = mHistory;
+            }
+
+            // Bands spread over the pool, so the wall-clock estimate is the cost per thread
+            auto estimatedWall = std::chrono::nanoseconds(
+                static_cast<std::int64_t>(mDeadlineStats.estimatedCostNanos / mPool.threadCount()));
+            job->predictedMiss = Clock::now() + estimatedWall > deadline;
+        }
+
+        std::vector<WorkerPool::Task> bands;
+        std::vector<std::size_t> nodes;
+        bands.reserve(bandCount);
+        for (int band = 0; band < bandCount; ++band) {
+            int firstRow = band * mBandRows;
+            int lastRow = std::min(mHeight, firstRow + mBandRows);
+            bands.push_back([this, job, firstRow, lastRow]() mutable { renderBand(std::move(job), firstRow, lastRow); });
+            if (mPool.nodeCount() > 1)
+                nodes.push_back(numaNodeForBand(band, bandCount, mPool.nodeCount()));
+        }
+        mPool.submitBatch(std::move(bands), deadline, nodes);
+    }
+
+    // Cancel the frame in flight and any kept ones, for a resize or shutdown
+    void cancelInFlight()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mInFlight)
+            mInFlight->token.cancel();
+        mInFlight.reset();
+        for (const std::weak_ptr<FrameJob>& kept : mKept) {
+            if (std::shared_ptr<FrameJob> job = kept.lock())
+                job->token.cancel();
+        }
+        mKept.clear();
+    }
+
+    CancellationStats stats() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mStats;
+    }
+
+    DeadlineStats deadlineStats() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mDeadlineStats;
+    }
+
+    TemporalStats temporalStats() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mTemporalStats;
+    }
+
+    std::string statsReport() const
+    {
+        CancellationStats s = stats();
+        DeadlineStats d = deadlineStats();
+        TemporalStats t = temporalStats();
+        char text[512];
+        std::snprintf(text, sizeof(text),
+            "%s: deadline misses %llu of %llu (%.1f%%, %llu predicted, worst %.2f ms late), cost %.2f ms; "
+            "frames: %llu requested, %llu published, %llu cancelled, %llu kept; bands: %llu rendered, %llu skipped; "
+            "cpu: %.1f ms wasted, %.1f ms reclaimed\n",
+            mSourceName.c_str(), (unsigned long long)d.deadlineMisses, (unsigned long long)d.framesPublished,
+            d.missRate() * 100.0, (unsigned long long)d.predictedMisses, d.worstLatenessNanos / 1e6,
+            d.estimatedCostNanos / 1e6,
+            (unsigned long long)s.framesRequested, (unsigned long long)s.framesPublished,
+            (unsigned long long)s.framesCancelled, (unsigned long long)s.framesKept, (unsigned long long)s.bandsRendered,
+            (unsigned long long)s.bandsSkipped, s.wastedNanos / 1e6, s.reclaimedNanos / 1e6);
+        std::string report = text;
+        if (t.framesReconstructed) {
+            std::snprintf(text, sizeof(text), "%s: temporal: %.1f%% of %llu frames rendered in full\n",
+                mSourceName.c_str(), t.fullFraction() * 100.0,
+                (unsigned long long)(t.framesFull + t.framesReconstructed));
+            report += text;
+        }
+        return report;
+    }
+
+private:
+    struct FrameJob
+    {
+        FrameJob(FrameRenderer& renderer, std::size_t frameId)
+            : renderer(renderer)
+            , frameId(frameId)
+            , pixels(renderer.mBuffers.acquire())
+        {
+        }
+
+        ~FrameJob()
+        {
+            renderer.mBuffers.recycle(std::move(pixels));
+        }
+
+        FrameRenderer& renderer;
+        std::size_t frameId;
+        std::vector<std::uint32_t> pixels;
+        Clock::time_point requested;
+        Clock::time_point deadline;
+        bool predictedMiss = false;
+        TemporalMode temporal = TemporalMode::Full;
+        int parity = 0;
+        std::shared_ptr<const FrameJob> history;  // Previous published frame, dropped once this one finishes
+        CancellationToken token;
+        int bandCount = 0;
+        std::atomic<int> pendingBands{0};
+        std::atomic<std::uint64_t> renderedBands{0};
+        std::atomic<std::uint64_t> skippedBands{0};
+        std::atomic<std::uint64_t> spentNanos{0};
+    };
+
+    // Caller holds mMutex
+    void supersede(const std::shared_ptr<FrameJob>& job)
+    {
+        int done = job->bandCount - job->pendingBands.load();
+        if (mConsecutiveCancels < gMaxConsecutiveCancels && done < job->bandCount * gCancelProgressLimit) {
+            job->token.cancel();
+            ++mConsecutiveCancels;
+            return;
+        }
+        ++mStats.framesKept;
+        mConsecutiveCancels = 0;
+        mKept.erase(std::remove_if(mKept.begin(), mKept.end(), [](const std::weak_ptr<FrameJob>& kept) { return kept.expired(); }),
+            mKept.end());
+        mKept.push_back(job);
+    }
+
+    // Takes the task's reference to the job, so the job is gone before the
+    // band counts as done and the destructor may return
+    void renderBand(std::shared_ptr<FrameJob> job, int firstRow, int lastRow)
+    {
+        if (job->token.isCancelled()) {
+            ++job->skippedBands;
+            mCounters.bandsSkipped.add();
+        } else {
+            // Band kernels take their scratch from this thread's arena
+            FrameArenaScope scratch(threadFrameArena());
+            auto start = std::chrono::steady_clock::now();
+            if (job->temporal == TemporalMode::Full) {
+                ProfileStageScope stage("shade");
+                mShade(job->frameId, job->pixels.data(), firstRow, lastRow);
+            } else {
+                ProfileStageScope stage("shade.temporal");
+                mShadeTemporal(job->frameId, job->temporal, job->parity, job->pixels.data(), firstRow, lastRow);
+                ProfileStageScope reconstruct("reconstruct");
+                reconstructRows(job->pixels.data(), job->history->pixels.data(), mWidth, firstRow, lastRow, job->temporal, job->parity);
+            }
+            auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+            job->spentNanos += static_cast<std::uint64_t>(elapsed.count());
+            ++job->renderedBands;
+            mCounters.bandsRendered.add();
+            mCounters.bandNanos.add(static_cast<std::uint64_t>(elapsed.count()));
+        }
+
+        if (job->pendingBands.fetch_sub(1) == 1)
+            finishJob(job);
+        job.reset();
+
+        std::lock_guard<std::mutex> lock(mBandsMutex);
+        if (--mBandsOutstanding == 0)
+            mBandsDone.notify_all();
+    }
+
+    void finishJob(const std::shared_ptr<FrameJob>& finished)
+    {
+        FrameJob& job = *finished;
+        job.history.reset();
+        bool cancelled = job.token.isCancelled();
+        Clock::time_point finishedAt = Clock::now();
+
+        // Held from the order check through the publish, so a kept frame
+        // overtaken by a newer one is dropped rather than shown out of order
+        std::unique_lock<std::mutex> publishing(mPublishMutex, std::defer_lock);
+        if (!cancelled)
+            publishing.lock();
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (!cancelled && mPublishedAny && job.frameId <= mLastPublishedId)
+                cancelled = true;
+            mStats.bandsRendered += job.renderedBands;
+            mStats.bandsSkipped += job.skippedBands;
+            mTotalBandNanos += job.spentNanos;
+            if (cancelled) {
+                ++mStats.framesCancelled;
+                mCounters.framesCancelled.add();
+                mStats.wastedNanos += job.spentNanos;
+            } else {
+                ++mStats.framesPublished;
+                mCounters.framesPublished.add();
+                mPublishedAny = true;
+                mLastPublishedId = job.frameId;
+                mConsecutiveCancels = 0;
+                recordDeadline(job, finishedAt);
+                if (job.temporal == TemporalMode::Full) {
+                    ++mTemporalStats.framesFull;
+                    mCounters.framesFull.add();
+                } else {
+                    ++mTemporalStats.framesReconstructed;
+                }
+                if (mTemporalMode != TemporalMode::Full)
+                    mHistory = finished;
+            }
+            if (mStats.bandsRendered > 0)
+                mStats.reclaimedNanos += job.skippedBands * (mTotalBandNanos / mStats.bandsRendered);
+            if (mInFlight.get() == &job)
+                mInFlight.reset();
+        }
+
+        if (mFrameLog) {
+            std::uint8_t flags = 0;
+            if (cancelled)
+                flags |= FrameEventFlag::Dropped;
+            else if (finishedAt > job.deadline)
+                flags |= FrameEventFlag::DeadlineMiss;
+            if (job.predictedMiss)
+                flags |= FrameEventFlag::PredictedMiss;
+            if (job.temporal != TemporalMode::Full)
+                flags |= FrameEventFlag::Reconstructed;
+            mFrameLog->rendered(mFrameLogSource, job.frameId, job.requested, finishedAt, job.deadline, flags,
+                static_cast<std::uint32_t>(job.renderedBands), static_cast<std::uint32_t>(job.skippedBands));
+        }
+
+        if (!cancelled) {
+            ProfileStageScope stage("publish");
+            mPublish(job.frameId, job.pixels);
+        }
+    }
+
+    // Caller holds mMutex
+    void recordDeadline(const FrameJob& job, Clock::time_point finished)
+    {
+        DeadlineStats& d = mDeadlineStats;
+        ++d.framesPublished;
+        if (job.predictedMiss)
+            ++d.predictedMisses;
+        if (finished > job.deadline) {
+            ++d.deadlineMisses;
+            mCounters.deadlineMisses.add();
+            auto lateness = std::chrono::duration_cast<std::chrono::nanoseconds>(finished - job.deadline);
+            d.worstLatenessNanos = std::max(d.worstLatenessNanos, static_cast<std::uint64_t>(lateness.count()));
+        }
+
+        // Exponentially weighted history of the whole-frame CPU cost
+        double cost = static_cast<double>(job.spentNanos);
+        if (d.estimatedCostNanos == 0.0)
+            d.estimatedCostNanos = cost;
+        else
+            d.estimatedCostNanos += (cost - d.estimatedCostNanos) * gCostEstimateWeight;
+    }
+
+    WorkerPool& mPool;
+    int mWidth;
+    int mHeight;
+    int mBandRows;
+    ShadeFunction mShade;
+    PublishFunction mPublish;
+    std::string mSourceName;
+    FrameBufferPool mBuffers;
+
+    // Serializes publishing; taken before mMutex
+    std::mutex mPublishMutex;
+
+    mutable std::mutex mMutex;
+    std::shared_ptr<FrameJob> mInFlight;
+    std::vector<std::weak_ptr<FrameJob>> mKept;  // Superseded frames left to finish
+    int mConsecutiveCancels = 0;
+    bool mPublishedAny = false;
+    std::size_t mLastPublishedId = 0;
+    CancellationStats mStats;
+    DeadlineStats mDeadlineStats;
+    RenderCounters mCounters;
+    std::uint64_t mTotalBandNanos = 0;
+
+    TemporalMode mTemporalMode = TemporalMode::Full;
+    TemporalShadeFunction mShadeTemporal;
+    std::shared_ptr<const FrameJob> mHistory;
+    TemporalStats mTemporalStats;
+
+    FrameLog* mFrameLog = nullptr;
+    std::uint32_t mFrameLogSource = 0;
+
+    // Bands submitted and not yet returned, which the destructor waits for
+    std::mutex mBandsMutex;
+    std::condition_variable mBandsDone;
+    std::size_t mBandsOutstanding = 0;
+};
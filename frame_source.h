@@ -0,0 +1,434 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FRAME_SOURCE_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FRAME_SOURCE_NEON 1
+#endif
+
+#include "frame_arena.h"
+#include "image_view.h"
+#include "temporal_reconstruction.h"
+
+enum class ShadingMode
+{
+    Double,      // Reference path, libm in double precision
+    FixedPoint,  // Integer-only, bit-identical on every platform
+    Adaptive,    // Coarse grid, interpolating smooth blocks within an error budget
+};
+
+// Block size of the adaptive path's coarse grid and its default error budget in LSB
+constexpr int gCoarseBlockSize = 4;
+constexpr int gDefaultAdaptiveErrorBudget = 1;
+
+// Shade one pixel of the animated gradient
+inline std::uint32_t shadeAnimationPixel(int x, int y, int width, int height, double timeFactor)
+{
+    std::uint8_t r = static_cast<std::uint8_t>((std::cos((double)x / width + timeFactor) * 0.5 + 0.5) * 255);
+    std::uint8_t g = static_cast<std::uint8_t>((std::sin((double)y / height + timeFactor) * 0.5 + 0.5) * 255);
+    std::uint8_t b = static_cast<std::uint8_t>((std::cos((double)(x + y) / (width + height) + timeFactor) * 0.5 + 0.5) * 255);
+    std::uint8_t a = 255;
+
+    // ARGB format (macOS expects premultiplied alpha)
+    return (static_cast<std::uint32_t>(a) << 24) | (r << 16) | (g << 8) | b;
+}
+
+// Shade the part of the animated gradient that target covers; every
+// kernel below takes a view and the region of the frame it lies at
+inline void shadeAnimation(ArgbView target, const FrameRegion& region, std::size_t frameId, double frameTime)
+{
+    double timeFactor = frameId * frameTime;
+    for (int y = 0; y < target.height(); ++y) {
+        std::uint32_t* row = target.row(y);
+        for (int x = 0; x < target.width(); ++x)
+            row[x] = shadeAnimationPixel(region.x + x, region.y + y, region.frameWidth, region.frameHeight, timeFactor);
+    }
+}
+
+// Shade rows [firstRow, lastRow) of the animated gradient into a width-wide ARGB buffer
+inline void shadeAnimationRows(
+    std::uint32_t* pixels,
+    int width,
+    int height,
+    std::size_t frameId,
+    double frameTime,
+    int firstRow,
+    int lastRow)
+{
+    shadeAnimation(ArgbView(pixels, width, height).rows(firstRow, lastRow), frameRows(width, height, firstRow), frameId, frameTime);
+}
+
+// Quarter-wave sine table: sin(i / 256 * pi / 2) in Q15, 32768 = 1.0. Kept as
+// literals so the fixed-point path does not depend on the platform's libm.
+constexpr std::int32_t gQuarterSineTable[257] = {
+    0, 201, 402, 603, 804, 1005, 1206, 1407, 1608, 1809, 2009, 2210,
+    2411, 2611, 2811, 3012, 3212, 3412, 3612, 3812, 4011, 4211, 4410, 4609,
+    4808, 5007, 5205, 5404, 5602, 5800, 5998, 6195, 6393, 6590, 6787, 6983,
+    7180, 7376, 7571, 7767, 7962, 8157, 8351, 8546, 8740, 8933, 9127, 9319,
+    9512, 9704, 9896, 10088, 10279, 10469, 10660, 10850, 11039, 11228, 11417, 11605,
+    11793, 11980, 12167, 12354, 12540, 12725, 12910, 13095, 13279, 13463, 13646, 13828,
+    14010, 14192, 14373, 14553, 14733, 14912, 15091, 15269, 15447, 15624, 15800, 15976,
+    16151, 16326, 16500, 16673, 16846, 17018, 17190, 17361, 17531, 17700, 17869, 18037,
+    18205, 18372, 18538, 18703, 18868, 19032, 19195, 19358, 19520, 19681, 19841, 20001,
+    20160, 20318, 20475, 20632, 20788, 20943, 21097, 21251, 21403, 21555, 21706, 21856,
+    22006, 22154, 22302, 22449, 22595, 22740, 22884, 23028, 23170, 23312, 23453, 23593,
+    23732, 23870, 24008, 24144, 24279, 24414, 24548, 24680, 24812, 24943, 25073, 25202,
+    25330, 25457, 25583, 25708, 25833, 25956, 26078, 26199, 26320, 26439, 26557, 26674,
+    26791, 26906, 27020, 27133, 27246, 27357, 27467, 27576, 27684, 27791, 27897, 28002,
+    28106, 28209, 28311, 28411, 28511, 28610, 28707, 28803, 28899, 28993, 29086, 29178,
+    29269, 29359, 29448, 29535, 29622, 29707, 29792, 29875, 29957, 30038, 30118, 30196,
+    30274, 30350, 30425, 30499, 30572, 30644, 30715, 30784, 30853, 30920, 30986, 31050,
+    31114, 31177, 31238, 31298, 31357, 31415, 31471, 31527, 31581, 31634, 31686, 31737,
+    31786, 31834, 31881, 31927, 31972, 32015, 32058, 32099, 32138, 32177, 32214, 32251,
+    32286, 32319, 32352, 32383, 32413, 32442, 32470, 32496, 32522, 32546, 32568, 32590,
+    32610, 32629, 32647, 32664, 32679, 32693, 32706, 32718, 32729, 32738, 32746, 32753,
+    32758, 32762, 32766, 32767, 32768,
+};
+
+// Sine of a phase given as a 32-bit fraction of a full turn, Q15 result.
+// The top two bits pick the quadrant, the next eight the table entry, and
+// eight more interpolate linearly between entries.
+inline std::int32_t fixedSin(std::uint32_t phase)
+{
+    std::uint32_t quadrant = phase >> 30;
+    std::uint32_t offset = (phase >> 14) & 0xFFFF;
+    if (quadrant & 1)
+        offset = 0x10000 - offset;
+
+    std::uint32_t index = offset >> 8;
+    std::int32_t value = gQuarterSineTable[index];
+    if (index < 256) {
+        std::int32_t fraction = static_cast<std::int32_t>(offset & 0xFF);
+        value += ((gQuarterSineTable[index + 1] - value) * fraction + 128) >> 8;
+    }
+    return (quadrant & 2) ? -value : value;
+}
+
+inline std::uint32_t fixedCosPhase(std::uint32_t phase) { return phase + 0x40000000u; }
+
+// (sin * 0.5 + 0.5) * 255 in integers
+inline std::uint8_t fixedChannel(std::int32_t sineQ15)
+{
+    return static_cast<std::uint8_t>(((sineQ15 + 32768) * 255) >> 16);
+}
+
+// Phase increment, in 2^32 units per turn, for an angle step in radians
+inline std::uint32_t fixedPhaseStep(double radians)
+{
+    const double turn = 2.0 * 3.14159265358979323846;
+    double step = std::floor(radians / turn * 4294967296.0 + 0.5);
+    return static_cast<std::uint32_t>(static_cast<std::uint64_t>(step) & 0xFFFFFFFFu);
+}
+
+// Interleave one row of channel values into ARGB words, 16 pixels per step
+inline void packArgbRow(
+    std::uint32_t* row,
+    const std::uint8_t* red,
+    std::uint8_t green,
+    const std::uint8_t* blue,
+    int width)
+{
+    int x = 0;
+#if defined(FRAME_SOURCE_SSE2)
+    const __m128i g = _mm_set1_epi8(static_cast<char>(green));
+    const __m128i a = _mm_set1_epi8(static_cast<char>(0xFF));
+    for (; x + 16 <= width; x += 16) {
+        __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(red + x));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(blue + x));
+        __m128i bgLow = _mm_unpacklo_epi8(b, g);
+        __m128i bgHigh = _mm_unpackhi_epi8(b, g);
+        __m128i raLow = _mm_unpacklo_epi8(r, a);
+        __m128i raHigh = _mm_unpackhi_epi8(r, a);
+        __m128i* out = reinterpret_cast<__m128i*>(row + x);
+        _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(bgLow, raLow));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(bgLow, raLow));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(bgHigh, raHigh));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(bgHigh, raHigh));
+    }
+#elif defined(FRAME_SOURCE_NEON)
+    uint8x16x4_t bgra;
+    bgra.val[1] = vdupq_n_u8(green);
+    bgra.val[3] = vdupq_n_u8(0xFF);
+    for (; x + 16 <= width; x += 16) {
+        bgra.val[0] = vld1q_u8(blue + x);
+        bgra.val[2] = vld1q_u8(red + x);
+        vst4q_u8(reinterpret_cast<std::uint8_t*>(row + x), bgra);
+    }
+#endif
+    for (; x < width; ++x)
+        row[x] = 0xFF000000u | (static_cast<std::uint32_t>(red[x]) << 16) | (static_cast<std::uint32_t>(green) << 8) | blue[x];
+}
+
+// Integer-only version of shadeAnimation. All three channels are sines of a
+// phase that is linear in x, y or x + y, so each view first evaluates them
+// once per column, row and diagonal into scratch tables and then only packs
+// bytes per pixel. Matches the double path within one LSB.
+inline void shadeAnimationFixed(ArgbView target, const FrameRegion& region, std::size_t frameId, double frameTime)
+{
+    if (target.empty())
+        return;
+    int width = target.width();
+    int rows = target.height();
+
+    // Phase of the time term, wrapped to a turn; frame ids wrap modulo 2^32 as well
+    std::uint32_t timePhase = static_cast<std::uint32_t>(frameId) * fixedPhaseStep(frameTime);
+    std::uint32_t redStep = fixedPhaseStep(1.0 / region.frameWidth);
+    std::uint32_t greenStep = fixedPhaseStep(1.0 / region.frameHeight);
+    std::uint32_t blueStep = fixedPhaseStep(1.0 / (region.frameWidth + region.frameHeight));
+
+    FrameArenaScope scratch(threadFrameArena());
+    std::uint8_t* red = threadFrameArena().allocateArray<std::uint8_t>(width);
+    int diagonalCount = width + rows;
+    std::uint8_t* blue = threadFrameArena().allocateArray<std::uint8_t>(diagonalCount);
+
+    for (int x = 0; x < width; ++x)
+        red[x] = fixedChannel(fixedSin(fixedCosPhase(timePhase + static_cast<std::uint32_t>(region.x + x) * redStep)));
+    for (int d = 0; d < diagonalCount; ++d) {
+        std::uint32_t diagonal = static_cast<std::uint32_t>(region.x + region.y + d);
+        blue[d] = fixedChannel(fixedSin(fixedCosPhase(timePhase + diagonal * blueStep)));
+    }
+
+    for (int y = 0; y < rows; ++y) {
+        std::uint8_t green = fixedChannel(fixedSin(timePhase + static_cast<std::uint32_t>(region.y + y) * greenStep));
+        packArgbRow(target.row(y), red, green, blue + y, width);
+    }
+}
+
+inline void shadeAnimationRowsFixed(
+    std::uint32_t* pixels,
+    int width,
+    int height,
+    std::size_t frameId,
+    double frameTime,
+    int firstRow,
+    int lastRow)
+{
+    shadeAnimationFixed(ArgbView(pixels, width, height).rows(firstRow, lastRow), frameRows(width, height, firstRow), frameId, frameTime);
+}
+
+// Largest per-channel difference between two ARGB pixels
+inline int argbDistance(std::uint32_t a, std::uint32_t b)
+{
+    int worst = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        int difference = static_cast<int>((a >> shift) & 0xFF) - static_cast<int>((b >> shift) & 0xFF);
+        if (difference < 0)
+            difference = -difference;
+        if (difference > worst)
+            worst = difference;
+    }
+    return worst;
+}
+
+// ARGB spread into four 16-bit lanes, so all channels blend in one multiply-add
+inline std::uint64_t expandArgb(std::uint32_t pixel)
+{
+    std::uint64_t value = pixel;
+    return (value & 0xFF) | ((value & 0xFF00) << 8) | ((value & 0xFF0000) << 16) | ((value & 0xFF000000) << 24);
+}
+
+inline std::uint32_t compactArgb(std::uint64_t lanes)
+{
+    return static_cast<std::uint32_t>((lanes & 0xFF) | ((lanes >> 8) & 0xFF00) | ((lanes >> 16) & 0xFF0000) | ((lanes >> 24) & 0xFF000000));
+}
+
+// Bilinear blend of four expanded corners with weights in 1/gCoarseBlockSize
+// steps; lane sums stay below 2^12, so lanes never carry into each other
+inline std::uint32_t blendExpanded(std::uint64_t e00, std::uint64_t e10, std::uint64_t e01, std::uint64_t e11, int fx, int fy)
+{
+    static_assert(gCoarseBlockSize == 4, "the final shift divides by gCoarseBlockSize squared");
+    const std::uint64_t n = gCoarseBlockSize;
+    const std::uint64_t rounding = (n * n / 2) * 0x0001000100010001ull;
+    std::uint64_t sum = e00 * ((n - fx) * (n - fy)) + e10 * (fx * (n - fy)) + e01 * ((n - fx) * fy) + e11 * (fx * fy) + rounding;
+    return compactArgb((sum >> 4) & 0x00FF00FF00FF00FFull);
+}
+
+inline std::uint32_t blendArgb(std::uint32_t c00, std::uint32_t c10, std::uint32_t c01, std::uint32_t c11, int fx, int fy)
+{
+    return blendExpanded(expandArgb(c00), expandArgb(c10), expandArgb(c01), expandArgb(c11), fx, fy);
+}
+
+struct AdaptiveShadingStats
+{
+    std::uint64_t blocksInterpolated = 0;
+    std::uint64_t blocksShaded = 0;
+};
+
+// Adaptive version of shadeAnimation. Shades the corners of every
+// gCoarseBlockSize square block plus one probe at its centre; when the probe
+// is within errorBudget LSB of the corners' bilinear estimate the block is
+// interpolated, otherwise every pixel in it is shaded. The grid starts at the
+// view's top-left pixel; grid points on its right and bottom edges may fall
+// just outside the view and are shaded there.
+inline void shadeAnimationAdaptive(
+    ArgbView target,
+    const FrameRegion& region,
+    std::size_t frameId,
+    double frameTime,
+    int errorBudget,
+    AdaptiveShadingStats* stats = nullptr)
+{
+    if (target.empty())
+        return;
+    const int n = gCoarseBlockSize;
+    int width = target.width();
+    int height = target.height();
+    double timeFactor = frameId * frameTime;
+    int gridColumns = (width + n - 1) / n + 1;
+    auto shade = [&](int x, int y) {
+        return shadeAnimationPixel(region.x + x, region.y + y, region.frameWidth, region.frameHeight, timeFactor);
+    };
+
+    FrameArenaScope scratch(threadFrameArena());
+    std::uint32_t* top = threadFrameArena().allocateArray<std::uint32_t>(gridColumns);
+    std::uint32_t* bottom = threadFrameArena().allocateArray<std::uint32_t>(gridColumns);
+    for (int gx = 0; gx < gridColumns; ++gx)
+        top[gx] = shade(gx * n, 0);
+
+    AdaptiveShadingStats local;
+    for (int y0 = 0; y0 < height; y0 += n) {
+        int rows = height - y0 < n ? height - y0 : n;
+        for (int gx = 0; gx < gridColumns; ++gx)
+            bottom[gx] = shade(gx * n, y0 + n);
+
+        for (int gx = 0; gx + 1 < gridColumns; ++gx) {
+            int x0 = gx * n;
+            int columns = width - x0 < n ? width - x0 : n;
+            std::uint32_t probe = shade(x0 + n / 2, y0 + n / 2);
+            std::uint32_t estimate = blendArgb(top[gx], top[gx + 1], bottom[gx], bottom[gx + 1], n / 2, n / 2);
+
+            if (argbDistance(probe, estimate) <= errorBudget) {
+                std::uint64_t e00 = expandArgb(top[gx]);
+                std::uint64_t e10 = expandArgb(top[gx + 1]);
+                std::uint64_t e01 = expandArgb(bottom[gx]);
+                std::uint64_t e11 = expandArgb(bottom[gx + 1]);
+                for (int dy = 0; dy < rows; ++dy) {
+                    std::uint32_t* row = target.row(y0 + dy) + x0;
+                    for (int dx = 0; dx < columns; ++dx)
+                        row[dx] = blendExpanded(e00, e10, e01, e11, dx, dy);
+                }
+                ++local.blocksInterpolated;
+            } else {
+                for (int dy = 0; dy < rows; ++dy) {
+                    std::uint32_t* row = target.row(y0 + dy) + x0;
+                    for (int dx = 0; dx < columns; ++dx)
+                        row[dx] = shade(x0 + dx, y0 + dy);
+                }
+                ++local.blocksShaded;
+            }
+        }
+
+        std::uint32_t* swap = top;
+        top = bottom;
+        bottom = swap;
+    }
+
+    if (stats) {
+        stats->blocksInterpolated += local.blocksInterpolated;
+        stats->blocksShaded += local.blocksShaded;
+    }
+}
+
+inline void shadeAnimationRowsAdaptive(
+    std::uint32_t* pixels,
+    int width,
+    int height,
+    std::size_t frameId,
+    double frameTime,
+    int firstRow,
+    int lastRow,
+    int errorBudget,
+    AdaptiveShadingStats* stats = nullptr)
+{
+    shadeAnimationAdaptive(ArgbView(pixels, width, height).rows(firstRow, lastRow), frameRows(width, height, firstRow),
+        frameId, frameTime, errorBudget, stats);
+}
+
+inline void shadeAnimation(
+    ShadingMode mode,
+    ArgbView target,
+    const FrameRegion& region,
+    std::size_t frameId,
+    double frameTime,
+    int errorBudget = gDefaultAdaptiveErrorBudget)
+{
+    if (mode == ShadingMode::FixedPoint)
+        shadeAnimationFixed(target, region, frameId, frameTime);
+    else if (mode == ShadingMode::Adaptive)
+        shadeAnimationAdaptive(target, region, frameId, frameTime, errorBudget);
+    else
+        shadeAnimation(target, region, frameId, frameTime);
+}
+
+inline void shadeAnimationRows(
+    ShadingMode mode,
+    std::uint32_t* pixels,
+    int width,
+    int height,
+    std::size_t frameId,
+    double frameTime,
+    int firstRow,
+    int lastRow,
+    int errorBudget = gDefaultAdaptiveErrorBudget)
+{
+    shadeAnimation(mode, ArgbView(pixels, width, height).rows(firstRow, lastRow), frameRows(width, height, firstRow),
+        frameId, frameTime, errorBudget);
+}
+
+// Shade only the pixels a temporal mode shades this frame; the rest are left
+// for reconstructView. Parity is that of frame coordinates, not view ones.
+// Interlaced rows go through the selected shading path. Checkerboard pixels
+// are shaded one by one with the double kernel, since the other paths share
+// their work across whole rows.
+inline void shadeAnimationTemporal(
+    ShadingMode mode,
+    TemporalMode temporal,
+    int parity,
+    ArgbView target,
+    const FrameRegion& region,
+    std::size_t frameId,
+    double frameTime,
+    int errorBudget = gDefaultAdaptiveErrorBudget)
+{
+    if (temporal == TemporalMode::Interlaced) {
+        for (int y = 0; y < target.height(); ++y) {
+            if (((region.y + y) & 1) == parity) {
+                FrameRegion row = { region.frameWidth, region.frameHeight, region.x, region.y + y };
+                shadeAnimation(mode, target.rows(y, y + 1), row, frameId, frameTime, errorBudget);
+            }
+        }
+    } else if (temporal == TemporalMode::Checkerboard) {
+        double timeFactor = frameId * frameTime;
+        for (int y = 0; y < target.height(); ++y) {
+            std::uint32_t* row = target.row(y);
+            int frameY = region.y + y;
+            for (int x = (parity + frameY + region.x) & 1; x < target.width(); x += 2)
+                row[x] = shadeAnimationPixel(region.x + x, frameY, region.frameWidth, region.frameHeight, timeFactor);
+        }
+    } else {
+        shadeAnimation(mode, target, region, frameId, frameTime, errorBudget);
+    }
+}
+
+inline void shadeAnimationRowsTemporal(
+    ShadingMode mode,
+    TemporalMode temporal,
+    int parity,
+    std::uint32_t* pixels,
+    int width,
+    int height,
+    std::size_t frameId,
+    double frameTime,
+    int firstRow,
+    int lastRow,
+    int errorBudget = gDefaultAdaptiveErrorBudget)
+{
+    shadeAnimationTemporal(mode, temporal, parity, ArgbView(pixels, width, height).rows(firstRow, lastRow),
+        frameRows(width, height, firstRow), frameId, frameTime, errorBudget);
+}
@@ -0,0 +1,364 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#define HDR_FRAME_F16C 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HDR_FRAME_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+// Half conversions are only part of NEON from ARMv8 on
+#include <arm_neon.h>
+#define HDR_FRAME_NEON 1
+#endif
+
+#include "color_space.h"
+#include "frame_arena.h"
+#include "image_view.h"
+
+// Optional HDR working format: four IEEE half floats per pixel in R, G, B, A
+// order, linear light, unbounded above. Twice the bytes of ARGB, but stages
+// keep highlights above 1.0 and never requantize to 8 bits.
+constexpr int gHdrChannels = 4;
+constexpr std::size_t gHdrPixelBytes = gHdrChannels * sizeof(std::uint16_t);
+
+struct HdrPixel
+{
+    std::uint16_t r;
+    std::uint16_t g;
+    std::uint16_t b;
+    std::uint16_t a;
+};
+static_assert(sizeof(HdrPixel) == gHdrPixelBytes, "HDR pixels are four packed halves");
+
+using HdrView = ImageView<HdrPixel>;
+using ConstHdrView = ImageView<const HdrPixel>;
+
+// Rows of HDR pixels as the flat half arrays the conversion kernels take
+inline std::uint16_t* hdrHalves(HdrPixel* row) { return reinterpret_cast<std::uint16_t*>(row); }
+inline const std::uint16_t* hdrHalves(const HdrPixel* row) { return reinterpret_cast<const std::uint16_t*>(row); }
+
+// Brightest value the HDR gradient reaches, in multiples of display white
+constexpr float gHdrDefaultPeak = 4.0f;
+
+// Largest finite half; tone mapping clamps to it first, so infinities map to white
+constexpr float gHdrMaxValue = 65504.0f;
+
+enum class ToneMapOperator
+{
+    Clamp,     // No curve, values above 1.0 clip
+    Reinhard,  // x / (1 + x)
+    Aces,      // Narkowicz's fit of the ACES filmic curve
+};
+
+// Scalar conversions, rounding to nearest even like the hardware ones;
+// only NaN payloads may differ
+inline std::uint16_t floatToHalf(float value)
+{
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    std::uint32_t sign = (bits >> 16) & 0x8000u;
+    bits &= 0x7FFFFFFFu;
+
+    std::uint16_t half;
+    if (bits >= 0x47800000u) {
+        // At least 2^16, infinity or NaN; NaN stays quiet
+        half = static_cast<std::uint16_t>(bits > 0x7F800000u ? 0x7E00u : 0x7C00u);
+    } else if (bits < 0x38800000u) {
+        // Subnormal half: the float adder rounds the mantissa into place
+        const std::uint32_t magicBits = ((127 - 15) + (23 - 10) + 1) << 23;
+        float magic;
+        float magnitude;
+        std::memcpy(&magic, &magicBits, sizeof(magic));
+        std::memcpy(&magnitude, &bits, sizeof(magnitude));
+        magnitude += magic;
+        std::memcpy(&bits, &magnitude, sizeof(bits));
+        half = static_cast<std::uint16_t>(bits - magicBits);
+    } else {
+        // Rebias the exponent and round the dropped 13 bits to even; a carry
+        // out of the mantissa correctly bumps the exponent, up to infinity
+        std::uint32_t odd = (bits >> 13) & 1;
+        bits += (static_cast<std::uint32_t>(15 - 127) << 23) + 0xFFFu + odd;
+        half = static_cast<std::uint16_t>(bits >> 13);
+    }
+    return static_cast<std::uint16_t>(half | sign);
+}
+
+inline float halfToFloat(std::uint16_t half)
+{
+    const std::uint32_t shiftedExponent = 0x7C00u << 13;
+    std::uint32_t bits = (half & 0x7FFFu) << 13;
+    std::uint32_t exponent = bits & shiftedExponent;
+    bits += static_cast<std::uint32_t>(127 - 15) << 23;
+    if (exponent == shiftedExponent) {
+        bits += static_cast<std::uint32_t>(128 - 16) << 23;  // Infinity or NaN
+    } else if (exponent == 0) {
+        // Zero or subnormal: renormalize through a float subtraction
+        const std::uint32_t magicBits = 113u << 23;
+        float magic;
+        float value;
+        bits += 1u << 23;
+        std::memcpy(&magic, &magicBits, sizeof(magic));
+        std::memcpy(&value, &bits, sizeof(value));
+        value -= magic;
+        std::memcpy(&bits, &value, sizeof(bits));
+    }
+    bits |= static_cast<std::uint32_t>(half & 0x8000u) << 16;
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Row conversions, four values per step with F16C or ARMv8 NEON
+inline void floatToHalfRow(const float* values, std::uint16_t* halves, std::size_t count)
+{
+    std::size_t i = 0;
+#if defined(HDR_FRAME_F16C) || defined(HDR_FRAME_NEON)
+    const std::size_t vectorEnd = count & ~static_cast<std::size_t>(3);
+#endif
+#if defined(HDR_FRAME_F16C)
+    for (; i < vectorEnd; i += 4)
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(halves + i), _mm_cvtps_ph(_mm_loadu_ps(values + i), _MM_FROUND_TO_NEAREST_INT));
+#elif defined(HDR_FRAME_NEON)
+    for (; i < vectorEnd; i += 4)
+        vst1_u16(halves + i, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(values + i))));
+#endif
+    for (; i < count; ++i)
+        halves[i] = floatToHalf(values[i]);
+}
+
+inline void halfToFloatRow(const std::uint16_t* halves, float* values, std::size_t count)
+{
+    std::size_t i = 0;
+#if defined(HDR_FRAME_F16C) || defined(HDR_FRAME_NEON)
+    const std::size_t vectorEnd = count & ~static_cast<std::size_t>(3);
+#endif
+#if defined(HDR_FRAME_F16C)
+    for (; i < vectorEnd; i += 4)
+        _mm_storeu_ps(values + i, _mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(halves + i))));
+#elif defined(HDR_FRAME_NEON)
+    for (; i < vectorEnd; i += 4)
+        vst1q_f32(values + i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(halves + i))));
+#endif
+    for (; i < count; ++i)
+        values[i] = halfToFloat(halves[i]);
+}
+
+// srgbToLinear on [0, 1] by linear interpolation in a table of 1024 steps,
+// within 1e-6 of the exact curve; bands rebuild their channel tables, and
+// pow there would cost more than the pixels
+constexpr int gHdrDecodeSteps = 1024;
+
+inline float srgbToLinearInterpolated(float value)
+{
+    static const std::vector<float> table = [] {
+        std::vector<float> built(gHdrDecodeSteps + 2);
+        for (int i = 0; i <= gHdrDecodeSteps; ++i)
+            built[i] = static_cast<float>(srgbToLinear(static_cast<double>(i) / gHdrDecodeSteps));
+        built[gHdrDecodeSteps + 1] = built[gHdrDecodeSteps];
+        return built;
+    }();
+    float position = std::min(std::max(value, 0.0f), 1.0f) * gHdrDecodeSteps;
+    int index = static_cast<int>(position);
+    float fraction = position - index;
+    return table[index] + (table[index + 1] - table[index]) * fraction;
+}
+
+// Shade the part of the animated gradient that target covers in linear
+// light. Each channel is the display value of the 8-bit gradient decoded to
+// linear light and scaled by peak, so the bright parts of the gradient become
+// highlights above display white.
+inline void shadeAnimationHdr(
+    HdrView target,
+    const FrameRegion& region,
+    std::size_t frameId,
+    double frameTime,
+    float peak = gHdrDefaultPeak)
+{
+    if (target.empty())
+        return;
+    int width = target.width();
+    int rows = target.height();
+    double timeFactor = frameId * frameTime;
+    auto scene = [peak](double wave) { return srgbToLinearInterpolated(static_cast<float>(wave * 0.5 + 0.5)) * peak; };
+
+    // As in the fixed-point path, each channel depends only on x, y or x + y
+    FrameArenaScope scratch(threadFrameArena());
+    int diagonalCount = width + rows;
+    float* red = threadFrameArena().allocateArray<float>(width);
+    float* blue = threadFrameArena().allocateArray<float>(diagonalCount);
+    float* row = threadFrameArena().allocateArray<float>(static_cast<std::size_t>(width) * gHdrChannels);
+    for (int x = 0; x < width; ++x)
+        red[x] = scene(std::cos(static_cast<double>(region.x + x) / region.frameWidth + timeFactor));
+    for (int d = 0; d < diagonalCount; ++d)
+        blue[d] = scene(std::cos(static_cast<double>(region.x + region.y + d) / (region.frameWidth + region.frameHeight) + timeFactor));
+
+    for (int y = 0; y < rows; ++y) {
+        float green = scene(std::sin(static_cast<double>(region.y + y) / region.frameHeight + timeFactor));
+        const float* diagonal = blue + y;
+        for (int x = 0; x < width; ++x) {
+            float* pixel = row + static_cast<std::size_t>(x) * gHdrChannels;
+            pixel[0] = red[x];
+            pixel[1] = green;
+            pixel[2] = diagonal[x];
+            pixel[3] = 1.0f;
+        }
+        floatToHalfRow(row, hdrHalves(target.row(y)), static_cast<std::size_t>(width) * gHdrChannels);
+    }
+}
+
+// Rows [firstRow, lastRow) into hdr, which holds only those rows
+inline void shadeAnimationRowsHdr(
+    std::uint16_t* hdr,
+    int width,
+    int height,
+    std::size_t frameId,
+    double frameTime,
+    int firstRow,
+    int lastRow,
+    float peak = gHdrDefaultPeak)
+{
+    shadeAnimationHdr(HdrView(reinterpret_cast<HdrPixel*>(hdr), width, lastRow - firstRow), frameRows(width, height, firstRow),
+        frameId, frameTime, peak);
+}
+
+inline float toneMapChannel(ToneMapOperator op, float value)
+{
+    if (op == ToneMapOperator::Reinhard)
+        return value / (1.0f + value);
+    if (op == ToneMapOperator::Aces)
+        return (value * (2.51f * value + 0.03f)) / (value * (2.43f * value + 0.59f) + 0.14f);
+    return value;
+}
+
+// The single pass from HDR to presentation: scale by exposure, apply the
+// curve to colour, clamp, then encode colour to sRGB through the table of
+// color_space.h and pack into ARGB words. Only the part both views cover is
+// written.
+inline void toneMap(ToneMapOperator op, ConstHdrView hdr, ArgbView argb, float exposure = 1.0f)
+{
+    const int width = std::min(hdr.width(), argb.width());
+    const int rows = std::min(hdr.height(), argb.height());
+    if (width <= 0 || rows <= 0)
+        return;
+    const std::uint8_t* encode = srgbTables().encode;
+    const int shift = 16 - gSrgbEncodeBits;
+    const std::size_t rowValues = static_cast<std::size_t>(width) * gHdrChannels;
+
+    FrameArenaScope scratch(threadFrameArena());
+    float* values = threadFrameArena().allocateArray<float>(rowValues);
+    std::int32_t* lanes = threadFrameArena().allocateArray<std::int32_t>(rowValues);
+    for (int y = 0; y < rows; ++y) {
+        halfToFloatRow(hdrHalves(hdr.row(y)), values, rowValues);
+
+        // One pixel per vector: the curve on R, G and B, alpha passed through
+        std::size_t i = 0;
+#if defined(HDR_FRAME_SSE2)
+        const __m128 scale = _mm_set_ps(1.0f, exposure, exposure, exposure);
+        const __m128 colourLanes = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 largest = _mm_set1_ps(gHdrMaxValue);
+        const __m128 full = _mm_set1_ps(65535.0f);
+        for (; i < rowValues; i += gHdrChannels) {
+            // max returns its second operand for NaN, so NaN becomes 0 and infinity the largest half
+            __m128 x = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(values + i), scale), zero), largest);
+            __m128 curved = x;
+            if (op == ToneMapOperator::Reinhard) {
+                curved = _mm_div_ps(x, _mm_add_ps(one, x));
+            } else if (op == ToneMapOperator::Aces) {
+                __m128 numerator = _mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.51f), x), _mm_set1_ps(0.03f)));
+                __m128 denominator = _mm_add_ps(_mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.43f), x), _mm_set1_ps(0.59f))), _mm_set1_ps(0.14f));
+                curved = _mm_div_ps(numerator, denominator);
+            }
+            x = _mm_or_ps(_mm_and_ps(colourLanes, curved), _mm_andnot_ps(colourLanes, x));
+            x = _mm_min_ps(x, one);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes + i), _mm_cvtps_epi32(_mm_mul_ps(x, full)));
+        }
+#elif defined(HDR_FRAME_NEON)
+        static const std::uint32_t colourMask[4] = { ~0u, ~0u, ~0u, 0 };
+        const uint32x4_t colourLanes = vld1q_u32(colourMask);
+        const float32x4_t scale = { exposure, exposure, exposure, 1.0f };
+        const float32x4_t one = vdupq_n_f32(1.0f);
+        for (; i < rowValues; i += gHdrChannels) {
+            // vmaxnm returns the number when one operand is NaN
+            float32x4_t x = vminq_f32(vmaxnmq_f32(vmulq_f32(vld1q_f32(values + i), scale), vdupq_n_f32(0.0f)), vdupq_n_f32(gHdrMaxValue));
+            float32x4_t curved = x;
+            if (op == ToneMapOperator::Reinhard) {
+                curved = vdivq_f32(x, vaddq_f32(one, x));
+            } else if (op == ToneMapOperator::Aces) {
+                float32x4_t numerator = vmulq_f32(x, vmlaq_n_f32(vdupq_n_f32(0.03f), x, 2.51f));
+                float32x4_t denominator = vmlaq_f32(vdupq_n_f32(0.14f), x, vmlaq_n_f32(vdupq_n_f32(0.59f), x, 2.43f));
+                curved = vdivq_f32(numerator, denominator);
+            }
+            x = vminq_f32(vbslq_f32(colourLanes, curved, x), one);
+            vst1q_s32(lanes + i, vcvtnq_s32_f32(vmulq_n_f32(x, 65535.0f)));
+        }
+#endif
+        for (; i < rowValues; i += gHdrChannels) {
+            for (int channel = 0; channel < gHdrChannels; ++channel) {
+                float x = values[i + channel] * (channel < 3 ? exposure : 1.0f);
+                x = x > 0.0f ? std::min(x, gHdrMaxValue) : 0.0f;
+                if (channel < 3)
+                    x = toneMapChannel(op, x);
+                x = std::min(x, 1.0f);
+                lanes[i + channel] = static_cast<std::int32_t>(std::nearbyint(x * 65535.0f));
+            }
+        }
+
+        std::uint32_t* out = argb.row(y);
+        for (int x = 0; x < width; ++x) {
+            const std::int32_t* pixel = lanes + static_cast<std::size_t>(x) * gHdrChannels;
+            out[x] = (static_cast<std::uint32_t>(narrowChannel(pixel[3])) << 24) | (static_cast<std::uint32_t>(encode[pixel[0] >> shift]) << 16)
+                | (static_cast<std::uint32_t>(encode[pixel[1] >> shift]) << 8) | encode[pixel[2] >> shift];
+        }
+    }
+}
+
+// rows is the number of rows in hdr and argb, both packed
+inline void toneMapRows(ToneMapOperator op, const std::uint16_t* hdr, std::uint32_t* argb, int width, int rows, float exposure = 1.0f)
+{
+    toneMap(op, ConstHdrView(reinterpret_cast<const HdrPixel*>(hdr), width, rows), ArgbView(argb, width, rows), exposure);
+}
+
+// HDR variant of shadeAnimation: shade the view into a half-float working
+// buffer from the frame arena, then tone map it into the ARGB target. Stages
+// that should see HDR values run on that buffer in between.
+inline void shadeAnimationHdrToneMapped(
+    ToneMapOperator op,
+    ArgbView target,
+    const FrameRegion& region,
+    std::size_t frameId,
+    double frameTime,
+    float exposure = 1.0f)
+{
+    if (target.empty())
+        return;
+    FrameArenaScope scratch(threadFrameArena());
+    HdrView hdr(threadFrameArena().allocateArray<HdrPixel>(target.pixelCount()), target.width(), target.height());
+    shadeAnimationHdr(hdr, region, frameId, frameTime);
+    toneMap(op, hdr, target, exposure);
+}
+
+inline void shadeAnimationRowsHdrToneMapped(
+    ToneMapOperator op,
+    std::uint32_t* pixels,
+    int width,
+    int height,
+    std::size_t frameId,
+    double frameTime,
+    int firstRow,
+    int lastRow,
+    float exposure = 1.0f)
+{
+    shadeAnimationHdrToneMapped(op, ArgbView(pixels, width, height).rows(firstRow, lastRow), frameRows(width, height, firstRow), frameId, frameTime,
+        exposure);
+}
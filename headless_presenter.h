@@ -0,0 +1,122 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "input_latency.h"
+
+// Stand-in for a display when there is no window: published frames are
+// queued into a swap chain of the given depth and a vsync thread presents
+// one per refresh, reporting the present time to the latency tracker. Every
+// vsync scans out the oldest queued frame; the chain holds up to `depth`
+// frames, so a producer running ahead of the display adds up to one refresh
+// of latency per level, and a frame arriving at a full chain replaces the
+// newest queued one.
+class HeadlessPresenter
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    HeadlessPresenter(std::size_t pixelCount, double refreshInterval, std::size_t depth, InputLatencyTracker* tracker = nullptr)
+        : mRefresh(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(refreshInterval)))
+        , mDepth(depth == 0 ? 1 : depth)
+        , mTracker(tracker)
+        , mSlots(mDepth, Slot{ 0, std::vector<std::uint32_t>(pixelCount) })
+        , mFront(pixelCount)
+    {
+        mVsyncThread = std::thread([this] { vsyncLoop(); });
+    }
+
+    ~HeadlessPresenter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStopping = true;
+        }
+        mWake.notify_all();
+        mVsyncThread.join();
+    }
+
+    HeadlessPresenter(const HeadlessPresenter&) = delete;
+    HeadlessPresenter& operator=(const HeadlessPresenter&) = delete;
+
+    void submit(std::size_t frameId, const std::vector<std::uint32_t>& pixels)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mQueued == mDepth) {
+            ++mReplaced;
+            --mQueued;
+        }
+        Slot& slot = mSlots[(mHead + mQueued) % mDepth];
+        slot.frameId = frameId;
+        std::copy(pixels.begin(), pixels.begin() + std::min(pixels.size(), slot.pixels.size()), slot.pixels.begin());
+        ++mQueued;
+    }
+
+    std::uint64_t presentedCount() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mPresented;
+    }
+
+    std::uint64_t replacedCount() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mReplaced;
+    }
+
+private:
+    struct Slot
+    {
+        std::size_t frameId;
+        std::vector<std::uint32_t> pixels;
+    };
+
+    void vsyncLoop()
+    {
+        Clock::time_point nextVsync = Clock::now() + mRefresh;
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (!mStopping) {
+            mWake.wait_until(lock, nextVsync, [this] { return mStopping; });
+            if (mStopping)
+                break;
+            nextVsync += mRefresh;
+
+            // Scan out the oldest queued frame; with nothing queued the previous
+            // frame stays on screen
+            if (mQueued == 0)
+                continue;
+
+            Slot& slot = mSlots[mHead];
+            mFront.swap(slot.pixels);
+            std::size_t frameId = slot.frameId;
+            mHead = (mHead + 1) % mDepth;
+            --mQueued;
+            ++mPresented;
+
+            if (mTracker)
+                mTracker->frameReached(frameId, FrameStage::Presented);
+        }
+    }
+
+    Clock::duration mRefresh;
+    std::size_t mDepth;
+    InputLatencyTracker* mTracker;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mWake;
+    std::vector<Slot> mSlots;
+    std::vector<std::uint32_t> mFront;
+    std::size_t mHead = 0;
+    std::size_t mQueued = 0;
+    std::uint64_t mPresented = 0;
+    std::uint64_t mReplaced = 0;
+    bool mStopping = false;
+    std::thread mVsyncThread;
+};
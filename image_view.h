@@ -0,0 +1,141 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+// Non-owning view of a 2D image: the top-left pixel, the size in pixels and
+// the distance between rows in bytes. Views are two words and an int to copy,
+// and subView and rows slice without touching pixels, so one kernel can work
+// on a whole frame, a band, a tile, a dirty rectangle or a padded buffer
+// owned by someone else. The stride must be a multiple of the pixel size, so
+// every row is as aligned as the first one for SIMD loads.
+template <typename PixelT>
+class ImageView
+{
+public:
+    using Pixel = PixelT;
+
+    ImageView() = default;
+
+    // A stride of 0 means tightly packed rows
+    ImageView(PixelT* data, int width, int height, std::ptrdiff_t strideBytes = 0)
+        : mData(data)
+        , mWidth(std::max(0, width))
+        , mHeight(std::max(0, height))
+        , mStrideBytes(strideBytes ? strideBytes : static_cast<std::ptrdiff_t>(std::max(0, width) * sizeof(PixelT)))
+    {
+    }
+
+    // Mutable views convert to const ones
+    template <typename Other, typename = typename std::enable_if<std::is_same<const Other, PixelT>::value && !std::is_const<Other>::value>::type>
+    ImageView(const ImageView<Other>& other)
+        : mData(other.data())
+        , mWidth(other.width())
+        , mHeight(other.height())
+        , mStrideBytes(other.strideBytes())
+    {
+    }
+
+    PixelT* data() const { return mData; }
+    int width() const { return mWidth; }
+    int height() const { return mHeight; }
+    std::ptrdiff_t strideBytes() const { return mStrideBytes; }
+    std::ptrdiff_t stridePixels() const { return mStrideBytes / static_cast<std::ptrdiff_t>(sizeof(PixelT)); }
+    std::size_t pixelCount() const { return static_cast<std::size_t>(mWidth) * mHeight; }
+    bool empty() const { return mWidth == 0 || mHeight == 0; }
+    bool contiguous() const { return mStrideBytes == static_cast<std::ptrdiff_t>(mWidth * sizeof(PixelT)); }
+
+    PixelT* row(int y) const
+    {
+        using Byte = typename std::conditional<std::is_const<PixelT>::value, const unsigned char, unsigned char>::type;
+        return reinterpret_cast<PixelT*>(reinterpret_cast<Byte*>(mData) + y * mStrideBytes);
+    }
+
+    PixelT& operator()(int x, int y) const { return row(y)[x]; }
+
+    // The part of the rectangle that lies inside this view
+    ImageView subView(int x, int y, int width, int height) const
+    {
+        int left = std::min(std::max(0, x), mWidth);
+        int top = std::min(std::max(0, y), mHeight);
+        int right = std::min(std::max(left, x + width), mWidth);
+        int bottom = std::min(std::max(top, y + height), mHeight);
+        return ImageView(row(top) + left, right - left, bottom - top, mStrideBytes);
+    }
+
+    ImageView rows(int firstRow, int lastRow) const { return subView(0, firstRow, mWidth, lastRow - firstRow); }
+
+    // Iterates over row pointers: for (PixelT* row : view) ...
+    class RowIterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = PixelT*;
+        using difference_type = std::ptrdiff_t;
+        using pointer = PixelT**;
+        using reference = PixelT*;
+
+        RowIterator(const ImageView* view, int y)
+            : mView(view)
+            , mY(y)
+        {
+        }
+
+        PixelT* operator*() const { return mView->row(mY); }
+        RowIterator& operator++()
+        {
+            ++mY;
+            return *this;
+        }
+        bool operator==(const RowIterator& other) const { return mY == other.mY; }
+        bool operator!=(const RowIterator& other) const { return mY != other.mY; }
+
+    private:
+        const ImageView* mView;
+        int mY;
+    };
+
+    RowIterator begin() const { return RowIterator(this, 0); }
+    RowIterator end() const { return RowIterator(this, mHeight); }
+
+private:
+    PixelT* mData = nullptr;
+    int mWidth = 0;
+    int mHeight = 0;
+    std::ptrdiff_t mStrideBytes = 0;
+};
+
+using ArgbView = ImageView<std::uint32_t>;
+using ConstArgbView = ImageView<const std::uint32_t>;
+
+// A packed frame held in a vector
+template <typename PixelT>
+ImageView<PixelT> makeImageView(std::vector<PixelT>& pixels, int width, int height)
+{
+    return ImageView<PixelT>(pixels.data(), width, height);
+}
+
+template <typename PixelT>
+ImageView<const PixelT> makeImageView(const std::vector<PixelT>& pixels, int width, int height)
+{
+    return ImageView<const PixelT>(pixels.data(), width, height);
+}
+
+// Where a view's top-left pixel lies in the full frame being generated, and
+// that frame's size, for kernels whose output depends on the position
+struct FrameRegion
+{
+    int frameWidth;
+    int frameHeight;
+    int x;
+    int y;
+};
+
+inline FrameRegion frameRows(int frameWidth, int frameHeight, int firstRow)
+{
+    return FrameRegion{ frameWidth, frameHeight, 0, firstRow };
+}
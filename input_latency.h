@@ -0,0 +1,194 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+constexpr std::uint64_t gLatencyBucketNanos = 100 * 1000;
+constexpr std::size_t gLatencyBucketCount = 2000;
+constexpr std::size_t gMaxPendingInputs = 1024;
+
+// Fixed-bucket latency histogram: 100 us buckets up to 200 ms plus overflow.
+// One thread records at a time; any thread may read without a lock, seeing
+// each field as of some recent record.
+class LatencyHistogram
+{
+public:
+    LatencyHistogram()
+        : mBuckets(gLatencyBucketCount + 1)
+    {
+    }
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    void record(std::uint64_t nanos)
+    {
+        std::size_t bucket = static_cast<std::size_t>(std::min<std::uint64_t>(nanos / gLatencyBucketNanos, gLatencyBucketCount));
+        increment(mBuckets[bucket], 1);
+        increment(mCount, 1);
+        increment(mTotalNanos, nanos);
+        if (nanos > mMaxNanos.load(std::memory_order_relaxed))
+            mMaxNanos.store(nanos, std::memory_order_relaxed);
+    }
+
+    std::uint64_t count() const { return mCount.load(std::memory_order_relaxed); }
+    double meanMs() const { return count() ? mTotalNanos.load(std::memory_order_relaxed) / 1e6 / count() : 0.0; }
+    double maxMs() const { return mMaxNanos.load(std::memory_order_relaxed) / 1e6; }
+
+    // Upper edge of the bucket holding the given quantile, in milliseconds
+    double quantileMs(double quantile) const
+    {
+        std::uint64_t total = count();
+        if (total == 0)
+            return 0.0;
+        std::uint64_t rank = static_cast<std::uint64_t>(quantile * (total - 1)) + 1;
+        std::uint64_t seen = 0;
+        for (std::size_t bucket = 0; bucket < mBuckets.size(); ++bucket) {
+            seen += mBuckets[bucket].load(std::memory_order_relaxed);
+            if (seen >= rank)
+                return bucket == gLatencyBucketCount ? maxMs() : (bucket + 1) * gLatencyBucketNanos / 1e6;
+        }
+        return maxMs();
+    }
+
+    std::string report(const char* name) const
+    {
+        char line[256];
+        std::snprintf(line, sizeof(line), "  %-18s n=%-7llu mean %7.2f  p50 %7.2f  p90 %7.2f  p99 %7.2f  max %7.2f ms\n",
+            name, (unsigned long long)count(), meanMs(), quantileMs(0.5), quantileMs(0.9), quantileMs(0.99), maxMs());
+        return line;
+    }
+
+private:
+    // Single writer, so a load and store is enough and cheaper than a locked add
+    static void increment(std::atomic<std::uint64_t>& value, std::uint64_t amount)
+    {
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    std::vector<std::atomic<std::uint64_t>> mBuckets;
+    std::atomic<std::uint64_t> mCount{ 0 };
+    std::atomic<std::uint64_t> mTotalNanos{ 0 };
+    std::atomic<std::uint64_t> mMaxNanos{ 0 };
+};
+
+enum class FrameStage
+{
+    Rendered,
+    Published,
+    Presented,
+};
+
+// Follows input events into the frames that show them. An input is stamped
+// when it arrives; the next frame requested carries the stamp of the oldest
+// input not yet on screen, and the stamp is checked off at every stage the
+// frame reaches. Frames are tracked by id, so the renderer and presenter only
+// report ids and no stamp has to travel inside the frame itself. When a
+// stamped frame is presented, every input that arrived before it was
+// requested is recorded as input-to-photon latency.
+class InputLatencyTracker
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit InputLatencyTracker(std::size_t maxFramesInFlight = 64)
+        : mFrames(maxFramesInFlight)
+    {
+    }
+
+    void stampInput() { stampInput(Clock::now()); }
+
+    void stampInput(Clock::time_point arrival)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mPendingInputs.size() >= gMaxPendingInputs) {
+            mPendingInputs.pop_front();
+            mDroppedInputs.fetch_add(1, std::memory_order_relaxed);
+        }
+        mPendingInputs.push_back(arrival);
+    }
+
+    void frameRequested(std::size_t frameId)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        FrameSlot& slot = mFrames[frameId % mFrames.size()];
+        slot.frameId = frameId;
+        slot.requested = Clock::now();
+        slot.stamped = !mPendingInputs.empty();
+        if (slot.stamped)
+            slot.oldestInput = mPendingInputs.front();
+    }
+
+    void frameReached(std::size_t frameId, FrameStage stage) { frameReached(frameId, stage, Clock::now()); }
+
+    void frameReached(std::size_t frameId, FrameStage stage, Clock::time_point when)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        FrameSlot& slot = mFrames[frameId % mFrames.size()];
+        if (slot.frameId != frameId || !slot.stamped)
+            return;
+
+        mStages[static_cast<int>(stage)].record(nanosBetween(slot.oldestInput, when));
+        if (stage != FrameStage::Presented)
+            return;
+
+        // Everything that arrived before the frame was requested is now visible
+        while (!mPendingInputs.empty() && mPendingInputs.front() <= slot.requested) {
+            mInputToPhoton.record(nanosBetween(mPendingInputs.front(), when));
+            mPendingInputs.pop_front();
+        }
+        slot.stamped = false;
+    }
+
+    // Histograms read lock-free; the tracker is their only writer
+    const LatencyHistogram& inputToPhoton() const { return mInputToPhoton; }
+    const LatencyHistogram& stage(FrameStage stage) const { return mStages[static_cast<int>(stage)]; }
+    std::uint64_t droppedInputs() const { return mDroppedInputs.load(std::memory_order_relaxed); }
+
+    std::string report() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        std::string text = "input latency:\n";
+        text += mStages[static_cast<int>(FrameStage::Rendered)].report("input->rendered");
+        text += mStages[static_cast<int>(FrameStage::Published)].report("input->published");
+        text += mStages[static_cast<int>(FrameStage::Presented)].report("input->presented");
+        text += mInputToPhoton.report("input-to-photon");
+        if (droppedInputs()) {
+            char line[64];
+            std::snprintf(line, sizeof(line), "  %llu inputs dropped unseen\n", (unsigned long long)droppedInputs());
+            text += line;
+        }
+        return text;
+    }
+
+private:
+    struct FrameSlot
+    {
+        std::size_t frameId = static_cast<std::size_t>(-1);
+        bool stamped = false;
+        Clock::time_point requested;
+        Clock::time_point oldestInput;
+    };
+
+    static std::uint64_t nanosBetween(Clock::time_point from, Clock::time_point to)
+    {
+        if (to <= from)
+            return 0;
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count());
+    }
+
+    mutable std::mutex mMutex;
+    std::vector<FrameSlot> mFrames;
+    std::deque<Clock::time_point> mPendingInputs;
+    std::atomic<std::uint64_t> mDroppedInputs{ 0 };
+    LatencyHistogram mStages[3];
+    LatencyHistogram mInputToPhoton;
+};
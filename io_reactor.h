@@ -0,0 +1,238 @@
+#pragma once
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+struct IoReactorStats
+{
+    std::uint64_t readinessWaits = 0;
+    std::uint64_t fileReads = 0;
+    std::uint64_t pollIterations = 0;
+};
+
+// Waits for I/O on behalf of sources that must not block a worker. One thread
+// polls the descriptors callers are waiting on; a second serves file reads,
+// which poll cannot wait for since regular files always report readable.
+// Completions run on those threads and should only hand the work on, for
+// example by submitting it to the worker pool, so neither thread stalls.
+// Every request completes exactly once: when the reactor is destroyed or
+// polling fails, whatever is still pending completes with ECANCELED or the
+// poll error, and later requests complete at once on the calling thread.
+class IoReactor
+{
+public:
+    using Completion = std::function<void(int error)>;
+    using ReadCompletion = std::function<void(ssize_t result, int error)>;
+
+    IoReactor()
+    {
+        if (pipe(mWakePipe) < 0)
+            throwSystemError("pipe");
+        fcntl(mWakePipe[0], F_SETFL, O_NONBLOCK);
+        fcntl(mWakePipe[1], F_SETFL, O_NONBLOCK);
+        mPollThread = std::thread([this] { pollLoop(); });
+        mFileThread = std::thread([this] { fileLoop(); });
+    }
+
+    ~IoReactor()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStopping = true;
+        }
+        wakePoller();
+        mFileRequested.notify_all();
+        mPollThread.join();
+        mFileThread.join();
+        close(mWakePipe[0]);
+        close(mWakePipe[1]);
+    }
+
+    IoReactor(const IoReactor&) = delete;
+    IoReactor& operator=(const IoReactor&) = delete;
+
+    // Run done(0) once fd is readable, hung up or invalid, or done(error)
+    // if the wait ends first; any thread
+    void whenReadable(int fd, Completion done)
+    {
+        int error = 0;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            error = mStopping ? ECANCELED : mPollError;
+            if (!error) {
+                mWaiters.push_back(Waiter{ fd, std::move(done) });
+                ++mStats.readinessWaits;
+            }
+        }
+        if (error) {
+            done(error);
+            return;
+        }
+        wakePoller();
+    }
+
+    // pread on the file thread, then done(result, errno); any thread. The
+    // buffer must stay valid until done runs.
+    void readFile(int fd, void* buffer, std::size_t bytes, off_t offset, ReadCompletion done)
+    {
+        bool stopping = false;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            stopping = mStopping;
+            if (!stopping) {
+                mFileReads.push_back(FileRead{ fd, buffer, bytes, offset, std::move(done) });
+                ++mStats.fileReads;
+            }
+        }
+        if (stopping) {
+            done(-1, ECANCELED);
+            return;
+        }
+        mFileRequested.notify_one();
+    }
+
+    IoReactorStats stats() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mStats;
+    }
+
+private:
+    struct Waiter
+    {
+        int fd;
+        Completion done;
+    };
+
+    struct FileRead
+    {
+        int fd;
+        void* buffer;
+        std::size_t bytes;
+        off_t offset;
+        ReadCompletion done;
+    };
+
+    void wakePoller()
+    {
+        char byte = 0;
+        ssize_t written = write(mWakePipe[1], &byte, 1);
+        (void)written;  // A full pipe already guarantees a wakeup
+    }
+
+    void pollLoop()
+    {
+        std::vector<struct pollfd> fds;
+        std::vector<Waiter> ready;
+        for (;;) {
+            fds.clear();
+            fds.push_back(pollfd{ mWakePipe[0], POLLIN, 0 });
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                if (mStopping)
+                    break;
+                for (const Waiter& waiter : mWaiters)
+                    fds.push_back(pollfd{ waiter.fd, POLLIN, 0 });
+                ++mStats.pollIterations;
+            }
+
+            if (poll(fds.data(), static_cast<nfds_t>(fds.size()), -1) < 0) {
+                if (errno == EINTR)
+                    continue;
+                failWaiters(errno);
+                return;
+            }
+            if (fds[0].revents) {
+                char drain[64];
+                while (read(mWakePipe[0], drain, sizeof(drain)) > 0) {
+                }
+            }
+
+            // Waiters are only appended while polling, so the first fds.size() - 1 are the ones polled
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                std::size_t kept = 0;
+                for (std::size_t i = 0; i < mWaiters.size(); ++i) {
+                    bool polled = i + 1 < fds.size();
+                    if (polled && fds[i + 1].revents)
+                        ready.push_back(std::move(mWaiters[i]));
+                    else
+                        mWaiters[kept++] = std::move(mWaiters[i]);
+                }
+                mWaiters.resize(kept);
+            }
+            for (Waiter& waiter : ready)
+                waiter.done(0);
+            ready.clear();
+        }
+        failWaiters(ECANCELED);
+    }
+
+    // Complete every waiter with error, and any later one at once
+    void failWaiters(int error)
+    {
+        std::vector<Waiter> failed;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mPollError = error;
+            failed.swap(mWaiters);
+        }
+        for (Waiter& waiter : failed)
+            waiter.done(error);
+    }
+
+    void fileLoop()
+    {
+        for (;;) {
+            FileRead request;
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                mFileRequested.wait(lock, [this] { return mStopping || !mFileReads.empty(); });
+                if (mStopping)
+                    break;
+                request = std::move(mFileReads.front());
+                mFileReads.pop_front();
+            }
+            ssize_t result = pread(request.fd, request.buffer, request.bytes, request.offset);
+            request.done(result, result < 0 ? errno : 0);
+        }
+
+        std::deque<FileRead> cancelled;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            cancelled.swap(mFileReads);
+        }
+        for (FileRead& request : cancelled)
+            request.done(-1, ECANCELED);
+    }
+
+    static void throwSystemError(const char* call)
+    {
+        throw std::runtime_error(std::string(call) + ": " + std::strerror(errno));
+    }
+
+    mutable std::mutex mMutex;
+    std::condition_variable mFileRequested;
+    std::vector<Waiter> mWaiters;
+    std::deque<FileRead> mFileReads;
+    IoReactorStats mStats;
+    bool mStopping = false;
+    int mPollError = 0;  // Set once the poll thread has stopped
+    int mWakePipe[2] = { -1, -1 };
+    std::thread mPollThread;
+    std::thread mFileThread;
+};
@@ -4,9 +4,25 @@
 #include <CoreFoundation/CoreFoundation.h>
 #include <CoreGraphics/CoreGraphics.h>
 #include <vector>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <mutex>
 #include <string>
 
+#include "command_queue.h"
+#include "frame_renderer.h"
+#include "frame_source.h"
+#include "hdr_frame.h"
+#include "input_latency.h"
+#include "memory_governor.h"
+#include "metrics_exporter.h"
+#include "virtual_canvas.h"
+#include "worker_pool.h"
+
 // Define proper types
 using ObjcObject = objc_object*;
 using ObjcSelector = objc_selector*;
@@ -68,15 +84,139 @@ constexpr int gImageWidth = 800;
 constexpr int gImageHeight = 600;
 constexpr int gTargetFps = 60;
 constexpr double gTargetFrameTime = 1.0 / gTargetFps;
+constexpr std::size_t gFrameBytes = gImageWidth * gImageHeight * sizeof(std::uint32_t);
+
+// Memory budget, overridable in MiB through MACOS_WINDOW_MEMORY_BUDGET_MB
+constexpr std::size_t gDefaultMemoryBudget = 256 * 1024 * 1024;
+constexpr int gMemoryReportInterval = gTargetFps * 10;
+
+// Rows per band; workers check for cancellation between bands
+constexpr int gBandRows = 32;
 
 // Global image data with mutex for thread safety
 std::vector<std::uint32_t> gImageData;
+std::size_t gImageFrameId = 0;
 std::mutex gImageDataMutex;
-ObjcObject gContentView = nullptr;
+std::atomic<ObjcObject> gContentView(nullptr);
+
+// Memory governor owner for the displayed frame
+MemoryGovernor::OwnerId gFrontBufferOwner = -1;
+
+// Startup timing for the time-to-first-frame metric
+using StartupClock = std::chrono::steady_clock;
+StartupClock::time_point gLaunchTime;
+std::atomic<bool> gFirstFramePublished(false);
+bool gFirstFramePresented = false;
+
+// Commands from workers to the main thread, drained by a run loop source
+CommandQueue gUiCommands;
+CommandQueue::CommandId gRedrawCommand = -1;
+CFRunLoopSourceRef gUiCommandSource = nullptr;
+
+// Input events are stamped on arrival and followed to the frame that shows them
+InputLatencyTracker gInputLatency;
+
+double millisecondsSinceLaunch()
+{
+    return std::chrono::duration<double, std::milli>(StartupClock::now() - gLaunchTime).count();
+}
+
+// Shading path, selected with MACOS_WINDOW_SHADING=fixed or adaptive
+ShadingMode gShadingMode = ShadingMode::Double;
+int gShadingErrorBudget = gDefaultAdaptiveErrorBudget;
+
+// Half-rate shading under load, selected with MACOS_WINDOW_TEMPORAL=checkerboard or interlaced
+TemporalMode gTemporalMode = TemporalMode::Full;
+
+// Half-float HDR shading, tone mapped when packing to ARGB; MACOS_WINDOW_HDR=reinhard, aces or clamp
+bool gHdrShading = false;
+ToneMapOperator gToneMap = ToneMapOperator::Reinhard;
+
+// Pan and zoom over a canvas of gCanvasSide squared pixels instead of the
+// animation, selected with MACOS_WINDOW_CANVAS=1. The viewport is only
+// touched on the main thread; each frame takes a copy when it is requested.
+constexpr int gCanvasSide = 1 << 20;
+constexpr double gCanvasZoomPerScrollUnit = 0.01;
+VirtualCanvas* gCanvas = nullptr;
+CanvasViewport gCanvasViewport;
+
+// Worker threads and the band renderer feeding updateImageData
+WorkerPool* gWorkerPool = nullptr;
+FrameRenderer* gFrameRenderer = nullptr;
+
+// Per-frame event log written to MACOS_WINDOW_FRAME_LOG when it is set
+FrameLog* gFrameLog = nullptr;
+std::uint32_t gFrameLogSource = 0;
+
+// Metrics served on MACOS_WINDOW_METRICS_SOCKET when it is set
+MetricsExporter* gMetricsExporter = nullptr;
+
+// Exporter collectors, run on the exporter thread only
+void collectMetrics(MetricsWriter& writer)
+{
+    static std::uint64_t previousPublished = 0;
+    static std::chrono::steady_clock::time_point previousTime = std::chrono::steady_clock::now();
+
+    writer.gauge("uptime_seconds", "Seconds since launch", millisecondsSinceLaunch() / 1e3);
+    writer.gauge("target_frame_rate_hz", "Frame rate the animation timer asks for", gTargetFps);
+    writeRendererMetrics(writer, *gFrameRenderer, previousPublished, previousTime);
+    writeLatencyMetrics(writer, gInputLatency);
+    writeCommandMetrics(writer, gUiCommands);
+    writeMemoryMetrics(writer, memoryGovernor());
+
+    static EnergyMeter energyMeter;
+    static EnergyCounter energy(energyMeter);
+    writeEnergyMetrics(writer, energy);
+}
+
+void startMetricsExporter()
+{
+    const char* socketPath = std::getenv("MACOS_WINDOW_METRICS_SOCKET");
+    if (!socketPath || !*socketPath)
+        return;
+
+    gMetricsExporter = new MetricsExporter(socketPath);
+    gMetricsExporter->addCollector(collectMetrics);
+    try {
+        gMetricsExporter->start();
+    } catch (const std::exception& error) {
+        std::fprintf(stderr, "metrics exporter disabled: %s\n", error.what());
+        delete gMetricsExporter;
+        gMetricsExporter = nullptr;
+    }
+}
 
 // The windowShouldClose method implementation
 bool windowShouldClose(ObjcObject self, ObjcSelector _cmd, ObjcObject sender)
 {
+    // The exporter reads the renderer, so it stops first
+    delete gMetricsExporter;
+    gMetricsExporter = nullptr;
+
+    // Stop rendering before the process exits underneath the workers
+    if (gFrameRenderer) {
+        std::fputs(gFrameRenderer->statsReport().c_str(), stderr);
+        std::fputs(gInputLatency.report().c_str(), stderr);
+        delete gFrameRenderer;
+        gFrameRenderer = nullptr;
+    }
+
+    // Frames sampled the canvas, so it goes after the renderer
+    if (gCanvas) {
+        CanvasStats stats = gCanvas->stats();
+        std::fprintf(stderr, "canvas: %llu tiles used, %.1f%% hits, %llu shaded by frames, %llu prefetched (%llu used), %llu evicted\n",
+            (unsigned long long)stats.tilesUsed, stats.hitRate() * 100.0, (unsigned long long)stats.tilesShaded,
+            (unsigned long long)stats.tilesPrefetched, (unsigned long long)stats.prefetchHits, (unsigned long long)stats.tilesEvicted);
+        delete gCanvas;
+        gCanvas = nullptr;
+    }
+
+    // Written out after the renderer, its last producer besides this thread
+    if (gFrameLog) {
+        delete gFrameLog;
+        gFrameLog = nullptr;
+    }
+
     ObjcObject application = sendClassMessage<ObjcObject>(getClass("NSApplication"), "sharedApplication");
     sendMessage<void>(application, "terminate:", nullptr);
     return YES;
@@ -90,6 +230,15 @@ void drawRect(ObjcObject self, ObjcSelector _cmd, CGRect rect)
     if (gImageData.empty())
         return;
 
+    gInputLatency.frameReached(gImageFrameId, FrameStage::Presented);
+    if (gFrameLog)
+        gFrameLog->reached(gFrameLogSource, gImageFrameId, FrameEventKind::Presented);
+
+    if (!gFirstFramePresented) {
+        gFirstFramePresented = true;
+        std::fprintf(stderr, "time to first frame: %.2f ms presented\n", millisecondsSinceLaunch());
+    }
+
     // Get view bounds
     CGRect bounds = sendMessage<CGRect>(self, "bounds");
     
@@ -100,8 +249,9 @@ void drawRect(ObjcObject self, ObjcSelector _cmd, CGRect rect)
     // Cast to CGContextRef
     CGContextRef contextRef = reinterpret_cast<CGContextRef>(cgContext);
     
-    // Draw the image using Core Graphics
-    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+    // Draw the image using Core Graphics; the shading writes sRGB values, so
+    // tag them as such rather than as device RGB and let the display convert
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateWithName(kCGColorSpaceSRGB);
     
     CGContextSaveGState(contextRef);
     
@@ -144,6 +294,50 @@ void drawRect(ObjcObject self, ObjcSelector _cmd, CGRect rect)
     CGContextRestoreGState(contextRef);
 }
 
+// Input handlers on the content view stamp the event for latency tracking
+void mouseDown(ObjcObject self, ObjcSelector _cmd, ObjcObject event)
+{
+    gInputLatency.stampInput();
+}
+
+void keyDown(ObjcObject self, ObjcSelector _cmd, ObjcObject event)
+{
+    gInputLatency.stampInput();
+}
+
+// Dragging pans the canvas; the view is drawn scaled to fit, so event
+// deltas in view points are converted to image pixels
+void mouseDragged(ObjcObject self, ObjcSelector _cmd, ObjcObject event)
+{
+    gInputLatency.stampInput();
+    if (!gCanvas)
+        return;
+    CGRect bounds = sendMessage<CGRect>(self, "bounds");
+    double dx = sendMessage<CGFloat>(event, "deltaX") * gImageWidth / CGRectGetWidth(bounds);
+    double dy = sendMessage<CGFloat>(event, "deltaY") * gImageHeight / CGRectGetHeight(bounds);
+    gCanvasViewport = panViewport(gCanvasViewport, dx, dy);
+}
+
+// Scrolling zooms the canvas about the point under the cursor
+void scrollWheel(ObjcObject self, ObjcSelector _cmd, ObjcObject event)
+{
+    gInputLatency.stampInput();
+    if (!gCanvas)
+        return;
+    CGRect bounds = sendMessage<CGRect>(self, "bounds");
+    CGPoint location = sendMessage<CGPoint>(event, "locationInWindow");
+    location = sendMessage<CGPoint>(self, "convertPoint:fromView:", location, static_cast<ObjcObject>(nullptr));
+    double x = location.x * gImageWidth / CGRectGetWidth(bounds);
+    double y = (CGRectGetHeight(bounds) - location.y) * gImageHeight / CGRectGetHeight(bounds);
+    double factor = std::exp(sendMessage<CGFloat>(event, "scrollingDeltaY") * gCanvasZoomPerScrollUnit);
+    gCanvasViewport = zoomViewport(gCanvasViewport, factor, x, y, gImageWidth, gImageHeight);
+}
+
+bool acceptsFirstResponder(ObjcObject self, ObjcSelector _cmd)
+{
+    return YES;
+}
+
 // Delegate class to handle window close events
 ObjcClass createWindowDelegateClass()
 {
@@ -172,64 +366,218 @@ ObjcClass createContentViewClass()
         reinterpret_cast<ObjcMethodImplementation>(drawRect), 
         "v@:{CGRect={CGPoint=dd}{CGSize=dd}}"
     );
+    class_addMethod(
+        contentViewClass, 
+        sel_registerName("mouseDown:"), 
+        reinterpret_cast<ObjcMethodImplementation>(mouseDown), 
+        "v@:@"
+    );
+    class_addMethod(
+        contentViewClass, 
+        sel_registerName("keyDown:"), 
+        reinterpret_cast<ObjcMethodImplementation>(keyDown), 
+        "v@:@"
+    );
+    class_addMethod(
+        contentViewClass, 
+        sel_registerName("mouseDragged:"), 
+        reinterpret_cast<ObjcMethodImplementation>(mouseDragged), 
+        "v@:@"
+    );
+    class_addMethod(
+        contentViewClass, 
+        sel_registerName("scrollWheel:"), 
+        reinterpret_cast<ObjcMethodImplementation>(scrollWheel), 
+        "v@:@"
+    );
+    class_addMethod(
+        contentViewClass, 
+        sel_registerName("acceptsFirstResponder"), 
+        reinterpret_cast<ObjcMethodImplementation>(acceptsFirstResponder), 
+        "c@:"
+    );
     objc_registerClassPair(contentViewClass);
     return contentViewClass;
 }
 
+// Run loop source callback: execute everything posted since the last tick
+void drainUiCommands(void* info)
+{
+    gUiCommands.drain();
+}
+
+// Register the UI commands and the run loop source that wakes up for them
+void setUpUiCommands()
+{
+    gRedrawCommand = gUiCommands.registerCommand([](std::uint64_t) {
+        // Before the view exists the frame is picked up by its initial display instead
+        ObjcObject contentView = gContentView.load();
+        if (contentView)
+            sendMessage<void>(contentView, "setNeedsDisplay:", YES);
+    });
+
+    CFRunLoopSourceContext sourceContext = {0};
+    sourceContext.perform = drainUiCommands;
+    gUiCommandSource = CFRunLoopSourceCreate(kCFAllocatorDefault, 0, &sourceContext);
+    CFRunLoopAddSource(CFRunLoopGetMain(), gUiCommandSource, kCFRunLoopCommonModes);
+
+    // One signal per batch; the main run loop may be asleep, so wake it too
+    gUiCommands.setWakeFunction([] {
+        CFRunLoopSourceSignal(gUiCommandSource);
+        CFRunLoopWakeUp(CFRunLoopGetMain());
+    });
+}
+
 // Function to update image data dynamically
-void updateImageData(const std::vector<std::uint32_t>& newData)
+void updateImageData(const std::vector<std::uint32_t>& newData, std::size_t frameId = 0)
 {
     if (newData.size() != gImageWidth * gImageHeight)
         return;
     
     {
         std::lock_guard<std::mutex> lock(gImageDataMutex);
+        if (gImageData.empty())
+            memoryGovernor().acquire(gFrontBufferOwner, gFrameBytes);
         gImageData = newData;
+        gImageFrameId = frameId;
     }
+    gInputLatency.frameReached(frameId, FrameStage::Published);
+    if (gFrameLog)
+        gFrameLog->reached(gFrameLogSource, frameId, FrameEventKind::Published);
+
+    if (!gFirstFramePublished.exchange(true))
+        std::fprintf(stderr, "time to first frame: %.2f ms rendered\n", millisecondsSinceLaunch());
     
-    // Request redraw on the main thread
-    if (gContentView) {
-        // Use performSelectorOnMainThread to ensure UI updates happen on the main thread
-        ObjcSelector setNeedsDisplaySel = sel_registerName("setNeedsDisplay:");
-        sendMessage<void>(
-            gContentView, 
-            "performSelectorOnMainThread:withObject:waitUntilDone:", 
-            setNeedsDisplaySel, 
-            sendClassMessage<ObjcObject>(getClass("NSNumber"), "numberWithBool:", YES), 
-            YES
-        );
-    }
+    // Request redraw on the main thread; duplicate requests coalesce until the UI drains them
+    gUiCommands.post(gRedrawCommand);
 }
 
-// Function to generate a simple animation frame
+// Function to generate a simple animation frame; supersedes any frame still in flight
 void generateAnimationFrame(std::size_t frameId)
 {
-    std::vector<std::uint32_t> newData(gImageWidth * gImageHeight);
-    for (int y = 0; y < gImageHeight; ++y) {
-        for (int x = 0; x < gImageWidth; ++x) {
-            double timeFactor = frameId * gTargetFrameTime;
-            std::uint8_t r = static_cast<std::uint8_t>((cos((double)x / gImageWidth + timeFactor) * 0.5 + 0.5) * 255);
-            std::uint8_t g = static_cast<std::uint8_t>((sin((double)y / gImageHeight + timeFactor) * 0.5 + 0.5) * 255);
-            std::uint8_t b = static_cast<std::uint8_t>((cos((double)(x + y) / (gImageWidth + gImageHeight) + timeFactor) * 0.5 + 0.5) * 255);
-            std::uint8_t a = 255;
-
-            // ARGB format (macOS expects premultiplied alpha)
-            newData[y * gImageWidth + x] = (a << 24) | (r << 16) | (g << 8) | b;
-        }
+    // The frame is due when the next timer fire would present it
+    auto deadline = WorkerPool::Clock::now() + std::chrono::duration_cast<WorkerPool::Clock::duration>(
+        std::chrono::duration<double>(gTargetFrameTime));
+    if (gFrameRenderer) {
+        gInputLatency.frameRequested(frameId);
+        if (gCanvas)
+            gCanvas->setFrameViewport(frameId, gCanvasViewport);
+        gFrameRenderer->requestFrame(frameId, deadline);
     }
-    
-    updateImageData(newData);
+
+    // Queued behind the frame's bands, so only idle workers shade them
+    if (gCanvas)
+        gCanvas->prefetch(gCanvasViewport, gImageWidth, gImageHeight);
 }
 
 // Timer callback for animation
 void timerCallback(CFRunLoopTimerRef timer, void* info)
 {
-    static std::size_t frameId = 0;
+    // Frame 0 was requested during startup
+    static std::size_t frameId = 1;
     generateAnimationFrame(frameId++);
+
+    // Periodic memory breakdown, renderer statistics and input latency
+    if (frameId % gMemoryReportInterval == 0) {
+        std::fputs(memoryGovernor().report().c_str(), stderr);
+        if (gFrameRenderer)
+            std::fputs(gFrameRenderer->statsReport().c_str(), stderr);
+        std::fputs(gInputLatency.report().c_str(), stderr);
+    }
 }
 
 int main()
 {
+    gLaunchTime = StartupClock::now();
+
+    // Configure the memory budget before anything allocates frame buffers
+    MemoryGovernor& governor = memoryGovernor();
+    governor.setBudget(memoryBudgetFromEnvironment("MACOS_WINDOW_MEMORY_BUDGET_MB", gDefaultMemoryBudget));
+    governor.setEssentialReserve(2 * gFrameBytes);
+    gFrontBufferOwner = governor.registerOwner("frame.front", MemoryOwnerKind::Essential);
+
+    const char* shading = std::getenv("MACOS_WINDOW_SHADING");
+    if (shading && std::string(shading) == "fixed")
+        gShadingMode = ShadingMode::FixedPoint;
+    else if (shading && std::string(shading) == "adaptive")
+        gShadingMode = ShadingMode::Adaptive;
+    const char* shadingError = std::getenv("MACOS_WINDOW_SHADING_ERROR");
+    if (shadingError && *shadingError)
+        gShadingErrorBudget = std::atoi(shadingError);
+
+    const char* temporal = std::getenv("MACOS_WINDOW_TEMPORAL");
+    if (temporal && std::string(temporal) == "checkerboard")
+        gTemporalMode = TemporalMode::Checkerboard;
+    else if (temporal && std::string(temporal) == "interlaced")
+        gTemporalMode = TemporalMode::Interlaced;
+
+    // Temporal reconstruction works on ARGB history, so HDR frames render in full
+    const char* hdr = std::getenv("MACOS_WINDOW_HDR");
+    if (hdr && *hdr) {
+        gHdrShading = true;
+        gTemporalMode = TemporalMode::Full;
+        if (std::string(hdr) == "aces")
+            gToneMap = ToneMapOperator::Aces;
+        else if (std::string(hdr) == "clamp")
+            gToneMap = ToneMapOperator::Clamp;
+    }
+
+    // The canvas is static, so there is no history to reconstruct from or HDR to shade
+    const char* canvas = std::getenv("MACOS_WINDOW_CANVAS");
+    bool canvasMode = canvas && *canvas && std::string(canvas) != "0";
+    if (canvasMode) {
+        gTemporalMode = TemporalMode::Full;
+        gHdrShading = false;
+    }
+
+    // Workers reach the main thread only through the UI command queue
+    setUpUiCommands();
+
+    // Band renderer on a worker pool; publishing goes through updateImageData.
+    // Workers and buffers are set up before anything else so the first frame
+    // renders while the window is being built.
+    gWorkerPool = new WorkerPool();
+    if (canvasMode) {
+        gCanvas = new VirtualCanvas(*gWorkerPool, gCanvasSide, gCanvasSide, shadeCanvasPattern,
+            memoryBudgetFromEnvironment("MACOS_WINDOW_CANVAS_CACHE_MB", gDefaultCanvasCacheBytes));
+        gCanvasViewport.centerX = gCanvasSide / 2;
+        gCanvasViewport.centerY = gCanvasSide / 2;
+        gCanvas->setFrameViewport(0, gCanvasViewport);
+    }
+    gFrameRenderer = new FrameRenderer(
+        *gWorkerPool,
+        gImageWidth,
+        gImageHeight,
+        gBandRows,
+        [](std::size_t frameId, std::uint32_t* pixels, int firstRow, int lastRow) {
+            if (gCanvas)
+                gCanvas->render(ArgbView(pixels, gImageWidth, gImageHeight).rows(firstRow, lastRow), frameRows(gImageWidth, gImageHeight, firstRow),
+                    gCanvas->frameViewport(frameId));
+            else if (gHdrShading)
+                shadeAnimationRowsHdrToneMapped(gToneMap, pixels, gImageWidth, gImageHeight, frameId, gTargetFrameTime, firstRow, lastRow);
+            else
+                shadeAnimationRows(gShadingMode, pixels, gImageWidth, gImageHeight, frameId, gTargetFrameTime, firstRow, lastRow, gShadingErrorBudget);
+        },
+        [](std::size_t frameId, const std::vector<std::uint32_t>& pixels) {
+            gInputLatency.frameReached(frameId, FrameStage::Rendered);
+            updateImageData(pixels, frameId);
+        },
+        "gradient"
+    );
+    gFrameRenderer->setTemporalMode(gTemporalMode,
+        [](std::size_t frameId, TemporalMode mode, int parity, std::uint32_t* pixels, int firstRow, int lastRow) {
+            shadeAnimationRowsTemporal(gShadingMode, mode, parity, pixels, gImageWidth, gImageHeight, frameId, gTargetFrameTime, firstRow, lastRow, gShadingErrorBudget);
+        });
+    const char* frameLogPath = std::getenv("MACOS_WINDOW_FRAME_LOG");
+    if (frameLogPath && *frameLogPath) {
+        gFrameLog = new FrameLog(frameLogPath);
+        gFrameRenderer->setFrameLog(gFrameLog);
+        gFrameLogSource = gFrameRenderer->frameLogSource();
+    }
+    startMetricsExporter();
+    generateAnimationFrame(0);
+    gFrameRenderer->prewarm(2);
+
     // Get shared application
     ObjcObject application = sendClassMessage<ObjcObject>(getClass("NSApplication"), "sharedApplication");
     sendMessage<void>(application, "setActivationPolicy:", AppActivation::Regular);
@@ -281,10 +629,10 @@ int main()
     ObjcObject newContentView = sendClassMessage<ObjcObject>(contentViewClass, "alloc");
     newContentView = sendMessage<ObjcObject>(newContentView, "initWithFrame:", contentBounds);
     sendMessage<void>(window, "setContentView:", newContentView);
-    sendMessage<void>(newContentView, "setNeedsDisplay:", YES);
     
     // Store the content view reference for dynamic updates
     gContentView = newContentView;
+    sendMessage<void>(newContentView, "setNeedsDisplay:", YES);
     
     // Set up a timer for animation demonstration using the target FPS
     CFRunLoopTimerContext timerContext = {0};
@@ -306,6 +654,8 @@ int main()
     // Clean up
     CFRunLoopTimerInvalidate(timer);
     CFRelease(timer);
+    CFRunLoopSourceInvalidate(gUiCommandSource);
+    CFRelease(gUiCommandSource);
     
     return 0;
 }
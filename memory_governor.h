@@ -0,0 +1,311 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <condition_variable>
+#include <cstdlib>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Who holds the memory, in the order the governor gives it back
+enum class MemoryOwnerKind
+{
+    Essential,  // Buffers the render loop cannot run without; never refused
+    Cache,      // Evicted first under pressure
+    Pool,       // Shrunk second under pressure
+    Optional    // New consumers refused once the budget is tight
+};
+
+struct MemoryOwnerUsage
+{
+    std::string name;
+    MemoryOwnerKind kind;
+    std::size_t bytes;
+    std::size_t peakBytes;
+    std::size_t refusals;
+};
+
+// Tracks frame-sized allocations by owner and enforces a process budget.
+// Owners that can give memory back register a reclaim callback: it is called
+// without the governor lock held, must free up to the requested number of
+// bytes and returns how many it actually freed. The governor subtracts the
+// returned amount from the owner, so the owner must not release() it again.
+// Slots of unregistered owners are reused by later registrations.
+class MemoryGovernor
+{
+public:
+    using OwnerId = int;
+    using ReclaimFunction = std::function<std::size_t(std::size_t)>;
+
+    explicit MemoryGovernor(std::size_t budgetBytes = 0)
+        : mBudgetBytes(budgetBytes)
+    {
+    }
+
+    void setBudget(std::size_t budgetBytes)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mBudgetBytes = budgetBytes;
+    }
+
+    // Headroom kept free for essential owners; optional growth may not use it
+    void setEssentialReserve(std::size_t reserveBytes)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mEssentialReserveBytes = reserveBytes;
+    }
+
+    std::size_t budget() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mBudgetBytes;
+    }
+
+    std::size_t totalBytes() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mTotalBytes;
+    }
+
+    OwnerId registerOwner(const std::string& name, MemoryOwnerKind kind, ReclaimFunction reclaim = nullptr)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        Owner owner;
+        owner.usage.name = name;
+        owner.usage.kind = kind;
+        owner.usage.bytes = 0;
+        owner.usage.peakBytes = 0;
+        owner.usage.refusals = 0;
+        owner.reclaim = reclaim;
+        if (!mFreeOwners.empty()) {
+            OwnerId ownerId = mFreeOwners.back();
+            mFreeOwners.pop_back();
+            mOwners[ownerId] = owner;
+            return ownerId;
+        }
+        mOwners.push_back(owner);
+        return static_cast<OwnerId>(mOwners.size() - 1);
+    }
+
+    // Drop an owner that is going away, releasing whatever it still holds.
+    // Waits for reclaim callbacks already running on other threads, so the
+    // callback is never running or called again once this returns. It must
+    // not be called from the owner's own callback, or while holding a lock
+    // that callback takes.
+    void unregisterOwner(OwnerId ownerId)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mOwners[ownerId].reclaim = nullptr;
+        mReclaimDone.wait(lock, [this, ownerId] { return mOwners[ownerId].reclaimsRunning == 0; });
+        Owner& owner = mOwners[ownerId];
+        mTotalBytes -= owner.usage.bytes;
+        owner.usage.bytes = 0;
+        owner.retired = true;
+        mFreeOwners.push_back(ownerId);
+    }
+
+    // Charge memory the caller is going to allocate regardless of the budget.
+    // Caches and pools are squeezed to make room. Returns false when the
+    // process is over budget even after reclaiming.
+    bool acquire(OwnerId ownerId, std::size_t bytes)
+    {
+        std::size_t overBy = charge(ownerId, bytes);
+        if (overBy == 0)
+            return true;
+
+        reclaim(overBy, ownerId);
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mBudgetBytes == 0 || mTotalBytes <= mBudgetBytes;
+    }
+
+    // Charge memory only if it fits the budget, minus the essential reserve
+    // for anything that is not itself essential. Unless squeeze is false,
+    // caches and pools are squeezed before giving up; a refused caller must
+    // not allocate.
+    bool tryAcquire(OwnerId ownerId, std::size_t bytes, bool squeeze = true)
+    {
+        std::size_t shortfall = 0;
+        if (tryCharge(ownerId, bytes, shortfall))
+            return true;
+
+        if (squeeze)
+            reclaim(shortfall, ownerId);
+        if (squeeze && tryCharge(ownerId, bytes, shortfall))
+            return true;
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        ++mOwners[ownerId].usage.refusals;
+        return false;
+    }
+
+    void release(OwnerId ownerId, std::size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        Owner& owner = mOwners[ownerId];
+        if (bytes > owner.usage.bytes)
+            bytes = owner.usage.bytes;
+        owner.usage.bytes -= bytes;
+        mTotalBytes -= bytes;
+    }
+
+    // Ask caches, then pools, to free at least the given number of bytes
+    std::size_t reclaim(std::size_t bytes, OwnerId requester = -1)
+    {
+        std::size_t freed = reclaimKind(MemoryOwnerKind::Cache, bytes, requester);
+        if (freed < bytes)
+            freed += reclaimKind(MemoryOwnerKind::Pool, bytes - freed, requester);
+        return freed;
+    }
+
+    std::vector<MemoryOwnerUsage> snapshot() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        std::vector<MemoryOwnerUsage> usage;
+        usage.reserve(mOwners.size());
+        for (const Owner& owner : mOwners) {
+            if (!owner.retired)
+                usage.push_back(owner.usage);
+        }
+        return usage;
+    }
+
+    // Human-readable per-owner breakdown, one owner per line
+    std::string report() const
+    {
+        std::vector<MemoryOwnerUsage> usage = snapshot();
+        std::size_t total = totalBytes();
+        std::size_t budgetBytes = budget();
+
+        std::string text;
+        char line[256];
+        std::snprintf(line, sizeof(line), "memory: %.1f MiB of %.1f MiB budget\n",
+            total / 1048576.0, budgetBytes / 1048576.0);
+        text += line;
+        for (const MemoryOwnerUsage& owner : usage) {
+            std::snprintf(line, sizeof(line), "  %-24s %-9s %10.2f MiB (peak %.2f MiB, refused %zu)\n",
+                owner.name.c_str(), kindName(owner.kind), owner.bytes / 1048576.0,
+                owner.peakBytes / 1048576.0, owner.refusals);
+            text += line;
+        }
+        return text;
+    }
+
+    static const char* kindName(MemoryOwnerKind kind)
+    {
+        switch (kind) {
+            case MemoryOwnerKind::Essential: return "essential";
+            case MemoryOwnerKind::Cache: return "cache";
+            case MemoryOwnerKind::Pool: return "pool";
+            case MemoryOwnerKind::Optional: return "optional";
+        }
+        return "unknown";
+    }
+
+private:
+    struct Owner
+    {
+        MemoryOwnerUsage usage;
+        ReclaimFunction reclaim;
+        int reclaimsRunning = 0;  // Callbacks called and not yet returned
+        bool retired = false;
+    };
+
+    // Returns how far over budget the process is after charging
+    std::size_t charge(OwnerId ownerId, std::size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        addBytes(mOwners[ownerId], bytes);
+        if (mBudgetBytes == 0 || mTotalBytes <= mBudgetBytes)
+            return 0;
+        return mTotalBytes - mBudgetBytes;
+    }
+
+    bool tryCharge(OwnerId ownerId, std::size_t bytes, std::size_t& shortfall)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        Owner& owner = mOwners[ownerId];
+        std::size_t limit = mBudgetBytes;
+        if (limit != 0 && owner.usage.kind != MemoryOwnerKind::Essential)
+            limit = limit > mEssentialReserveBytes ? limit - mEssentialReserveBytes : 0;
+
+        if (mBudgetBytes == 0 || mTotalBytes + bytes <= limit) {
+            addBytes(owner, bytes);
+            return true;
+        }
+        shortfall = mTotalBytes + bytes - limit;
+        return false;
+    }
+
+    void addBytes(Owner& owner, std::size_t bytes)
+    {
+        owner.usage.bytes += bytes;
+        if (owner.usage.bytes > owner.usage.peakBytes)
+            owner.usage.peakBytes = owner.usage.bytes;
+        mTotalBytes += bytes;
+    }
+
+    std::size_t reclaimKind(MemoryOwnerKind kind, std::size_t bytes, OwnerId requester)
+    {
+        std::size_t freed = 0;
+        for (std::size_t i = 0; freed < bytes; ++i) {
+            ReclaimFunction reclaimOwner;
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                if (i >= mOwners.size())
+                    break;
+                Owner& owner = mOwners[i];
+                if (owner.usage.kind != kind || owner.usage.bytes == 0 || !owner.reclaim
+                    || static_cast<OwnerId>(i) == requester)
+                    continue;
+                reclaimOwner = owner.reclaim;
+                ++owner.reclaimsRunning;
+            }
+
+            // Callbacks may free buffers or call back into the governor;
+            // unregisterOwner() waits for them, so the slot stays this owner's
+            std::size_t ownerFreed = reclaimOwner(bytes - freed);
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                Owner& owner = mOwners[i];
+                ownerFreed = std::min(ownerFreed, owner.usage.bytes);
+                owner.usage.bytes -= ownerFreed;
+                mTotalBytes -= ownerFreed;
+                --owner.reclaimsRunning;
+            }
+            mReclaimDone.notify_all();
+            freed += ownerFreed;
+        }
+        return freed;
+    }
+
+    mutable std::mutex mMutex;
+    std::condition_variable mReclaimDone;
+    std::vector<Owner> mOwners;
+    std::vector<OwnerId> mFreeOwners;
+    std::size_t mBudgetBytes = 0;
+    std::size_t mEssentialReserveBytes = 0;
+    std::size_t mTotalBytes = 0;
+};
+
+// Process-wide governor shared by every frame-sized consumer
+inline MemoryGovernor& memoryGovernor()
+{
+    static MemoryGovernor governor;
+    return governor;
+}
+
+// Budget in MiB from the environment, or the given default
+inline std::size_t memoryBudgetFromEnvironment(const char* variable, std::size_t defaultBytes)
+{
+    const char* value = std::getenv(variable);
+    if (!value || !*value)
+        return defaultBytes;
+    char* end = nullptr;
+    unsigned long long megabytes = std::strtoull(value, &end, 10);
+    if (end == value)
+        return defaultBytes;
+    return static_cast<std::size_t>(megabytes) * 1024 * 1024;
+}
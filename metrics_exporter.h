@@ -0,0 +1,406 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "command_queue.h"
+#include "energy_meter.h"
+#include "frame_renderer.h"
+#include "input_latency.h"
+#include "memory_governor.h"
+
+constexpr const char* gMetricsPrefix = "macos_window_";
+constexpr int gMetricsRequestTimeoutMs = 200;
+constexpr std::size_t gMetricsMaxRequestBytes = 4096;
+
+// Builds a scrape in the Prometheus text exposition format; every metric name
+// gets gMetricsPrefix
+class MetricsWriter
+{
+public:
+    void family(const std::string& name, const char* type, const char* help)
+    {
+        mText += "# HELP " + (gMetricsPrefix + name) + " " + help + "\n";
+        mText += "# TYPE " + (gMetricsPrefix + name) + " " + type + "\n";
+    }
+
+    void sample(const std::string& name, double value, const std::string& labels = std::string())
+    {
+        char number[32];
+        std::snprintf(number, sizeof(number), "%.15g", value);
+        mText += gMetricsPrefix + name;
+        if (!labels.empty())
+            mText += "{" + labels + "}";
+        mText += " ";
+        mText += number;
+        mText += "\n";
+    }
+
+    void counter(const std::string& name, const char* help, double value)
+    {
+        family(name, "counter", help);
+        sample(name, value);
+    }
+
+    void gauge(const std::string& name, const char* help, double value)
+    {
+        family(name, "gauge", help);
+        sample(name, value);
+    }
+
+    const std::string& text() const { return mText; }
+
+    // key="value" with the value escaped; join several with commas
+    static std::string label(const char* key, const std::string& value)
+    {
+        std::string text = std::string(key) + "=\"";
+        for (char c : value) {
+            if (c == '\\' || c == '"')
+                text += '\\';
+            if (c == '\n') {
+                text += "\\n";
+                continue;
+            }
+            text += c;
+        }
+        return text + "\"";
+    }
+
+private:
+    std::string mText;
+};
+
+// Serves metrics on a Unix domain socket from a thread of its own. Every
+// connection gets one scrape: an HTTP GET is answered with an HTTP response,
+// so `curl --unix-socket` works, and anything else gets the bare text.
+// Collectors are registered before start() and run on the exporter thread
+// only; they are expected to read lock-free counters, so a scrape never
+// waits on or stalls the render path.
+class MetricsExporter
+{
+public:
+    using Collector = std::function<void(MetricsWriter&)>;
+
+    explicit MetricsExporter(const std::string& socketPath)
+        : mSocketPath(socketPath)
+    {
+    }
+
+    ~MetricsExporter() { stop(); }
+
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+    void addCollector(Collector collector) { mCollectors.push_back(collector); }
+
+    // Bind the socket and start serving. A stale socket left at the path by
+    // an exporter that died is replaced; a live one, or any other file, is an
+    // error rather than something to delete.
+    void start()
+    {
+        struct sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (mSocketPath.size() >= sizeof(address.sun_path))
+            throw std::runtime_error("metrics socket path too long: " + mSocketPath);
+        std::memcpy(address.sun_path, mSocketPath.c_str(), mSocketPath.size() + 1);
+
+        if (pipe(mStopPipe) < 0)
+            throwSystemError("pipe");
+        mListenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (mListenFd < 0)
+            throwSystemError("socket");
+        fcntl(mListenFd, F_SETFD, FD_CLOEXEC);
+        removeStaleSocket(address);
+        if (bind(mListenFd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0)
+            throwSystemError("bind");
+        if (listen(mListenFd, 8) < 0)
+            throwSystemError("listen");
+
+        mThread = std::thread([this] { serve(); });
+    }
+
+    void stop()
+    {
+        if (mThread.joinable()) {
+            char byte = 0;
+            ssize_t written = write(mStopPipe[1], &byte, 1);
+            (void)written;
+            mThread.join();
+            unlink(mSocketPath.c_str());
+        }
+        closeFd(mListenFd);
+        closeFd(mStopPipe[0]);
+        closeFd(mStopPipe[1]);
+    }
+
+    // Run every collector on the calling thread
+    std::string scrape()
+    {
+        MetricsWriter writer;
+        for (const Collector& collector : mCollectors)
+            collector(writer);
+        mScrapes.fetch_add(1, std::memory_order_relaxed);
+        return writer.text();
+    }
+
+    std::uint64_t scrapeCount() const { return mScrapes.load(std::memory_order_relaxed); }
+
+private:
+    void serve()
+    {
+        for (;;) {
+            struct pollfd fds[2] = {};
+            fds[0].fd = mListenFd;
+            fds[0].events = POLLIN;
+            fds[1].fd = mStopPipe[0];
+            fds[1].events = POLLIN;
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR)
+                    continue;
+                return;
+            }
+            if (fds[1].revents)
+                return;
+            if (!(fds[0].revents & POLLIN))
+                continue;
+
+            int client = accept(mListenFd, nullptr, nullptr);
+            if (client < 0)
+                continue;
+            respond(client);
+            close(client);
+        }
+    }
+
+    void respond(int client)
+    {
+#ifdef SO_NOSIGPIPE
+        int one = 1;
+        setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+        // Read the request head, or give up waiting and answer a silent client anyway
+        std::string request;
+        char buffer[512];
+        while (request.size() < gMetricsMaxRequestBytes && request.find("\n\n") == std::string::npos
+            && request.find("\r\n\r\n") == std::string::npos) {
+            struct pollfd fd = { client, POLLIN, 0 };
+            if (poll(&fd, 1, gMetricsRequestTimeoutMs) <= 0)
+                break;
+            ssize_t received = recv(client, buffer, sizeof(buffer), 0);
+            if (received <= 0)
+                break;
+            request.append(buffer, static_cast<std::size_t>(received));
+            if (request.compare(0, 3, "GET") != 0)
+                break;
+        }
+
+        std::string body = scrape();
+        std::string response;
+        if (request.compare(0, 3, "GET") == 0) {
+            response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+                + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n";
+        }
+        response += body;
+        sendAll(client, response);
+    }
+
+    static void sendAll(int fd, const std::string& data)
+    {
+#ifdef MSG_NOSIGNAL
+        const int flags = MSG_NOSIGNAL;
+#else
+        const int flags = 0;
+#endif
+        std::size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t written = send(fd, data.data() + sent, data.size() - sent, flags);
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written <= 0)
+                return;
+            sent += static_cast<std::size_t>(written);
+        }
+    }
+
+    static void closeFd(int& fd)
+    {
+        if (fd >= 0)
+            close(fd);
+        fd = -1;
+    }
+
+    // Unlink the path only if it is a socket nobody is listening on
+    void removeStaleSocket(const struct sockaddr_un& address)
+    {
+        struct stat status;
+        if (lstat(mSocketPath.c_str(), &status) < 0) {
+            if (errno == ENOENT)
+                return;
+            throwSystemError("lstat");
+        }
+        if (!S_ISSOCK(status.st_mode))
+            throw std::runtime_error("metrics socket path exists and is not a socket: " + mSocketPath);
+
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (probe < 0)
+            throwSystemError("socket");
+        int result = connect(probe, reinterpret_cast<const struct sockaddr*>(&address), sizeof(address));
+        int error = errno;
+        close(probe);
+        if (result == 0)
+            throw std::runtime_error("metrics socket is already being served: " + mSocketPath);
+        if (error != ECONNREFUSED) {
+            errno = error;
+            throwSystemError("connect");
+        }
+        if (unlink(mSocketPath.c_str()) < 0 && errno != ENOENT)
+            throwSystemError("unlink");
+    }
+
+    static void throwSystemError(const char* call)
+    {
+        throw std::runtime_error(std::string(call) + ": " + std::strerror(errno));
+    }
+
+    std::string mSocketPath;
+    std::vector<Collector> mCollectors;
+    int mListenFd = -1;
+    int mStopPipe[2] = { -1, -1 };
+    std::thread mThread;
+    std::atomic<std::uint64_t> mScrapes{ 0 };
+};
+
+// Frame, band and buffer pool metrics of one renderer, labelled by source.
+// previousPublished and previousTime carry the frame rate between scrapes.
+inline void writeRendererMetrics(
+    MetricsWriter& writer,
+    const FrameRenderer& renderer,
+    std::uint64_t& previousPublished,
+    std::chrono::steady_clock::time_point& previousTime)
+{
+    const RenderCounters& counters = renderer.counters();
+    const FrameBufferPool& buffers = renderer.buffers();
+    std::string source = MetricsWriter::label("source", renderer.sourceName());
+
+    std::uint64_t published = counters.framesPublished.value();
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - previousTime).count();
+    double rate = elapsed > 0.0 ? (published - previousPublished) / elapsed : 0.0;
+    previousPublished = published;
+    previousTime = now;
+
+    writer.family("frame_rate_hz", "gauge", "Frames published per second since the previous scrape");
+    writer.sample("frame_rate_hz", rate, source);
+    writer.family("frames_total", "counter", "Frames by outcome");
+    writer.sample("frames_total", counters.framesRequested.value(), source + "," + MetricsWriter::label("outcome", "requested"));
+    writer.sample("frames_total", published, source + "," + MetricsWriter::label("outcome", "published"));
+    writer.sample("frames_total", counters.framesCancelled.value(), source + "," + MetricsWriter::label("outcome", "dropped"));
+    writer.family("frames_full_total", "counter", "Published frames shaded in full rather than reconstructed");
+    writer.sample("frames_full_total", counters.framesFull.value(), source);
+    writer.family("frame_deadline_misses_total", "counter", "Published frames that finished after their deadline");
+    writer.sample("frame_deadline_misses_total", counters.deadlineMisses.value(), source);
+    writer.family("bands_total", "counter", "Row bands by outcome");
+    writer.sample("bands_total", counters.bandsRendered.value(), source + "," + MetricsWriter::label("outcome", "rendered"));
+    writer.sample("bands_total", counters.bandsSkipped.value(), source + "," + MetricsWriter::label("outcome", "skipped"));
+    writer.family("band_cpu_seconds_total", "counter", "Worker time spent shading bands");
+    writer.sample("band_cpu_seconds_total", counters.bandNanos.value() / 1e9, source);
+
+    std::uint64_t hits = buffers.hits();
+    std::uint64_t misses = buffers.misses();
+    writer.family("buffer_pool_buffers", "gauge", "Frame buffers by state");
+    writer.sample("buffer_pool_buffers", static_cast<double>(buffers.idleCount()), source + "," + MetricsWriter::label("state", "idle"));
+    writer.sample("buffer_pool_buffers", static_cast<double>(buffers.inUseCount()), source + "," + MetricsWriter::label("state", "in_use"));
+    writer.family("buffer_pool_requests_total", "counter", "Buffer requests served from the pool (hit) or allocated (miss)");
+    writer.sample("buffer_pool_requests_total", hits, source + "," + MetricsWriter::label("result", "hit"));
+    writer.sample("buffer_pool_requests_total", misses, source + "," + MetricsWriter::label("result", "miss"));
+    writer.family("buffer_pool_hit_ratio", "gauge", "Share of buffer requests served without allocating");
+    writer.sample("buffer_pool_hit_ratio", hits + misses ? double(hits) / (hits + misses) : 0.0, source);
+}
+
+// Stage latency quantiles from input to each frame stage, as summaries
+inline void writeLatencyMetrics(MetricsWriter& writer, const InputLatencyTracker& tracker)
+{
+    struct Series
+    {
+        const char* stage;
+        const LatencyHistogram& histogram;
+    };
+    const Series series[] = {
+        { "rendered", tracker.stage(FrameStage::Rendered) },
+        { "published", tracker.stage(FrameStage::Published) },
+        { "presented", tracker.stage(FrameStage::Presented) },
+        { "photon", tracker.inputToPhoton() },
+    };
+    const double quantiles[] = { 0.5, 0.9, 0.99 };
+
+    writer.family("input_latency_seconds", "summary", "Latency from input to each frame stage, bucketed at 100 us");
+    for (const Series& s : series) {
+        std::string stage = MetricsWriter::label("stage", s.stage);
+        for (double quantile : quantiles) {
+            char text[16];
+            std::snprintf(text, sizeof(text), "%g", quantile);
+            writer.sample("input_latency_seconds", s.histogram.quantileMs(quantile) / 1e3, stage + "," + MetricsWriter::label("quantile", text));
+        }
+        writer.sample("input_latency_seconds_sum", s.histogram.meanMs() * s.histogram.count() / 1e3, stage);
+        writer.sample("input_latency_seconds_count", s.histogram.count(), stage);
+    }
+    writer.counter("inputs_dropped_total", "Inputs dropped unseen when too many were pending", tracker.droppedInputs());
+}
+
+inline void writeCommandMetrics(MetricsWriter& writer, const CommandQueue& queue)
+{
+    CommandQueueStats stats = queue.stats();
+    writer.family("ui_commands_total", "counter", "UI commands by outcome");
+    writer.sample("ui_commands_total", stats.posted, MetricsWriter::label("outcome", "posted"));
+    writer.sample("ui_commands_total", stats.coalesced, MetricsWriter::label("outcome", "coalesced"));
+    writer.sample("ui_commands_total", stats.executed, MetricsWriter::label("outcome", "executed"));
+    writer.counter("ui_wakeups_total", "Wakeups of the UI thread by the command queue", stats.wakeups);
+}
+
+// Memory by governor owner. The governor takes its lock here, but it is only
+// ever touched when buffers are allocated or freed, never per band.
+inline void writeMemoryMetrics(MetricsWriter& writer, const MemoryGovernor& governor)
+{
+    std::vector<MemoryOwnerUsage> usage = governor.snapshot();
+    writer.gauge("memory_budget_bytes", "Process memory budget, 0 when unlimited", static_cast<double>(governor.budget()));
+    writer.family("memory_bytes", "gauge", "Bytes charged to each owner");
+    for (const MemoryOwnerUsage& owner : usage) {
+        writer.sample("memory_bytes", static_cast<double>(owner.bytes),
+            MetricsWriter::label("owner", owner.name) + "," + MetricsWriter::label("kind", MemoryGovernor::kindName(owner.kind)));
+    }
+    writer.family("memory_peak_bytes", "gauge", "Highest bytes ever charged to each owner");
+    for (const MemoryOwnerUsage& owner : usage)
+        writer.sample("memory_peak_bytes", static_cast<double>(owner.peakBytes), MetricsWriter::label("owner", owner.name));
+    writer.family("memory_refusals_total", "counter", "Allocations refused to each owner by the budget");
+    for (const MemoryOwnerUsage& owner : usage)
+        writer.sample("memory_refusals_total", static_cast<double>(owner.refusals), MetricsWriter::label("owner", owner.name));
+}
+
+// RAPL energy by domain, 0 samples and energy_available 0 where the counters
+// cannot be read. Joules per frame is the rate of energy_joules_total over
+// the rate of published frames_total.
+inline void writeEnergyMetrics(MetricsWriter& writer, EnergyCounter& energy)
+{
+    const EnergyMeter& meter = energy.meter();
+    std::vector<double> joules = energy.update();
+    writer.gauge("energy_available", "Whether RAPL energy counters could be read", meter.available() ? 1.0 : 0.0);
+    writer.family("energy_joules_total", "counter", "CPU package and DRAM energy by RAPL domain; subdomains are part of their package");
+    for (std::size_t domain = 0; domain < joules.size(); ++domain)
+        writer.sample("energy_joules_total", joules[domain], MetricsWriter::label("domain", meter.domainName(domain)));
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// CPUs of each NUMA node the process may run on. Machines with one node,
+// and platforms without NUMA information, report a single node, and every
+// NUMA-aware path in the renderer is then a no-op.
+struct NumaTopology
+{
+    std::vector<std::vector<int>> nodeCpus;
+
+    std::size_t nodeCount() const { return nodeCpus.empty() ? 1 : nodeCpus.size(); }
+    bool multiNode() const { return nodeCpus.size() > 1; }
+};
+
+// Parse a sysfs CPU list such as "0-3,8-11"
+inline std::vector<int> parseCpuList(const std::string& text)
+{
+    std::vector<int> cpus;
+    std::stringstream ranges(text);
+    std::string range;
+    while (std::getline(ranges, range, ',')) {
+        if (range.empty() || range[0] < '0' || range[0] > '9')
+            continue;
+        std::size_t dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; ++cpu)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+// Nodes with at least one CPU in the process's affinity mask, read from sysfs
+inline NumaTopology detectNumaTopology()
+{
+    NumaTopology topology;
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    bool haveMask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+    std::ifstream online("/sys/devices/system/node/online");
+    std::string nodeList;
+    if (!std::getline(online, nodeList))
+        return topology;
+    for (int node : parseCpuList(nodeList)) {
+        std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        std::string cpuList;
+        if (!std::getline(file, cpuList))
+            continue;
+        std::vector<int> cpus;
+        for (int cpu : parseCpuList(cpuList)) {
+            if (!haveMask || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)))
+                cpus.push_back(cpu);
+        }
+        if (!cpus.empty())
+            topology.nodeCpus.push_back(cpus);
+    }
+#endif
+    return topology;
+}
+
+// Detected once per process
+inline const NumaTopology& systemNumaTopology()
+{
+    static const NumaTopology topology = detectNumaTopology();
+    return topology;
+}
+
+// The given CPUs split into nodeCount equal nodes, to exercise the NUMA paths
+// on a single-node machine; nodes left without a CPU are not pinned
+inline NumaTopology simulatedNumaTopology(std::size_t nodeCount, const std::vector<int>& cpus)
+{
+    NumaTopology topology;
+    topology.nodeCpus.resize(nodeCount);
+    for (std::size_t i = 0; i < cpus.size(); ++i)
+        topology.nodeCpus[i * nodeCount / cpus.size()].push_back(cpus[i]);
+    return topology;
+}
+
+// Node serving band out of bandCount: each node gets one contiguous range of
+// bands, so the pages of its range are touched and reused by its own workers
+inline std::size_t numaNodeForBand(int band, int bandCount, std::size_t nodeCount)
+{
+    return bandCount > 0 ? static_cast<std::size_t>(band) * nodeCount / static_cast<std::size_t>(bandCount) : 0;
+}
+
+// Restrict the calling thread to the given CPUs; false where affinity is not supported
+inline bool pinCurrentThread(const std::vector<int>& cpus)
+{
+#ifdef __linux__
+    if (cpus.empty())
+        return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpus;
+    return false;
+#endif
+}
+
+// Return the whole pages inside [data, data + bytes) to the kernel. They read
+// as zero afterwards and are placed on the node of whichever thread touches
+// them next, so a buffer filled by several nodes' workers ends up striped
+// across those nodes. The partial pages at either end keep their placement.
+inline void releaseForFirstTouch(void* data, std::size_t bytes)
+{
+#ifdef __linux__
+    long pageSize = sysconf(_SC_PAGESIZE);
+    if (pageSize <= 0)
+        return;
+    std::uintptr_t page = static_cast<std::uintptr_t>(pageSize);
+    std::uintptr_t begin = (reinterpret_cast<std::uintptr_t>(data) + page - 1) & ~(page - 1);
+    std::uintptr_t end = (reinterpret_cast<std::uintptr_t>(data) + bytes) & ~(page - 1);
+    if (end > begin)
+        madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED);
+#else
+    (void)data;
+    (void)bytes;
+#endif
+}
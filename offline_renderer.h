@@ -0,0 +1,173 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "buffer_pool.h"
+#include "frame_arena.h"
+#include "sampling_profiler.h"
+#include "worker_pool.h"
+
+struct OfflineRenderStats
+{
+    std::uint64_t framesDelivered = 0;
+    double seconds = 0.0;
+    std::size_t framesInFlight = 0;
+    std::size_t groupSize = 0;       // Tasks, and so at most workers, per frame
+    std::size_t maxBuffered = 0;     // Most finished frames held back waiting for an earlier one
+    std::uint64_t reorderWaits = 0;  // Times delivery waited on a frame while later ones were done
+
+    double framesPerSecond() const { return seconds > 0.0 ? framesDelivered / seconds : 0.0; }
+};
+
+// Headless batch rendering of a range of frames. Small frames do not have
+// enough bands to keep every worker busy, so up to framesInFlight frames
+// render at once, each split into groupSize row ranges so that a group of
+// about threadCount / framesInFlight workers serves each frame. Frames are
+// dispatched in order, so the earliest frames get workers first, and finish
+// into a bounded reorder buffer of framesInFlight slots from which the sink
+// receives them strictly in order on the calling thread. A slot is reused
+// only after its frame has been delivered, which bounds memory to
+// framesInFlight buffers drawn from a FrameBufferPool.
+class OfflineRenderer
+{
+public:
+    using Clock = WorkerPool::Clock;
+    using ShadeFunction = std::function<void(std::size_t frameId, std::uint32_t* pixels, int firstRow, int lastRow)>;
+    using SinkFunction = std::function<void(std::size_t frameId, const std::vector<std::uint32_t>& pixels)>;
+
+    // framesInFlight 0 means one frame per worker
+    OfflineRenderer(
+        WorkerPool& pool,
+        int width,
+        int height,
+        ShadeFunction shade,
+        std::size_t framesInFlight = 0,
+        const std::string& name = "offline")
+        : mPool(pool)
+        , mWidth(width)
+        , mHeight(height)
+        , mShade(shade)
+        , mFramesInFlight(std::max<std::size_t>(1, framesInFlight ? framesInFlight : pool.threadCount()))
+        , mGroupSize(std::max<std::size_t>(1, (pool.threadCount() + mFramesInFlight - 1) / mFramesInFlight))
+        , mBuffers(static_cast<std::size_t>(width) * height, name + ".buffers", mFramesInFlight)
+        , mSlots(mFramesInFlight)
+    {
+        mGroupSize = std::min<std::size_t>(mGroupSize, static_cast<std::size_t>(std::max(1, height)));
+    }
+
+    ~OfflineRenderer()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mSlotChanged.wait(lock, [this] { return mRendering == 0; });
+    }
+
+    OfflineRenderer(const OfflineRenderer&) = delete;
+    OfflineRenderer& operator=(const OfflineRenderer&) = delete;
+
+    std::size_t framesInFlight() const { return mFramesInFlight; }
+    std::size_t groupSize() const { return mGroupSize; }
+
+    // Render frames [firstFrame, firstFrame + frameCount) and hand each to
+    // sink in frame order; returns when the last one has been delivered
+    OfflineRenderStats render(std::size_t firstFrame, std::size_t frameCount, SinkFunction sink)
+    {
+        OfflineRenderStats stats;
+        stats.framesInFlight = mFramesInFlight;
+        stats.groupSize = mGroupSize;
+        Clock::time_point started = Clock::now();
+
+        std::size_t end = firstFrame + frameCount;
+        std::size_t nextSubmit = firstFrame;
+        for (std::size_t nextDeliver = firstFrame; nextDeliver < end; ++nextDeliver) {
+            // Keep the window full: frames [nextDeliver, nextDeliver + framesInFlight) may be in flight
+            while (nextSubmit < end && nextSubmit < nextDeliver + mFramesInFlight)
+                submit(nextSubmit++, started, firstFrame);
+
+            Slot& slot = mSlots[nextDeliver % mFramesInFlight];
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                if (!slot.finished && mFinishedCount > 0)
+                    ++stats.reorderWaits;
+                mSlotChanged.wait(lock, [&slot] { return slot.finished; });
+                stats.maxBuffered = std::max(stats.maxBuffered, mFinishedCount - 1);
+            }
+
+            sink(nextDeliver, slot.pixels);
+            mBuffers.recycle(std::move(slot.pixels));
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                slot.finished = false;
+                --mFinishedCount;
+            }
+            ++stats.framesDelivered;
+        }
+
+        stats.seconds = std::chrono::duration<double>(Clock::now() - started).count();
+        return stats;
+    }
+
+private:
+    struct Slot
+    {
+        std::vector<std::uint32_t> pixels;
+        std::size_t pendingTasks = 0;
+        bool finished = false;
+    };
+
+    // Frames are ordered among themselves by index, one nanosecond apart
+    void submit(std::size_t frameId, Clock::time_point started, std::size_t firstFrame)
+    {
+        Slot& slot = mSlots[frameId % mFramesInFlight];
+        slot.pixels = mBuffers.acquire();
+        slot.pendingTasks = mGroupSize;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            ++mRendering;
+        }
+
+        std::vector<WorkerPool::Task> tasks;
+        tasks.reserve(mGroupSize);
+        int rowsPerTask = static_cast<int>((mHeight + mGroupSize - 1) / mGroupSize);
+        for (std::size_t task = 0; task < mGroupSize; ++task) {
+            int firstRow = static_cast<int>(task) * rowsPerTask;
+            int lastRow = std::min(mHeight, firstRow + rowsPerTask);
+            tasks.push_back([this, &slot, frameId, firstRow, lastRow] {
+                if (firstRow < lastRow) {
+                    FrameArenaScope scratch(threadFrameArena());
+                    ProfileStageScope stage("shade");
+                    mShade(frameId, slot.pixels.data(), firstRow, lastRow);
+                }
+                std::lock_guard<std::mutex> lock(mMutex);
+                if (--slot.pendingTasks == 0) {
+                    slot.finished = true;
+                    ++mFinishedCount;
+                    --mRendering;
+                    mSlotChanged.notify_all();
+                }
+            });
+        }
+        mPool.submitBatch(std::move(tasks), started + std::chrono::nanoseconds(frameId - firstFrame));
+    }
+
+    WorkerPool& mPool;
+    int mWidth;
+    int mHeight;
+    ShadeFunction mShade;
+    std::size_t mFramesInFlight;
+    std::size_t mGroupSize;
+    FrameBufferPool mBuffers;
+
+    std::mutex mMutex;
+    std::condition_variable mSlotChanged;
+    std::vector<Slot> mSlots;
+    std::size_t mFinishedCount = 0;
+    std::size_t mRendering = 0;
+};
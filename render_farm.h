@@ -0,0 +1,508 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+constexpr std::size_t gRenderFarmMaxChunkFrames = 32;
+constexpr int gRenderFarmPollMs = 10;
+
+struct RenderFarmOptions
+{
+    int workers = 4;
+    std::size_t chunkFrames = 8;    // Frames per assignment, at most gRenderFarmMaxChunkFrames
+    std::size_t chunksAhead = 2;    // Assignments queued per worker, so it never waits for the next one
+    int maxRestarts = 3;            // Per worker slot, before the slot is given up
+    double stragglerFactor = 2.0;   // Duplicate the chunk holding up delivery once it takes this many average chunk times
+};
+
+struct RenderFarmStats
+{
+    std::uint64_t framesDelivered = 0;
+    std::uint64_t chunksAssigned = 0;
+    std::uint64_t chunksDuplicated = 0;   // Straggler chunks also handed to an idle worker
+    std::uint64_t framesDiscarded = 0;    // Second results of duplicated frames
+    std::uint64_t framesReassigned = 0;   // Unfinished frames of crashed workers
+    std::uint64_t workerCrashes = 0;
+    std::uint64_t workerRestarts = 0;
+    std::vector<std::uint64_t> framesPerWorker;
+    double seconds = 0.0;
+
+    double framesPerSecond() const { return seconds > 0.0 ? framesDelivered / seconds : 0.0; }
+};
+
+// Index of the farm worker process the caller runs in; -1 in the coordinator
+inline int& renderFarmWorkerIndex()
+{
+    static int index = -1;
+    return index;
+}
+
+// Splits a frame range across local worker processes, so a long offline
+// render is not limited by one process's heap and allocator. Workers are
+// forked from the coordinator and share one anonymous mapping of frame slots
+// with it; each talks to the coordinator over a SOCK_SEQPACKET socket pair.
+// Chunks are pulled: a worker gets its next chunk when one completes, so a
+// slow worker simply takes fewer. Once nothing is left to hand out, the chunk
+// holding up delivery is duplicated to an idle worker when it runs long, and
+// the first result of each frame wins. A worker that dies is reaped and
+// restarted, and its unfinished frames go back to the front of the queue.
+// Frames reach the sink in order, straight from shared memory.
+//
+// Workers start as a copy of the coordinator with only the forking thread, so
+// the render function must not depend on other threads or on locks they may
+// have held at the fork.
+class RenderFarm
+{
+public:
+    using RenderFunction = std::function<void(std::size_t frameId, std::uint32_t* pixels, int width, int height)>;
+    using SinkFunction = std::function<void(std::size_t frameId, const std::uint32_t* pixels)>;
+
+    RenderFarm(int width, int height, RenderFunction render, RenderFarmOptions options = RenderFarmOptions())
+        : mWidth(width)
+        , mHeight(height)
+        , mRender(render)
+        , mOptions(options)
+    {
+        mOptions.workers = std::max(1, mOptions.workers);
+        mOptions.chunkFrames = std::min(std::max<std::size_t>(1, mOptions.chunkFrames), gRenderFarmMaxChunkFrames);
+        mOptions.chunksAhead = std::max<std::size_t>(1, mOptions.chunksAhead);
+
+        // Room for every queued chunk, a reserve for the chunk delivery waits on and one duplicate
+        mSlotCount = (static_cast<std::size_t>(mOptions.workers) * mOptions.chunksAhead + 2) * mOptions.chunkFrames;
+        mSlotBytes = static_cast<std::size_t>(width) * height * sizeof(std::uint32_t);
+        mSlots = mmap(nullptr, mSlotCount * mSlotBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (mSlots == MAP_FAILED)
+            throwSystemError("mmap");
+    }
+
+    ~RenderFarm()
+    {
+        stopWorkers();
+        munmap(mSlots, mSlotCount * mSlotBytes);
+    }
+
+    RenderFarm(const RenderFarm&) = delete;
+    RenderFarm& operator=(const RenderFarm&) = delete;
+
+    // Render frames [firstFrame, firstFrame + frameCount) in the workers and
+    // hand each to sink in frame order on the calling thread. Throws when
+    // every worker has failed past its restart limit.
+    RenderFarmStats render(std::size_t firstFrame, std::size_t frameCount, SinkFunction sink)
+    {
+        auto started = std::chrono::steady_clock::now();
+        mStats = RenderFarmStats();
+        mStats.framesPerWorker.assign(mOptions.workers, 0);
+        mQueue.clear();
+        mAssignments.clear();
+        mFinished.clear();
+        mFreeSlots.clear();
+        for (std::size_t slot = mSlotCount; slot-- > 0;)
+            mFreeSlots.push_back(static_cast<std::uint32_t>(slot));
+        for (std::size_t frame = firstFrame; frame < firstFrame + frameCount; frame += mOptions.chunkFrames)
+            mQueue.push_back(Range{ frame, std::min(mOptions.chunkFrames, firstFrame + frameCount - frame) });
+        mNextDeliver = firstFrame;
+        mChunkSeconds = 0.0;
+
+        mWorkers.assign(mOptions.workers, Worker());
+        for (int index = 0; index < mOptions.workers; ++index)
+            spawn(index);
+
+        std::size_t end = firstFrame + frameCount;
+        std::vector<struct pollfd> fds;
+        while (mNextDeliver < end) {
+            dispatch();
+            duplicateStraggler();
+
+            fds.clear();
+            for (const Worker& worker : mWorkers)
+                fds.push_back(pollfd{ worker.fd, POLLIN, 0 });
+            if (poll(fds.data(), static_cast<nfds_t>(fds.size()), gRenderFarmPollMs) < 0 && errno != EINTR)
+                throwSystemError("poll");
+            for (std::size_t index = 0; index < fds.size(); ++index) {
+                if (fds[index].fd >= 0 && fds[index].revents)
+                    receive(static_cast<int>(index));
+            }
+
+            for (auto found = mFinished.find(mNextDeliver); found != mFinished.end(); found = mFinished.find(mNextDeliver)) {
+                sink(mNextDeliver, slotPixels(found->second));
+                mFreeSlots.push_back(found->second);
+                mFinished.erase(found);
+                ++mNextDeliver;
+                ++mStats.framesDelivered;
+            }
+        }
+
+        stopWorkers();
+        mStats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        return mStats;
+    }
+
+private:
+    enum : std::uint32_t
+    {
+        AssignMessage = 1,
+        QuitMessage = 2,
+    };
+
+    struct AssignRequest
+    {
+        std::uint32_t kind;
+        std::uint32_t assignment;
+        std::uint64_t firstFrame;
+        std::uint32_t frameCount;
+        std::uint32_t slots[gRenderFarmMaxChunkFrames];
+    };
+
+    struct FrameReport
+    {
+        std::uint32_t assignment;
+        std::uint32_t index;  // Frame within the assignment
+    };
+
+    struct Range
+    {
+        std::size_t first;
+        std::size_t count;
+    };
+
+    struct Assignment
+    {
+        int worker;
+        std::size_t first;
+        std::size_t count;
+        std::vector<std::uint32_t> slots;
+        std::vector<bool> reported;
+        std::size_t outstanding;
+        std::chrono::steady_clock::time_point started;
+        bool duplicated;  // A copy is out, or this is the copy
+    };
+
+    struct Worker
+    {
+        pid_t pid = -1;
+        int fd = -1;
+        int restarts = 0;
+        std::vector<std::uint32_t> active;  // Assignment ids
+    };
+
+    std::uint32_t* slotPixels(std::uint32_t slot) const
+    {
+        return reinterpret_cast<std::uint32_t*>(static_cast<char*>(mSlots) + slot * mSlotBytes);
+    }
+
+    void spawn(int index)
+    {
+        int pair[2];
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, pair) < 0)
+            throwSystemError("socketpair");
+        pid_t pid = fork();
+        if (pid < 0)
+            throwSystemError("fork");
+        if (pid == 0) {
+            close(pair[0]);
+            for (const Worker& other : mWorkers) {
+                if (other.fd >= 0)
+                    close(other.fd);
+            }
+            renderFarmWorkerIndex() = index;
+            try {
+                workerMain(pair[1]);
+            } catch (...) {
+                _exit(1);
+            }
+            _exit(0);
+        }
+        close(pair[1]);
+        mWorkers[index].pid = pid;
+        mWorkers[index].fd = pair[0];
+        mWorkers[index].active.clear();
+    }
+
+    // Worker process: render assignments until told to quit or the coordinator goes away
+    void workerMain(int fd)
+    {
+        AssignRequest request;
+        for (;;) {
+            ssize_t received = recv(fd, &request, sizeof(request), 0);
+            if (received < 0 && errno == EINTR)
+                continue;
+            if (received != static_cast<ssize_t>(sizeof(request)) || request.kind != AssignMessage)
+                return;
+            for (std::uint32_t i = 0; i < request.frameCount; ++i) {
+                mRender(static_cast<std::size_t>(request.firstFrame + i), slotPixels(request.slots[i]), mWidth, mHeight);
+                FrameReport report = { request.assignment, i };
+                if (send(fd, &report, sizeof(report), MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(report)))
+                    return;
+            }
+        }
+    }
+
+    // Does the range cover the frame delivery is waiting for
+    bool holdsNextDeliver(std::size_t first, std::size_t count) const
+    {
+        return first <= mNextDeliver && mNextDeliver < first + count;
+    }
+
+    // Slots for count frames; only the chunk delivery waits on may use the reserve
+    bool takeSlots(std::size_t count, bool head, std::vector<std::uint32_t>& slots)
+    {
+        std::size_t reserve = head ? 0 : mOptions.chunkFrames;
+        if (mFreeSlots.size() < count + reserve)
+            return false;
+        slots.assign(mFreeSlots.end() - count, mFreeSlots.end());
+        mFreeSlots.resize(mFreeSlots.size() - count);
+        return true;
+    }
+
+    bool assign(int workerIndex, std::size_t first, std::size_t count, bool duplicate)
+    {
+        Assignment assignment;
+        if (!takeSlots(count, holdsNextDeliver(first, count) && !duplicate, assignment.slots))
+            return false;
+        assignment.worker = workerIndex;
+        assignment.first = first;
+        assignment.count = count;
+        assignment.reported.assign(count, false);
+        assignment.outstanding = count;
+        assignment.started = std::chrono::steady_clock::now();
+        assignment.duplicated = duplicate;
+
+        AssignRequest request = {};
+        request.kind = AssignMessage;
+        request.assignment = mNextAssignment++;
+        request.firstFrame = first;
+        request.frameCount = static_cast<std::uint32_t>(count);
+        std::copy(assignment.slots.begin(), assignment.slots.end(), request.slots);
+
+        Worker& worker = mWorkers[workerIndex];
+        mAssignments[request.assignment] = assignment;
+        worker.active.push_back(request.assignment);
+        ++mStats.chunksAssigned;
+        if (send(worker.fd, &request, sizeof(request), MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(request)))
+            workerFailed(workerIndex);
+        return true;
+    }
+
+    // Pull model: top every live worker up to chunksAhead assignments, lowest frames first
+    void dispatch()
+    {
+        for (std::size_t round = 0; round < mOptions.chunksAhead && !mQueue.empty(); ++round) {
+            for (int index = 0; index < mOptions.workers && !mQueue.empty(); ++index) {
+                Worker& worker = mWorkers[index];
+                if (worker.fd < 0 || worker.active.size() > round)
+                    continue;
+                // Popped first: a worker failing during the send requeues its frames
+                Range range = mQueue.front();
+                mQueue.pop_front();
+                if (!assign(index, range.first, range.count, false)) {
+                    mQueue.push_front(range);
+                    return;
+                }
+            }
+        }
+    }
+
+    // With the queue drained, give an idle worker the unfinished frames of the
+    // chunk delivery waits on once it has run stragglerFactor average chunk times
+    void duplicateStraggler()
+    {
+        if (!mQueue.empty() || mChunkSeconds <= 0.0)
+            return;
+        int idle = -1;
+        for (int index = 0; index < mOptions.workers && idle < 0; ++index) {
+            if (mWorkers[index].fd >= 0 && mWorkers[index].active.empty())
+                idle = index;
+        }
+        if (idle < 0)
+            return;
+
+        auto now = std::chrono::steady_clock::now();
+        for (auto& entry : mAssignments) {
+            Assignment& straggler = entry.second;
+            if (straggler.duplicated || !holdsNextDeliver(straggler.first, straggler.count))
+                continue;
+            double elapsed = std::chrono::duration<double>(now - straggler.started).count();
+            if (elapsed < mChunkSeconds * mOptions.stragglerFactor)
+                return;
+            std::size_t first = mNextDeliver;
+            std::size_t count = straggler.first + straggler.count - first;
+            if (assign(idle, first, count, true)) {
+                straggler.duplicated = true;
+                ++mStats.chunksDuplicated;
+            }
+            return;
+        }
+    }
+
+    void receive(int workerIndex)
+    {
+        FrameReport report;
+        for (;;) {
+            ssize_t received = recv(mWorkers[workerIndex].fd, &report, sizeof(report), MSG_DONTWAIT);
+            if (received == static_cast<ssize_t>(sizeof(report))) {
+                frameReported(workerIndex, report);
+                continue;
+            }
+            if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+                return;
+            workerFailed(workerIndex);
+            return;
+        }
+    }
+
+    void frameReported(int workerIndex, const FrameReport& report)
+    {
+        auto found = mAssignments.find(report.assignment);
+        if (found == mAssignments.end() || report.index >= found->second.count || found->second.reported[report.index])
+            return;
+        Assignment& assignment = found->second;
+        assignment.reported[report.index] = true;
+        --assignment.outstanding;
+
+        std::size_t frame = assignment.first + report.index;
+        std::uint32_t slot = assignment.slots[report.index];
+        if (frame < mNextDeliver || mFinished.count(frame)) {
+            mFreeSlots.push_back(slot);
+            ++mStats.framesDiscarded;
+        } else {
+            mFinished[frame] = slot;
+            ++mStats.framesPerWorker[workerIndex];
+        }
+
+        if (assignment.outstanding == 0) {
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - assignment.started).count();
+            mChunkSeconds = mChunkSeconds > 0.0 ? mChunkSeconds * 0.8 + seconds * 0.2 : seconds;
+            removeActive(workerIndex, report.assignment);
+            mAssignments.erase(found);
+        }
+    }
+
+    void removeActive(int workerIndex, std::uint32_t assignment)
+    {
+        std::vector<std::uint32_t>& active = mWorkers[workerIndex].active;
+        active.erase(std::remove(active.begin(), active.end(), assignment), active.end());
+    }
+
+    // Reap the worker, requeue what it had not finished and start a replacement
+    void workerFailed(int workerIndex)
+    {
+        Worker& worker = mWorkers[workerIndex];
+        close(worker.fd);
+        worker.fd = -1;
+        kill(worker.pid, SIGKILL);
+        waitpid(worker.pid, nullptr, 0);
+        ++mStats.workerCrashes;
+
+        std::vector<std::size_t> lost;
+        for (std::uint32_t id : worker.active) {
+            Assignment& assignment = mAssignments[id];
+            for (std::size_t i = 0; i < assignment.count; ++i) {
+                if (assignment.reported[i])
+                    continue;
+                mFreeSlots.push_back(assignment.slots[i]);
+                std::size_t frame = assignment.first + i;
+                if (frame >= mNextDeliver && !mFinished.count(frame))
+                    lost.push_back(frame);
+            }
+            mAssignments.erase(id);
+        }
+        worker.active.clear();
+
+        // Frames a surviving duplicate is still rendering are requeued anyway; the first result wins
+        std::sort(lost.begin(), lost.end());
+        lost.erase(std::unique(lost.begin(), lost.end()), lost.end());
+        mStats.framesReassigned += lost.size();
+        for (std::size_t i = 0; i < lost.size();) {
+            std::size_t j = i + 1;
+            while (j < lost.size() && lost[j] == lost[j - 1] + 1 && j - i < mOptions.chunkFrames)
+                ++j;
+            Range range = { lost[i], j - i };
+            auto position = std::lower_bound(mQueue.begin(), mQueue.end(), range,
+                [](const Range& a, const Range& b) { return a.first < b.first; });
+            mQueue.insert(position, range);
+            i = j;
+        }
+
+        if (worker.restarts < mOptions.maxRestarts) {
+            ++worker.restarts;
+            ++mStats.workerRestarts;
+            spawn(workerIndex);
+            return;
+        }
+        for (const Worker& other : mWorkers) {
+            if (other.fd >= 0)
+                return;
+        }
+        throw std::runtime_error("render farm: every worker failed");
+    }
+
+    // Idle workers are asked to quit; ones still on a chunk whose result is no longer needed are killed
+    void stopWorkers()
+    {
+        AssignRequest quit = {};
+        quit.kind = QuitMessage;
+        for (Worker& worker : mWorkers) {
+            if (worker.fd < 0)
+                continue;
+            if (worker.active.empty()) {
+                ssize_t sent = send(worker.fd, &quit, sizeof(quit), MSG_NOSIGNAL);
+                (void)sent;
+            } else {
+                kill(worker.pid, SIGKILL);
+            }
+            worker.active.clear();
+            close(worker.fd);
+            worker.fd = -1;
+        }
+        for (Worker& worker : mWorkers) {
+            if (worker.pid > 0)
+                waitpid(worker.pid, nullptr, 0);
+            worker.pid = -1;
+        }
+    }
+
+    static void throwSystemError(const char* call)
+    {
+        throw std::runtime_error(std::string(call) + ": " + std::strerror(errno));
+    }
+
+    int mWidth;
+    int mHeight;
+    RenderFunction mRender;
+    RenderFarmOptions mOptions;
+
+    void* mSlots = nullptr;
+    std::size_t mSlotCount = 0;
+    std::size_t mSlotBytes = 0;
+    std::vector<std::uint32_t> mFreeSlots;
+
+    std::vector<Worker> mWorkers;
+    std::deque<Range> mQueue;
+    std::map<std::uint32_t, Assignment> mAssignments;
+    std::map<std::size_t, std::uint32_t> mFinished;  // Rendered, waiting for delivery in order
+    std::uint32_t mNextAssignment = 0;
+    std::size_t mNextDeliver = 0;
+    double mChunkSeconds = 0.0;  // Moving average of a chunk's wall time
+    RenderFarmStats mStats;
+};
+
+#endif // __linux__
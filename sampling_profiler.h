@@ -0,0 +1,616 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <string>
+
+// Pipeline stage the calling thread is working on, read by the sampling
+// profiler's signal handler to tag each sample. Names must outlive the
+// profile: string literals, or names from internProfileStage().
+inline const char*& currentProfileStage()
+{
+    static thread_local const char* stage = nullptr;
+    return stage;
+}
+
+// Tags the calling thread with a stage until the end of the scope; nests
+class ProfileStageScope
+{
+public:
+    explicit ProfileStageScope(const char* stage)
+        : mPrevious(currentProfileStage())
+    {
+        currentProfileStage() = stage;
+        std::atomic_signal_fence(std::memory_order_release);
+    }
+
+    ~ProfileStageScope()
+    {
+        std::atomic_signal_fence(std::memory_order_release);
+        currentProfileStage() = mPrevious;
+    }
+
+    ProfileStageScope(const ProfileStageScope&) = delete;
+    ProfileStageScope& operator=(const ProfileStageScope&) = delete;
+
+private:
+    const char* mPrevious;
+};
+
+// A copy of a stage name built at run time that lives until the process exits
+inline const char* internProfileStage(const std::string& name)
+{
+    static std::mutex mutex;
+    static std::set<std::string> names;
+    std::lock_guard<std::mutex> lock(mutex);
+    return names.insert(name).first->c_str();
+}
+
+#ifdef __linux__
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <cxxabi.h>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+// Frames kept per sample, leaf first
+constexpr int gProfilerMaxDepth = 64;
+
+// How often the background thread drains samples and looks for new threads
+constexpr int gProfilerDrainMs = 50;
+
+// What drives each thread's sampling timer
+enum class SamplingClock
+{
+    ThreadCpu,  // The thread's CPU time: busy threads only, but expiries wait for the scheduler tick
+    Wall,       // Monotonic time: exact rate on high-resolution timers, blocked threads sampled too
+};
+
+struct SamplingProfilerOptions
+{
+    int frequencyHz = 1000;            // Samples per second of each thread's clock
+    SamplingClock clock = SamplingClock::ThreadCpu;
+    std::size_t bufferSamples = 4096;  // Rounded up to a power of two
+    bool skipIdle = true;              // Wall clock only: discard samples outside any stage or of blocked threads
+};
+
+struct SamplingProfilerStats
+{
+    std::uint64_t samples = 0;       // Drained into the profile
+    std::uint64_t dropped = 0;       // Lost because the buffer was full
+    std::uint64_t skipped = 0;       // Discarded by skipIdle
+    std::uint64_t handlerNanos = 0;  // Spent in the signal handler
+    std::size_t threads = 0;         // Given a timer of their own since start(); 0 with the process-wide fallback
+    std::size_t uniqueStacks = 0;
+    bool perThreadTimers = false;
+
+    double handlerMicrosPerSample() const { return samples ? handlerNanos / 1e3 / samples : 0.0; }
+};
+
+// In-process sampling profiler for hosts where external profilers are not
+// allowed. Every thread gets a POSIX timer that sends it SIGPROF. On its
+// CPU-time clock, threads are sampled in proportion to the CPU they use and
+// idle threads not at all, but the kernel checks CPU timers once per
+// scheduler tick, so the rate tops out at CONFIG_HZ (often 250). The wall
+// clock reaches the full rate but also signals blocked threads; with
+// skipIdle, the handler discards those samples, and samples outside any
+// ProfileStageScope, before they reach the buffer, and with it off the
+// profile also shows where threads block. New
+// threads are picked up from /proc/self/task by a background thread. Where
+// per-thread timers are refused, one process-wide ITIMER_PROF is used instead.
+//
+// The handler walks the frame-pointer chain, so build with
+// -fno-omit-frame-pointer, and link with -rdynamic so that functions of the
+// executable get names. Frames are read only inside the interrupted thread's
+// stack mapping, which is looked up once per thread through
+// async-signal-safe calls. Each sample goes into a lock-free bounded buffer
+// (Vyukov's), or is dropped and counted when the buffer is full. The
+// background thread drains it, tags each stack with the stage named by
+// ProfileStageScope and symbolizes it with dladdr, caching per address.
+// The result is in folded-stack format for flame graphs, one
+// "[stage];outer;...;leaf count" line per distinct stack.
+//
+// One profiler runs at a time. Its handler stays installed after stop(),
+// since a SIGPROF still pending would otherwise end the process.
+class SamplingProfiler
+{
+public:
+    explicit SamplingProfiler(const SamplingProfilerOptions& options = SamplingProfilerOptions())
+        : mOptions(options)
+    {
+        std::size_t capacity = 1;
+        while (capacity < std::max<std::size_t>(options.bufferSamples, 2))
+            capacity <<= 1;
+        mMask = capacity - 1;
+        mIntervalNanos = 1000000000ull / static_cast<std::uint64_t>(std::max(1, options.frequencyHz));
+        mSkipIdle = options.skipIdle && options.clock == SamplingClock::Wall;
+        mSlots = std::vector<Slot>(capacity);
+        for (std::size_t i = 0; i < capacity; ++i)
+            mSlots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    ~SamplingProfiler() { stop(); }
+
+    SamplingProfiler(const SamplingProfiler&) = delete;
+    SamplingProfiler& operator=(const SamplingProfiler&) = delete;
+
+    void start()
+    {
+        if (mThread.joinable())
+            return;
+#if !defined(__x86_64__) && !defined(__aarch64__)
+        throw std::runtime_error("sampling profiler: no frame-pointer walk for this architecture");
+#endif
+        SamplingProfiler* expected = nullptr;
+        if (!activeProfiler().compare_exchange_strong(expected, this))
+            throw std::runtime_error("another sampling profiler is running");
+
+        struct sigaction action;
+        std::memset(&action, 0, sizeof(action));
+        action.sa_sigaction = onSignal;
+        action.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        if (sigaction(SIGPROF, &action, nullptr) < 0) {
+            activeProfiler().store(nullptr);
+            throwSystemError("sigaction");
+        }
+
+        mStopping = false;
+        mPerThreadTimers = true;
+        mThreadsTimed = 0;
+        mThread = std::thread([this] { run(); });
+    }
+
+    void stop()
+    {
+        if (!mThread.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStopping = true;
+        }
+        mWake.notify_all();
+        mThread.join();
+
+        // Handlers that saw this profiler finish before it can go away
+        activeProfiler().store(nullptr);
+        while (handlersRunning().load() != 0)
+            std::this_thread::yield();
+        drain();
+    }
+
+    SamplingProfilerStats stats() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        SamplingProfilerStats stats;
+        stats.samples = mSamples;
+        stats.dropped = mDropped.load(std::memory_order_relaxed);
+        stats.skipped = mSkipped.load(std::memory_order_relaxed);
+        stats.handlerNanos = mHandlerNanos.load(std::memory_order_relaxed);
+        stats.threads = mThreadsTimed;
+        stats.uniqueStacks = mFolded.size();
+        stats.perThreadTimers = mPerThreadTimers;
+        return stats;
+    }
+
+    // Samples per stage; untagged samples count under "none"
+    std::map<std::string, std::uint64_t> stageSamples() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return std::map<std::string, std::uint64_t>(mStageSamples.begin(), mStageSamples.end());
+    }
+
+    // The profile so far, heaviest stacks first
+    std::string foldedStacks() const
+    {
+        std::vector<std::pair<std::string, std::uint64_t>> stacks;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            stacks.assign(mFolded.begin(), mFolded.end());
+        }
+        std::sort(stacks.begin(), stacks.end(), [](const std::pair<std::string, std::uint64_t>& a, const std::pair<std::string, std::uint64_t>& b) {
+            return a.second != b.second ? a.second > b.second : a.first < b.first;
+        });
+        std::string text;
+        for (const auto& stack : stacks)
+            text += stack.first + " " + std::to_string(stack.second) + "\n";
+        return text;
+    }
+
+    void writeFoldedStacks(const std::string& path) const
+    {
+        std::string text = foldedStacks();
+        std::FILE* file = std::fopen(path.c_str(), "w");
+        if (!file)
+            throwSystemError("fopen");
+        bool written = std::fwrite(text.data(), 1, text.size(), file) == text.size();
+        if (std::fclose(file) != 0 || !written)
+            throwSystemError("fwrite");
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<std::uint64_t> sequence{ 0 };
+        const char* stage = nullptr;
+        int depth = 0;
+        std::uintptr_t frames[gProfilerMaxDepth];
+    };
+
+    // Stack mapping of the calling thread, cached for the signal handler
+    struct ThreadStack
+    {
+        std::uintptr_t low;
+        std::uintptr_t high;
+    };
+
+    static std::atomic<SamplingProfiler*>& activeProfiler()
+    {
+        static std::atomic<SamplingProfiler*> profiler{ nullptr };
+        return profiler;
+    }
+
+    static std::atomic<int>& handlersRunning()
+    {
+        static std::atomic<int> running{ 0 };
+        return running;
+    }
+
+    static ThreadStack& threadStack()
+    {
+        static thread_local ThreadStack stack = { 0, 0 };
+        return stack;
+    }
+
+    // CPU time of the calling thread at its previous wall-clock sample
+    static std::uint64_t& lastSampleCpuNanos()
+    {
+        static thread_local std::uint64_t nanos = 0;
+        return nanos;
+    }
+
+    static void onSignal(int, siginfo_t*, void* context)
+    {
+        int savedErrno = errno;
+        handlersRunning().fetch_add(1);
+        SamplingProfiler* profiler = activeProfiler().load();
+        if (profiler)
+            profiler->record(static_cast<const ucontext_t*>(context));
+        handlersRunning().fetch_sub(1);
+        errno = savedErrno;
+    }
+
+    static std::uint64_t clockNanos(clockid_t clock)
+    {
+        timespec now;
+        clock_gettime(clock, &now);
+        return static_cast<std::uint64_t>(now.tv_sec) * 1000000000ull + static_cast<std::uint64_t>(now.tv_nsec);
+    }
+
+    static std::uint64_t monotonicNanos() { return clockNanos(CLOCK_MONOTONIC); }
+
+    // Wall clock with skipIdle: the thread is outside any stage, or ran for
+    // less than half an interval since its previous sample
+    bool idleSample() const
+    {
+        if (!currentProfileStage())
+            return true;
+        std::uint64_t cpuNanos = clockNanos(CLOCK_THREAD_CPUTIME_ID);
+        std::uint64_t& last = lastSampleCpuNanos();
+        bool blocked = cpuNanos - last < mIntervalNanos / 2;
+        last = cpuNanos;
+        return blocked;
+    }
+
+    // Bounds of the mapping that holds address, from /proc/self/maps with
+    // async-signal-safe calls only
+    static bool findMapping(std::uintptr_t address, ThreadStack& mapping)
+    {
+        int fd = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return false;
+        char buffer[4096];
+        std::uintptr_t start = 0;
+        std::uintptr_t end = 0;
+        int field = 0;  // Start address, end address, then the rest of the line
+        bool found = false;
+        while (!found) {
+            ssize_t count = read(fd, buffer, sizeof(buffer));
+            if (count < 0 && errno == EINTR)
+                continue;
+            if (count <= 0)
+                break;
+            for (ssize_t i = 0; i < count && !found; ++i) {
+                char c = buffer[i];
+                if (c == '\n') {
+                    start = end = 0;
+                    field = 0;
+                } else if (field == 0 && c == '-') {
+                    field = 1;
+                } else if (field == 1 && c == ' ') {
+                    found = address >= start && address < end;
+                    field = 2;
+                } else if (field < 2) {
+                    std::uintptr_t digit = c >= 'a' ? c - 'a' + 10 : c - '0';
+                    std::uintptr_t& value = field == 0 ? start : end;
+                    value = value << 4 | digit;
+                }
+            }
+        }
+        close(fd);
+        if (found) {
+            mapping.low = start;
+            mapping.high = end;
+        }
+        return found;
+    }
+
+    // Signal handler context: async-signal-safe calls and lock-free atomics only
+    void record(const ucontext_t* context)
+    {
+        std::uint64_t begin = monotonicNanos();
+#if defined(__x86_64__)
+        std::uintptr_t pc = static_cast<std::uintptr_t>(context->uc_mcontext.gregs[REG_RIP]);
+        std::uintptr_t fp = static_cast<std::uintptr_t>(context->uc_mcontext.gregs[REG_RBP]);
+        std::uintptr_t sp = static_cast<std::uintptr_t>(context->uc_mcontext.gregs[REG_RSP]);
+#elif defined(__aarch64__)
+        std::uintptr_t pc = static_cast<std::uintptr_t>(context->uc_mcontext.pc);
+        std::uintptr_t fp = static_cast<std::uintptr_t>(context->uc_mcontext.regs[29]);
+        std::uintptr_t sp = static_cast<std::uintptr_t>(context->uc_mcontext.sp);
+#else
+        (void)context;
+        std::uintptr_t pc = 0;
+        std::uintptr_t fp = 0;
+        std::uintptr_t sp = 0;
+#endif
+        if (mSkipIdle && idleSample()) {
+            mSkipped.fetch_add(1, std::memory_order_relaxed);
+            mHandlerNanos.fetch_add(monotonicNanos() - begin, std::memory_order_relaxed);
+            return;
+        }
+
+        // Claim a slot, or drop the sample when the drain thread is behind
+        std::uint64_t position = mWritePosition.load(std::memory_order_relaxed);
+        Slot* slot = nullptr;
+        for (;;) {
+            slot = &mSlots[position & mMask];
+            std::uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+            if (sequence == position) {
+                if (mWritePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    break;
+            } else if (sequence < position) {
+                mDropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            } else {
+                position = mWritePosition.load(std::memory_order_relaxed);
+            }
+        }
+
+        ThreadStack& stack = threadStack();
+        if (sp < stack.low || sp >= stack.high) {
+            if (!findMapping(sp, stack))
+                stack.low = stack.high = 0;
+        }
+
+        // Each frame record is the caller's frame pointer, then the return address
+        slot->stage = currentProfileStage();
+        slot->frames[0] = pc;
+        int depth = 1;
+        std::uintptr_t low = sp;
+        while (depth < gProfilerMaxDepth && fp >= low && fp % sizeof(std::uintptr_t) == 0 && fp + 2 * sizeof(std::uintptr_t) <= stack.high) {
+            const std::uintptr_t* frame = reinterpret_cast<const std::uintptr_t*>(fp);
+            if (frame[1] == 0)
+                break;
+            slot->frames[depth++] = frame[1];
+            low = fp + 2 * sizeof(std::uintptr_t);
+            fp = frame[0];
+        }
+        slot->depth = depth;
+        slot->sequence.store(position + 1, std::memory_order_release);
+        mHandlerNanos.fetch_add(monotonicNanos() - begin, std::memory_order_relaxed);
+    }
+
+    void run()
+    {
+        mThreadId = static_cast<pid_t>(syscall(SYS_gettid));
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (!mStopping) {
+            lock.unlock();
+            updateTimers();
+            drain();
+            lock.lock();
+            mWake.wait_for(lock, std::chrono::milliseconds(gProfilerDrainMs), [this] { return mStopping; });
+        }
+
+        for (auto& timer : mTimers)
+            timer_delete(timer.second);
+        mTimers.clear();
+        if (!mPerThreadTimers) {
+            itimerval off;
+            std::memset(&off, 0, sizeof(off));
+            setitimer(ITIMER_PROF, &off, nullptr);
+        }
+    }
+
+    // Give every thread but this one a CPU-time timer, and forget threads that exited
+    void updateTimers()
+    {
+        if (!mPerThreadTimers)
+            return;
+        std::vector<pid_t> threads;
+        if (DIR* directory = opendir("/proc/self/task")) {
+            while (dirent* entry = readdir(directory)) {
+                if (entry->d_name[0] != '.')
+                    threads.push_back(static_cast<pid_t>(std::atoi(entry->d_name)));
+            }
+            closedir(directory);
+        }
+
+        long intervalNanos = 1000000000L / std::max(1, mOptions.frequencyHz);
+        itimerspec interval;
+        interval.it_interval.tv_sec = intervalNanos / 1000000000L;
+        interval.it_interval.tv_nsec = intervalNanos % 1000000000L;
+        interval.it_value = interval.it_interval;
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (auto it = mTimers.begin(); it != mTimers.end();) {
+            if (std::find(threads.begin(), threads.end(), it->first) == threads.end()) {
+                timer_delete(it->second);
+                it = mTimers.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        for (pid_t thread : threads) {
+            if (thread == mThreadId || mTimers.count(thread))
+                continue;
+
+            // The CPU-time clock of another thread, as glibc builds it for pthread_getcpuclockid
+            clockid_t clock = CLOCK_MONOTONIC;
+            if (mOptions.clock == SamplingClock::ThreadCpu)
+                clock = static_cast<clockid_t>((~static_cast<unsigned>(thread) << 3) | 6);
+            sigevent event;
+            std::memset(&event, 0, sizeof(event));
+            event.sigev_notify = SIGEV_THREAD_ID;
+            event.sigev_signo = SIGPROF;
+            event.sigev_notify_thread_id = thread;
+            timer_t timer;
+            if (timer_create(clock, &event, &timer) < 0) {
+                // The thread just exited, or per-thread timers are not allowed here
+                if (errno == EINVAL)
+                    continue;
+                fallBackToProcessTimer(intervalNanos);
+                return;
+            }
+            timer_settime(timer, 0, &interval, nullptr);
+            mTimers[thread] = timer;
+            ++mThreadsTimed;
+        }
+    }
+
+    // Caller holds mMutex
+    void fallBackToProcessTimer(long intervalNanos)
+    {
+        for (auto& timer : mTimers)
+            timer_delete(timer.second);
+        mTimers.clear();
+        mThreadsTimed = 0;
+        mPerThreadTimers = false;
+        itimerval interval;
+        interval.it_interval.tv_sec = intervalNanos / 1000000000L;
+        interval.it_interval.tv_usec = intervalNanos % 1000000000L / 1000;
+        interval.it_value = interval.it_interval;
+        setitimer(ITIMER_PROF, &interval, nullptr);
+    }
+
+    // Fold everything written so far into the profile; drain thread, or after it stopped
+    void drain()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (;;) {
+            Slot& slot = mSlots[mReadPosition & mMask];
+            if (slot.sequence.load(std::memory_order_acquire) != mReadPosition + 1)
+                break;
+            std::string stage = slot.stage ? slot.stage : "none";
+            std::string stack = "[" + stage + "]";
+            for (int i = slot.depth - 1; i >= 0; --i) {
+                // Return addresses point after the call, so look up the byte before
+                stack += ';';
+                stack += symbolName(i == 0 ? slot.frames[i] : slot.frames[i] - 1);
+            }
+            slot.sequence.store(mReadPosition + mMask + 1, std::memory_order_release);
+            ++mReadPosition;
+            ++mFolded[stack];
+            ++mStageSamples[stage];
+            ++mSamples;
+        }
+    }
+
+    // Caller holds mMutex
+    const std::string& symbolName(std::uintptr_t address)
+    {
+        auto found = mSymbols.find(address);
+        if (found != mSymbols.end())
+            return found->second;
+
+        std::string name;
+        // info is only filled in when dladdr succeeds
+        Dl_info info = {};
+        bool resolved = dladdr(reinterpret_cast<void*>(address), &info) != 0;
+        if (resolved && info.dli_sname) {
+            int status = 0;
+            char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+            name = status == 0 && demangled ? demangled : info.dli_sname;
+            std::free(demangled);
+        } else if (resolved && info.dli_fname) {
+            const char* base = std::strrchr(info.dli_fname, '/');
+            char offset[32];
+            std::snprintf(offset, sizeof(offset), "+0x%llx", (unsigned long long)(address - reinterpret_cast<std::uintptr_t>(info.dli_fbase)));
+            name = std::string(base ? base + 1 : info.dli_fname) + offset;
+        } else {
+            char text[32];
+            std::snprintf(text, sizeof(text), "0x%llx", (unsigned long long)address);
+            name = text;
+        }
+        // Folded stacks separate frames with ';'
+        std::replace(name.begin(), name.end(), ';', ',');
+        return mSymbols.emplace(address, name).first->second;
+    }
+
+    static void throwSystemError(const char* call)
+    {
+        throw std::runtime_error(std::string(call) + ": " + std::strerror(errno));
+    }
+
+    SamplingProfilerOptions mOptions;
+    std::vector<Slot> mSlots;
+    std::size_t mMask = 0;
+    std::atomic<std::uint64_t> mWritePosition{ 0 };
+    std::uint64_t mReadPosition = 0;
+    std::uint64_t mIntervalNanos = 0;
+    bool mSkipIdle = false;
+    std::atomic<std::uint64_t> mDropped{ 0 };
+    std::atomic<std::uint64_t> mSkipped{ 0 };
+    std::atomic<std::uint64_t> mHandlerNanos{ 0 };
+
+    mutable std::mutex mMutex;
+    std::condition_variable mWake;
+    std::thread mThread;
+    pid_t mThreadId = 0;
+    bool mStopping = false;
+    bool mPerThreadTimers = true;
+    std::map<pid_t, timer_t> mTimers;
+    std::size_t mThreadsTimed = 0;
+    std::unordered_map<std::uintptr_t, std::string> mSymbols;
+    std::unordered_map<std::string, std::uint64_t> mFolded;
+    std::unordered_map<std::string, std::uint64_t> mStageSamples;
+    std::uint64_t mSamples = 0;
+};
+
+#endif
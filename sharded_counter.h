@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+constexpr std::size_t gCounterShards = 16;
+constexpr std::size_t gCounterShardBytes = 64;
+
+// Shard of the calling thread; threads are numbered on first use, so up to
+// gCounterShards threads each get a shard of their own
+inline std::size_t counterShardIndex()
+{
+    static std::atomic<std::size_t> nextThread{ 0 };
+    static thread_local std::size_t index = nextThread.fetch_add(1, std::memory_order_relaxed) % gCounterShards;
+    return index;
+}
+
+// Monotonic counter split into one cache line per thread. Adding is a relaxed
+// increment of the caller's own shard, so hot paths never contend on it, and
+// readers such as the metrics exporter sum the shards without taking a lock.
+class ShardedCounter
+{
+public:
+    ShardedCounter() = default;
+    ShardedCounter(const ShardedCounter&) = delete;
+    ShardedCounter& operator=(const ShardedCounter&) = delete;
+
+    void add(std::uint64_t amount = 1)
+    {
+        mShards[counterShardIndex()].value.fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    std::uint64_t value() const
+    {
+        std::uint64_t total = 0;
+        for (const Shard& shard : mShards)
+            total += shard.value.load(std::memory_order_relaxed);
+        return total;
+    }
+
+private:
+    struct Shard
+    {
+        std::atomic<std::uint64_t> value{ 0 };
+        char padding[gCounterShardBytes - sizeof(std::atomic<std::uint64_t>)];
+    };
+
+    Shard mShards[gCounterShards];
+};
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TEMPORAL_RECONSTRUCTION_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define TEMPORAL_RECONSTRUCTION_NEON 1
+#endif
+
+#include "image_view.h"
+
+enum class TemporalMode
+{
+    Full,          // Every pixel shaded every frame
+    Checkerboard,  // Pixels with (x + y) of the frame's parity shaded, the rest reconstructed
+    Interlaced,    // Rows with y of the frame's parity shaded, the rest reconstructed
+};
+
+// Largest frame id gap across which the previous frame is still used as history
+constexpr std::size_t gTemporalMaxFrameGap = 2;
+
+// Whether the pixel was shaded this frame rather than reconstructed
+inline bool temporalPixelShaded(TemporalMode mode, int x, int y, int parity)
+{
+    if (mode == TemporalMode::Checkerboard)
+        return ((x + y) & 1) == parity;
+    if (mode == TemporalMode::Interlaced)
+        return (y & 1) == parity;
+    return true;
+}
+
+// Per-channel minimum, maximum and clamp of ARGB pixels
+inline std::uint32_t minArgb(std::uint32_t a, std::uint32_t b)
+{
+    std::uint32_t result = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        std::uint32_t channelA = (a >> shift) & 0xFF;
+        std::uint32_t channelB = (b >> shift) & 0xFF;
+        result |= (channelA < channelB ? channelA : channelB) << shift;
+    }
+    return result;
+}
+
+inline std::uint32_t maxArgb(std::uint32_t a, std::uint32_t b)
+{
+    std::uint32_t result = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        std::uint32_t channelA = (a >> shift) & 0xFF;
+        std::uint32_t channelB = (b >> shift) & 0xFF;
+        result |= (channelA > channelB ? channelA : channelB) << shift;
+    }
+    return result;
+}
+
+inline std::uint32_t clampArgb(std::uint32_t value, std::uint32_t low, std::uint32_t high)
+{
+    return minArgb(maxArgb(value, low), high);
+}
+
+// Missing pixels of one row: the previous frame's pixel clamped per channel
+// to the range of four neighbours shaded this frame. The vertical offsets are
+// relative to the row, so band edges substitute whichever row exists; offsets
+// of -1 and 1 mean there is none and the left and right neighbours stand in.
+// When every is set the whole row is missing; otherwise only pixels whose x
+// parity differs from shadedParity are written.
+inline void reconstructRow(
+    std::uint32_t* row,
+    const std::uint32_t* previous,
+    int width,
+    std::ptrdiff_t upOffset,
+    std::ptrdiff_t downOffset,
+    bool every,
+    int shadedParity)
+{
+    bool horizontal = upOffset == -1;
+    auto missing = [&](int x) { return every || (x & 1) != shadedParity; };
+    auto reconstruct = [&](int x) {
+        std::uint32_t left = row[x > 0 ? x - 1 : x + 1];
+        std::uint32_t right = row[x + 1 < width ? x + 1 : x - 1];
+        std::uint32_t up = horizontal ? left : row[x + upOffset];
+        std::uint32_t down = horizontal ? right : row[x + downOffset];
+        if (every)
+            left = right = up;
+        std::uint32_t low = minArgb(minArgb(left, right), minArgb(up, down));
+        std::uint32_t high = maxArgb(maxArgb(left, right), maxArgb(up, down));
+        row[x] = clampArgb(previous[x], low, high);
+    };
+
+    if (width < 2) {
+        if (width == 1 && missing(0))
+            row[0] = previous[0];
+        return;
+    }
+    if (missing(0))
+        reconstruct(0);
+
+    // Interior pixels four at a time; shaded lanes are blended back unchanged
+    int x = 1;
+#if defined(TEMPORAL_RECONSTRUCTION_SSE2)
+    // Lane 0 is x, which is odd at every step
+    const __m128i mask = every ? _mm_set1_epi32(-1)
+        : shadedParity == 1 ? _mm_set_epi32(-1, 0, -1, 0) : _mm_set_epi32(0, -1, 0, -1);
+    for (; x + 4 < width; x += 4) {
+        __m128i up = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x + upOffset));
+        __m128i down = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x + downOffset));
+        __m128i low = _mm_min_epu8(up, down);
+        __m128i high = _mm_max_epu8(up, down);
+        __m128i current = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+        if (!every) {
+            __m128i left = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x - 1));
+            __m128i right = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x + 1));
+            low = _mm_min_epu8(low, _mm_min_epu8(left, right));
+            high = _mm_max_epu8(high, _mm_max_epu8(left, right));
+        }
+        __m128i history = _mm_loadu_si128(reinterpret_cast<const __m128i*>(previous + x));
+        __m128i clamped = _mm_min_epu8(_mm_max_epu8(history, low), high);
+        __m128i blended = _mm_or_si128(_mm_and_si128(mask, clamped), _mm_andnot_si128(mask, current));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(row + x), blended);
+    }
+#elif defined(TEMPORAL_RECONSTRUCTION_NEON)
+    static const std::uint32_t oddLanes[4] = { 0, ~0u, 0, ~0u };
+    static const std::uint32_t evenLanes[4] = { ~0u, 0, ~0u, 0 };
+    const uint32x4_t mask = every ? vdupq_n_u32(~0u) : vld1q_u32(shadedParity == 1 ? oddLanes : evenLanes);
+    for (; x + 4 < width; x += 4) {
+        uint8x16_t up = vld1q_u8(reinterpret_cast<const std::uint8_t*>(row + x + upOffset));
+        uint8x16_t down = vld1q_u8(reinterpret_cast<const std::uint8_t*>(row + x + downOffset));
+        uint8x16_t low = vminq_u8(up, down);
+        uint8x16_t high = vmaxq_u8(up, down);
+        if (!every) {
+            uint8x16_t left = vld1q_u8(reinterpret_cast<const std::uint8_t*>(row + x - 1));
+            uint8x16_t right = vld1q_u8(reinterpret_cast<const std::uint8_t*>(row + x + 1));
+            low = vminq_u8(low, vminq_u8(left, right));
+            high = vmaxq_u8(high, vmaxq_u8(left, right));
+        }
+        uint8x16_t history = vld1q_u8(reinterpret_cast<const std::uint8_t*>(previous + x));
+        uint32x4_t clamped = vreinterpretq_u32_u8(vminq_u8(vmaxq_u8(history, low), high));
+        vst1q_u32(row + x, vbslq_u32(mask, clamped, vld1q_u32(row + x)));
+    }
+#endif
+    for (; x < width; ++x) {
+        if (missing(x))
+            reconstruct(x);
+    }
+}
+
+// Fill the pixels of the view that were not shaded this frame from the
+// previous frame's view of the same place, clamped to their freshly shaded
+// neighbours. Parity is that of frame coordinates, which region gives. Only
+// rows inside the view are read, so bands and tiles reconstruct independently.
+inline void reconstructView(ArgbView pixels, ConstArgbView previous, const FrameRegion& region, TemporalMode mode, int parity)
+{
+    if (mode == TemporalMode::Full)
+        return;
+
+    int width = pixels.width();
+    int rows = pixels.height();
+    for (int y = 0; y < rows; ++y) {
+        int frameY = region.y + y;
+        bool every = mode == TemporalMode::Interlaced;
+        if (every && (frameY & 1) == parity)
+            continue;
+
+        // Vertical neighbours inside the view; a view of one row falls back to the row itself,
+        // whose shaded pixels then bound the missing ones from the left and right
+        std::ptrdiff_t stride = pixels.stridePixels();
+        std::ptrdiff_t upOffset = y > 0 ? -stride : (y + 1 < rows ? stride : 0);
+        std::ptrdiff_t downOffset = y + 1 < rows ? stride : upOffset;
+        std::uint32_t* row = pixels.row(y);
+        const std::uint32_t* history = previous.row(y);
+        if (upOffset == 0) {
+            if (every) {
+                for (int x = 0; x < width; ++x)
+                    row[x] = history[x];
+                continue;
+            }
+            upOffset = -1;
+            downOffset = 1;
+        }
+        reconstructRow(row, history, width, upOffset, downOffset, every, (parity + frameY + region.x) & 1);
+    }
+}
+
+// Rows [firstRow, lastRow) of packed width-wide frames
+inline void reconstructRows(
+    std::uint32_t* pixels,
+    const std::uint32_t* previous,
+    int width,
+    int firstRow,
+    int lastRow,
+    TemporalMode mode,
+    int parity)
+{
+    reconstructView(ArgbView(pixels, width, lastRow).rows(firstRow, lastRow),
+        ConstArgbView(previous, width, lastRow).rows(firstRow, lastRow), frameRows(width, lastRow, firstRow), mode, parity);
+}
@@ -0,0 +1,532 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "frame_arena.h"
+#include "frame_source.h"
+#include "image_view.h"
+#include "memory_governor.h"
+#include "sampling_profiler.h"
+#include "worker_pool.h"
+
+// Square canvas tiles, in pixels of their level
+constexpr int gCanvasTileSize = 256;
+constexpr std::size_t gCanvasTileBytes = static_cast<std::size_t>(gCanvasTileSize) * gCanvasTileSize * sizeof(std::uint32_t);
+
+// Tile cache size, overridable in MiB through MACOS_WINDOW_CANVAS_CACHE_MB
+constexpr std::size_t gDefaultCanvasCacheBytes = 64 * 1024 * 1024;
+
+// Tiles prefetched around the viewport on each side, and at most queued at once
+constexpr int gCanvasPrefetchMargin = 1;
+constexpr std::size_t gCanvasPrefetchLimit = 32;
+
+// Viewports remembered per frame id, enough for every frame in flight
+constexpr std::size_t gCanvasViewportHistory = 8;
+
+// Window pixels outside the canvas
+constexpr std::uint32_t gCanvasBackground = 0xFF202020u;
+
+// Spacing of the demo pattern's grid lines in level 0 pixels
+constexpr int gCanvasGridSpacing = 512;
+
+struct CanvasTileKey
+{
+    int level;
+    int x;
+    int y;
+
+    bool operator==(const CanvasTileKey& other) const { return level == other.level && x == other.x && y == other.y; }
+};
+
+struct CanvasTileKeyHash
+{
+    std::size_t operator()(const CanvasTileKey& key) const
+    {
+        std::uint64_t packed = (static_cast<std::uint64_t>(key.level) << 56) ^ (static_cast<std::uint64_t>(static_cast<std::uint32_t>(key.x)) << 28)
+            ^ static_cast<std::uint32_t>(key.y);
+        return static_cast<std::size_t>(packed * 0x9E3779B97F4A7C15ull >> 16);
+    }
+};
+
+// What the window shows: the level 0 canvas point at its centre and the
+// window pixels per level 0 canvas pixel
+struct CanvasViewport
+{
+    double centerX = 0.0;
+    double centerY = 0.0;
+    double zoom = 1.0;
+};
+
+// Move the viewport by a distance in window pixels
+inline CanvasViewport panViewport(CanvasViewport viewport, double dx, double dy)
+{
+    viewport.centerX -= dx / viewport.zoom;
+    viewport.centerY -= dy / viewport.zoom;
+    return viewport;
+}
+
+// Scale the zoom, keeping the canvas point under window position (x, y) in place
+inline CanvasViewport zoomViewport(CanvasViewport viewport, double factor, double x, double y, int windowWidth, int windowHeight)
+{
+    double offsetX = x - windowWidth * 0.5;
+    double offsetY = y - windowHeight * 0.5;
+    double anchorX = viewport.centerX + offsetX / viewport.zoom;
+    double anchorY = viewport.centerY + offsetY / viewport.zoom;
+    viewport.zoom *= factor;
+    viewport.centerX = anchorX - offsetX / viewport.zoom;
+    viewport.centerY = anchorY - offsetY / viewport.zoom;
+    return viewport;
+}
+
+struct CanvasStats
+{
+    std::uint64_t tilesUsed = 0;        // Tile lookups by frames
+    std::uint64_t tilesHit = 0;         // Found ready in the cache
+    std::uint64_t tilesShaded = 0;      // Shaded on a frame's critical path
+    std::uint64_t tilesWaited = 0;      // Found being shaded by another thread
+    std::uint64_t tilesPrefetched = 0;
+    std::uint64_t prefetchHits = 0;     // First used by a frame after being prefetched
+    std::uint64_t prefetchSkipped = 0;  // Out of the viewport's reach by the time a worker got to them
+    std::uint64_t prefetchRefused = 0;  // Refused by the memory governor
+    std::uint64_t tilesEvicted = 0;
+
+    double hitRate() const { return tilesUsed ? double(tilesHit) / tilesUsed : 0.0; }
+};
+
+// A canvas far larger than the window, shaded on demand in tiles at several
+// levels of detail. Level L has 1 / 2^L of the canvas resolution, and the
+// coarsest level fits in one tile. Each frame samples the level whose pixels
+// are closest to, but no smaller than, half a window pixel, so a frame reads
+// at most (window / tile + 2)^2 tiles at zoom 1 and about four times that
+// zoomed out, however large the canvas is.
+//
+// Tiles live in an LRU cache keyed by (level, x, y) and charged to the memory
+// governor as a cache. A frame that misses shades the tile itself; bands that
+// need a tile another thread is shading wait for it rather than shading it
+// twice. prefetch() queues tiles in a ring around the viewport, and the
+// next coarser level under it, as batches with no deadline, so the worker
+// pool runs them only when no frame work is waiting. Content must not change
+// over time, as cached tiles are never invalidated.
+class VirtualCanvas
+{
+public:
+    // Shade tile, which region places in a level whose size is region.frameWidth by region.frameHeight
+    using TileShadeFunction = std::function<void(ArgbView tile, const FrameRegion& region, int level)>;
+
+    VirtualCanvas(
+        WorkerPool& pool,
+        int canvasWidth,
+        int canvasHeight,
+        TileShadeFunction shade,
+        std::size_t cacheBytes = gDefaultCanvasCacheBytes,
+        const std::string& ownerName = "canvas.tiles")
+        : mPool(pool)
+        , mCanvasWidth(std::max(1, canvasWidth))
+        , mCanvasHeight(std::max(1, canvasHeight))
+        , mShade(shade)
+        , mCacheBytes(std::max(cacheBytes, gCanvasTileBytes))
+    {
+        while (std::max(levelWidth(mLevelCount - 1), levelHeight(mLevelCount - 1)) > gCanvasTileSize)
+            ++mLevelCount;
+        mOwner = memoryGovernor().registerOwner(ownerName, MemoryOwnerKind::Cache,
+            [this](std::size_t bytes) { return evict(bytes); });
+    }
+
+    // Prefetch tasks still queued on the pool hold this canvas; they return
+    // at once when closing, and other work on the pool is not waited for
+    ~VirtualCanvas()
+    {
+        mClosing.store(true, std::memory_order_relaxed);
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mPrefetchDone.wait(lock, [this] { return mPrefetchTasks == 0; });
+        }
+        memoryGovernor().unregisterOwner(mOwner);
+    }
+
+    VirtualCanvas(const VirtualCanvas&) = delete;
+    VirtualCanvas& operator=(const VirtualCanvas&) = delete;
+
+    int canvasWidth() const { return mCanvasWidth; }
+    int canvasHeight() const { return mCanvasHeight; }
+    int levelCount() const { return mLevelCount; }
+    int levelWidth(int level) const { return static_cast<int>((static_cast<std::int64_t>(mCanvasWidth) + (1LL << level) - 1) >> level); }
+    int levelHeight(int level) const { return static_cast<int>((static_cast<std::int64_t>(mCanvasHeight) + (1LL << level) - 1) >> level); }
+
+    // Finest level whose pixels cover at least half a window pixel
+    int levelForZoom(double zoom) const
+    {
+        int level = zoom > 0.0 ? static_cast<int>(std::floor(-std::log2(zoom))) : mLevelCount - 1;
+        return std::min(std::max(level, 0), mLevelCount - 1);
+    }
+
+    CanvasStats stats() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mStats;
+    }
+
+    std::size_t cachedBytes() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mLru.size() * gCanvasTileBytes;
+    }
+
+    // The viewport a frame was requested with, so every band of it agrees
+    // even when the viewport moves while the frame renders
+    void setFrameViewport(std::size_t frameId, const CanvasViewport& viewport)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        FrameViewport& slot = mFrameViewports[frameId % gCanvasViewportHistory];
+        slot.frameId = frameId;
+        slot.viewport = viewport;
+        mLatestViewport = viewport;
+    }
+
+    CanvasViewport frameViewport(std::size_t frameId) const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        const FrameViewport& slot = mFrameViewports[frameId % gCanvasViewportHistory];
+        return slot.frameId == frameId ? slot.viewport : mLatestViewport;
+    }
+
+    // Draw the part of the window that target covers. region places target
+    // in a window of region.frameWidth by region.frameHeight pixels.
+    void render(ArgbView target, const FrameRegion& region, const CanvasViewport& viewport)
+    {
+        if (target.empty())
+            return;
+        const int level = levelForZoom(viewport.zoom);
+        const int width = levelWidth(level);
+        const int height = levelHeight(level);
+        const double step = 1.0 / (viewport.zoom * static_cast<double>(1LL << level));
+        const double originX = viewport.centerX / (1LL << level) - region.frameWidth * 0.5 * step;
+        const double originY = viewport.centerY / (1LL << level) - region.frameHeight * 0.5 * step;
+
+        // Tile column and offset in it of each target column; tile -1 is off the canvas
+        FrameArenaScope scratch(threadFrameArena());
+        int* tileColumns = threadFrameArena().allocateArray<int>(target.width());
+        int* offsets = threadFrameArena().allocateArray<int>(target.width());
+        int firstTileX = -1;
+        int lastTileX = -1;
+        for (int x = 0; x < target.width(); ++x) {
+            double levelX = std::floor(originX + (region.x + x + 0.5) * step);
+            tileColumns[x] = -1;
+            offsets[x] = 0;
+            if (levelX >= 0.0 && levelX < width) {
+                tileColumns[x] = static_cast<int>(levelX) / gCanvasTileSize;
+                offsets[x] = static_cast<int>(levelX) % gCanvasTileSize;
+                firstTileX = firstTileX < 0 ? tileColumns[x] : std::min(firstTileX, tileColumns[x]);
+                lastTileX = std::max(lastTileX, tileColumns[x]);
+            }
+        }
+        for (int x = 0; x < target.width(); ++x) {
+            if (tileColumns[x] >= 0)
+                tileColumns[x] -= firstTileX;
+        }
+
+        // Tiles of the current tile row, held so they cannot be evicted under us
+        std::vector<std::shared_ptr<const Tile>>& held = heldTiles();
+        held.assign(firstTileX < 0 ? 0 : lastTileX - firstTileX + 1, nullptr);
+        int heldTileY = -1;
+        for (int y = 0; y < target.height(); ++y) {
+            std::uint32_t* out = target.row(y);
+            double levelY = std::floor(originY + (region.y + y + 0.5) * step);
+            if (firstTileX < 0 || levelY < 0.0 || levelY >= height) {
+                std::fill(out, out + target.width(), gCanvasBackground);
+                continue;
+            }
+            int row = static_cast<int>(levelY);
+            if (row / gCanvasTileSize != heldTileY) {
+                heldTileY = row / gCanvasTileSize;
+                for (std::size_t i = 0; i < held.size(); ++i)
+                    held[i] = acquireTile(CanvasTileKey{ level, firstTileX + static_cast<int>(i), heldTileY });
+            }
+            std::size_t rowOffset = static_cast<std::size_t>(row % gCanvasTileSize) * gCanvasTileSize;
+            for (int x = 0; x < target.width(); ++x)
+                out[x] = tileColumns[x] < 0 ? gCanvasBackground : held[tileColumns[x]]->pixels[rowOffset + offsets[x]];
+        }
+        held.clear();
+    }
+
+    // Queue the tiles just outside the viewport at its level, and those under
+    // it one level coarser for zooming out, to be shaded when workers are idle
+    void prefetch(const CanvasViewport& viewport, int windowWidth, int windowHeight)
+    {
+        std::vector<CanvasTileKey> wanted;
+        int level = levelForZoom(viewport.zoom);
+        TileRange ring = visibleTiles(viewport, windowWidth, windowHeight, level, gCanvasPrefetchMargin);
+        for (int y = ring.top; y <= ring.bottom; ++y) {
+            for (int x = ring.left; x <= ring.right; ++x)
+                wanted.push_back(CanvasTileKey{ level, x, y });
+        }
+        TileRange coarser = { 0, 0, -1, -1 };
+        if (level + 1 < mLevelCount) {
+            coarser = visibleTiles(viewport, windowWidth, windowHeight, level + 1, 0);
+            for (int y = coarser.top; y <= coarser.bottom; ++y) {
+                for (int x = coarser.left; x <= coarser.right; ++x)
+                    wanted.push_back(CanvasTileKey{ level + 1, x, y });
+            }
+        }
+
+        std::vector<CanvasTileKey> queued;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mPrefetchLevel = level;
+            mPrefetchRing = ring;
+            mPrefetchCoarser = coarser;
+            for (const CanvasTileKey& key : wanted) {
+                if (mPrefetchQueued.size() >= gCanvasPrefetchLimit)
+                    break;
+                if (mIndex.count(key) || mPrefetchQueued.count(key))
+                    continue;
+                mPrefetchQueued.insert(key);
+                queued.push_back(key);
+            }
+            mPrefetchTasks += queued.size();
+        }
+
+        // One task per batch, so a started batch never holds priority over a frame
+        for (const CanvasTileKey& key : queued) {
+            std::vector<WorkerPool::Task> task;
+            task.push_back([this, key] {
+                prefetchTile(key);
+                std::lock_guard<std::mutex> lock(mMutex);
+                if (--mPrefetchTasks == 0)
+                    mPrefetchDone.notify_all();
+            });
+            mPool.submitBatch(std::move(task), WorkerPool::Clock::time_point::max());
+        }
+    }
+
+private:
+    struct Tile
+    {
+        CanvasTileKey key;
+        std::vector<std::uint32_t> pixels;
+        bool ready = false;
+        bool prefetched = false;
+        bool used = false;
+    };
+
+    struct TileRange
+    {
+        int left;
+        int top;
+        int right;
+        int bottom;
+
+        bool contains(int x, int y) const { return x >= left && x <= right && y >= top && y <= bottom; }
+    };
+
+    struct FrameViewport
+    {
+        std::size_t frameId = static_cast<std::size_t>(-1);
+        CanvasViewport viewport;
+    };
+
+    using TileList = std::list<std::shared_ptr<Tile>>;
+
+    static std::vector<std::shared_ptr<const Tile>>& heldTiles()
+    {
+        static thread_local std::vector<std::shared_ptr<const Tile>> held;
+        return held;
+    }
+
+    // Tiles of a level the window covers, widened by margin tiles and clipped to the level
+    TileRange visibleTiles(const CanvasViewport& viewport, int windowWidth, int windowHeight, int level, int margin) const
+    {
+        double scale = viewport.zoom * static_cast<double>(1LL << level);
+        double left = (viewport.centerX / (1LL << level) - windowWidth * 0.5 / scale) / gCanvasTileSize;
+        double top = (viewport.centerY / (1LL << level) - windowHeight * 0.5 / scale) / gCanvasTileSize;
+        double right = (viewport.centerX / (1LL << level) + windowWidth * 0.5 / scale) / gCanvasTileSize;
+        double bottom = (viewport.centerY / (1LL << level) + windowHeight * 0.5 / scale) / gCanvasTileSize;
+        int tilesX = (levelWidth(level) + gCanvasTileSize - 1) / gCanvasTileSize;
+        int tilesY = (levelHeight(level) + gCanvasTileSize - 1) / gCanvasTileSize;
+        TileRange range;
+        range.left = std::max(0, static_cast<int>(std::floor(std::max(left, -1.0))) - margin);
+        range.top = std::max(0, static_cast<int>(std::floor(std::max(top, -1.0))) - margin);
+        range.right = std::min(tilesX - 1, static_cast<int>(std::floor(std::min(right, static_cast<double>(tilesX)))) + margin);
+        range.bottom = std::min(tilesY - 1, static_cast<int>(std::floor(std::min(bottom, static_cast<double>(tilesY)))) + margin);
+        return range;
+    }
+
+    // Caller holds mMutex
+    void touch(TileList::iterator it)
+    {
+        mLru.splice(mLru.begin(), mLru, it);
+    }
+
+    // A ready tile for a frame, shading it here if nobody has
+    std::shared_ptr<const Tile> acquireTile(const CanvasTileKey& key)
+    {
+        std::shared_ptr<Tile> tile;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            ++mStats.tilesUsed;
+            auto found = mIndex.find(key);
+            if (found != mIndex.end()) {
+                tile = *found->second;
+                touch(found->second);
+                if (!tile->ready) {
+                    ++mStats.tilesWaited;
+                    mTileReady.wait(lock, [&tile] { return tile->ready; });
+                } else {
+                    ++mStats.tilesHit;
+                }
+                if (tile->prefetched && !tile->used)
+                    ++mStats.prefetchHits;
+                tile->used = true;
+                return tile;
+            }
+            ++mStats.tilesShaded;
+            tile = insertPending(key);
+            tile->used = true;
+        }
+
+        // Frames must be drawn, so visible tiles are charged even over budget
+        memoryGovernor().acquire(mOwner, gCanvasTileBytes);
+        shadeTile(*tile);
+        return tile;
+    }
+
+    void prefetchTile(const CanvasTileKey& key)
+    {
+        std::shared_ptr<Tile> tile;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mPrefetchQueued.erase(key);
+            bool wanted = key.level == mPrefetchLevel ? mPrefetchRing.contains(key.x, key.y)
+                                                      : key.level == mPrefetchLevel + 1 && mPrefetchCoarser.contains(key.x, key.y);
+            if (mClosing.load(std::memory_order_relaxed) || !wanted) {
+                ++mStats.prefetchSkipped;
+                return;
+            }
+            if (mIndex.count(key))
+                return;
+        }
+
+        // Speculative tiles only take memory the budget has to spare
+        if (!memoryGovernor().tryAcquire(mOwner, gCanvasTileBytes)) {
+            std::lock_guard<std::mutex> lock(mMutex);
+            ++mStats.prefetchRefused;
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (mIndex.count(key)) {
+                memoryGovernor().release(mOwner, gCanvasTileBytes);
+                return;
+            }
+            ++mStats.tilesPrefetched;
+            tile = insertPending(key);
+            tile->prefetched = true;
+        }
+        shadeTile(*tile);
+    }
+
+    // Caller holds mMutex; other threads wait on the tile until shadeTile finishes
+    std::shared_ptr<Tile> insertPending(const CanvasTileKey& key)
+    {
+        std::shared_ptr<Tile> tile = std::make_shared<Tile>();
+        tile->key = key;
+        mLru.push_front(tile);
+        mIndex[key] = mLru.begin();
+        return tile;
+    }
+
+    void shadeTile(Tile& tile)
+    {
+        const CanvasTileKey& key = tile.key;
+        tile.pixels.assign(static_cast<std::size_t>(gCanvasTileSize) * gCanvasTileSize, gCanvasBackground);
+        ArgbView view(tile.pixels.data(), gCanvasTileSize, gCanvasTileSize);
+        int width = levelWidth(key.level);
+        int height = levelHeight(key.level);
+        FrameRegion region = { width, height, key.x * gCanvasTileSize, key.y * gCanvasTileSize };
+        ProfileStageScope stage("canvas.tile");
+        mShade(view.subView(0, 0, width - region.x, height - region.y), region, key.level);
+
+        std::size_t overBy = 0;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            tile.ready = true;
+            std::size_t bytes = mLru.size() * gCanvasTileBytes;
+            overBy = bytes > mCacheBytes ? bytes - mCacheBytes : 0;
+        }
+        mTileReady.notify_all();
+        if (overBy)
+            memoryGovernor().release(mOwner, evict(overBy));
+    }
+
+    // Drop least recently used tiles no frame holds; also the governor's
+    // reclaim callback, which releases the returned bytes itself
+    std::size_t evict(std::size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        std::size_t freed = 0;
+        for (auto it = mLru.end(); freed < bytes && it != mLru.begin();) {
+            --it;
+            if (!(*it)->ready || it->use_count() > 1)
+                continue;
+            mIndex.erase((*it)->key);
+            it = mLru.erase(it);
+            freed += gCanvasTileBytes;
+            ++mStats.tilesEvicted;
+        }
+        return freed;
+    }
+
+    WorkerPool& mPool;
+    int mCanvasWidth;
+    int mCanvasHeight;
+    int mLevelCount = 1;
+    TileShadeFunction mShade;
+    std::size_t mCacheBytes;
+    MemoryGovernor::OwnerId mOwner = -1;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mTileReady;
+    std::condition_variable mPrefetchDone;
+    std::size_t mPrefetchTasks = 0;  // Submitted to the pool and not yet returned
+    TileList mLru;  // Most recently used first
+    std::unordered_map<CanvasTileKey, TileList::iterator, CanvasTileKeyHash> mIndex;
+    std::unordered_set<CanvasTileKey, CanvasTileKeyHash> mPrefetchQueued;
+    int mPrefetchLevel = -1;
+    TileRange mPrefetchRing = { 0, 0, -1, -1 };
+    TileRange mPrefetchCoarser = { 0, 0, -1, -1 };
+    FrameViewport mFrameViewports[gCanvasViewportHistory];
+    CanvasViewport mLatestViewport;
+    CanvasStats mStats;
+    std::atomic<bool> mClosing{ false };
+};
+
+// Demo content: the animation's gradient stretched over each level, frozen
+// at its first frame, under grid lines every gCanvasGridSpacing canvas pixels
+// that stay one pixel wide at every level
+inline void shadeCanvasPattern(ArgbView tile, const FrameRegion& region, int level)
+{
+    shadeAnimationFixed(tile, region, 0, 0.0);
+    const int spacing = std::max(2, gCanvasGridSpacing >> level);
+    for (int y = 0; y < tile.height(); ++y) {
+        std::uint32_t* row = tile.row(y);
+        if ((region.y + y) % spacing == 0) {
+            std::fill(row, row + tile.width(), 0xFF000000u);
+            continue;
+        }
+        for (int x = (spacing - region.x % spacing) % spacing; x < tile.width(); x += spacing)
+            row[x] = 0xFF000000u;
+    }
+}
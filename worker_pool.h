@@ -0,0 +1,264 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "numa_topology.h"
+
+enum class SchedulingPolicy
+{
+    Fifo,               // Batches run in submission order
+    EarliestDeadline,   // Batches run in deadline order
+};
+
+// Tasks run on their preferred NUMA node and tasks taken over by another node
+struct NumaTaskStats
+{
+    std::uint64_t localTasks = 0;
+    std::uint64_t stolenTasks = 0;
+};
+
+// Fixed-size pool of worker threads. Work is submitted in batches (one per
+// frame job, one task per tile or band) that carry a deadline. Under the
+// earliest-deadline policy a worker always takes the next tile of the batch
+// with the earliest deadline, so an urgent frame overtakes a long one at the
+// next tile boundary. With preemption off, batches that already started keep
+// priority until their tiles are all dispatched.
+//
+// On machines with several NUMA nodes, workers are spread evenly over the
+// nodes and pinned to their node's CPUs. Tasks may name the node they should
+// run on; a worker takes its own node's tasks of the chosen batch first and
+// only then steals another node's, from the far end of that node's range.
+class WorkerPool
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using Task = std::function<void()>;
+
+    explicit WorkerPool(
+        unsigned threadCount = 0,
+        SchedulingPolicy policy = SchedulingPolicy::EarliestDeadline,
+        const NumaTopology& topology = systemNumaTopology())
+        : mPolicy(policy)
+        , mNodeCount(topology.nodeCount())
+    {
+        if (threadCount == 0)
+            threadCount = std::thread::hardware_concurrency();
+        if (threadCount == 0)
+            threadCount = 1;
+
+        mThreads.reserve(threadCount);
+        for (unsigned i = 0; i < threadCount; ++i) {
+            std::size_t node = static_cast<std::size_t>(i) * mNodeCount / threadCount;
+            std::vector<int> cpus = topology.multiNode() ? topology.nodeCpus[node] : std::vector<int>();
+            mThreads.emplace_back([this, node, cpus] { workerLoop(node, cpus); });
+        }
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStopping = true;
+        }
+        mTaskAvailable.notify_all();
+        for (std::thread& thread : mThreads)
+            thread.join();
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    unsigned threadCount() const { return static_cast<unsigned>(mThreads.size()); }
+
+    // NUMA nodes the workers are spread over; 1 on single-node machines
+    std::size_t nodeCount() const { return mNodeCount; }
+
+    // Node of the calling worker thread; 0 on threads outside any pool
+    static std::size_t currentNode() { return currentNodeSlot(); }
+
+    NumaTaskStats numaStats() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mNumaStats;
+    }
+
+    void setPolicy(SchedulingPolicy policy)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mPolicy = policy;
+    }
+
+    void setPreemptive(bool preemptive)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mPreemptive = preemptive;
+    }
+
+    // Single task that should run as soon as possible
+    void submit(Task task)
+    {
+        std::vector<Task> tasks;
+        tasks.push_back(std::move(task));
+        submitBatch(std::move(tasks), Clock::now());
+    }
+
+    // Tiles of one job, dispatched in order, due by the given deadline.
+    // nodes, when given, holds the preferred NUMA node of each task.
+    void submitBatch(std::vector<Task> tasks, Clock::time_point deadline, const std::vector<std::size_t>& nodes = {})
+    {
+        if (tasks.empty())
+            return;
+
+        std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+        batch->deadline = deadline;
+        batch->tasks.resize(mNodeCount);
+        for (std::size_t i = 0; i < tasks.size(); ++i) {
+            std::size_t node = i < nodes.size() ? nodes[i] % mNodeCount : 0;
+            batch->tasks[node].push_back(std::move(tasks[i]));
+        }
+        batch->remaining = tasks.size();
+        std::size_t taskCount = tasks.size();  // Workers start popping once the lock drops
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            batch->sequence = mNextSequence++;
+            mBatches.insert(batch);
+        }
+        if (taskCount == 1)
+            mTaskAvailable.notify_one();
+        else
+            mTaskAvailable.notify_all();
+    }
+
+    // Block until the queue is empty and no task is running
+    void waitIdle()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mIdle.wait(lock, [this] { return mBatches.empty() && mRunning == 0; });
+    }
+
+private:
+    struct Batch
+    {
+        Clock::time_point deadline;
+        std::uint64_t sequence = 0;
+        std::vector<std::deque<Task>> tasks;  // One queue per node
+        std::size_t remaining = 0;
+        bool started = false;
+    };
+
+    struct BatchOrder
+    {
+        bool operator()(const std::shared_ptr<Batch>& a, const std::shared_ptr<Batch>& b) const
+        {
+            if (a->deadline != b->deadline)
+                return a->deadline < b->deadline;
+            return a->sequence < b->sequence;
+        }
+    };
+
+    // Caller holds mMutex and mBatches is not empty
+    std::set<std::shared_ptr<Batch>, BatchOrder>::iterator pickBatch()
+    {
+        auto chosen = mBatches.begin();
+        if (mPolicy == SchedulingPolicy::Fifo) {
+            for (auto it = mBatches.begin(); it != mBatches.end(); ++it) {
+                if ((*it)->sequence < (*chosen)->sequence)
+                    chosen = it;
+            }
+        } else if (!mPreemptive) {
+            for (auto it = mBatches.begin(); it != mBatches.end(); ++it) {
+                if ((*it)->started) {
+                    chosen = it;
+                    break;
+                }
+            }
+        }
+        return chosen;
+    }
+
+    static std::size_t& currentNodeSlot()
+    {
+        static thread_local std::size_t node = 0;
+        return node;
+    }
+
+    // Caller holds mMutex; the batch has tasks left
+    Task popTask(Batch& batch, std::size_t node)
+    {
+        std::deque<Task>& local = batch.tasks[node];
+        if (!local.empty()) {
+            Task task = std::move(local.front());
+            local.pop_front();
+            ++mNumaStats.localTasks;
+            return task;
+        }
+        for (std::deque<Task>& other : batch.tasks) {
+            if (!other.empty()) {
+                Task task = std::move(other.back());
+                other.pop_back();
+                ++mNumaStats.stolenTasks;
+                return task;
+            }
+        }
+        return Task();
+    }
+
+    // Pinned before the first task, so the thread's arena and stack pages land on its node
+    void workerLoop(std::size_t node, const std::vector<int>& cpus)
+    {
+        if (!cpus.empty())
+            pinCurrentThread(cpus);
+        currentNodeSlot() = node;
+
+        for (;;) {
+            Task task;
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                mTaskAvailable.wait(lock, [this] { return mStopping || !mBatches.empty(); });
+                if (mBatches.empty())
+                    return;
+
+                auto it = pickBatch();
+                Batch& batch = **it;
+                task = popTask(batch, node);
+                batch.started = true;
+                if (--batch.remaining == 0)
+                    mBatches.erase(it);
+                ++mRunning;
+            }
+
+            task();
+            task = nullptr;  // Drop captured state before reporting idle
+
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                --mRunning;
+                if (mBatches.empty() && mRunning == 0)
+                    mIdle.notify_all();
+            }
+        }
+    }
+
+    mutable std::mutex mMutex;
+    std::condition_variable mTaskAvailable;
+    std::condition_variable mIdle;
+    std::set<std::shared_ptr<Batch>, BatchOrder> mBatches;
+    std::vector<std::thread> mThreads;
+    std::uint64_t mNextSequence = 0;
+    std::size_t mRunning = 0;
+    SchedulingPolicy mPolicy;
+    std::size_t mNodeCount;
+    NumaTaskStats mNumaStats;
+    bool mPreemptive = true;
+    bool mStopping = false;
+};